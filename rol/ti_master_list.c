@@ -24,6 +24,9 @@
 #include "dmaBankTools.h"   /* Macros for handling CODA banks */
 #include "tiprimary_list.c" /* Source required for CODA readout lists using the TI */
 #include "sdLib.h"
+#ifdef TI_AUTOTUNE
+#include "tiAutoTune.h"
+#endif
 
 /* Define initial blocklevel and buffering level */
 #define BLOCKLEVEL 1
@@ -139,6 +142,13 @@ rocGo()
 
   /* Enable/Set Block Level on modules, if needed, here */
 
+#ifdef TI_AUTOTUNE
+  /* Example: Adapt the block level to the trigger rate, at sync events.
+     Defaults: 95% live, 100 ms event building latency */
+  tiAutoTuneInit(NULL);
+  tiAutoTuneStart(5000, 1);
+#endif
+
   /* Example: How to start internal pulser trigger */
 #ifdef INTRANDOMPULSER
   /* Enable Random at rate 500kHz/(2^7) = ~3.9kHz */
@@ -167,6 +177,11 @@ rocEnd()
   tiSoftTrig(1,0,700,0);
 #endif
 
+#ifdef TI_AUTOTUNE
+  tiAutoTuneStop();
+  tiAutoTunePrint(NULL);
+#endif
+
   tiStatus(0);
 
   printf("rocEnd: Ended after %d blocks\n",tiGetIntCount());
@@ -187,6 +202,12 @@ rocTrigger(int arg)
   /* Set TI output 1 high for diagnostics */
   tiSetOutputPort(1,0,0,0);
 
+#ifdef TI_AUTOTUNE
+  /* Block level may have been changed at the last sync event */
+  blockLevel = tiGetCurrentBlockLevel();
+  tiAutoTuneReadoutStart();
+#endif
+
   /* Readout the trigger block from the TI
      Trigger Block MUST be reaodut first */
   dCnt = tiReadTriggerBlock(dma_dabufp);
@@ -208,6 +229,10 @@ rocTrigger(int arg)
   *dma_dabufp++ = 0xcebaf222;
   BANKCLOSE;
 
+#ifdef TI_AUTOTUNE
+  tiAutoTuneReadoutEnd();
+#endif
+
   /* Set TI output 0 low */
   tiSetOutputPort(0,0,0,0);
 
@@ -0,0 +1,763 @@
+/*
+ * File:
+ *    jvmeSim.c
+ *
+ * Description:
+ *    Memory backed stand-in for the jvme VME routines used by the TI
+ *    library.  The TI A24 register space and the A32 data FIFO are
+ *    plain memory.  Registers read back what was last written, except:
+ *      - boardID and GTPtriggerBufferLength are read-only (except for the
+ *        crate ID) and preset to a TI in the requested slot with all
+ *        clocks locked / IODELAY ready.  The crate ID is looped back
+ *        into master_tiID.
+ *      - the fiber connected and trigger source enabled bits of the fiber
+ *        register are read-only
+ *      - reset and triggerCommand are strobes and always read 0
+ *      - block level and buffer level trigger commands are looped back
+ *        into the blocklevel and dataFormat registers
+ *      - the JTAG user_code readback returns the requested firmware, and
+ *        the JTAG PROM readback the serial number (jvmeSimSetSerialNumber)
+ *      - syncHistory reads from a FIFO filled with jvmeSimSyncHistoryPush
+ *        (0 when empty), with its status in the sync register, and is
+ *        cleared by the sync history reset
+ *      - DMA copies from the start of the data FIFO.  Once blocks are
+ *        queued with jvmeSimFifoPush, each DMA instead transfers (up to
+ *        its size) what is left of the next queued block, or nothing when
+ *        the queue is empty, like the block terminated TI FIFO.  Single
+ *        reads of the data FIFO (vmeRead32) return the queued words in
+ *        order, TI_EMPTY_FIFO when empty, and blockBuffer reports the
+ *        number of queued blocks ready.
+ *      - faults are injected in the readout path (jvmeSimFaultSet), by
+ *        probability and/or on a schedule of eligible operations:
+ *          HEADER, TRAILER, NOFILLER  a queued block, when first read
+ *          SHORTDMA, BUSERROR         a DMA (BUSERROR: also a FIFO read)
+ *          STUCKBUFFER                a blockBuffer read
+ *      - jvmeSimReplay plays a capture file (tiCaptureStart) back through
+ *        the library: blockBuffer reads back the captured value, and the
+ *        captured tiReadBlock words are queued and read again with the
+ *        same calls (tiBReady, tiReadTriggerBlock, tiReadBlock).
+ *      - the routine connected with vmeIntConnect runs on
+ *        jvmeSimInterrupt
+ *
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiCapture.h"
+#include "jvmeSim.h"
+
+static struct TI_A24RegStruct *simTIp = NULL;
+static volatile unsigned int *simFifo = NULL;
+static unsigned int simA24Addr = 0, simFirmware = 0, simSerialNumber = 0;
+
+static unsigned int simSyncHistory[JVME_SIM_SYNCHISTORY_WORDS];
+static int simSyncHistoryHead = 0, simSyncHistoryCount = 0;
+static pthread_mutex_t simSyncHistoryMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static VOIDFUNCPTR simIntRoutine = NULL;
+static unsigned int simIntArg = 0;
+static int simDmaSize = 0;
+
+static unsigned int simChunkData[JVME_SIM_FIFO_WORDS];
+static int simChunkStart[JVME_SIM_FIFO_CHUNKS], simChunkWords[JVME_SIM_FIFO_CHUNKS];
+static int simChunkHead = 0, simChunkCount = 0, simChunkUsed = 0, simChunkMode = 0;
+static int simChunkPos = 0;         /* words of the head block already read */
+static int simChunkError[JVME_SIM_FIFO_CHUNKS];   /* DMA of the block ends in error */
+static unsigned int simBlockBuffer = 0;
+
+typedef struct
+{
+  double   probability;
+  int      first, period;           /* schedule, first < 0: none */
+  uint32_t ops, injected;
+} simFault;
+
+static simFault simFaults[JVME_SIM_NFAULTS];
+static uint32_t simFaultRandom = 1;
+
+static struct
+{
+  int                 active, started, pending;
+  unsigned int        blockBuffer;
+  JVMESIMREADOUT      readout;
+  void               *arg;
+  jvmeSimReplayStats *stats;
+} simReplay;
+static unsigned int simReplayData[(8*255) + 16] __attribute__((aligned(8)));
+
+int32_t
+jvmeSimInit(uint32_t a24addr, uint32_t firmware)
+{
+  jvmeSimFree();
+
+  simTIp = (struct TI_A24RegStruct *)calloc(1, sizeof(struct TI_A24RegStruct));
+  simFifo = (volatile unsigned int *)calloc(JVME_SIM_FIFO_WORDS, sizeof(unsigned int));
+  if((simTIp == NULL) || (simFifo == NULL))
+    {
+      printf("%s: ERROR allocating simulated TI\n", __func__);
+      jvmeSimFree();
+      return ERROR;
+    }
+
+  simA24Addr = a24addr;
+  simFirmware = firmware;
+  simSerialNumber = 0;
+  simSyncHistoryHead = 0;
+  simSyncHistoryCount = 0;
+  jvmeSimFifoClear();
+  jvmeSimFaultClear();
+  simBlockBuffer = 0;
+
+  simTIp->boardID = (TI_BOARDID_TYPE_TI << 16) | (((a24addr >> 19) << 8) & TI_BOARDID_GEOADR_MASK);
+  simTIp->GTPtriggerBufferLength =
+    TI_GTPTRIGGERBUFFERLENGTH_IODELAY_READY |
+    TI_GTPTRIGGERBUFFERLENGTH_CLK250_DCM_LOCK |
+    TI_GTPTRIGGERBUFFERLENGTH_CLK125_DCM_LOCK |
+    TI_GTPTRIGGERBUFFERLENGTH_VMECLK_DCM_LOCK;
+
+  return OK;
+}
+
+void
+jvmeSimFree()
+{
+  if(simTIp)
+    free(simTIp);
+  if(simFifo)
+    free((void *)simFifo);
+
+  simTIp = NULL;
+  simFifo = NULL;
+}
+
+volatile uint32_t *
+jvmeSimRegisters()
+{
+  return (volatile uint32_t *)simTIp;
+}
+
+/* Serial number returned by the JTAG PROM readback (tiGetSerialNumber) */
+void
+jvmeSimSetSerialNumber(uint32_t serial)
+{
+  simSerialNumber = serial;
+}
+
+volatile uint32_t *
+jvmeSimFifo()
+{
+  return (volatile uint32_t *)simFifo;
+}
+
+int32_t
+jvmeSimSyncHistoryPush(uint32_t word)
+{
+  int32_t rval = OK;
+
+  pthread_mutex_lock(&simSyncHistoryMutex);
+  if(simSyncHistoryCount == JVME_SIM_SYNCHISTORY_WORDS)
+    rval = ERROR;
+  else
+    {
+      simSyncHistory[(simSyncHistoryHead + simSyncHistoryCount) % JVME_SIM_SYNCHISTORY_WORDS] = word;
+      simSyncHistoryCount++;
+    }
+  pthread_mutex_unlock(&simSyncHistoryMutex);
+
+  return rval;
+}
+
+int32_t
+jvmeSimFifoPush(const uint32_t *words, int nwords)
+{
+  int ichunk;
+
+  if((nwords < 0) || (simChunkCount == JVME_SIM_FIFO_CHUNKS) ||
+     (simChunkUsed + nwords > JVME_SIM_FIFO_WORDS))
+    return ERROR;
+
+  ichunk = (simChunkHead + simChunkCount) % JVME_SIM_FIFO_CHUNKS;
+  memcpy(&simChunkData[simChunkUsed], words, nwords * sizeof(uint32_t));
+  simChunkStart[ichunk] = simChunkUsed;
+  simChunkWords[ichunk] = nwords;
+  simChunkError[ichunk] = 0;
+  simChunkUsed += nwords;
+  simChunkCount++;
+  simChunkMode = 1;
+
+  return OK;
+}
+
+void
+jvmeSimFifoClear()
+{
+  simChunkHead = 0;
+  simChunkCount = 0;
+  simChunkUsed = 0;
+  simChunkPos = 0;
+  simChunkMode = 0;
+}
+
+/* Inject the fault in eligible operations with the probability, and/or
+   at the first one (counted from now) and every period after it (0: once).
+   first < 0: no schedule */
+int32_t
+jvmeSimFaultSet(int fault, double probability, int first, int period)
+{
+  if((fault < 0) || (fault >= JVME_SIM_NFAULTS) ||
+     (probability < 0.) || (probability > 1.) || (period < 0))
+    return ERROR;
+
+  simFaults[fault].probability = probability;
+  simFaults[fault].first = first;
+  simFaults[fault].period = period;
+  simFaults[fault].ops = 0;
+  simFaults[fault].injected = 0;
+
+  return OK;
+}
+
+void
+jvmeSimFaultSeed(uint32_t seed)
+{
+  simFaultRandom = seed ? seed : 1;
+}
+
+void
+jvmeSimFaultClear()
+{
+  int ifault;
+
+  for(ifault = 0; ifault < JVME_SIM_NFAULTS; ifault++)
+    jvmeSimFaultSet(ifault, 0., -1, 0);
+}
+
+uint32_t
+jvmeSimFaultCount(int fault)
+{
+  if((fault < 0) || (fault >= JVME_SIM_NFAULTS))
+    return 0;
+
+  return simFaults[fault].injected;
+}
+
+/* Count an eligible operation for the fault, and decide to inject it */
+static int
+simFaultHit(int fault)
+{
+  simFault *f = &simFaults[fault];
+  int op = f->ops++, hit = 0;
+
+  if((f->first >= 0) && (op >= f->first))
+    {
+      if(op == f->first)
+	hit = 1;
+      else if((f->period > 0) && (((op - f->first) % f->period) == 0))
+	hit = 1;
+    }
+
+  if(!hit && (f->probability > 0.))
+    {
+      /* xorshift32 */
+      simFaultRandom ^= simFaultRandom << 13;
+      simFaultRandom ^= simFaultRandom >> 17;
+      simFaultRandom ^= simFaultRandom << 5;
+      hit = ((double)simFaultRandom / 4294967296.) < f->probability;
+    }
+
+  if(hit)
+    f->injected++;
+
+  return hit;
+}
+
+/* Block faults, applied to the head block before its first word is read.
+   Blocks are queued as in the FIFO (big endian). */
+static void
+simFaultBlock()
+{
+  unsigned int *block = &simChunkData[simChunkStart[simChunkHead]];
+  int nwords = simChunkWords[simChunkHead], iword;
+  unsigned int word;
+
+  if(nwords == 0)
+    return;
+
+  if(simFaultHit(JVME_SIM_FAULT_HEADER))
+    block[0] = LSWAP(LSWAP(block[0]) ^ TI_DATA_TYPE_DEFINE_MASK);
+
+  for(iword = nwords - 1; iword >= 0; iword--)
+    {
+      word = LSWAP(block[iword]);
+      if((word & (TI_DATA_TYPE_DEFINE_MASK | TI_WORD_TYPE_MASK)) ==
+	 (TI_DATA_TYPE_DEFINE_MASK | TI_BLOCK_TRAILER_WORD_TYPE))
+	{
+	  if(simFaultHit(JVME_SIM_FAULT_TRAILER))
+	    block[iword] = LSWAP(word ^ 0x1);
+	  break;
+	}
+    }
+
+  word = LSWAP(block[nwords - 1]);
+  if((word & (TI_DATA_TYPE_DEFINE_MASK | TI_WORD_TYPE_MASK)) ==
+     (TI_DATA_TYPE_DEFINE_MASK | TI_FILLER_WORD_TYPE))
+    {
+      if(simFaultHit(JVME_SIM_FAULT_NOFILLER))
+	simChunkWords[simChunkHead]--;
+    }
+}
+
+/* Start reading the head block.  Returns the words left in it, 0 if empty */
+static int
+simChunkBegin()
+{
+  if(simChunkCount == 0)
+    return 0;
+
+  if(simChunkPos == 0)
+    simFaultBlock();
+
+  return simChunkWords[simChunkHead] - simChunkPos;
+}
+
+/* Words of the head block read */
+static void
+simChunkAdvance(int nwords)
+{
+  simChunkPos += nwords;
+  if(simChunkPos < simChunkWords[simChunkHead])
+    return;
+
+  simChunkHead = (simChunkHead + 1) % JVME_SIM_FIFO_CHUNKS;
+  simChunkPos = 0;
+  simChunkCount--;
+  if(simChunkCount == 0)
+    simChunkUsed = 0;
+}
+
+static unsigned int
+simFifoRead()
+{
+  unsigned int word;
+
+  if(simFaultHit(JVME_SIM_FAULT_BUSERROR))
+    return 0xFFFFFFFF;
+
+  /* Skip empty blocks */
+  while((simChunkCount > 0) && (simChunkBegin() == 0))
+    simChunkAdvance(0);
+  if(simChunkCount == 0)
+    return LSWAP(TI_EMPTY_FIFO);
+
+  word = simChunkData[simChunkStart[simChunkHead] + simChunkPos];
+  simChunkAdvance(1);
+
+  return word;
+}
+
+static unsigned int
+simBlockBufferRead(volatile unsigned int *addr)
+{
+  if(simReplay.active)
+    return simReplay.blockBuffer;
+
+  if(!simFaultHit(JVME_SIM_FAULT_STUCKBUFFER))
+    {
+      simBlockBuffer = *addr;
+      if(simChunkMode)
+	simBlockBuffer = (simBlockBuffer & ~TI_BLOCKBUFFER_BLOCKS_READY_MASK) |
+	  ((simChunkCount << 8) & TI_BLOCKBUFFER_BLOCKS_READY_MASK);
+    }
+
+  return simBlockBuffer;
+}
+
+int
+jvmeSimFifoCount()
+{
+  return simChunkCount;
+}
+
+static unsigned int
+simSyncHistoryRead()
+{
+  unsigned int word = 0;
+
+  pthread_mutex_lock(&simSyncHistoryMutex);
+  if(simSyncHistoryCount > 0)
+    {
+      word = simSyncHistory[simSyncHistoryHead];
+      simSyncHistoryHead = (simSyncHistoryHead + 1) % JVME_SIM_SYNCHISTORY_WORDS;
+      simSyncHistoryCount--;
+    }
+  pthread_mutex_unlock(&simSyncHistoryMutex);
+
+  return word;
+}
+
+static unsigned int
+simSyncHistoryStatus()
+{
+  unsigned int status = TI_SYNC_HISTORY_FIFO_EMPTY;
+
+  pthread_mutex_lock(&simSyncHistoryMutex);
+  if(simSyncHistoryCount == JVME_SIM_SYNCHISTORY_WORDS)
+    status = TI_SYNC_HISTORY_FIFO_FULL;
+  else if(simSyncHistoryCount >= JVME_SIM_SYNCHISTORY_WORDS / 2)
+    status = TI_SYNC_HISTORY_FIFO_HALF_FULL;
+  else if(simSyncHistoryCount > 0)
+    status = 0;
+  pthread_mutex_unlock(&simSyncHistoryMutex);
+
+  return status;
+}
+
+unsigned int
+vmeRead32(volatile unsigned int *addr)
+{
+  if(simTIp && (addr == &simTIp->JTAGFPGABase[(0x1F1C)>>2]))
+    return simFirmware;
+
+  if(simTIp && (addr == &simTIp->JTAGPROMBase[(0x1F1C)>>2]))
+    return simSerialNumber;
+
+  if(simTIp && (addr == &simTIp->syncHistory))
+    return simSyncHistoryRead();
+
+  if(simTIp && (addr == &simTIp->sync))
+    return (*addr & ~TI_SYNC_HISTORY_FIFO_MASK) | simSyncHistoryStatus();
+
+  if(simTIp && (addr == &simTIp->blockBuffer))
+    return simBlockBufferRead(addr);
+
+  if(simChunkMode && (addr == simFifo))
+    return simFifoRead();
+
+  return *addr;
+}
+
+void
+vmeWrite32(volatile unsigned int *addr, unsigned int val)
+{
+  if(simTIp)
+    {
+      if(addr == &simTIp->boardID)
+	{
+	  /* Only the crate ID is writable, and reported back in the loopback ID */
+	  val &= TI_BOARDID_CRATEID_MASK;
+	  simTIp->boardID = (simTIp->boardID & ~TI_BOARDID_CRATEID_MASK) | val;
+	  simTIp->master_tiID = (simTIp->master_tiID & ~TI_ID_CRATEID_MASK) | (val << 8);
+	  return;
+	}
+
+      if(addr == &simTIp->GTPtriggerBufferLength)
+	return;
+
+      if(addr == &simTIp->fiber)
+	{
+	  /* Fiber connected and trigger source enabled bits are status */
+	  simTIp->fiber = (simTIp->fiber & 0xFFFF0000) | (val & 0xFFFF);
+	  return;
+	}
+
+      if(addr == &simTIp->reset)
+	{
+	  if(val & TI_RESET_SYNC_HISTORY)
+	    {
+	      pthread_mutex_lock(&simSyncHistoryMutex);
+	      simSyncHistoryCount = 0;
+	      pthread_mutex_unlock(&simSyncHistoryMutex);
+	    }
+	  return;
+	}
+
+      if(addr == &simTIp->triggerCommand)
+	{
+	  /* Loop back block level / buffer level broadcasts */
+	  unsigned int value = val & TI_TRIGGERCOMMAND_VALUE_MASK;
+
+	  switch(val & TI_TRIGGERCOMMAND_CODE_MASK)
+	    {
+	    case TI_TRIGGERCOMMAND_SET_BLOCKLEVEL:
+	      simTIp->blocklevel =
+		(simTIp->blocklevel & ~(TI_BLOCKLEVEL_CURRENT_MASK | TI_BLOCKLEVEL_RECEIVED_MASK))
+		| (value << 16) | (value << 24);
+	      break;
+
+	    case TI_TRIGGERCOMMAND_SET_BUFFERLEVEL:
+	      simTIp->dataFormat =
+		(simTIp->dataFormat & ~TI_DATAFORMAT_BCAST_BUFFERLEVEL_MASK) | (value << 24);
+	      break;
+	    }
+	  return;
+	}
+    }
+
+  *addr = val;
+}
+
+int
+vmeBusToLocalAdrs(int vmeAdrsSpace, char *vmeBusAdrs, char **pPciAdrs)
+{
+  unsigned long vmeAdr = (unsigned long)vmeBusAdrs;
+
+  if(simTIp == NULL)
+    return ERROR;
+
+  if((vmeAdrsSpace == 0x39) && (vmeAdr == simA24Addr))
+    *pPciAdrs = (char *)simTIp;
+  else if(vmeAdrsSpace == 0x09)
+    *pPciAdrs = (char *)simFifo;
+  else
+    return ERROR;
+
+  return OK;
+}
+
+int
+vmeMemProbe(char *addr, int size, char *rval)
+{
+  if(simTIp == NULL)
+    return ERROR;
+
+  memcpy(rval, addr, size);
+  return OK;
+}
+
+int
+vmeOpenDefaultWindows()
+{
+  return (simTIp == NULL) ? ERROR : OK;
+}
+
+int
+vmeCloseDefaultWindows()
+{
+  return OK;
+}
+
+int
+vmeBusLock()
+{
+  return OK;
+}
+
+int
+vmeBusUnlock()
+{
+  return OK;
+}
+
+int
+vmeSetMaximumVMESlots(int slot)
+{
+  return OK;
+}
+
+int
+vmeDmaSend(unsigned long locAdrs, unsigned int vmeAdrs, int size)
+{
+  if((simFifo == NULL) || (size < 0) ||
+     (size > (int)(JVME_SIM_FIFO_WORDS * sizeof(unsigned int))))
+    return ERROR;
+
+  if(simChunkMode)
+    {
+      int nwords = simChunkBegin(), error;
+
+      error = (simChunkCount > 0) && simChunkError[simChunkHead];
+
+      if(nwords > (int)(size / sizeof(unsigned int)))
+	nwords = size / sizeof(unsigned int);
+      if((nwords > 1) && simFaultHit(JVME_SIM_FAULT_SHORTDMA))
+	nwords /= 2;
+
+      memcpy((void *)locAdrs, &simChunkData[simChunkStart[simChunkHead] + simChunkPos],
+	     nwords * sizeof(unsigned int));
+      if(simChunkCount > 0)
+	simChunkAdvance(nwords);
+
+      /* Reported by vmeDmaDone, after the words that made it */
+      if(simFaultHit(JVME_SIM_FAULT_BUSERROR) || error)
+	simDmaSize = ERROR;
+      else
+	simDmaSize = nwords * sizeof(unsigned int);
+      return OK;
+    }
+
+  memcpy((void *)locAdrs, (void *)simFifo, size);
+  simDmaSize = size;
+
+  return OK;
+}
+
+int
+vmeDmaDone()
+{
+  int size = simDmaSize;
+
+  simDmaSize = 0;
+  return size;
+}
+
+/* Read the block of the last tiReadTriggerBlock record, with what was
+   queued since for its readout recovery */
+static void
+simReplayReadout()
+{
+  int nwords;
+
+  if(!simReplay.pending)
+    return;
+
+  nwords = tiReadTriggerBlock(simReplayData);
+  simReplay.pending = 0;
+  simReplay.stats->readouts++;
+  if(simReplay.readout)
+    simReplay.readout(simReplayData, nwords, simReplay.arg);
+}
+
+static int
+simReplayFeed(const tiCaptureInfo *info, const tiCaptureRecord *rec,
+	      const uint32_t *words, void *arg)
+{
+  int caller, rflag, maxwords, nwords;
+
+  if(!simReplay.started)
+    {
+      if(info->blockLevel > 0)
+	tiSetBlockLevel(info->blockLevel);
+      simReplay.started = 1;
+    }
+  simReplay.stats->records++;
+
+  if(rec->type == TI_CAPTURE_BREADY)
+    {
+      simReplayReadout();
+      simReplay.blockBuffer = rec->value;
+      tiBReady();
+      simReplay.stats->breadys++;
+      return OK;
+    }
+
+  if(rec->type != TI_CAPTURE_BLOCK)
+    return OK;
+
+  caller = rec->flags & TI_CAPTURE_CALLER_MASK;
+  if(caller != TI_CAPTURE_RECOVERY)
+    simReplayReadout();
+
+  if(jvmeSimFifoPush(words, rec->nwords) != OK)
+    {
+      printf("%s: ERROR: FIFO full\n", __func__);
+      return ERROR;
+    }
+  /* The DMA of this block ended in error */
+  if(rec->value < 0)
+    simChunkError[(simChunkHead + simChunkCount - 1) % JVME_SIM_FIFO_CHUNKS] = 1;
+
+  if(caller == TI_CAPTURE_TRIGGERBLOCK)
+    simReplay.pending = 1;
+  else if(caller == TI_CAPTURE_READBLOCK)
+    {
+      rflag = (rec->flags >> TI_CAPTURE_RFLAG_SHIFT) & 0xF;
+      maxwords = rec->maxwords;
+      if(maxwords > (int)(sizeof(simReplayData) / sizeof(unsigned int)) - 1)
+	maxwords = sizeof(simReplayData) / sizeof(unsigned int) - 1;
+
+      nwords = tiReadBlock(simReplayData, maxwords, rflag);
+      simReplay.stats->readouts++;
+      if(simReplay.readout)
+	simReplay.readout(simReplayData, nwords, simReplay.arg);
+    }
+
+  return OK;
+}
+
+int32_t
+jvmeSimReplay(const char *filename, double speed, JVMESIMREADOUT readout, void *arg,
+	      jvmeSimReplayStats *stats)
+{
+  jvmeSimReplayStats local;
+  struct timespec start, end;
+  int nrec;
+
+  if(stats == NULL)
+    stats = &local;
+  memset(stats, 0, sizeof(*stats));
+
+  memset(&simReplay, 0, sizeof(simReplay));
+  simReplay.readout = readout;
+  simReplay.arg = arg;
+  simReplay.stats = stats;
+  simReplay.active = 1;
+  jvmeSimFifoClear();
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  nrec = tiCaptureReplay(filename, speed, simReplayFeed, NULL);
+  simReplayReadout();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  simReplay.active = 0;
+  stats->elapsed_s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+  return (nrec < 0) ? ERROR : OK;
+}
+
+int
+vmeIntConnect(unsigned int vector, unsigned int level, VOIDFUNCPTR routine, unsigned int arg)
+{
+  simIntRoutine = routine;
+  simIntArg = arg;
+
+  return OK;
+}
+
+int
+vmeIntDisconnect(unsigned int level)
+{
+  simIntRoutine = NULL;
+
+  return OK;
+}
+
+int32_t
+jvmeSimInterrupt()
+{
+  if(simIntRoutine == NULL)
+    return ERROR;
+
+  (*simIntRoutine) (simIntArg);
+
+  return OK;
+}
+
+#ifndef taskDelay
+void
+taskDelay(int ticks)
+{
+  /* Nothing to wait for in memory */
+}
+#endif
+
+#ifndef logMsg
+int
+logMsg(const char *format, ...)
+{
+  va_list args;
+  int rval;
+
+  va_start(args, format);
+  rval = vprintf(format, args);
+  va_end(args);
+
+  return rval;
+}
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+/*
+ * File:
+ *    jvmeSim.h
+ *
+ * Description:
+ *    Memory backed stand-in for the jvme VME routines used by the TI
+ *    library.  Lets the library and config code run without a crate.
+ *
+ */
+
+#include <stdint.h>
+
+#define JVME_SIM_A24_ADDR    (21<<19)
+#define JVME_SIM_FIRMWARE    0x71E03113
+#define JVME_SIM_FIFO_WORDS  (64*1024)
+#define JVME_SIM_SYNCHISTORY_WORDS 1024
+#define JVME_SIM_FIFO_CHUNKS 256
+
+/* Readout path faults, see jvmeSimFaultSet */
+#define JVME_SIM_FAULT_HEADER       0  /* block header word type corrupted */
+#define JVME_SIM_FAULT_TRAILER      1  /* block trailer word count off by one */
+#define JVME_SIM_FAULT_NOFILLER     2  /* filler word of an odd length block missing */
+#define JVME_SIM_FAULT_SHORTDMA     3  /* DMA transfers half of what is left */
+#define JVME_SIM_FAULT_BUSERROR     4  /* DMA ends with an error, FIFO read 0xFFFFFFFF */
+#define JVME_SIM_FAULT_STUCKBUFFER  5  /* blockBuffer reads back its last value */
+#define JVME_SIM_NFAULTS            6
+
+/* Called by jvmeSimReplay with what each replayed readout returned */
+typedef void (*JVMESIMREADOUT)(volatile unsigned int *data, int nwords, void *arg);
+
+typedef struct jvmeSimReplayStats
+{
+  uint32_t records;
+  uint32_t breadys;    /* tiBReady calls */
+  uint32_t readouts;   /* tiReadTriggerBlock and tiReadBlock calls */
+  double   elapsed_s;
+} jvmeSimReplayStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  int32_t jvmeSimInit(uint32_t a24addr, uint32_t firmware);
+  void    jvmeSimFree();
+  volatile uint32_t *jvmeSimRegisters();
+  void    jvmeSimSetSerialNumber(uint32_t serial);
+  volatile uint32_t *jvmeSimFifo();
+  int32_t jvmeSimSyncHistoryPush(uint32_t word);
+  int32_t jvmeSimInterrupt();
+  int32_t jvmeSimFifoPush(const uint32_t *words, int nwords);
+  void    jvmeSimFifoClear();
+  int     jvmeSimFifoCount();
+  int32_t jvmeSimFaultSet(int fault, double probability, int first, int period);
+  void    jvmeSimFaultSeed(uint32_t seed);
+  void    jvmeSimFaultClear();
+  uint32_t jvmeSimFaultCount(int fault);
+  int32_t jvmeSimReplay(const char *filename, double speed, JVMESIMREADOUT readout,
+			void *arg, jvmeSimReplayStats *stats);
+#ifdef __cplusplus
+}
+#endif
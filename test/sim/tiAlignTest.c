@@ -0,0 +1,308 @@
+/*
+ * File:
+ *    tiAlignTest.c
+ *
+ * Description:
+ *    Cross-crate alignment check, on trigger banks from files and a pipe
+ *    and on a trigger archive.
+ *      - aligned sources, starting at different event numbers, are found
+ *        aligned from the first event number common to all
+ *      - a timestamp shift beyond the tolerance, a missing event and a
+ *        repeated event number are reported at the right event and source
+ *      - merge rate
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiArchive.h"
+#include "tiAlign.h"
+
+#define NEVENTS     1000000
+#define BL          4
+#define ARCHIVEDIR  "/tmp/tiAlignTest.arch"
+#define BANKFILE    "/tmp/tiAlignTest%d.dat"
+#define NFILES      3
+
+#define TIMESTAMP(_evnum)  ((uint64_t)(_evnum) * 50 + 0x123456789ULL)
+
+/* Trigger banks to generate */
+typedef struct
+{
+  uint64_t first, n;     /* event numbers first to first + n - 1 */
+  uint64_t shiftFrom;    /* timestamps shifted from this event number */
+  int      shift;
+  uint64_t skip;         /* event number left out */
+  uint64_t repeat;       /* event number written twice */
+} gen;
+
+static void
+event(uint32_t *b, int *n, uint64_t evnum, const gen *g)
+{
+  uint64_t ts = TIMESTAMP(evnum);
+
+  if(g->shiftFrom && (evnum >= g->shiftFrom))
+    ts += g->shift;
+
+  b[(*n)++] = (1 << 24) | (0x01 << 16) | 3;
+  b[(*n)++] = evnum & 0xFFFFFFFF;
+  b[(*n)++] = ts & 0xFFFFFFFF;
+  b[(*n)++] = ((evnum >> 32) << 16) | ((ts >> 32) & 0xFFFF);
+}
+
+static int
+writeBanks(int fd, const gen *g)
+{
+  static __thread uint32_t buf[64 * 1024];
+  uint64_t evnum = g->first;
+  int n = 0, bank, nev;
+
+  while(evnum < g->first + g->n)
+    {
+      bank = n;
+      n += 2;
+      for(nev = 0; (nev < BL) && (evnum < g->first + g->n); evnum++)
+	{
+	  if(evnum == g->skip)
+	    continue;
+	  event(buf, &n, evnum, g);
+	  nev++;
+	  if(evnum == g->repeat)
+	    {
+	      event(buf, &n, evnum, g);
+	      nev++;
+	    }
+	}
+      buf[bank] = n - bank - 1;
+      buf[bank + 1] = 0xFF102000 | nev;
+
+      if((n > (int)(sizeof(buf) / sizeof(uint32_t)) - 64) || (evnum >= g->first + g->n))
+	{
+	  if(write(fd, buf, n * sizeof(uint32_t)) != (ssize_t)(n * sizeof(uint32_t)))
+	    return ERROR;
+	  n = 0;
+	}
+    }
+
+  return OK;
+}
+
+static int
+writeFile(int ifile, const gen *g)
+{
+  char name[256];
+  int fd, rval;
+
+  snprintf(name, sizeof(name), BANKFILE, ifile);
+  fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+    return ERROR;
+  rval = writeBanks(fd, g);
+  close(fd);
+
+  return rval;
+}
+
+static int
+writeArchive(const gen *g)
+{
+  tiDecodedEvent ev[1024];
+  uint64_t evnum;
+  int n = 0;
+
+  system("rm -rf " ARCHIVEDIR);
+  if(tiArchiveStart(ARCHIVEDIR) != OK)
+    return ERROR;
+
+  for(evnum = g->first; evnum < g->first + g->n; evnum++)
+    {
+      memset(&ev[n], 0, sizeof(tiDecodedEvent));
+      ev[n].evnum = evnum;
+      ev[n].timestamp = TIMESTAMP(evnum);
+      ev[n].hasTimestamp = 1;
+      if(++n == 1024)
+	{
+	  tiArchiveAppend(ev, n);
+	  n = 0;
+	}
+    }
+  tiArchiveAppend(ev, n);
+
+  return tiArchiveStop();
+}
+
+typedef struct
+{
+  int fd;
+  gen g;
+} pipeWriter;
+
+static void *
+writePipe(void *arg)
+{
+  pipeWriter *w = (pipeWriter *)arg;
+
+  writeBanks(w->fd, &w->g);
+  close(w->fd);
+
+  return NULL;
+}
+
+/* Check the bank files, the archive and a pipe.  files: trigger banks of
+   each file.  Returns tiAlignRun, with its results in stats. */
+static int
+check(const gen *files, uint32_t tolerance, int stopAtFirst, tiAlignStats *stats)
+{
+  pthread_t writer;
+  pipeWriter w;
+  char name[256];
+  int ifile, p[2], rval;
+
+  for(ifile = 0; ifile < NFILES; ifile++)
+    writeFile(ifile, &files[ifile]);
+
+  tiAlignInit(tolerance);
+  for(ifile = 0; ifile < NFILES; ifile++)
+    {
+      snprintf(name, sizeof(name), BANKFILE, ifile);
+      tiAlignAddFile(NULL, name);
+    }
+  tiAlignAddArchive("archive", ARCHIVEDIR);
+
+  if(pipe(p) != 0)
+    return ERROR;
+  memset(&w, 0, sizeof(w));
+  w.fd = p[1];
+  w.g.first = 1;
+  w.g.n = NEVENTS;
+  pthread_create(&writer, NULL, writePipe, &w);
+  tiAlignAddStream("pipe", p[0]);
+
+  rval = tiAlignRun(0, stopAtFirst, stats);
+
+  /* Let the writer finish.  The sources stay, for tiAlignPrintStats */
+  close(p[0]);
+  pthread_join(writer, NULL);
+
+  return rval;
+}
+
+static void
+base(gen *files)
+{
+  int ifile;
+
+  memset(files, 0, NFILES * sizeof(gen));
+  for(ifile = 0; ifile < NFILES; ifile++)
+    {
+      files[ifile].first = 1;
+      files[ifile].n = NEVENTS;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+  tiAlignStats st;
+  gen files[NFILES], archive;
+  int failed = 0, rval;
+
+  /* The pipe is closed under its writer when stopping at a divergence */
+  signal(SIGPIPE, SIG_IGN);
+
+  memset(&archive, 0, sizeof(archive));
+  archive.first = 1;
+  archive.n = NEVENTS;
+  if(writeArchive(&archive) != OK)
+    {
+      printf("ERROR: Writing the archive\n");
+      exit(1);
+    }
+
+  /* Aligned, captures started at different event numbers */
+  base(files);
+  files[1].first = 101;
+  files[1].n = NEVENTS - 100;
+  files[2].first = 1;
+  files[2].n = NEVENTS + 500;
+  rval = check(files, 0, 0, &st);
+  tiAlignPrintStats(&st);
+  if((rval != OK) || (st.firstEvnum != 101) || (st.events != NEVENTS - 100) ||
+     (st.aligned != st.events))
+    {
+      printf("ERROR: Aligned sources: %llu events from %llu, %llu aligned\n",
+	     (unsigned long long)st.events, (unsigned long long)st.firstEvnum,
+	     (unsigned long long)st.aligned);
+      failed = 1;
+    }
+  if(st.events / st.elapsed_s < 1e6)
+    {
+      printf("ERROR: Merge below 1 M events/s\n");
+      failed = 1;
+    }
+
+  /* Timestamp shift, beyond and within the tolerance */
+  base(files);
+  files[1].shiftFrom = 500001;
+  files[1].shift = 3;
+  rval = check(files, 2, 0, &st);
+  if((rval != ERROR) || !st.diverged || (st.first.kind != TI_ALIGN_TIMESTAMP) ||
+     (st.first.source != 1) || (st.first.evnum != 500001) || (st.first.refSource != 0) ||
+     (st.first.timestamp - st.first.reference != 3) || (st.timestamp != NEVENTS - 500000))
+    {
+      printf("ERROR: Timestamp shift not found\n");
+      tiAlignPrintStats(&st);
+      failed = 1;
+    }
+  rval = check(files, 3, 0, &st);
+  if((rval != OK) || (st.aligned != NEVENTS))
+    {
+      printf("ERROR: Timestamp shift within the tolerance\n");
+      failed = 1;
+    }
+
+  /* Missing event, stopping at the first divergence */
+  base(files);
+  files[2].skip = 700001;
+  rval = check(files, 0, 1, &st);
+  if((rval != ERROR) || (st.first.kind != TI_ALIGN_MISSING) || (st.first.source != 2) ||
+     (st.first.evnum != 700001) || (st.events != 700001) || (st.missing != 1))
+    {
+      printf("ERROR: Missing event not found\n");
+      tiAlignPrintStats(&st);
+      failed = 1;
+    }
+
+  /* Repeated event number */
+  base(files);
+  files[0].repeat = 12345;
+  rval = check(files, 0, 0, &st);
+  if((rval != ERROR) || (st.first.kind != TI_ALIGN_ORDER) || (st.first.source != 0) ||
+     (st.first.evnum != 12345) || (st.order != 1) || (st.aligned != NEVENTS))
+    {
+      printf("ERROR: Repeated event number not found\n");
+      tiAlignPrintStats(&st);
+      failed = 1;
+    }
+
+  tiAlignClose();
+  system("rm -rf " ARCHIVEDIR " /tmp/tiAlignTest*.dat");
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiAlignTest "
+  End:
+*/
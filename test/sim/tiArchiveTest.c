@@ -0,0 +1,318 @@
+/*
+ * File:
+ *    tiArchiveTest.c
+ *
+ * Description:
+ *    Write the columnar trigger archive, and read it back.
+ *      - every value, chunk footer and event number range is found again
+ *        by the reader, trigger banks (tiArchiveWriteBank) included
+ *      - a reader sees the rows of the chunk being filled after
+ *        tiArchiveFlush
+ *      - an archive started again on the same directory is appended to
+ *      - tiArchiveFindEvent finds the event numbers, and not the missing ones
+ *      - a chunk that cannot be added closes the archive, keeping the
+ *        rows before it
+ *      - write and scan rates
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiArchive.h"
+
+#define ARCHIVEDIR  "/tmp/tiArchiveTest"
+#define NROWS       (2000000 + 1234)  /* last chunk partly filled */
+#define NAPPEND     100000
+#define NBANKS      1000
+#define BANKLEVEL   4
+#define BATCH       1024
+
+/* Values of row i */
+#define EVNUM(_i)      ((uint64_t)(_i) * 2 + 1)
+#define TIMESTAMP(_i)  ((uint64_t)(_i) * 25 + 0x100000000ULL)
+#define EVTYPE(_i)     ((uint8_t)(((_i) % 15) + 1))
+#define TSINPUTS(_i)   ((uint32_t)(((_i) * 7) & 0x3F))
+
+static double
+now()
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void
+fill(tiDecodedEvent *ev, uint64_t row)
+{
+  memset(ev, 0, sizeof(*ev));
+  ev->evnum = EVNUM(row);
+  ev->timestamp = TIMESTAMP(row);
+  ev->hasTimestamp = 1;
+  ev->evtype = EVTYPE(row);
+  ev->tsInputs = TSINPUTS(row);
+  ev->hasTSInputs = 1;
+  ev->nwords = 4;
+}
+
+/* Append rows [first, first + n) */
+static int
+append(uint64_t first, uint64_t n)
+{
+  tiDecodedEvent ev[BATCH];
+  uint64_t row = first;
+  int i, nb;
+
+  while(row < first + n)
+    {
+      nb = ((first + n - row) < BATCH) ? (int)(first + n - row) : BATCH;
+      for(i = 0; i < nb; i++)
+	fill(&ev[i], row + i);
+      if(tiArchiveAppend(ev, nb) != nb)
+	return ERROR;
+      row += nb;
+    }
+
+  return OK;
+}
+
+/* Append rows [first, first + NBANKS * BANKLEVEL) as format 3 trigger banks */
+static int
+appendBanks(uint64_t first)
+{
+  static uint32_t bank[NBANKS * (2 + BANKLEVEL * 5)];
+  uint64_t row = first;
+  int n = 0, ib, iev, blen;
+
+  for(ib = 0; ib < NBANKS; ib++)
+    {
+      blen = n;
+      bank[n++] = 0;
+      bank[n++] = 0xFF102000 | BANKLEVEL;
+      for(iev = 0; iev < BANKLEVEL; iev++, row++)
+	{
+	  bank[n++] = (EVTYPE(row) << 24) | (0x01 << 16) | 4;
+	  bank[n++] = EVNUM(row) & 0xFFFFFFFF;
+	  bank[n++] = TIMESTAMP(row) & 0xFFFFFFFF;
+	  bank[n++] = ((EVNUM(row) >> 32) << 16) | ((TIMESTAMP(row) >> 32) & 0xFFFF);
+	  bank[n++] = TSINPUTS(row);
+	}
+      bank[blen] = n - blen - 1;
+    }
+
+  return (tiArchiveWriteBank(bank, n) == NBANKS * BANKLEVEL) ? OK : ERROR;
+}
+
+/* Number of open file descriptors */
+static int
+nfds()
+{
+  DIR *d = opendir("/proc/self/fd");
+  int n = 0;
+
+  if(d == NULL)
+    return -1;
+  while(readdir(d) != NULL)
+    n++;
+  closedir(d);
+
+  return n;
+}
+
+/* Check every row of the archive against its values.  Returns the number
+   of errors, the scan time in scan */
+static int
+verify(uint64_t nrows, double *scan)
+{
+  tiArchiveReader r;
+  tiArchiveColumns c;
+  uint64_t row = 0, sum = 0, emin, emax;
+  uint32_t i;
+  int chunk, errors = 0;
+  double t;
+
+  if(tiArchiveOpen(ARCHIVEDIR, &r) != OK)
+    return 1;
+
+  if(r.rows != nrows)
+    {
+      printf("ERROR: %llu rows read, %llu written\n",
+	     (unsigned long long)r.rows, (unsigned long long)nrows);
+      tiArchiveClose(&r);
+      return 1;
+    }
+
+  for(chunk = 0; chunk < r.nchunks; chunk++)
+    {
+      tiArchiveChunk(&r, chunk, &c);
+      if((c.firstRow != row) ||
+	 ((chunk < r.nchunks - 1) && (c.rows != TI_ARCHIVE_CHUNK_ROWS)))
+	{
+	  printf("ERROR: Chunk %d: first row %llu, %u rows\n",
+		 chunk, (unsigned long long)c.firstRow, c.rows);
+	  errors++;
+	}
+
+      emin = EVNUM(c.firstRow);
+      emax = EVNUM(c.firstRow + c.rows - 1);
+      if((c.evnumMin != emin) || (c.evnumMax != emax) ||
+	 (c.timestampMin != TIMESTAMP(c.firstRow)) ||
+	 (c.timestampMax != TIMESTAMP(c.firstRow + c.rows - 1)))
+	{
+	  printf("ERROR: Chunk %d: footer range\n", chunk);
+	  errors++;
+	}
+
+      for(i = 0; (i < c.rows) && (errors < 10); i++, row++)
+	{
+	  if((c.evnum[i] != EVNUM(row)) || (c.timestamp[i] != TIMESTAMP(row)) ||
+	     (c.evtype[i] != EVTYPE(row)) || (c.tsInputs[i] != TSINPUTS(row)))
+	    {
+	      printf("ERROR: Row %llu differs\n", (unsigned long long)row);
+	      errors++;
+	    }
+	}
+    }
+
+  /* Scan: sum of a column over the archive */
+  t = now();
+  for(chunk = 0; chunk < r.nchunks; chunk++)
+    {
+      tiArchiveChunk(&r, chunk, &c);
+      for(i = 0; i < c.rows; i++)
+	sum += c.timestamp[i] + c.evtype[i];
+    }
+  *scan = now() - t;
+  if(sum == 0)
+    errors++;
+
+  /* Lookups: present (odd) and missing (even) event numbers */
+  if((tiArchiveFindEvent(&r, EVNUM(0)) != 0) ||
+     (tiArchiveFindEvent(&r, EVNUM(nrows / 3)) != (int64_t)(nrows / 3)) ||
+     (tiArchiveFindEvent(&r, EVNUM(nrows - 1)) != (int64_t)(nrows - 1)) ||
+     (tiArchiveFindEvent(&r, EVNUM(nrows / 2) + 1) != -1) ||
+     (tiArchiveFindEvent(&r, EVNUM(nrows)) != -1))
+    {
+      printf("ERROR: tiArchiveFindEvent\n");
+      errors++;
+    }
+
+  tiArchiveClose(&r);
+
+  return errors;
+}
+
+int
+main(int argc, char *argv[])
+{
+  tiArchiveReader r;
+  uint64_t nrows;
+  double t, write, scan;
+  struct rlimit fsize, limit;
+  struct stat st;
+  int failed = 0, fds;
+
+  system("rm -rf " ARCHIVEDIR);
+
+  /* Write */
+  if(tiArchiveStart(ARCHIVEDIR) != OK)
+    {
+      printf("ERROR: tiArchiveStart failed\n");
+      exit(1);
+    }
+  t = now();
+  if(append(0, NROWS) != OK)
+    {
+      printf("ERROR: tiArchiveAppend failed\n");
+      exit(1);
+    }
+  write = now() - t;
+
+  /* Readers see the partial chunk once flushed */
+  tiArchiveFlush();
+  if((tiArchiveOpen(ARCHIVEDIR, &r) != OK) || (r.rows != NROWS))
+    {
+      printf("ERROR: %llu rows after tiArchiveFlush, %d written\n",
+	     (unsigned long long)r.rows, NROWS);
+      failed = 1;
+    }
+  tiArchiveClose(&r);
+
+  if(appendBanks(NROWS) != OK)
+    {
+      printf("ERROR: tiArchiveWriteBank failed\n");
+      failed = 1;
+    }
+  nrows = NROWS + NBANKS * BANKLEVEL;
+  if(tiArchiveGetRows() != nrows)
+    {
+      printf("ERROR: tiArchiveGetRows %llu\n", (unsigned long long)tiArchiveGetRows());
+      failed = 1;
+    }
+  tiArchiveStop();
+
+  failed |= (verify(nrows, &scan) != 0);
+  printf("  %llu rows: write %.1f Mrows/s, scan %.1f Mrows/s\n",
+	 (unsigned long long)nrows, NROWS / write * 1e-6, nrows / scan * 1e-6);
+  if(nrows / scan < 1e6)
+    {
+      printf("ERROR: Scan below 1 Mrows/s\n");
+      failed = 1;
+    }
+
+  /* Start again, to append */
+  if((tiArchiveStart(ARCHIVEDIR) != OK) || (tiArchiveGetRows() != nrows) ||
+     (append(nrows, NAPPEND) != OK))
+    {
+      printf("ERROR: Appending to the archive\n");
+      failed = 1;
+    }
+  tiArchiveStop();
+  nrows += NAPPEND;
+  failed |= (verify(nrows, &scan) != 0);
+
+  /* Files may not grow: the next chunk fails */
+  fds = nfds();
+  stat(ARCHIVEDIR "/evnum.col", &st);
+  signal(SIGXFSZ, SIG_IGN);
+  getrlimit(RLIMIT_FSIZE, &fsize);
+  limit = fsize;
+  limit.rlim_cur = st.st_size;
+  setrlimit(RLIMIT_FSIZE, &limit);
+
+  if((tiArchiveStart(ARCHIVEDIR) != OK) ||
+     (append(nrows, TI_ARCHIVE_CHUNK_ROWS) != ERROR) ||
+     (tiArchiveGetRows() != 0) || (nfds() != fds))
+    {
+      printf("ERROR: Chunk not added: %llu rows, %d open files (%d before)\n",
+	     (unsigned long long)tiArchiveGetRows(), nfds(), fds);
+      failed = 1;
+    }
+  setrlimit(RLIMIT_FSIZE, &fsize);
+
+  /* The last chunk was filled before */
+  nrows += TI_ARCHIVE_CHUNK_ROWS - (nrows % TI_ARCHIVE_CHUNK_ROWS);
+  failed |= (verify(nrows, &scan) != 0);
+
+  system("rm -rf " ARCHIVEDIR);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiArchiveTest "
+  End:
+*/
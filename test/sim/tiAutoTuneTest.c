@@ -0,0 +1,192 @@
+/*
+ * File:
+ *    tiAutoTuneTest.c
+ *
+ * Description:
+ *    Check the block level autotuner, using the simulated VME backend.
+ *      - 20 kHz offered, readout of 30 us + 10 us/event per block,
+ *        buffer level 4, starting at block level 1 (80% busy)
+ *      - expect the smallest block level that reaches the live target
+ *        within the latency limit, applied on the second update
+ *      - not broadcast again until the sync event made it current
+ *      - expect the service time model from the two block levels
+ *      - a latency limit too tight for the live target
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiAutoTune.h"
+#include "jvmeSim.h"
+
+#define TIMER_UNIT  7.68e-6   /* seconds per live/busy timer count */
+#define OFFERED     20000.
+#define OVERHEAD    30e-6
+#define PEREVENT    10e-6
+#define BUFFERLEVEL 4
+
+static volatile struct TI_A24RegStruct *simTIp = NULL;
+
+/* One second of running at the current block level, with the live time
+   of a buffer of BUFFERLEVEL blocks (M/M/1/K) */
+static double
+simSecond()
+{
+  int bl = (simTIp->blocklevel & TI_BLOCKLEVEL_CURRENT_MASK) >> 16;
+  double S = OVERHEAD + PEREVENT * bl, rho = OFFERED / bl * S, live = 0.;
+  unsigned int ticks = (unsigned int)(1. / TIMER_UNIT), events = 0;
+
+  live = 1. - (1. - rho) * pow(rho, BUFFERLEVEL) / (1. - pow(rho, BUFFERLEVEL + 1));
+  events = (unsigned int)(OFFERED * live);
+
+  simTIp->livetime += (unsigned int)(ticks * live);
+  simTIp->busytime += ticks - (unsigned int)(ticks * live);
+  simTIp->eventNumber_lo += events;
+  tiAutoTuneAddService(events / bl, (events / bl) * S);
+
+  return live;
+}
+
+static int
+checkProposal(const tiAutoTuneStatus *s, const tiAutoTuneConfig *cfg)
+{
+  double live = 0., latency = 0.;
+
+  if(s->proposed < cfg->minBlockLevel)
+    return 0;
+
+  tiAutoTunePredict(s, s->proposed, &live, &latency);
+  if((live < cfg->liveTarget) || (latency > cfg->maxLatency))
+    return 0;
+
+  /* ... and the smallest one */
+  if(s->proposed > cfg->minBlockLevel)
+    {
+      tiAutoTunePredict(s, s->proposed - 1, &live, &latency);
+      if((live >= cfg->liveTarget) && (latency <= cfg->maxLatency))
+	return 0;
+    }
+
+  return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  tiAutoTuneConfig cfg =
+    {
+      .liveTarget = 0.98,
+      .maxLatency = 0.05,
+      .minBlockLevel = 1,
+      .maxBlockLevel = 100,
+      .bufferLevel = -1,
+      .overhead = 0.5,
+      .timeout_ms = 2000
+    };
+  tiAutoTuneStatus s;
+  int failed = 0, first = 0;
+  double live = 0., latency = 0.;
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    {
+      printf("ERROR: jvmeSimInit failed\n");
+      exit(1);
+    }
+  simTIp = (volatile struct TI_A24RegStruct *)jvmeSimRegisters();
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      printf("ERROR: tiInit failed\n");
+      exit(1);
+    }
+  tiSetBlockLevel(1);
+  tiSetBlockBufferLevel(BUFFERLEVEL);
+
+  if(tiAutoTuneInit(&cfg) != OK)
+    {
+      printf("ERROR: tiAutoTuneInit failed\n");
+      exit(1);
+    }
+
+  /* Block level 1: proposed, not applied yet */
+  simSecond();
+  tiAutoTuneUpdate(1, &s);
+  tiAutoTunePrint(&s);
+  if((s.blockLevel != 1) || (fabs(s.offered - OFFERED) > 0.01 * OFFERED) ||
+     (fabs(s.service - (OVERHEAD + PEREVENT)) > 1e-7) ||
+     !s.liveMet || !s.latencyMet || s.applied || !checkProposal(&s, &cfg))
+    {
+      printf("ERROR: First proposal %d (offered %.1f Hz, service %.2f us)\n",
+	     s.proposed, s.offered, 1e6 * s.service);
+      failed = 1;
+    }
+  first = s.proposed;
+
+  /* Same again: applied */
+  simSecond();
+  tiAutoTuneUpdate(1, &s);
+  if((s.proposed != first) || !s.applied || (tiGetCurrentBlockLevel() != first))
+    {
+      printf("ERROR: Block level %d not applied (proposed %d, now %d)\n",
+	     first, s.proposed, tiGetCurrentBlockLevel());
+      failed = 1;
+    }
+
+  /* No sync event yet: the broadcast is not repeated */
+  simTIp->blocklevel = (simTIp->blocklevel & ~TI_BLOCKLEVEL_CURRENT_MASK) | (1 << 16);
+  simSecond();
+  tiAutoTuneUpdate(1, &s);
+  if((s.proposed != first) || s.applied)
+    {
+      printf("ERROR: Block level %d broadcast again before the sync event\n", first);
+      failed = 1;
+    }
+  simTIp->blocklevel = (simTIp->blocklevel & ~TI_BLOCKLEVEL_CURRENT_MASK) | (first << 16);
+
+  /* Second block level: the model is measured.  The interval of the
+     change is not used. */
+  simSecond();
+  tiAutoTuneUpdate(0, &s);
+  simSecond();
+  tiAutoTuneUpdate(0, &s);
+  tiAutoTunePrint(&s);
+  if((fabs(s.overhead - OVERHEAD) > 1e-7) || (fabs(s.perEvent - PEREVENT) > 1e-8) ||
+     (s.baseDead > 1e-3) || !checkProposal(&s, &cfg))
+    {
+      printf("ERROR: Model %.3f us + %.3f us/event (%.4f other), proposal %d\n",
+	     1e6 * s.overhead, 1e6 * s.perEvent, s.baseDead, s.proposed);
+      failed = 1;
+    }
+
+  /* Latency limit too tight for the live target.  Back at block level 1,
+     with the overhead fraction of the model, only block level 2 (200 us)
+     is within the limit, at 96.8% live. */
+  tiSetBlockLevel(1);
+  cfg.overhead = OVERHEAD / (OVERHEAD + PEREVENT);
+  cfg.maxLatency = 0.00021;
+  tiAutoTuneInit(&cfg);
+  simSecond();
+  tiAutoTuneUpdate(0, &s);
+  tiAutoTunePredict(&s, s.proposed, &live, &latency);
+  if((s.proposed != 2) || s.liveMet || !s.latencyMet || (latency > cfg.maxLatency) ||
+     (live >= cfg.liveTarget))
+    {
+      printf("ERROR: Tight latency: proposal %d, live %.3f, latency %.3f ms\n",
+	     s.proposed, live, 1e3 * latency);
+      failed = 1;
+    }
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiAutoTuneTest "
+  End:
+*/
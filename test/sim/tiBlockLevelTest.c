@@ -0,0 +1,206 @@
+/*
+ * File:
+ *    tiBlockLevelTest.c
+ *
+ * Description:
+ *    Check the coordinated block level change, using the simulated VME
+ *    backend.
+ *      - plans keep only the steps needed
+ *      - block and buffer level changed together while paused, refused
+ *        with a block waiting for readout
+ *      - controller levels from the trigger rate, with hysteresis
+ *      - confirmation from two slave ports, one of them late, and a
+ *        timeout when one never follows
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiBlockLevel.h"
+#include "jvmeSim.h"
+
+#define SLAVE_DELAY_MS  20
+
+static volatile struct TI_A24RegStruct *simTIp = NULL;
+
+static int
+currentBlockLevel()
+{
+  return (simTIp->blocklevel & TI_BLOCKLEVEL_CURRENT_MASK) >> 16;
+}
+
+static void
+setSlaveBlockLevel(int port, int blockLevel)
+{
+  simTIp->hfbr_tiID[port - 1] =
+    (simTIp->hfbr_tiID[port - 1] & ~TI_ID_BLOCKLEVEL_MASK) | (blockLevel << 16);
+}
+
+/* Slave on fiber 3 follows the broadcast late */
+static void *
+lateSlave(void *arg)
+{
+  struct timespec delay = {0, SLAVE_DELAY_MS * 1000000};
+
+  nanosleep(&delay, NULL);
+  setSlaveBlockLevel(3, *(int *)arg);
+
+  return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+  tiBlockLevelPlan plan;
+  tiBlockLevelCtrlLevel levels[3] =
+    {
+      {0.,     1, 1},
+      {1000., 10, 2},
+      {10000., 40, 4}
+    };
+  struct
+  {
+    double rate;
+    int    level;
+  } ctrl[] =
+    {
+      {500.,   0},
+      {1050.,  0},   /* within the hysteresis */
+      {1200.,  1},
+      {950.,   1},   /* within the hysteresis */
+      {850.,   0},
+      {20000., 2}
+    };
+  pthread_t thread;
+  int failed = 0, n = 0, ictrl, target = 0;
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    {
+      printf("ERROR: jvmeSimInit failed\n");
+      exit(1);
+    }
+  simTIp = (volatile struct TI_A24RegStruct *)jvmeSimRegisters();
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      printf("ERROR: tiInit failed\n");
+      exit(1);
+    }
+
+  /* Nothing to change */
+  n = tiBlockLevelPlanMake(&plan, tiGetCurrentBlockLevel(), tiGetBlockBufferLevel(),
+			   TI_BLCHANGE_PAUSED);
+  if((n != 0) || (plan.steps != 0) || (tiBlockLevelApply(&plan, 10) != OK))
+    {
+      printf("ERROR: Unchanged levels planned %d steps\n", n);
+      failed = 1;
+    }
+
+  /* Both, while paused */
+  n = tiBlockLevelPlanMake(&plan, 10, 4, TI_BLCHANGE_PAUSED);
+  if((n != 3) ||
+     (plan.steps != (TI_BLPLAN_SYNCRESET | TI_BLPLAN_BUFFERLEVEL | TI_BLPLAN_BLOCKLEVEL)) ||
+     (plan.fiberMask != 0))
+    {
+      printf("ERROR: Plan to 10/4 has %d steps (0x%x)\n", n, plan.steps);
+      failed = 1;
+    }
+
+  simTIp->blockBuffer |= (1 << 8);
+  if(tiBlockLevelApply(&plan, 10) != ERROR)
+    {
+      printf("ERROR: Applied with a block waiting for readout\n");
+      failed = 1;
+    }
+  simTIp->blockBuffer &= ~TI_BLOCKBUFFER_BLOCKS_READY_MASK;
+
+  if((tiBlockLevelApply(&plan, 10) != OK) || (currentBlockLevel() != 10) ||
+     (tiGetBlockBufferLevel() != 4) || (tiGetBroadcastBlockBufferLevel() != 4))
+    {
+      printf("ERROR: Block level %d, buffer level %d after the change to 10/4\n",
+	     currentBlockLevel(), tiGetBlockBufferLevel());
+      failed = 1;
+    }
+  tiBlockLevelPlanPrint(&plan);
+
+  /* Buffer level alone needs no SyncReset */
+  n = tiBlockLevelPlanMake(&plan, 0, 6, TI_BLCHANGE_PAUSED);
+  if((n != 1) || (plan.steps != TI_BLPLAN_BUFFERLEVEL) || (plan.blockLevel != 10) ||
+     (tiBlockLevelApply(&plan, 10) != OK) || (tiGetBlockBufferLevel() != 6))
+    {
+      printf("ERROR: Buffer level change has %d steps (0x%x)\n", n, plan.steps);
+      failed = 1;
+    }
+
+  /* Controller */
+  if(tiBlockLevelCtrlConfig(levels, 3, 0.1) != OK)
+    {
+      printf("ERROR: tiBlockLevelCtrlConfig failed\n");
+      failed = 1;
+    }
+
+  for(ictrl = 0; ictrl < (int)(sizeof(ctrl) / sizeof(ctrl[0])); ictrl++)
+    {
+      n = tiBlockLevelCtrlUpdate(ctrl[ictrl].rate, TI_BLCHANGE_PAUSED, 10);
+      if((n != ctrl[ictrl].level) ||
+	 (currentBlockLevel() != levels[ctrl[ictrl].level].blockLevel) ||
+	 (tiGetBlockBufferLevel() != levels[ctrl[ictrl].level].bufferLevel))
+	{
+	  printf("ERROR: %.0f Hz: level %d (expected %d), block level %d\n",
+		 ctrl[ictrl].rate, n, ctrl[ictrl].level, currentBlockLevel());
+	  failed = 1;
+	}
+    }
+
+  /* Slaves on fiber 1 and 3 */
+  tiAddSlave(1);
+  tiAddSlave(3);
+  simTIp->fiber |= (0x5 << 16);
+  setSlaveBlockLevel(1, 20);
+  setSlaveBlockLevel(3, currentBlockLevel());
+
+  n = tiBlockLevelPlanMake(&plan, 20, -1, TI_BLCHANGE_SYNCEVENT);
+  if((n != 1) || (plan.steps != TI_BLPLAN_BLOCKLEVEL) || (plan.fiberMask != 0x5))
+    {
+      printf("ERROR: Plan to 20 has %d steps (0x%x), fibers 0x%x\n",
+	     n, plan.steps, plan.fiberMask);
+      failed = 1;
+    }
+
+  target = 20;
+  pthread_create(&thread, NULL, lateSlave, &target);
+  if((tiBlockLevelApply(&plan, 1000) != OK) || (plan.pendingMask != 0) ||
+     (plan.elapsed_us < SLAVE_DELAY_MS * 1000))
+    {
+      printf("ERROR: Late slave not confirmed (pending 0x%x, %d us)\n",
+	     plan.pendingMask, plan.elapsed_us);
+      failed = 1;
+    }
+  pthread_join(thread, NULL);
+  tiBlockLevelPlanPrint(&plan);
+
+  /* Fiber 3 never follows */
+  setSlaveBlockLevel(1, 30);
+  tiBlockLevelPlanMake(&plan, 30, -1, TI_BLCHANGE_SYNCEVENT);
+  if((tiBlockLevelApply(&plan, 20) != ERROR) || (plan.pendingMask != 0x4))
+    {
+      printf("ERROR: Missing slave confirmation not reported (pending 0x%x)\n",
+	     plan.pendingMask);
+      failed = 1;
+    }
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiBlockLevelTest "
+  End:
+*/
@@ -0,0 +1,140 @@
+/*
+ * File:
+ *    tiBlockMonTest.c
+ *
+ * Description:
+ *    Check the block pipeline depth tracker using the simulated VME backend.
+ *      - TI Master with slaves on Fiber 1 and 2
+ *      - Fiber 2 holds more blocks needing acknowledge than the others
+ *      - expect Fiber 2 to be reported as the slowest ROC, by manual
+ *        samples and by the background sampler
+ *      - a sampler stopped on an error can be started again
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiBlockMon.h"
+#include "jvmeSim.h"
+
+/* Block status word for one port: ready in bits 0-7, need ack in bits 8-15 */
+#define BLOCKS(ready, needack) (((needack) << 8) | (ready))
+
+int
+main(int argc, char *argv[])
+{
+  volatile struct TI_A24RegStruct *regs;
+  tiBlockMonPort stats;
+  uint32_t count = 0;
+  int isamp, slowest = 0, failed = 0;
+
+  printf("\nJLAB TI Block Pipeline Monitor (simulated)\n");
+  printf("----------------------------\n");
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    exit(1);
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      failed = 1;
+      goto CLOSE;
+    }
+
+  tiAddSlave(1);
+  tiAddSlave(2);
+
+  if(tiBlockMonInit(0) != OK)
+    {
+      failed = 1;
+      goto CLOSE;
+    }
+
+  /* Loopback: 1 block, Fiber 1: 1 block, Fiber 2: 4 blocks */
+  regs = (volatile struct TI_A24RegStruct *)jvmeSimRegisters();
+  regs->adr24 = (regs->adr24 & 0xFFFF) | (BLOCKS(1, 1) << 16);
+  regs->blockStatus[0] = BLOCKS(1, 1) | (BLOCKS(4, 4) << 16);
+
+  for(isamp = 0; isamp < 10; isamp++)
+    {
+      slowest = tiBlockMonSample();
+      if(slowest != 2)
+	{
+	  printf("ERROR: sample %d slowest = %d (expected 2)\n", isamp, slowest);
+	  failed = 1;
+	}
+    }
+
+  /* All equal: nobody is behind */
+  regs->blockStatus[0] = BLOCKS(1, 1) | (BLOCKS(1, 1) << 16);
+  if(tiBlockMonSample() != -1)
+    {
+      printf("ERROR: a port was attributed with equal pipelines\n");
+      failed = 1;
+    }
+
+  tiBlockMonGetPort(2, &stats);
+  if((stats.nsamples != 11) || (stats.histo[4] != 10) || (stats.histo[1] != 1) ||
+     (stats.maxNeedAck != 4) || (stats.slowest != 10))
+    {
+      printf("ERROR: Fiber 2: %d samples, histo[4] = %d, histo[1] = %d, max %d, slowest %d\n",
+	     stats.nsamples, stats.histo[4], stats.histo[1],
+	     stats.maxNeedAck, stats.slowest);
+      failed = 1;
+    }
+
+  if((tiBlockMonSlowest(&count) != 2) || (count != 10))
+    {
+      printf("ERROR: slowest = %d x %d (expected Fiber 2 x 10)\n",
+	     tiBlockMonSlowest(NULL), count);
+      failed = 1;
+    }
+
+  /* Background sampler with Fiber 1 behind */
+  tiBlockMonInit(0);
+  regs->blockStatus[0] = BLOCKS(3, 3) | (BLOCKS(1, 1) << 16);
+  if(tiBlockMonStart(1) != OK)
+    failed = 1;
+  usleep(50000);
+  tiBlockMonStop();
+
+  tiBlockMonPrintStatus();
+
+  if(tiBlockMonSlowest(&count) != 1)
+    {
+      printf("ERROR: background sampler slowest = %d (expected Fiber 1)\n",
+	     tiBlockMonSlowest(NULL));
+      failed = 1;
+    }
+
+  /* Sampler stops when the TI is gone, and can be started again */
+  if(tiBlockMonStart(1) != OK)
+    failed = 1;
+  regs->boardID = 0;
+  tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0);
+  usleep(50000);
+  regs->boardID = (TI_BOARDID_TYPE_TI << 16) | (((JVME_SIM_A24_ADDR >> 19) << 8) & TI_BOARDID_GEOADR_MASK);
+  if((tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK) ||
+     (tiBlockMonStart(1) != OK))
+    {
+      printf("ERROR: sampler not restarted after stopping on an error\n");
+      failed = 1;
+    }
+  tiBlockMonStop();
+
+ CLOSE:
+  jvmeSimFree();
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiBlockMonTest "
+  End:
+*/
@@ -0,0 +1,282 @@
+/*
+ * File:
+ *    tiCaptureTest.c
+ *
+ * Description:
+ *    Capture the readout of the simulated TI, and replay it, with
+ *    programmed I/O (block level 2) and DMA (block level 4).
+ *      - the capture file has every tiBReady and tiReadBlock call, the
+ *        readout recovery drains included, and no record was dropped
+ *      - replayed through the library, the readout returns the same
+ *        trigger banks (fake ones included)
+ *      - replay at the recorded speed takes the recorded time
+ *      - cost of the capture, and replay throughput at maximum speed
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiLog.h"
+#include "tiCapture.h"
+#include "jvmeSim.h"
+
+#define CAPTUREFILE  "/tmp/tiCaptureTest.cap"
+#define NBLOCKS      100
+#define SLOT         21
+#define MAXWORDS     ((8*4) + 8)
+#define POLL_US      200
+
+static unsigned int data[MAXWORDS] __attribute__((aligned(8)));
+
+/* Banks returned by the readout, to compare */
+typedef struct
+{
+  int          n;
+  int          nwords[2 * NBLOCKS];
+  unsigned int words[2 * NBLOCKS][MAXWORDS];
+} banks;
+
+static banks captured, replayed;
+
+typedef struct
+{
+  int      breadys, triggerBlocks, recoveries, filler, unordered;
+  uint64_t last;
+} census;
+
+static void
+pushBlocks(int bl)
+{
+  uint32_t b[MAXWORDS];
+  int iblk, iev, n;
+
+  jvmeSimFifoClear();
+  for(iblk = 0; iblk < NBLOCKS; iblk++)
+    {
+      n = 0;
+      b[n++] = 0x80000000 | (SLOT << 22) | ((iblk & 0xFF) << 8) | bl;
+      b[n++] = 0xFF102000 | bl;
+      for(iev = 0; iev < bl; iev++)
+	{
+	  b[n++] = (0x01 << 24) | (iev << 16) | 2;
+	  b[n++] = iblk * bl + iev;
+	  b[n++] = 0x1000 + iev;
+	}
+      b[n] = 0x88000000 | (SLOT << 22) | (n + 1);
+      n++;
+      if(n & 1)
+	b[n++] = 0xF8000000 | (SLOT << 22);
+
+      for(iev = 0; iev < n; iev++)
+	b[iev] = LSWAP(b[iev]);
+      jvmeSimFifoPush(b, n);
+    }
+}
+
+static void
+keep(banks *k, volatile unsigned int *d, int nwords)
+{
+  if(k->n >= 2 * NBLOCKS)
+    return;
+
+  k->nwords[k->n] = nwords;
+  if(nwords > 0)
+    memcpy(k->words[k->n], (void *)d, nwords * sizeof(unsigned int));
+  k->n++;
+}
+
+static void
+replayReadout(volatile unsigned int *d, int nwords, void *arg)
+{
+  keep(&replayed, d, nwords);
+}
+
+static int
+count(const tiCaptureInfo *info, const tiCaptureRecord *rec, const uint32_t *words, void *arg)
+{
+  census *c = (census *)arg;
+
+  if(rec->time_ns < c->last)
+    c->unordered++;
+  c->last = rec->time_ns;
+
+  if(rec->type == TI_CAPTURE_BREADY)
+    c->breadys++;
+  else if((rec->flags & TI_CAPTURE_CALLER_MASK) == TI_CAPTURE_TRIGGERBLOCK)
+    c->triggerBlocks++;
+  else if((rec->flags & TI_CAPTURE_CALLER_MASK) == TI_CAPTURE_RECOVERY)
+    c->recoveries++;
+  if((rec->type == TI_CAPTURE_BLOCK) && (rec->value > 0) && ((int)rec->nwords == rec->value + 1))
+    c->filler++;
+
+  return OK;
+}
+
+static double
+now()
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Read out the queued blocks.  Returns the time spent in the library (s) */
+static double
+readout(banks *k)
+{
+  struct timespec poll = {0, POLL_US * 1000};
+  double spent = 0., t;
+  int nwords;
+
+  if(k)
+    k->n = 0;
+  while(jvmeSimFifoCount() > 0)
+    {
+      t = now();
+      if(tiBReady() > 0)
+	{
+	  memset(data, 0, sizeof(data));
+	  nwords = tiReadTriggerBlock(data);
+	  spent += now() - t;
+	  if(k)
+	    keep(k, data, nwords);
+	}
+      else
+	spent += now() - t;
+      nanosleep(&poll, NULL);
+    }
+
+  return spent;
+}
+
+static int
+run(int bl)
+{
+  tiCaptureStats st;
+  jvmeSimReplayStats rs;
+  census c;
+  double plain, capture, t;
+  int failed = 0, ibank;
+
+  tiSetBlockLevel(bl);
+  jvmeSimFaultClear();
+
+  /* Without capture, for the cost */
+  pushBlocks(bl);
+  plain = readout(NULL);
+
+  /* Capture, with a few blocks to recover */
+  jvmeSimFaultSet(JVME_SIM_FAULT_HEADER, 0., 10, 40);
+  pushBlocks(bl);
+  if(tiCaptureStart(CAPTUREFILE) != OK)
+    {
+      printf("ERROR: tiCaptureStart failed\n");
+      return 1;
+    }
+  capture = readout(&captured);
+  tiCaptureStop();
+  jvmeSimFaultClear();
+  tiCaptureGetStats(&st);
+
+  memset(&c, 0, sizeof(c));
+  tiCaptureReplay(CAPTUREFILE, 0., count, &c);
+  printf("  Block level %d: %llu records (%llu bytes), %d tiBReady, %d trigger blocks, %d drains\n",
+	 bl, (unsigned long long)st.records, (unsigned long long)st.bytes,
+	 c.breadys, c.triggerBlocks, c.recoveries);
+  printf("    readout %.2f us/block, captured %.2f us/block\n",
+	 plain * 1e6 / NBLOCKS, capture * 1e6 / NBLOCKS);
+
+  if((st.dropped != 0) || (c.unordered != 0) ||
+     (c.triggerBlocks != captured.n) || (c.recoveries == 0) ||
+     ((uint64_t)(c.breadys + c.triggerBlocks + c.recoveries) != st.records) ||
+     ((bl <= 2) && (c.filler == 0)))
+    {
+      printf("ERROR: Block level %d: capture file: %llu dropped, %d unordered, %d/%d readouts, %d drains, %d filler\n",
+	     bl, (unsigned long long)st.dropped, c.unordered, c.triggerBlocks, captured.n,
+	     c.recoveries, c.filler);
+      failed = 1;
+    }
+
+  /* Replay, at maximum speed */
+  replayed.n = 0;
+  if(jvmeSimReplay(CAPTUREFILE, 0., replayReadout, NULL, &rs) != OK)
+    {
+      printf("ERROR: jvmeSimReplay failed\n");
+      return 1;
+    }
+  printf("    replay %.0f readouts/s\n", rs.readouts / rs.elapsed_s);
+
+  if(replayed.n != captured.n)
+    {
+      printf("ERROR: Block level %d: %d banks replayed, %d captured\n", bl, replayed.n, captured.n);
+      failed = 1;
+    }
+  else
+    {
+      for(ibank = 0; ibank < captured.n; ibank++)
+	if((replayed.nwords[ibank] != captured.nwords[ibank]) ||
+	   ((captured.nwords[ibank] > 0) &&
+	    (memcmp(replayed.words[ibank], captured.words[ibank],
+		    captured.nwords[ibank] * sizeof(unsigned int)) != 0)))
+	  {
+	    printf("ERROR: Block level %d: bank %d differs\n", bl, ibank);
+	    failed = 1;
+	    break;
+	  }
+    }
+
+  /* Replay, at the recorded speed */
+  t = now();
+  replayed.n = 0;
+  jvmeSimReplay(CAPTUREFILE, 1., replayReadout, NULL, &rs);
+  t = now() - t;
+  if((replayed.n != captured.n) || (t < 0.9 * NBLOCKS * POLL_US * 1e-6))
+    {
+      printf("ERROR: Block level %d: recorded speed replay took %.3f s\n", bl, t);
+      failed = 1;
+    }
+
+  return failed;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int failed = 0;
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    {
+      printf("ERROR: jvmeSimInit failed\n");
+      exit(1);
+    }
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      printf("ERROR: tiInit failed\n");
+      exit(1);
+    }
+  /* Keep the expected errors off the output */
+  tiLogSetLevel(TI_LOG_ERROR + 1);
+
+  failed |= run(2);
+  failed |= run(4);
+
+  tiLogSetLevel(TI_LOG_DEBUG);
+  remove(CAPTUREFILE);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiCaptureTest "
+  End:
+*/
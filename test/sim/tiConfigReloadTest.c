@@ -0,0 +1,107 @@
+/*
+ * File:
+ *    tiConfigReloadTest.c
+ *
+ * Description:
+ *    Check tiConfigReload using the simulated VME backend.
+ *      - configure from a small ini file
+ *      - reload a copy with a changed input prescale (run-safe), and
+ *        a changed block level and trigger table expression (not run-safe)
+ *      - expect the prescale to be applied, and the block level and the
+ *        expression rejected
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiConfig.h"
+#include "jvmeSim.h"
+
+static int
+writeTestIni(const char *filename, int blocklevel, int prescale, const char *expr)
+{
+  FILE *f = fopen(filename, "w");
+
+  if(f == NULL)
+    {
+      perror("fopen");
+      return ERROR;
+    }
+
+  fprintf(f, "[general]\nBLOCK_LEVEL= %d\nTRIGGER_SOURCE= 5\n", blocklevel);
+  fprintf(f, "TRIGGER_TABLE_EXPR= %s\n", expr);
+  fprintf(f, "[tsinputs]\nENABLE_TS1= 1\nPRESCALE_TS1= %d\n", prescale);
+  fclose(f);
+
+  return OK;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char inifile[256], reloadfile[256];
+  int rval = 0, failed = 0;
+
+  snprintf(inifile, sizeof(inifile), "/tmp/tiConfigReloadTest.%d.ini", (int)getpid());
+  snprintf(reloadfile, sizeof(reloadfile), "/tmp/tiConfigReloadTest.%d.reload.ini", (int)getpid());
+
+  printf("\nJLAB TI Config reload (simulated)\n");
+  printf("----------------------------\n");
+
+  if((writeTestIni(inifile, 1, 0, "TS1 | TS2 -> trig1 type 1") != OK) ||
+     (writeTestIni(reloadfile, 2, 7, "TS1 & !TS2 -> trig1 type 1") != OK))
+    exit(1);
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    exit(1);
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      failed = 1;
+      goto CLOSE;
+    }
+
+  if(tiConfig(inifile) != OK)
+    {
+      failed = 1;
+      goto CLOSE;
+    }
+
+  rval = tiConfigReload(reloadfile);
+  printf("tiConfigReload returned %d (expected 2)\n", rval);
+  if(rval != 2)
+    failed = 1;
+
+  if(tiGetInputPrescale(1) != 7)
+    {
+      printf("ERROR: PRESCALE_TS1 = %d (expected 7)\n", tiGetInputPrescale(1));
+      failed = 1;
+    }
+
+  if(tiGetCurrentBlockLevel() != 1)
+    {
+      printf("ERROR: BLOCK_LEVEL changed to %d\n", tiGetCurrentBlockLevel());
+      failed = 1;
+    }
+
+ CLOSE:
+  tiConfigFree();
+  jvmeSimFree();
+  unlink(inifile);
+  unlink(reloadfile);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiConfigReloadTest "
+  End:
+*/
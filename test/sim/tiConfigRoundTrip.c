@@ -0,0 +1,149 @@
+/*
+ * File:
+ *    tiConfigRoundTrip.c
+ *
+ * Description:
+ *    Check that writeIni produces a lossless snapshot of the TI
+ *    configuration, using the simulated VME backend.
+ *
+ *      - configure from the input ini file, save the register image
+ *      - write the configuration out with writeIni
+ *      - start over with a fresh (simulated) module, configure from the
+ *        written file, and compare the register images
+ *      - the stock master.ini (-1: library default) keeps the tiInit
+ *        sync reset and trigger output pulses
+ *
+ *    Returns 0 if the register images are identical.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiConfig.h"
+#include "jvmeSim.h"
+
+#define NREGWORDS (2 * ((0x1FC + 4) >> 2) + 2)
+
+/* Pulses left to the library default by the stock master.ini */
+static int checkDefaults = 0, defaultsChanged = 0;
+
+static void
+readPulses(int32_t *p)
+{
+  tiGetSyncDelayWidth(&p[0], &p[1], &p[2]);
+  tiGetTriggerPulse(1, &p[3], &p[4], &p[5]);
+  p[6] = tiGetPromptTriggerWidth();
+}
+
+static int
+configureAndRead(const char *filename, unsigned int *image)
+{
+  int32_t before[7], after[7];
+  int nwords = 0;
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    return ERROR;
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      printf("ERROR: tiInit failed\n");
+      return ERROR;
+    }
+
+  readPulses(before);
+  if(tiConfig(filename) != OK)
+    {
+      printf("ERROR: tiConfig(%s) failed\n", filename);
+      return ERROR;
+    }
+  readPulses(after);
+  if(checkDefaults && (memcmp(before, after, sizeof(before)) != 0))
+    {
+      printf("ERROR: %s changed the library default sync reset or trigger pulses\n",
+	     filename);
+      defaultsChanged = 1;
+    }
+
+  tiConfigEnablePulser();
+
+  nwords = tiGetHWRegisters(image, NREGWORDS);
+
+  tiConfigFree();
+
+  return nwords;
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *inifile = "../../cfg/master.ini";
+  char outfile[256];
+  unsigned int image1[NREGWORDS], image2[NREGWORDS];
+  int nwords1 = 0, nwords2 = 0, iword, ndiff = 0;
+
+  if(argc > 1)
+    inifile = argv[1];
+  else
+    checkDefaults = 1;
+
+  snprintf(outfile, sizeof(outfile), "/tmp/tiConfigRoundTrip.%d.ini", (int)getpid());
+
+  printf("\nJLAB TI Config round trip (simulated)\n");
+  printf("----------------------------\n");
+
+  memset(image1, 0, sizeof(image1));
+  memset(image2, 0, sizeof(image2));
+
+  nwords1 = configureAndRead(inifile, image1);
+  if(nwords1 <= 0)
+    goto CLOSE;
+
+  if(writeIni(outfile) != 0)
+    {
+      printf("ERROR: writeIni(%s) failed\n", outfile);
+      goto CLOSE;
+    }
+
+  nwords2 = configureAndRead(outfile, image2);
+  if(nwords2 != nwords1)
+    {
+      printf("ERROR: register image length mismatch (%d != %d)\n", nwords1, nwords2);
+      goto CLOSE;
+    }
+
+  /* data words are (address, value) pairs after the header */
+  for(iword = 1; iword < nwords1; iword += 2)
+    {
+      if(image1[iword + 1] != image2[iword + 1])
+	{
+	  printf("  0x%04x: 0x%08x != 0x%08x\n",
+		 image1[iword], image1[iword + 1], image2[iword + 1]);
+	  ndiff++;
+	}
+    }
+
+  printf("\n%s -> %s: %d register(s) differ\n", inifile, outfile, ndiff);
+
+ CLOSE:
+  jvmeSimFree();
+  unlink(outfile);
+
+  if((nwords1 <= 0) || (nwords2 != nwords1) || ndiff || defaultsChanged)
+    {
+      printf("FAILED\n");
+      exit(1);
+    }
+
+  printf("PASSED\n");
+  exit(0);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiConfigRoundTrip "
+  End:
+*/
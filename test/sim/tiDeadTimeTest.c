@@ -0,0 +1,109 @@
+/*
+ * File:
+ *    tiDeadTimeTest.c
+ *
+ * Description:
+ *    Check the dead time accounting using the simulated VME backend.
+ *      - two callers with their own differential state
+ *      - loopback busy for 30% and SWB for 10% of each interval, with a
+ *        40% dead time
+ *      - expect each caller to see its own interval, the loopback as the
+ *        dominant source and 10% of the dead time unexplained
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiDeadTime.h"
+#include "jvmeSim.h"
+
+#define INTERVAL 100000  /* timer counts */
+
+static void
+advance(volatile struct TI_A24RegStruct *regs)
+{
+  regs->livetime += (INTERVAL * 6) / 10;
+  regs->busytime += (INTERVAL * 4) / 10;
+  regs->busy_scaler2[0] += (INTERVAL * 3) / 10;  /* Loopback */
+  regs->busy_scaler1[1] += INTERVAL / 10;        /* SWB */
+}
+
+static int
+check(const char *name, tiDeadTime *dt, double interval)
+{
+  int failed = 0;
+
+  if((fabs(dt->interval - interval) > 1e-6) ||
+     (fabs(dt->dead - 0.4) > 1e-6) ||
+     (fabs(dt->source[7] - 0.3) > 1e-6) ||
+     (fabs(dt->source[1] - 0.1) > 1e-6) ||
+     (dt->dominant != 7) ||
+     (fabs(dt->unexplained - 0.1) > 1e-6))
+    {
+      printf("ERROR: %s: interval %f dead %f loopback %f SWB %f dominant %d unexplained %f\n",
+	     name, dt->interval, dt->dead, dt->source[7], dt->source[1],
+	     dt->dominant, dt->unexplained);
+      failed = 1;
+    }
+
+  return failed;
+}
+
+int
+main(int argc, char *argv[])
+{
+  volatile struct TI_A24RegStruct *regs;
+  tiDeadTimeState fast, slow;
+  tiDeadTime dt;
+  int failed = 0;
+
+  printf("\nJLAB TI Dead Time (simulated)\n");
+  printf("----------------------------\n");
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    exit(1);
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      failed = 1;
+      goto CLOSE;
+    }
+  tiSetBusySource(TI_BUSY_LOOPBACK | TI_BUSY_SWB, 1);
+
+  regs = (volatile struct TI_A24RegStruct *)jvmeSimRegisters();
+
+  if((tiDeadTimeInit(&fast) != OK) || (tiDeadTimeInit(&slow) != OK))
+    {
+      failed = 1;
+      goto CLOSE;
+    }
+
+  advance(regs);
+  tiDeadTimeUpdate(&fast, &dt);
+  failed |= check("fast, first interval", &dt, INTERVAL * 7.68e-6);
+
+  advance(regs);
+  tiDeadTimeUpdate(&fast, &dt);
+  failed |= check("fast, second interval", &dt, INTERVAL * 7.68e-6);
+
+  tiDeadTimeUpdate(&slow, &dt);
+  failed |= check("slow", &dt, 2 * INTERVAL * 7.68e-6);
+  tiDeadTimePrint(&dt);
+
+ CLOSE:
+  jvmeSimFree();
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiDeadTimeTest "
+  End:
+*/
@@ -0,0 +1,264 @@
+/*
+ * File:
+ *    tiFaultTest.c
+ *
+ * Description:
+ *    Read out blocks with faults injected in the simulated VME backend,
+ *    with programmed I/O (block level 2) and DMA (block level 4).
+ *    For each fault (corrupt block header, wrong trailer word count,
+ *    missing filler, short DMA, bus error, stuck blockBuffer):
+ *      - every block returned by tiReadTriggerBlock is intact and in order
+ *      - lost blocks are replaced by fake trigger banks, at most two per
+ *        injected fault
+ *      - the readout loop ends with the FIFO drained
+ *    A fault on a schedule hits exactly the scheduled blocks.
+ *    A programmed I/O read of a block that exactly fills the destination
+ *    is complete.
+ *    The readout throughput is printed for each case.
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiLog.h"
+#include "jvmeSim.h"
+
+#define NBLOCKS     200
+#define SLOT        21
+#define MAXBL       4
+#define MAXWORDS    ((8*MAXBL) + 8)
+
+static uint32_t blocks[NBLOCKS][MAXWORDS];
+static int      blockWords[NBLOCKS], blockTrailer[NBLOCKS];
+static unsigned int data[MAXWORDS] __attribute__((aligned(8)));
+
+static const char *faultName[JVME_SIM_NFAULTS] =
+  {
+    "header", "trailer", "nofiller", "shortdma", "buserror", "stuckbuffer"
+  };
+
+typedef struct
+{
+  int    good, fake, bad, reads;
+  double rate;                  /* blocks read per second */
+} result;
+
+static void
+makeBlocks(int bl)
+{
+  int iblk, iev, n;
+
+  for(iblk = 0; iblk < NBLOCKS; iblk++)
+    {
+      uint32_t *b = blocks[iblk];
+
+      n = 0;
+      b[n++] = 0x80000000 | (SLOT << 22) | ((iblk & 0xFF) << 8) | bl;
+      b[n++] = 0xFF102000 | bl;
+      for(iev = 0; iev < bl; iev++)
+	{
+	  b[n++] = (0x01 << 24) | (iev << 16) | 2;
+	  b[n++] = iblk * bl + iev;
+	  b[n++] = 0x1000 + iev;
+	}
+      blockTrailer[iblk] = n;
+      b[n] = 0x88000000 | (SLOT << 22) | (n + 1);
+      n++;
+      if(n & 1)
+	b[n++] = 0xF8000000 | (SLOT << 22);
+      blockWords[iblk] = n;
+    }
+}
+
+static void
+pushBlocks()
+{
+  uint32_t tmp[MAXWORDS];
+  int iblk, iword;
+
+  jvmeSimFifoClear();
+  for(iblk = 0; iblk < NBLOCKS; iblk++)
+    {
+      for(iword = 0; iword < blockWords[iblk]; iword++)
+	tmp[iword] = LSWAP(blocks[iblk][iword]);
+      jvmeSimFifoPush(tmp, blockWords[iblk]);
+    }
+}
+
+/* Block index of a formed trigger bank, -1 if it is not one of ours */
+static int
+checkBank(int nwords, int bl)
+{
+  int iblk, iword;
+
+  if(nwords < 4)
+    return -1;
+
+  iblk = LSWAP(data[3]) / bl;
+  if((iblk < 0) || (iblk >= NBLOCKS) || (nwords != blockTrailer[iblk]))
+    return -1;
+  for(iword = 1; iword < nwords; iword++)
+    if(LSWAP(data[iword]) != blocks[iblk][iword])
+      return -1;
+
+  return iblk;
+}
+
+static void
+readout(int bl, result *r)
+{
+  struct timespec start, end;
+  int nwords, iblk, last = -1, ipoll;
+
+  memset(r, 0, sizeof(*r));
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(ipoll = 0; ipoll < 8 * NBLOCKS; ipoll++)
+    {
+      if(tiBReady() == 0)
+	{
+	  if(jvmeSimFifoCount() == 0)
+	    break;
+	  /* stuck blockBuffer: poll again */
+	  continue;
+	}
+
+      memset(data, 0, sizeof(data));
+      nwords = tiReadTriggerBlock(data);
+      r->reads++;
+
+      if((nwords == 2) && ((data[1] & 0xFFFFFF00) == 0xFF102000) &&
+	 ((data[1] & 0xFF) == (unsigned int)bl))
+	{
+	  r->fake++;
+	  continue;
+	}
+
+      iblk = checkBank(nwords, bl);
+      if(iblk <= last)
+	{
+	  printf("  bad bank: %d words, block %d after %d\n", nwords, iblk, last);
+	  r->bad++;
+	  continue;
+	}
+      last = iblk;
+      r->good++;
+    }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  r->rate = r->reads /
+    ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9);
+}
+
+static int
+run(int bl, int fault, double probability, int first, int period, result *r)
+{
+  makeBlocks(bl);
+  tiSetBlockLevel(bl);
+  jvmeSimFaultClear();
+  jvmeSimFaultSeed(12345);
+  if(fault >= 0)
+    jvmeSimFaultSet(fault, probability, first, period);
+  pushBlocks();
+
+  readout(bl, r);
+
+  printf("  %-4s %-12s %8.0f blocks/s  %3d good  %3d fake  %3d injected\n",
+	 (bl > 2) ? "DMA" : "PIO", (fault >= 0) ? faultName[fault] : "none",
+	 r->rate, r->good, r->fake, (fault >= 0) ? jvmeSimFaultCount(fault) : 0);
+
+  return (fault >= 0) ? jvmeSimFaultCount(fault) : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  const int bls[2] = {2, 4};
+  result r;
+  int failed = 0, ibl, ifault, injected, nwords;
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    {
+      printf("ERROR: jvmeSimInit failed\n");
+      exit(1);
+    }
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      printf("ERROR: tiInit failed\n");
+      exit(1);
+    }
+  /* Keep the expected errors off the output */
+  tiLogSetLevel(TI_LOG_ERROR + 1);
+
+  for(ibl = 0; ibl < 2; ibl++)
+    {
+      int bl = bls[ibl];
+
+      run(bl, -1, 0., -1, 0, &r);
+      if((r.good != NBLOCKS) || (r.fake != 0) || (r.bad != 0) ||
+	 (jvmeSimFifoCount() != 0))
+	{
+	  printf("ERROR: Block level %d without faults: %d good, %d fake, %d bad\n",
+		 bl, r.good, r.fake, r.bad);
+	  failed = 1;
+	}
+
+      for(ifault = 0; ifault < JVME_SIM_NFAULTS; ifault++)
+	{
+	  /* PIO reads make no DMA to shorten */
+	  if((bl <= 2) && (ifault == JVME_SIM_FAULT_SHORTDMA))
+	    continue;
+
+	  injected = run(bl, ifault, 0.1, -1, 0, &r);
+	  if((injected == 0) || (r.bad != 0) || (jvmeSimFifoCount() != 0) ||
+	     (r.good < NBLOCKS - 2 * injected))
+	    {
+	      printf("ERROR: Block level %d, %s: %d injected, %d good, %d fake, %d bad, %d queued\n",
+		     bl, faultName[ifault], injected, r.good, r.fake, r.bad, jvmeSimFifoCount());
+	      failed = 1;
+	    }
+	}
+    }
+
+  /* Schedule: blocks 5, 55, 105, 155 lose their header, and are dropped */
+  injected = run(4, JVME_SIM_FAULT_HEADER, 0., 5, 50, &r);
+  if((injected != 4) || (r.good != NBLOCKS - 4) || (r.bad != 0))
+    {
+      printf("ERROR: Schedule: %d injected, %d good\n", injected, r.good);
+      failed = 1;
+    }
+
+  /* Exact fit: the block trailer is the last word of the destination */
+  makeBlocks(2);
+  tiSetBlockLevel(2);
+  jvmeSimFaultClear();
+  pushBlocks();
+  memset(data, 0, sizeof(data));
+  nwords = tiReadBlock(data, blockTrailer[0] + 1, 0);
+  if((nwords != blockTrailer[0] + 1) ||
+     (LSWAP(data[blockTrailer[0]]) != blocks[0][blockTrailer[0]]))
+    {
+      printf("ERROR: Exact fit: %d words (expected %d)\n", nwords, blockTrailer[0] + 1);
+      failed = 1;
+    }
+
+  jvmeSimFaultClear();
+  jvmeSimFifoClear();
+  tiLogSetLevel(TI_LOG_DEBUG);
+  tiPrintReadoutRecovery();
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiFaultTest "
+  End:
+*/
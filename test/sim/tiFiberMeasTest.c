@@ -0,0 +1,88 @@
+/*
+ * File:
+ *    tiFiberMeasTest.c
+ *
+ * Description:
+ *    Check the fiber latency measurement of a TI Slave using the
+ *    simulated VME backend.
+ *      - preset a steady HFBR#5 latency in the simulated registers
+ *      - initialize as a TI Slave on HFBR#5
+ *      - expect the measurement to find that latency, stop early once
+ *        the histogram mode can no longer change, and program the
+ *        matching fiber sync delay
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "jvmeSim.h"
+
+#define LATENCY 0x40
+
+extern int FiberMeasMaxCount();
+extern int FiberMeasMaxIndex();
+
+int
+main(int argc, char *argv[])
+{
+  volatile struct TI_A24RegStruct *regs;
+  unsigned int syncDelay = 0, expected = 0;
+  int failed = 0;
+
+  printf("\nJLAB TI Fiber Measurement (simulated)\n");
+  printf("----------------------------\n");
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    exit(1);
+
+  /* One way trip of LATENCY: the data field holds the round trip */
+  regs = (volatile struct TI_A24RegStruct *)jvmeSimRegisters();
+  regs->fiberAlignment = ((LATENCY << 1) << 23) & TI_FIBERLATENCYMEASUREMENT_DATA_MASK;
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_TS_POLL, TI_INIT_SLAVE_FIBER_5) != OK)
+    {
+      failed = 1;
+      goto CLOSE;
+    }
+
+  if(tiGetFiberLatencyMeasurement() != LATENCY)
+    {
+      printf("ERROR: latency = 0x%x (expected 0x%x)\n",
+	     tiGetFiberLatencyMeasurement(), LATENCY);
+      failed = 1;
+    }
+
+  /* A steady latency is decided after 3 of the 5 tries */
+  if((FiberMeasMaxIndex() != LATENCY) || (FiberMeasMaxCount() != 3))
+    {
+      printf("ERROR: histogram mode %d x 0x%x (expected 3 x 0x%x)\n",
+	     FiberMeasMaxCount(), FiberMeasMaxIndex(), LATENCY);
+      failed = 1;
+    }
+
+  expected = (0xbf - LATENCY) & 0xFF;
+  expected = (expected << 8) | (expected << 16) | (expected << 24);
+  syncDelay = regs->fiberSyncDelay & 0xFFFFFF00;
+  if(syncDelay != expected)
+    {
+      printf("ERROR: fiberSyncDelay = 0x%08x (expected 0x%08x)\n",
+	     syncDelay, expected);
+      failed = 1;
+    }
+
+ CLOSE:
+  jvmeSimFree();
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiFiberMeasTest "
+  End:
+*/
@@ -0,0 +1,119 @@
+/*
+ * File:
+ *    tiFiberMonTest.c
+ *
+ * Description:
+ *    Check the fiber link monitor using the simulated VME backend.
+ *      - Fiber 1 and 3 connected, Fiber 1 steady at 10% busy,
+ *        Fiber 3 busy rising each sample
+ *      - expect only Fiber 3 to be flagged for its busy trend
+ *      - drop Fiber 1, expect it to be flagged for its link
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiFiberMon.h"
+#include "jvmeSim.h"
+
+#define NSAMPLES 16
+#define INTERVAL 13020  /* ~0.1 s of 7.68 us timer counts */
+
+int
+main(int argc, char *argv[])
+{
+  volatile struct TI_A24RegStruct *regs;
+  tiFiberMonStats stats;
+  uint32_t mask = 0;
+  int isamp, failed = 0;
+
+  printf("\nJLAB TI Fiber Link Monitor (simulated)\n");
+  printf("----------------------------\n");
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    exit(1);
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      failed = 1;
+      goto CLOSE;
+    }
+
+  regs = (volatile struct TI_A24RegStruct *)jvmeSimRegisters();
+  regs->fiber = (0x5 << 16) | (0x5 << 24);
+
+  if(tiFiberMonInit(0) != OK)
+    {
+      failed = 1;
+      goto CLOSE;
+    }
+
+  for(isamp = 0; isamp <= NSAMPLES; isamp++)
+    {
+      /* Busy counters: Fiber 1 at 10%, Fiber 3 at 2% more each sample */
+      regs->livetime += INTERVAL;
+      regs->busy_scaler2[1] += INTERVAL / 10;
+      regs->busy_scaler2[3] += (INTERVAL * 2 * isamp) / 100;
+
+      if(tiFiberMonUpdate() != OK)
+	{
+	  failed = 1;
+	  goto CLOSE;
+	}
+    }
+
+  tiFiberMonPrintStatus();
+
+  tiFiberMonGetStats(1, &stats);
+  if((stats.nsamples != NSAMPLES) || (fabs(stats.busyFraction - 0.1) > 0.001) ||
+     (stats.degraded != 0))
+    {
+      printf("ERROR: Fiber 1: %d samples, busy %f, degraded 0x%x\n",
+	     stats.nsamples, stats.busyFraction, stats.degraded);
+      failed = 1;
+    }
+
+  mask = tiFiberMonDegradedMask();
+  if(mask != 0x4)
+    {
+      printf("ERROR: degraded mask 0x%x (expected 0x4)\n", mask);
+      failed = 1;
+    }
+
+  if(tiFiberMonGetGTPTrend(NULL) != 0)
+    {
+      printf("ERROR: GTP buffer length flagged as rising\n");
+      failed = 1;
+    }
+
+  /* Drop Fiber 1 */
+  regs->fiber = (0x4 << 16) | (0x4 << 24);
+  regs->livetime += INTERVAL;
+  tiFiberMonUpdate();
+
+  tiFiberMonGetStats(1, &stats);
+  mask = tiFiberMonDegradedMask();
+  if((mask != 0x5) || !(stats.degraded & TI_FIBERMON_DEGRADED_LINK))
+    {
+      printf("ERROR: after drop, degraded mask 0x%x, Fiber 1 degraded 0x%x\n",
+	     mask, stats.degraded);
+      failed = 1;
+    }
+
+ CLOSE:
+  jvmeSimFree();
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiFiberMonTest "
+  End:
+*/
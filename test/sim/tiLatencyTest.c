@@ -0,0 +1,186 @@
+/*
+ * File:
+ *    tiLatencyTest.c
+ *
+ * Description:
+ *    Check the readout latency histograms, using the simulated VME
+ *    backend in interrupt mode.  The readout routine does a DMA and
+ *    spins for a known time (a few readouts ten times longer):
+ *      - every stage counts every readout
+ *      - routine p50 and p99 near the spin times
+ *      - percentiles in order, between min and max
+ *      - tiResetLatencyStats and tiInit clear them
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "jvmeSim.h"
+
+#define NREADOUT   1000
+#define NSLOW      20        /* 2%, so p99 lands in the slow readouts */
+#define FAST_NS    20000
+#define SLOW_NS    200000
+#define DMA_WORDS  256
+
+static volatile unsigned int dmaBuf[DMA_WORDS + 2];
+static int nread = 0, dmaOK = 1;
+
+static void
+spin(long ns)
+{
+  struct timespec start, now;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  while((now.tv_sec - start.tv_sec) * 1000000000L + (now.tv_nsec - start.tv_nsec) < ns);
+}
+
+static void
+readout(int arg)
+{
+  if(tiReadBlock(dmaBuf, DMA_WORDS, 1) != DMA_WORDS)
+    dmaOK = 0;
+
+  spin(((nread % (NREADOUT / NSLOW)) == 0) ? SLOW_NS : FAST_NS);
+  nread++;
+}
+
+static int
+checkStage(const char *name, tiLatencyStats *st)
+{
+  int rval = 1;
+
+  printf("%-16s %6llu: min %.0f  p50 %.0f  p90 %.0f  p99 %.0f  p99.9 %.0f  max %.0f ns\n",
+	 name, st->count, st->min, st->p50, st->p90, st->p99, st->p999, st->max);
+
+  if(st->count != NREADOUT)
+    rval = 0;
+  if(!((st->min <= st->p50) && (st->p50 <= st->p90) && (st->p90 <= st->p99) &&
+       (st->p99 <= st->p999) && (st->p999 <= st->max)))
+    rval = 0;
+  if((st->mean < st->min) || (st->mean > st->max))
+    rval = 0;
+
+  if(!rval)
+    printf("ERROR: %s latency wrong\n", name);
+
+  return rval;
+}
+
+/* Check that the histograms are empty */
+static int
+cleared(const char *what, const char **name)
+{
+  tiLatencyStats stats[TI_LATENCY_NSTAGES];
+  int istage, rval = 1;
+
+  tiGetLatencyStats(stats);
+  for(istage = 0; istage < TI_LATENCY_NSTAGES; istage++)
+    {
+      if((stats[istage].count != 0) || (stats[istage].max != 0.))
+	{
+	  printf("ERROR: %s: %s not cleared\n", what, name[istage]);
+	  rval = 0;
+	}
+    }
+
+  return rval;
+}
+
+int
+main(int argc, char *argv[])
+{
+  tiLatencyStats stats[TI_LATENCY_NSTAGES];
+  const char *name[TI_LATENCY_NSTAGES] =
+    { "ready to routine", "routine", "dma", "routine to ack" };
+  int failed = 0, ireadout, istage;
+  volatile unsigned int *fifo;
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    {
+      printf("ERROR: jvmeSimInit failed\n");
+      exit(1);
+    }
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_INT, 0) != OK)
+    {
+      printf("ERROR: tiInit failed\n");
+      exit(1);
+    }
+
+  fifo = jvmeSimFifo();
+  for(ireadout = 0; ireadout < DMA_WORDS; ireadout++)
+    fifo[ireadout] = ireadout;
+
+  tiIntConnect(TI_INT_VEC, readout, 0);
+  tiIntEnable(1);
+
+  for(ireadout = 0; ireadout < NREADOUT; ireadout++)
+    jvmeSimInterrupt();
+
+  tiIntDisable();
+  tiIntDisconnect();
+
+  if(!dmaOK || (nread != NREADOUT) || (tiGetAckCount() != NREADOUT))
+    {
+      printf("ERROR: readout: %d routines, %d acks, DMA %s\n",
+	     nread, tiGetAckCount(), dmaOK ? "ok" : "wrong");
+      failed = 1;
+    }
+
+  tiPrintLatencyStats();
+  if(tiGetLatencyStats(stats) != OK)
+    {
+      printf("ERROR: tiGetLatencyStats failed\n");
+      exit(1);
+    }
+
+  for(istage = 0; istage < TI_LATENCY_NSTAGES; istage++)
+    if(!checkStage(name[istage], &stats[istage]))
+      failed = 1;
+
+  /* Bins are ~3% wide, allow for scheduling on a busy machine */
+  if((stats[TI_LATENCY_CALLBACK].p50 < 0.95 * FAST_NS) ||
+     (stats[TI_LATENCY_CALLBACK].p50 > 2.0 * FAST_NS) ||
+     (stats[TI_LATENCY_CALLBACK].p99 < 0.95 * SLOW_NS) ||
+     (stats[TI_LATENCY_CALLBACK].p99 > 2.0 * SLOW_NS))
+    {
+      printf("ERROR: routine p50 %.0f ns (expect %d), p99 %.0f ns (expect %d)\n",
+	     stats[TI_LATENCY_CALLBACK].p50, FAST_NS,
+	     stats[TI_LATENCY_CALLBACK].p99, SLOW_NS);
+      failed = 1;
+    }
+
+  tiResetLatencyStats();
+  if(!cleared("tiResetLatencyStats", name))
+    failed = 1;
+
+  /* A few more readouts, then a new tiInit */
+  tiIntConnect(TI_INT_VEC, readout, 0);
+  tiIntEnable(1);
+  for(ireadout = 0; ireadout < 10; ireadout++)
+    jvmeSimInterrupt();
+  tiIntDisable();
+  tiIntDisconnect();
+
+  if((tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_INT, 0) != OK) ||
+     !cleared("tiInit", name))
+    failed = 1;
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiLatencyTest "
+  End:
+*/
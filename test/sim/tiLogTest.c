@@ -0,0 +1,274 @@
+/*
+ * File:
+ *    tiLogTest.c
+ *
+ * Description:
+ *    Check the readout path logging, using the simulated VME backend.
+ *      - tiInit does not start the drain thread: library messages are
+ *        printed when logged, not queued for the sink
+ *      - library messages go to the sink, formatted, with their level
+ *      - an idle drain thread waits for a message instead of polling
+ *      - a burst of one message from several threads: rate limited,
+ *        every message counted, and a report of the rest
+ *      - a full queue drops instead of blocking
+ *      - levels below the set level are not printed
+ *      - cost of a logged message
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <dirent.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiLog.h"
+#include "jvmeSim.h"
+
+#define NTHREADS  4
+#define NBURST    100000
+#define RATE      50
+#define IDLE_MS   300
+
+static const char *burstFormat = "burst: ERROR: bad block 0x%08x\n";
+static const char *infoFormat  = "burst: INFO: %d\n";
+
+static volatile int nsink = 0, nburst = 0, nreport = 0, nlibrary = 0, libraryLevel = -1;
+static double costNs = 0.;
+
+static void
+sink(int level, int id, double time, const char *msg)
+{
+  nsink++;
+  if(strncmp(msg, "burst: ERROR: bad block 0x", 26) == 0)
+    nburst++;
+  if(strstr(msg, "messages not printed: \"burst: ERROR"))
+    nreport++;
+  if(strstr(msg, "tiReadScalers: ERROR: Invalid latch (5).") != NULL)
+    {
+      nlibrary++;
+      libraryLevel = level;
+    }
+}
+
+static void *
+burst(void *arg)
+{
+  struct timespec start, end;
+  int imsg;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(imsg = 0; imsg < NBURST; imsg++)
+    tiLogMsgLevel(TI_LOG_ERROR, burstFormat, imsg, 2, 3, 4, 5, 6);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if(arg)
+    costNs = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / NBURST;
+
+  return NULL;
+}
+
+/* Voluntary context switches of the drain thread, -1 if not found */
+static long
+drainSwitches()
+{
+  char path[300], line[64];
+  struct dirent *task;
+  DIR *dir;
+  FILE *f;
+  long nswitch = -1;
+
+  dir = opendir("/proc/self/task");
+  if(dir == NULL)
+    return -1;
+
+  while((nswitch < 0) && ((task = readdir(dir)) != NULL))
+    {
+      snprintf(path, sizeof(path), "/proc/self/task/%s/comm", task->d_name);
+      f = fopen(path, "r");
+      if(f == NULL)
+	continue;
+      if((fgets(line, sizeof(line), f) == NULL) || (strcmp(line, "tiLog\n") != 0))
+	{
+	  fclose(f);
+	  continue;
+	}
+      fclose(f);
+
+      snprintf(path, sizeof(path), "/proc/self/task/%s/status", task->d_name);
+      f = fopen(path, "r");
+      if(f == NULL)
+	continue;
+      while(fgets(line, sizeof(line), f) != NULL)
+	if(sscanf(line, "voluntary_ctxt_switches: %ld", &nswitch) == 1)
+	  break;
+      fclose(f);
+    }
+  closedir(dir);
+
+  return nswitch;
+}
+
+static int
+findStats(const char *format, tiLogStats *st)
+{
+  static tiLogStats stats[TI_LOG_NIDS];
+  int nids, iid;
+
+  nids = tiLogGetStats(stats, TI_LOG_NIDS);
+  for(iid = 0; iid < nids; iid++)
+    {
+      if(stats[iid].format == format)
+	{
+	  *st = stats[iid];
+	  return 1;
+	}
+    }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  pthread_t thread[NTHREADS];
+  unsigned int data[12];
+  struct timespec idle = {0, IDLE_MS * 1000000};
+  tiLogStats st;
+  long nswitch;
+  int failed = 0, ithr, imsg, nfull = 0;
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    {
+      printf("ERROR: jvmeSimInit failed\n");
+      exit(1);
+    }
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      printf("ERROR: tiInit failed\n");
+      exit(1);
+    }
+  tiLogSetSink(sink);
+  tiLogSetRateLimit(RATE);
+
+  /* No drain thread yet */
+  tiReadScalers(data, 5);
+  if((nlibrary != 0) || (drainSwitches() >= 0))
+    {
+      printf("ERROR: Drain thread started by tiInit\n");
+      failed = 1;
+    }
+
+  if(tiLogStart() != OK)
+    {
+      printf("ERROR: tiLogStart failed\n");
+      exit(1);
+    }
+
+  /* Library message */
+  tiReadScalers(data, 5);
+  tiLogFlush(1000);
+  if((nlibrary != 1) || (libraryLevel != TI_LOG_ERROR))
+    {
+      printf("ERROR: Library message: %d printed, level %d\n", nlibrary, libraryLevel);
+      failed = 1;
+    }
+
+  /* Idle */
+  nswitch = drainSwitches();
+  nanosleep(&idle, NULL);
+  if(nswitch < 0)
+    {
+      printf("ERROR: Drain thread not found\n");
+      failed = 1;
+    }
+  nswitch = drainSwitches() - nswitch;
+  printf("Idle drain thread: %ld wakeups in %d ms\n", nswitch, IDLE_MS);
+  if(nswitch > 5)
+    {
+      printf("ERROR: Idle drain thread woke up %ld times\n", nswitch);
+      failed = 1;
+    }
+
+  /* Burst */
+  for(ithr = 0; ithr < NTHREADS; ithr++)
+    pthread_create(&thread[ithr], NULL, burst, (ithr == 0) ? (void *)1 : NULL);
+  for(ithr = 0; ithr < NTHREADS; ithr++)
+    pthread_join(thread[ithr], NULL);
+  tiLogFlush(1000);
+
+  printf("Logged message: %.1f ns\n", costNs);
+  if(!findStats(burstFormat, &st) || (st.count != NTHREADS * NBURST) ||
+     (st.printed + st.suppressed + st.dropped != st.count) ||
+     (st.printed != (uint64_t)nburst) || (st.printed > 3 * RATE) || (st.printed < RATE) ||
+     (st.level != TI_LOG_ERROR))
+    {
+      printf("ERROR: Burst: %llu logged, %llu printed (%d in sink), %llu suppressed, %llu dropped\n",
+	     (unsigned long long)st.count, (unsigned long long)st.printed, nburst,
+	     (unsigned long long)st.suppressed, (unsigned long long)st.dropped);
+      failed = 1;
+    }
+  if(costNs > 1000.)
+    {
+      printf("ERROR: Logged message takes %.1f ns\n", costNs);
+      failed = 1;
+    }
+
+  /* Full queue, without the drain thread emptying it */
+  tiLogSetRateLimit(10 * TI_LOG_QUEUE);
+  for(imsg = 0; imsg < 2 * TI_LOG_QUEUE; imsg++)
+    if(tiLogMsg(infoFormat, imsg, 0, 0, 0, 0, 0) == ERROR)
+      nfull++;
+  tiLogFlush(2000);
+  findStats(infoFormat, &st);
+  if((st.count != 2 * TI_LOG_QUEUE) || (st.dropped != (uint64_t)nfull) ||
+     (st.printed + st.dropped != st.count))
+    {
+      printf("ERROR: Queue: %llu logged, %llu printed, %llu dropped (%d full)\n",
+	     (unsigned long long)st.count, (unsigned long long)st.printed,
+	     (unsigned long long)st.dropped, nfull);
+      failed = 1;
+    }
+
+  /* Level */
+  tiLogSetLevel(TI_LOG_WARN);
+  nsink = 0;
+  for(imsg = 0; imsg < 10; imsg++)
+    tiLogMsg(infoFormat, imsg, 0, 0, 0, 0, 0);
+  tiLogFlush(1000);
+  if(nsink != 0)
+    {
+      printf("ERROR: %d messages below the level printed\n", nsink);
+      failed = 1;
+    }
+  tiLogSetLevel(TI_LOG_DEBUG);
+
+  /* Report of the suppressed burst messages, within a second or so */
+  for(imsg = 0; (imsg < 30) && (nreport == 0); imsg++)
+    {
+      struct timespec wait = {0, 100000000};
+      nanosleep(&wait, NULL);
+    }
+  if(nreport == 0)
+    {
+      printf("ERROR: No report of the suppressed messages\n");
+      failed = 1;
+    }
+
+  tiLogSetSink(NULL);
+  tiLogPrintStats();
+  tiLogStop();
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiLogTest "
+  End:
+*/
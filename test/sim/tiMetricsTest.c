@@ -0,0 +1,192 @@
+/*
+ * File:
+ *    tiMetricsTest.c
+ *
+ * Description:
+ *    Check the OpenMetrics exporter, using the simulated VME backend.
+ *      - rendered text has the register values of the snapshot
+ *      - the text does not change with the registers until the next
+ *        snapshot (no TI access when read)
+ *      - the exporter thread writes the file and serves the socket
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiMetrics.h"
+#include "jvmeSim.h"
+
+#define METRICSFILE  "/tmp/tiMetricsTest.prom"
+#define METRICSSOCK  "/tmp/tiMetricsTest.sock"
+
+static char text[TI_METRICS_TEXT_SIZE], other[TI_METRICS_TEXT_SIZE];
+
+static int
+expect(const char *where, const char *buf, const char *line)
+{
+  if(strstr(buf, line) == NULL)
+    {
+      printf("ERROR: %s: missing \"%s\"\n", where, line);
+      return 0;
+    }
+  return 1;
+}
+
+static int
+readSocket(char *buf, int maxlen)
+{
+  struct sockaddr_un addr;
+  int fd, n, len = 0;
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, METRICSSOCK);
+  if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+      close(fd);
+      return -1;
+    }
+
+  while((n = read(fd, &buf[len], maxlen - 1 - len)) > 0)
+    len += n;
+  buf[len] = 0;
+  close(fd);
+
+  return len;
+}
+
+static int
+readFile(char *buf, int maxlen)
+{
+  FILE *f = fopen(METRICSFILE, "r");
+  int len;
+
+  if(f == NULL)
+    return -1;
+  len = fread(buf, 1, maxlen - 1, f);
+  buf[len] = 0;
+  fclose(f);
+
+  return len;
+}
+
+int
+main(int argc, char *argv[])
+{
+  volatile struct TI_A24RegStruct *reg;
+  int failed = 0, len, itry;
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    {
+      printf("ERROR: jvmeSimInit failed\n");
+      exit(1);
+    }
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      printf("ERROR: tiInit failed\n");
+      exit(1);
+    }
+  tiAddSlave(2);
+
+  reg = (volatile struct TI_A24RegStruct *)jvmeSimRegisters();
+  reg->livetime = 3000;
+  reg->busytime = 1000;
+  reg->busy_scaler1[1] = 7;           /* SWB */
+  reg->busy_scaler2[3] = 11;          /* Fiber 3 */
+  reg->ts_scaler[0] = 123;
+  reg->eventNumber_lo = 12345;
+  reg->fiber = (reg->fiber & ~TI_FIBER_CONNECTED_MASK) | (0x2 << 16);
+
+  /* Snapshot */
+  if(tiMetricsUpdate() != OK)
+    {
+      printf("ERROR: tiMetricsUpdate failed\n");
+      failed = 1;
+    }
+  len = tiMetricsRender(text, sizeof(text));
+  printf("%s", text);
+
+  if((len <= 0) || (strcmp(&text[len - 6], "# EOF\n") != 0))
+    {
+      printf("ERROR: Text does not end with # EOF\n");
+      failed = 1;
+    }
+  if(!expect("snapshot", text, "ti_up 1\n") ||
+     !expect("snapshot", text, "# TYPE ti_events counter\n") ||
+     !expect("snapshot", text, "ti_events_total 12345\n") ||
+     !expect("snapshot", text, "ti_live_seconds_total 0.023040\n") ||
+     !expect("snapshot", text, "ti_busy_source_total{source=\"swb\"} 7\n") ||
+     !expect("snapshot", text, "ti_busy_source_total{source=\"fiber3\"} 11\n") ||
+     !expect("snapshot", text, "ti_ts_input_triggers_total{input=\"1\"} 123\n") ||
+     !expect("snapshot", text, "ti_fiber_slave{fiber=\"2\"} 1\n") ||
+     !expect("snapshot", text, "ti_fiber_connected{fiber=\"2\"} 1\n") ||
+     !expect("snapshot", text, "ti_readout_latency_seconds_count{stage=\"dma\"} 0\n"))
+    failed = 1;
+
+  /* Reading does not access the TI */
+  reg->eventNumber_lo = 20000;
+  reg->livetime = 3000 + 900;
+  reg->busytime = 1000 + 100;
+  tiMetricsRender(other, sizeof(other));
+  if(strcmp(text, other) != 0)
+    {
+      printf("ERROR: Text changed without a snapshot\n");
+      failed = 1;
+    }
+
+  tiMetricsUpdate();
+  tiMetricsRender(text, sizeof(text));
+  if(!expect("update", text, "ti_events_total 20000\n") ||
+     !expect("update", text, "ti_live_fraction 0.900000\n"))
+    failed = 1;
+
+  /* Exporter thread */
+  if(tiMetricsStart(20, METRICSFILE, METRICSSOCK) != OK)
+    {
+      printf("ERROR: tiMetricsStart failed\n");
+      exit(1);
+    }
+  reg->eventNumber_lo = 30000;
+  for(itry = 0; itry < 50; itry++)
+    {
+      usleep(20000);
+      if((readFile(other, sizeof(other)) > 0) &&
+	 (strstr(other, "ti_events_total 30000\n") != NULL))
+	break;
+    }
+  if(!expect("file", other, "ti_events_total 30000\n") ||
+     !expect("file", other, "# EOF\n"))
+    failed = 1;
+
+  len = readSocket(text, sizeof(text));
+  if((len <= 0) || !expect("socket", text, "ti_events_total 30000\n") ||
+     !expect("socket", text, "# EOF\n"))
+    failed = 1;
+
+  tiMetricsStop();
+  if(access(METRICSSOCK, F_OK) == 0)
+    {
+      printf("ERROR: Socket not removed\n");
+      failed = 1;
+    }
+  remove(METRICSFILE);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiMetricsTest "
+  End:
+*/
@@ -0,0 +1,172 @@
+/*
+ * File:
+ *    tiRateScanTest.c
+ *
+ * Description:
+ *    Check the pulser rate scan using the simulated VME backend.
+ *      - closest fixed and random pulser settings to a rate
+ *      - a thread stands in for the crate: it counts the events accepted
+ *        from the programmed pulser rate with a 10 us non-paralyzable
+ *        front end (SWA busy), and advances the live and busy timers
+ *      - expect throughput 1 / (1 + rate x 10 us), SWA as the dominant
+ *        busy, and the pulser disabled after the scan
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiRateScan.h"
+#include "jvmeSim.h"
+
+#define DEADTIME  10e-6    /* s per accepted event */
+#define TIMERUNIT 7.68e-6  /* s per live/busy timer count */
+#define NRATES    5
+
+static volatile struct TI_A24RegStruct *regs = NULL;
+static volatile int emulate = 1;
+
+/* Offered rate of the programmed pulser (Hz) */
+static double
+pulserRate()
+{
+  unsigned int reg = regs->fixedPulser1, inc = 0;
+
+  if(reg & TI_FIXEDPULSER1_NTRIGGERS_MASK)
+    {
+      inc = (reg & TI_FIXEDPULSER1_PERIOD_MASK) >> 16;
+      return 1e9 / (TI_FIXEDPULSER_PERIOD_MIN_NS + (double)inc * TI_FIXEDPULSER_STEP_NS *
+		    ((reg & TI_FIXEDPULSER1_PERIOD_RANGE) ? TI_FIXEDPULSER_RANGE1_FACTOR : 1));
+    }
+
+  reg = regs->randomPulser;
+  if(reg & TI_RANDOMPULSER_TRIG1_ENABLE)
+    return 500e6 / (1 << (reg & TI_RANDOMPULSER_TRIG1_RATE_MASK));
+
+  return 0;
+}
+
+static void *
+crate(void *arg)
+{
+  struct timespec last, now, tick = { 0, 500000 };
+  double dt = 0, rate = 0, accepted = 0, busy = 0;
+  double events = 0, live = 0, dead = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &last);
+  while(emulate)
+    {
+      nanosleep(&tick, NULL);
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      dt = (now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec) * 1e-9;
+      last = now;
+
+      rate = pulserRate();
+      accepted = rate / (1. + rate * DEADTIME);
+      busy = accepted * DEADTIME;
+
+      events += accepted * dt;
+      live += dt * (1. - busy) / TIMERUNIT;
+      dead += dt * busy / TIMERUNIT;
+
+      regs->eventNumber_lo = (unsigned int)events;
+      regs->livetime = (unsigned int)live;
+      regs->busytime = (unsigned int)dead;
+      regs->busy_scaler1[0] = (unsigned int)dead;   /* SWA */
+    }
+
+  return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+  const double rates[NRATES] = { 1e3, 1e4, 5e4, 1e5, 2e5 };
+  tiRateScanStep steps[NRATES];
+  pthread_t thread;
+  unsigned int inc = 0;
+  double actual = 0, expected = 0, rate = 0;
+  int failed = 0, range = 0, prescale = 0, istep;
+
+  printf("\nJLAB TI Rate Scan (simulated)\n");
+  printf("----------------------------\n");
+
+  /* Closest settings */
+  /* Within 2%, except between range 1 (61.44us steps) and range 0 (from 1017Hz) */
+  for(rate = 10; rate <= 1e6; rate *= 1.37)
+    {
+      tiRateScanFixedSetting(rate, &inc, &range, &actual);
+      if((rate > 650) && (rate < 1017))
+	continue;
+      if(fabs(actual - rate) / rate > 0.02)
+	{
+	  printf("ERROR: Fixed pulser %.1f Hz for %.1f Hz (inc %d, range %d)\n",
+		 actual, rate, inc, range);
+	  failed = 1;
+	}
+    }
+  tiRateScanFixedSetting(1000, &inc, &range, &actual);
+  if(fabs(actual - 1017.1) > 0.1)
+    {
+      printf("ERROR: Fixed pulser %.1f Hz (inc %d range %d) for 1 kHz\n", actual, inc, range);
+      failed = 1;
+    }
+  tiRateScanRandomSetting(61e3, &prescale, &actual);
+  if((prescale != 13) || (fabs(actual - 61035.16) > 0.01))
+    {
+      printf("ERROR: Random pulser prescale %d (%.2f Hz) for 61 kHz\n", prescale, actual);
+      failed = 1;
+    }
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    exit(1);
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    exit(1);
+  tiSetTriggerSource(TI_TRIGGER_PULSER);
+  tiSetBusySource(TI_BUSY_SWA, 1);
+
+  regs = (volatile struct TI_A24RegStruct *)jvmeSimRegisters();
+  pthread_create(&thread, NULL, crate, NULL);
+
+  if(tiRateScanRun(TI_RATESCAN_FIXED, rates, NRATES, 100, steps) != NRATES)
+    failed = 1;
+
+  emulate = 0;
+  pthread_join(thread, NULL);
+
+  tiRateScanPrint(steps, NRATES);
+  for(istep = 0; istep < NRATES; istep++)
+    {
+      expected = 1. / (1. + steps[istep].offered * DEADTIME);
+      if((fabs(steps[istep].throughput - expected) > 0.05) ||
+	 ((istep > 0) && (steps[istep].dt.dominant != 0)))
+	{
+	  printf("ERROR: %.0f Hz: throughput %.3f (expected %.3f), dominant %d\n",
+		 steps[istep].offered, steps[istep].throughput, expected,
+		 steps[istep].dt.dominant);
+	  failed = 1;
+	}
+    }
+
+  if(regs->fixedPulser1 & TI_FIXEDPULSER1_NTRIGGERS_MASK)
+    {
+      printf("ERROR: Pulser left enabled (0x%08x)\n", regs->fixedPulser1);
+      failed = 1;
+    }
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiRateScanTest "
+  End:
+*/
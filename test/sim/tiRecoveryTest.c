@@ -0,0 +1,292 @@
+/*
+ * File:
+ *    tiRecoveryTest.c
+ *
+ * Description:
+ *    Check the readout recovery of tiReadTriggerBlock, using the simulated
+ *    VME backend with one DMA per queued block.
+ *      - a valid block is formed, without recovery
+ *      - a word count mismatch returns the fake trigger bank, no drain
+ *      - a block read without its trailer: the rest is drained and dropped
+ *      - ... followed by the next block: held and returned next readout
+ *      - data without a block header: the next block is returned instead
+ *      - draining is bounded by maxDrains
+ *      - with recovery disabled, only the failure is recorded
+ *      - a held block is dropped by tiResetReadoutRecovery and by tiInit:
+ *        the next readout returns the next block from the FIFO
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "jvmeSim.h"
+
+#define BLOCKLEVEL  4
+#define MAXWORDS    ((8*BLOCKLEVEL) + 8)
+
+static unsigned int data[MAXWORDS] __attribute__((aligned(8)));
+
+/* Build a block of BLOCKLEVEL events, as it is in the TI FIFO.
+   Returns the number of words */
+static int
+makeBlock(uint32_t *block, int blocknum, int trailerCount)
+{
+  int nwords = 0, iev, count;
+
+  block[nwords++] = 0x80000000 | (blocknum << 8) | BLOCKLEVEL;
+  block[nwords++] = 0xFF102000 | BLOCKLEVEL;
+  for(iev = 0; iev < BLOCKLEVEL; iev++)
+    {
+      block[nwords++] = (0x01 << 24) | (iev << 16) | 2;
+      block[nwords++] = blocknum * BLOCKLEVEL + iev;
+      block[nwords++] = 0x1000 + iev;
+    }
+  count = nwords + 1;
+  block[nwords++] = 0x88000000 | ((trailerCount > 0) ? trailerCount : count);
+  if(nwords & 1)
+    block[nwords++] = 0xF8000000;
+
+  return nwords;
+}
+
+static void
+swapBlock(uint32_t *block, int nwords)
+{
+  int iword;
+
+  for(iword = 0; iword < nwords; iword++)
+    block[iword] = LSWAP(block[iword]);
+}
+
+static void
+push(uint32_t *block, int nwords)
+{
+  uint32_t tmp[MAXWORDS];
+
+  memcpy(tmp, block, nwords * sizeof(uint32_t));
+  swapBlock(tmp, nwords);
+  jvmeSimFifoPush(tmp, nwords);
+}
+
+/* Read a trigger block.  Returns the number of words, with the block
+   number of a formed block from its first event number (-1 for a fake
+   trigger bank).  The block is not swapped for a TI. */
+static int
+readBlock(int *blocknum)
+{
+  int nwords;
+
+  memset(data, 0, sizeof(data));
+  nwords = tiReadTriggerBlock(data);
+  *blocknum = -1;
+  if(nwords > 2)
+    *blocknum = LSWAP(data[3]) / BLOCKLEVEL;
+
+  return nwords;
+}
+
+static int
+expectRecord(const char *where, int failure, int outcome, unsigned int dropped)
+{
+  tiRecoveryStats st;
+  tiRecoveryRecord *r;
+
+  tiGetReadoutRecovery(&st);
+  if(st.nrecords == 0)
+    {
+      printf("ERROR: %s: no record\n", where);
+      return 0;
+    }
+  r = &st.record[st.nrecords - 1];
+  if((r->failure != failure) || (r->outcome != outcome) ||
+     ((dropped != (unsigned int)-1) && (r->wordsDropped != dropped)))
+    {
+      printf("ERROR: %s: failure %d, outcome %d, %u words dropped, %d drains\n",
+	     where, r->failure, r->outcome, r->wordsDropped, r->drains);
+      return 0;
+    }
+  return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint32_t block[MAXWORDS], junk[6];
+  tiRecoveryStats st;
+  int failed = 0, nwords, nread, blocknum, idrain, ireset;
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    {
+      printf("ERROR: jvmeSimInit failed\n");
+      exit(1);
+    }
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      printf("ERROR: tiInit failed\n");
+      exit(1);
+    }
+  /* Blocks read with DMA */
+  tiSetBlockLevel(BLOCKLEVEL);
+  tiSetReadoutRecovery(1, 4);
+  tiResetReadoutRecovery();
+
+  /* Valid block */
+  nwords = makeBlock(block, 1, 0);
+  push(block, nwords);
+  nread = readBlock(&blocknum);
+  tiGetReadoutRecovery(&st);
+  if((blocknum != 1) || (nread != (int)(block[nwords - 2] & TI_BLOCK_TRAILER_WORD_COUNT_MASK) - 1) ||
+     (st.nrecords != 0))
+    {
+      printf("ERROR: Valid block: %d words, block %d, %d records\n",
+	     nread, blocknum, st.nrecords);
+      failed = 1;
+    }
+
+  /* Word count mismatch: trailer read, nothing to drain */
+  nwords = makeBlock(block, 2, 5);
+  push(block, nwords);
+  nwords = makeBlock(block, 3, 0);
+  push(block, nwords);
+  nread = readBlock(&blocknum);
+  if((nread != 2) || (jvmeSimFifoCount() != 1) ||
+     !expectRecord("Count mismatch", TI_RECOVERY_COUNT_MISMATCH, TI_RECOVERY_DROPPED, nwords))
+    {
+      printf("ERROR: Count mismatch: %d words, %d queued\n", nread, jvmeSimFifoCount());
+      failed = 1;
+    }
+  nread = readBlock(&blocknum);
+  if(blocknum != 3)
+    {
+      printf("ERROR: Block after count mismatch: %d\n", blocknum);
+      failed = 1;
+    }
+
+  /* No trailer, the rest of the block in the next transfer */
+  nwords = makeBlock(block, 4, 0);
+  push(block, 8);
+  push(&block[8], nwords - 8);
+  nread = readBlock(&blocknum);
+  if((nread != 2) || (jvmeSimFifoCount() != 0) ||
+     !expectRecord("No trailer", TI_RECOVERY_NO_TRAILER, TI_RECOVERY_DROPPED, nwords))
+    {
+      printf("ERROR: No trailer: %d words, %d queued\n", nread, jvmeSimFifoCount());
+      failed = 1;
+    }
+
+  /* No trailer, followed by the next block: held */
+  nwords = makeBlock(block, 5, 0);
+  push(block, 8);
+  nwords = makeBlock(block, 6, 0);
+  push(block, nwords);
+  nread = readBlock(&blocknum);
+  if((nread != 2) ||
+     !expectRecord("Held", TI_RECOVERY_NO_TRAILER, TI_RECOVERY_HELD, 8))
+    failed = 1;
+  nread = readBlock(&blocknum);
+  if(blocknum != 6)
+    {
+      printf("ERROR: Held block not returned: %d words, block %d\n", nread, blocknum);
+      failed = 1;
+    }
+
+  /* No header (end of an earlier block), followed by the next block: resync */
+  memcpy(junk, &block[10], sizeof(junk));
+  push(junk, 6);
+  nwords = makeBlock(block, 7, 0);
+  push(block, nwords);
+  nread = readBlock(&blocknum);
+  if((blocknum != 7) ||
+     !expectRecord("Resync", TI_RECOVERY_NO_HEADER, TI_RECOVERY_RESYNCED, 6))
+    {
+      printf("ERROR: Resync: %d words, block %d\n", nread, blocknum);
+      failed = 1;
+    }
+
+  /* Draining is bounded */
+  for(idrain = 0; idrain < 10; idrain++)
+    push(junk, 4);
+  nread = readBlock(&blocknum);
+  if((nread != 2) || (jvmeSimFifoCount() != 10 - 1 - 4) ||
+     !expectRecord("Bounded", TI_RECOVERY_NO_HEADER, TI_RECOVERY_DROPPED, (unsigned int)-1))
+    {
+      printf("ERROR: Bounded: %d words, %d queued\n", nread, jvmeSimFifoCount());
+      failed = 1;
+    }
+  jvmeSimFifoClear();
+
+  /* Disabled */
+  tiSetReadoutRecovery(0, 4);
+  nwords = makeBlock(block, 8, 0);
+  push(block, 8);
+  push(&block[8], nwords - 8);
+  nread = readBlock(&blocknum);
+  if((nread != 2) || (jvmeSimFifoCount() != 1) ||
+     !expectRecord("Disabled", TI_RECOVERY_NO_TRAILER, TI_RECOVERY_DROPPED, 8))
+    failed = 1;
+  jvmeSimFifoClear();
+
+  tiGetReadoutRecovery(&st);
+  if((st.failures[TI_RECOVERY_NO_TRAILER] != 3) || (st.failures[TI_RECOVERY_NO_HEADER] != 2) ||
+     (st.failures[TI_RECOVERY_COUNT_MISMATCH] != 1) || (st.held != 1) || (st.resynced != 1) ||
+     (st.dropped != 4) || (st.nrecords != 6))
+    {
+      printf("ERROR: Counters\n");
+      failed = 1;
+    }
+  tiPrintReadoutRecovery();
+
+  if(tiSetReadoutRecovery(1, 0) != ERROR)
+    {
+      printf("ERROR: Invalid maxDrains accepted\n");
+      failed = 1;
+    }
+
+  /* Held, then reset (0) or init (1): the held block is stale */
+  for(ireset = 0; ireset < 2; ireset++)
+    {
+      tiSetReadoutRecovery(1, 4);
+      nwords = makeBlock(block, 10 + 3 * ireset, 0);
+      push(block, 8);
+      nwords = makeBlock(block, 11 + 3 * ireset, 0);
+      push(block, nwords);
+      nread = readBlock(&blocknum);
+      if(!expectRecord("Held before reset", TI_RECOVERY_NO_TRAILER, TI_RECOVERY_HELD, 8))
+	failed = 1;
+
+      if(ireset == 0)
+	tiResetReadoutRecovery();
+      else if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+	{
+	  printf("ERROR: tiInit failed\n");
+	  exit(1);
+	}
+      tiSetBlockLevel(BLOCKLEVEL);
+
+      nwords = makeBlock(block, 12 + 3 * ireset, 0);
+      push(block, nwords);
+      nread = readBlock(&blocknum);
+      if(blocknum != 12 + 3 * ireset)
+	{
+	  printf("ERROR: Held block returned after %s: %d words, block %d\n",
+		 (ireset == 0) ? "tiResetReadoutRecovery" : "tiInit", nread, blocknum);
+	  failed = 1;
+	}
+      jvmeSimFifoClear();
+    }
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiRecoveryTest "
+  End:
+*/
@@ -0,0 +1,168 @@
+/*
+ * File:
+ *    tiRuleSimTest.c
+ *
+ * Description:
+ *    Check the trigger rule model.  No TI is needed, except to apply
+ *    rule sets (simulated VME backend).
+ *      - rule 1 alone on Poisson triggers should follow the non-paralyzable
+ *        dead time formula: accepted = offered / (1 + rate * period)
+ *      - timesteps 1 and 2 cannot be mixed
+ *      - the optimizer should find settings without front end overflow
+ *        that accept at least as much as a safe hand-picked setting
+ *      - timestamps decoded from format 3 trigger banks, and format 2
+ *        banks decoded with the upper event number bits and no timestamp
+ *      - applying a rule set without minimum disables the minimum left by
+ *        the previous one
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiDecode.h"
+#include "tiRuleSim.h"
+#include "jvmeSim.h"
+
+#define NTRIG  200000
+#define RATE   100000.
+
+int
+main(int argc, char *argv[])
+{
+  static uint64_t t_ns[NTRIG];
+  tiRuleSet rules, best;
+  tiRuleSimResult result, bestResult;
+  uint32_t bank[2 + 2*5];
+  uint64_t ts[4];
+  tiDecodedEvent ev[2];
+  double expected = 0;
+  int failed = 0, iev;
+
+  printf("\nJLAB TI Trigger Rule Model\n");
+  printf("----------------------------\n");
+
+  tiRuleSimPoisson(RATE, NTRIG, 1, t_ns);
+
+  /* Rule 1: 10 x 480 ns */
+  memset(&rules, 0, sizeof(rules));
+  rules.value[0] = 10;
+  rules.timestep[0] = 1;
+  tiRuleSimRun(&rules, t_ns, NTRIG, 0, 0, &result);
+  expected = 1. / (1. + RATE * 4800e-9);
+  printf("Rule 1 only: accepted fraction %.4f (expected %.4f)\n",
+	 1. - result.deadFraction, expected);
+  if(fabs((1. - result.deadFraction) - expected) > 0.01)
+    failed = 1;
+
+  rules.value[1] = 10;
+  rules.timestep[1] = 2;
+  if(tiRuleSimValidate(&rules) != ERROR)
+    {
+      printf("ERROR: Mixed timesteps 1 and 2 accepted\n");
+      failed = 1;
+    }
+
+  /* Depth 4, 8 us readout.  Safe: rule 1 longer than the readout */
+  memset(&rules, 0, sizeof(rules));
+  rules.value[0] = 17;
+  rules.timestep[0] = 1;
+  tiRuleSimRun(&rules, t_ns, NTRIG, 4, 8000, &result);
+  if(result.overflows != 0)
+    {
+      printf("ERROR: Safe setting overflows (%llu)\n",
+	     (unsigned long long)result.overflows);
+      failed = 1;
+    }
+
+  if(tiRuleSimOptimize(t_ns, NTRIG, 4, 8000, &best, &bestResult) != OK)
+    failed = 1;
+  else
+    {
+      tiRuleSimPrint(&best, &bestResult);
+      if((bestResult.overflows != 0) || (bestResult.accepted < result.accepted))
+	{
+	  printf("ERROR: Optimized %llu accepted, %llu overflows (safe: %llu accepted)\n",
+		 (unsigned long long)bestResult.accepted,
+		 (unsigned long long)bestResult.overflows,
+		 (unsigned long long)result.accepted);
+	  failed = 1;
+	}
+    }
+
+  /* Format 3 trigger bank with 2 events */
+  bank[0] = 9;
+  bank[1] = 0xFF102002;
+  for(iev = 0; iev < 2; iev++)
+    {
+      bank[2 + 4*iev] = (1 << 24) | (0x01 << 16) | 3;
+      bank[3 + 4*iev] = 100 + iev;
+      bank[4 + 4*iev] = 0x10000000 * (iev + 1);
+      bank[5 + 4*iev] = 0x0001;
+    }
+  if((tiDecodeTimestamps(bank, 10, ts, 4) != 2) ||
+     (ts[0] != 0x110000000ULL) || (ts[1] != 0x120000000ULL))
+    {
+      printf("ERROR: Trigger bank timestamps decoded incorrectly\n");
+      failed = 1;
+    }
+
+  /* Format 2: the second word holds the upper timestamp and event number bits */
+  bank[0] = 7;
+  bank[1] = 0xFF102002;
+  for(iev = 0; iev < 2; iev++)
+    {
+      bank[2 + 3*iev] = (1 << 24) | (0x01 << 16) | 2;
+      bank[3 + 3*iev] = 100 + iev;
+      bank[4 + 3*iev] = (0x0002 << 16) | 0x0001;
+    }
+  tiDecodeSetEventFormat(2);
+  if((tiDecodeTriggerBank(bank, 8, ev, 2, NULL) != 2) ||
+     (ev[0].evnum != 0x200000064ULL) || (ev[1].evnum != 0x200000065ULL) ||
+     ev[0].hasTimestamp || ev[0].hasTSInputs || (ev[0].timestamp != 0) ||
+     (tiDecodeTimestamps(bank, 8, ts, 4) != 0))
+    {
+      printf("ERROR: Format 2 trigger bank decoded incorrectly\n");
+      failed = 1;
+    }
+  tiDecodeSetEventFormat(3);
+
+  /* Rule minimum programmed, then disabled */
+  if((jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK) ||
+     (tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK))
+    exit(1);
+  memset(&rules, 0, sizeof(rules));
+  rules.value[0] = 10;
+  rules.value[1] = 20;
+  rules.minValue[1] = 5;
+  tiRuleSimApply(&rules);
+  tiRuleSimRead(&best);
+  if(best.minValue[1] != 5)
+    {
+      printf("ERROR: Rule 2 minimum %d after apply (expected 5)\n", best.minValue[1]);
+      failed = 1;
+    }
+  rules.minValue[1] = 0;
+  tiRuleSimApply(&rules);
+  tiRuleSimRead(&best);
+  if((best.minValue[1] != 0) || (tiGetTriggerHoldoffMin(2, 0) & (1<<7)))
+    {
+      printf("ERROR: Rule 2 minimum still enabled (%d)\n", best.minValue[1]);
+      failed = 1;
+    }
+  jvmeSimFree();
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiRuleSimTest "
+  End:
+*/
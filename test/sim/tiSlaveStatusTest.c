@@ -0,0 +1,168 @@
+/*
+ * File:
+ *    tiSlaveStatusTest.c
+ *
+ * Description:
+ *    Check tiGetAllSlaveStatus using the simulated VME backend.
+ *      - slaves on Fiber 1 and 3, distinct register contents on each port
+ *      - every port agrees with tiGetCrateID, tiGetPortTrigSrcEnabled,
+ *        tiGetSlaveBlocklevel, tiBlockStatus and tiGetBusyCounter
+ *      - connection, busy and trigger link bits decoded per port
+ *      - cost against the per-port routines
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "jvmeSim.h"
+
+#define NCALLS 10000
+
+static double
+now()
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* What a monitoring cycle read before tiGetAllSlaveStatus */
+static void
+perPort()
+{
+  int iport;
+
+  for(iport = 0; iport < TI_PORT_NPORTS; iport++)
+    {
+      tiGetCrateID(iport);
+      tiGetPortTrigSrcEnabled(iport);
+      if(iport > 0)
+	tiGetSlaveBlocklevel(iport);
+      tiBlockStatus(iport, 0);
+      tiGetBusyCounter(7 + iport);
+    }
+  tiGetConnectedFiberMask();
+  tiGetTrigSrcEnabledFiberMask();
+  tiGetTriggerLinkStatus(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  volatile struct TI_A24RegStruct *regs;
+  tiPortStatus port[TI_PORT_NPORTS];
+  tiPortStatus *p;
+  unsigned int bs;
+  double t, tAll, tPort;
+  int iport, ireg, nslaves, failed = 0;
+
+  printf("\nJLAB TI Slave Status (simulated)\n");
+  printf("----------------------------\n");
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    exit(1);
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      failed = 1;
+      goto CLOSE;
+    }
+
+  tiAddSlave(1);
+  tiAddSlave(3);
+
+  regs = (volatile struct TI_A24RegStruct *)jvmeSimRegisters();
+  for(iport = 0; iport < 8; iport++)
+    regs->hfbr_tiID[iport] = ((iport + 2) << 16) | ((10 + iport) << 8) | (1 << iport);
+  regs->master_tiID = (3 << 8) | TI_TRIGSRC_LOOPBACK;
+  regs->fiber = (regs->fiber & 0xFFFF) | (0x5 << 16) | (0x1 << 24);
+  regs->busy = TI_BUSY_MONITOR_FIBER_BUSY(3);
+  for(ireg = 0; ireg < 4; ireg++)
+    regs->blockStatus[ireg] = ((2 * ireg + 2) << 24) | ((2 * ireg + 1) << 16) |
+      ((2 * ireg + 1) << 8) | (2 * ireg);
+  regs->adr24 = (regs->adr24 & 0xFFFF) | (6 << 24) | (7 << 16);
+  regs->GTPStatusB = 0x5 | (0x4 << 8) | (0x4 << 24);
+  for(iport = 0; iport < TI_PORT_NPORTS; iport++)
+    regs->busy_scaler2[iport] = 100 * iport + 1;
+
+  nslaves = tiGetAllSlaveStatus(port);
+  if(nslaves != 2)
+    {
+      printf("ERROR: %d slaves (expected 2)\n", nslaves);
+      failed = 1;
+    }
+
+  for(iport = 0; iport < TI_PORT_NPORTS; iport++)
+    {
+      p = &port[iport];
+      bs = tiBlockStatus(iport, 0);
+
+      if((p->port != iport) ||
+	 (p->crateID != tiGetCrateID(iport)) ||
+	 (p->portTrigSrc != tiGetPortTrigSrcEnabled(iport)) ||
+	 (p->blocklevel != ((iport == 0) ? tiGetCurrentBlockLevel() : tiGetSlaveBlocklevel(iport))) ||
+	 (p->blocksReady != (int)(bs & TI_BLOCKSTATUS_NBLOCKS_READY0)) ||
+	 (p->blocksNeedAck != (int)((bs & TI_BLOCKSTATUS_NBLOCKS_NEEDACK0) >> 8)) ||
+	 (p->busyCounter != tiGetBusyCounter(7 + iport)))
+	{
+	  printf("ERROR: Port %d differs from the per-port routines\n", iport);
+	  failed = 1;
+	}
+    }
+
+  /* Decoded bits */
+  if((port[0].crateID != 3) || !port[0].trigSrcEnabled || port[0].busy ||
+     (port[0].blocksReady != 7) || (port[0].blocksNeedAck != 6) ||
+     !port[1].slave || port[2].slave || !port[3].slave ||
+     !port[1].connected || port[2].connected || !port[3].connected ||
+     !port[1].trigSrcEnabled || port[3].trigSrcEnabled ||
+     port[1].busy || !port[3].busy ||
+     (port[3].crateID != 12) || (port[3].blocklevel != 4) ||
+     (port[3].blocksReady != 2) || (port[3].blocksNeedAck != 3) ||
+     !port[1].linkUp || port[2].linkUp || !port[3].linkUp ||
+     (port[1].linkErrors != 0) ||
+     (port[3].linkErrors != (TI_PORT_LINK_DATA_ERROR | TI_PORT_LINK_NOT_IN_TABLE)))
+    {
+      printf("ERROR: Decoded port status\n");
+      failed = 1;
+    }
+
+  /* Cost */
+  t = now();
+  for(iport = 0; iport < NCALLS; iport++)
+    tiGetAllSlaveStatus(port);
+  tAll = (now() - t) / NCALLS;
+
+  t = now();
+  for(iport = 0; iport < NCALLS; iport++)
+    perPort();
+  tPort = (now() - t) / NCALLS;
+
+  printf("  tiGetAllSlaveStatus %.2f us, per-port routines %.2f us\n",
+	 tAll * 1e6, tPort * 1e6);
+  if(tAll >= tPort)
+    {
+      printf("ERROR: tiGetAllSlaveStatus not cheaper than the per-port routines\n");
+      failed = 1;
+    }
+
+  tiSlaveStatus(0);
+
+ CLOSE:
+  jvmeSimFree();
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiSlaveStatusTest "
+  End:
+*/
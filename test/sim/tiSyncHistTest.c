@@ -0,0 +1,165 @@
+/*
+ * File:
+ *    tiSyncHistTest.c
+ *
+ * Description:
+ *    Check the sync history log, using the simulated VME backend.
+ *      - sync history words with a 64 bit time, sent as 16 bit
+ *        timestamps with the overflow flag on each wrap, pushed in bursts
+ *        while the drain thread runs and a reader queries the log
+ *      - expect the extended timestamps to match the time, the reader to
+ *        see entries in order, and the oldest entries overwritten
+ *      - queries by code and validity
+ *      - a full buffer is counted
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiSyncHist.h"
+#include "jvmeSim.h"
+
+#define NWORDS  10000
+#define BURST   100
+
+static uint64_t simTime[NWORDS];
+static volatile int reading = 1;
+static int readerErrors = 0;
+
+static uint32_t
+historyWord(int iword)
+{
+  int code = 1 + (iword % 15), valid = (iword % 3) != 0;
+  int overflow = (iword > 0) && ((simTime[iword] >> 16) != (simTime[iword - 1] >> 16));
+
+  return ((simTime[iword] & 0xFFFF) << 16) | (overflow << 15) | (valid << 14) | (code << 10);
+}
+
+/* Entries in order, with the timestamps of their seq */
+static void *
+reader(void *arg)
+{
+  tiSyncHistEntry entry[64];
+  uint64_t next = 0, last = 0;
+  int n = 0, ientry, first = 1;
+
+  while(reading)
+    {
+      n = tiSyncHistQuery(-1, 0, next, entry, 64, &next);
+      for(ientry = 0; ientry < n; ientry++)
+	{
+	  if((!first && (entry[ientry].seq <= last)) ||
+	     (entry[ientry].timestamp != simTime[entry[ientry].seq]))
+	    readerErrors++;
+	  last = entry[ientry].seq;
+	  first = 0;
+	}
+    }
+
+  return NULL;
+}
+
+static int
+countCode(const tiSyncHistEntry *entry, void *arg)
+{
+  (*(int *)arg)++;
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct timespec pause = { 0, 2000000 };
+  tiSyncHistEntry entry[16];
+  tiSyncHistStats stats;
+  pthread_t thread;
+  uint64_t next = 0;
+  int failed = 0, iword, n = 0, expected = 0, count = 0;
+
+  printf("\nJLAB TI Sync History Log (simulated)\n");
+  printf("----------------------------\n");
+
+  srand(3);
+  simTime[0] = 100;
+  for(iword = 1; iword < NWORDS; iword++)
+    simTime[iword] = simTime[iword - 1] + (rand() % 65536);
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    exit(1);
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    exit(1);
+
+  tiSyncHistInit();
+  tiSyncHistStart(1);
+  pthread_create(&thread, NULL, reader, NULL);
+
+  for(iword = 0; iword < NWORDS; iword++)
+    {
+      if((iword % BURST) == 0)
+	nanosleep(&pause, NULL);
+      while(jvmeSimSyncHistoryPush(historyWord(iword)) != OK)
+	nanosleep(&pause, NULL);
+    }
+
+  tiSyncHistStop();
+  reading = 0;
+  pthread_join(thread, NULL);
+
+  tiSyncHistGetStats(&stats);
+  if((stats.nentries != NWORDS) || (stats.overwritten != NWORDS - TI_SYNCHIST_RING) ||
+     (stats.nfull != 0) || (readerErrors != 0))
+    {
+      printf("ERROR: %llu entries, %llu overwritten, %llu full, %d reader errors\n",
+	     (unsigned long long)stats.nentries, (unsigned long long)stats.overwritten,
+	     (unsigned long long)stats.nfull, readerErrors);
+      failed = 1;
+    }
+
+  /* Oldest entry left, with its extended timestamp */
+  n = tiSyncHistQuery(-1, 0, 0, entry, 1, &next);
+  if((n != 1) || (entry[0].seq != NWORDS - TI_SYNCHIST_RING) ||
+     (entry[0].timestamp != simTime[entry[0].seq]))
+    {
+      printf("ERROR: Oldest entry seq %llu timestamp %llu\n",
+	     (unsigned long long)entry[0].seq, (unsigned long long)entry[0].timestamp);
+      failed = 1;
+    }
+
+  /* SyncReset (0xD), valid only */
+  for(iword = NWORDS - TI_SYNCHIST_RING; iword < NWORDS; iword++)
+    if(((1 + (iword % 15)) == 0xD) && ((iword % 3) != 0))
+      expected++;
+  tiSyncHistIterate(0xD, 1, countCode, &count);
+  if(count != expected)
+    {
+      printf("ERROR: %d valid SyncReset entries (expected %d)\n", count, expected);
+      failed = 1;
+    }
+
+  /* Full buffer */
+  n = stats.nfull;
+  for(iword = 0; iword < JVME_SIM_SYNCHISTORY_WORDS; iword++)
+    jvmeSimSyncHistoryPush(historyWord(iword));
+  if((tiSyncHistDrain() != JVME_SIM_SYNCHISTORY_WORDS) ||
+     (tiSyncHistGetStats(&stats) != OK) || (stats.nfull != n + 1))
+    {
+      printf("ERROR: Full buffer not counted\n");
+      failed = 1;
+    }
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiSyncHistTest "
+  End:
+*/
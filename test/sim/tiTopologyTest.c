@@ -0,0 +1,174 @@
+/*
+ * File:
+ *    tiTopologyTest.c
+ *
+ * Description:
+ *    Check the topology cache of tiInit using the simulated VME backend.
+ *      - a cold start of a TI Slave on HFBR#5, found by scanning, measures
+ *        the fiber latency and writes the cache
+ *      - with the same board and fibers, the next tiInit is a warm start:
+ *        the cached latency is checked and applied with the matching fiber
+ *        sync delay
+ *      - a fiber of another length, a new serial number, new firmware,
+ *        other connected fibers or TI_INIT_COLD_START each make a cold
+ *        start with a new measurement
+ *      - a TI Master keeps its topology too
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "jvmeSim.h"
+
+#define CACHE    "/tmp/tiTopologyTest.cache"
+#define LATENCY  0x40
+#define SERIAL   0x1234
+
+static volatile struct TI_A24RegStruct *regs;
+
+/* Simulated TI with a HFBR#5 latency, connected fibers in fiberMask */
+static int
+board(unsigned int firmware, unsigned int serial, int latency, unsigned int fiberMask)
+{
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, firmware) != OK)
+    return ERROR;
+  jvmeSimSetSerialNumber(serial);
+
+  regs = (volatile struct TI_A24RegStruct *)jvmeSimRegisters();
+  regs->fiberAlignment = ((latency << 1) << 23) & TI_FIBERLATENCYMEASUREMENT_DATA_MASK;
+  regs->fiber = (fiberMask << 16) & TI_FIBER_CONNECTED_MASK;
+
+  return OK;
+}
+
+/* Initialize a TI Slave on HFBR#5, and check the start and latency */
+static int
+slave(const char *what, int iFlag, int expectWarm, int expectLatency)
+{
+  tiTopology topo;
+  unsigned int syncDelay, expected;
+  int rval, failed = 0;
+
+  if(tiInit(0, TI_READOUT_TS_POLL, TI_INIT_SLAVE_FIBER_5 | iFlag) != OK)
+    {
+      printf("ERROR: %s: tiInit failed\n", what);
+      return 1;
+    }
+
+  rval = tiGetTopology(&topo);
+  if(rval != expectWarm)
+    {
+      printf("ERROR: %s: %s start (expected %s)\n", what,
+	     rval ? "warm" : "cold", expectWarm ? "warm" : "cold");
+      failed = 1;
+    }
+
+  if((tiGetFiberLatencyMeasurement() != expectLatency) ||
+     (topo.fiberLatency != expectLatency))
+    {
+      printf("ERROR: %s: latency = 0x%x (expected 0x%x)\n", what,
+	     tiGetFiberLatencyMeasurement(), expectLatency);
+      failed = 1;
+    }
+
+  expected = (0xbf - expectLatency) & 0xFF;
+  expected = (expected << 8) | (expected << 16) | (expected << 24);
+  syncDelay = regs->fiberSyncDelay & 0xFFFFFF00;
+  if(syncDelay != expected)
+    {
+      printf("ERROR: %s: fiberSyncDelay = 0x%08x (expected 0x%08x)\n", what,
+	     syncDelay, expected);
+      failed = 1;
+    }
+
+  if((topo.a24 != JVME_SIM_A24_ADDR) || (topo.slot != (JVME_SIM_A24_ADDR >> 19)) ||
+     (topo.serialNumber != tiGetSerialNumber(NULL)) || (topo.slaveFiberIn != 5))
+    {
+      printf("ERROR: %s: topology a24 0x%x slot %d serial 0x%x fiber %d\n", what,
+	     topo.a24, topo.slot, topo.serialNumber, topo.slaveFiberIn);
+      failed = 1;
+    }
+
+  return failed;
+}
+
+int
+main(int argc, char *argv[])
+{
+  tiTopology topo;
+  int failed = 0;
+
+  printf("\nJLAB TI Topology Cache (simulated)\n");
+  printf("----------------------------\n");
+
+  unlink(CACHE);
+  tiSetTopologyCache_preInit(CACHE);
+
+  /* Cold start, then warm: the sync delay is written again */
+  if(board(JVME_SIM_FIRMWARE, SERIAL, LATENCY, 1 << 4) != OK)
+    exit(1);
+  failed |= slave("First start", 0, 0, LATENCY);
+  if(access(CACHE, R_OK) != 0)
+    {
+      printf("ERROR: Topology cache not written\n");
+      failed = 1;
+    }
+
+  regs->fiberSyncDelay = 0;
+  failed |= slave("Same board", 0, 1, LATENCY);
+
+  /* Fiber swapped for a longer one */
+  regs->fiberAlignment = (((LATENCY + 8) << 1) << 23) & TI_FIBERLATENCYMEASUREMENT_DATA_MASK;
+  failed |= slave("Longer fiber", 0, 0, LATENCY + 8);
+  failed |= slave("Longer fiber, again", 0, 1, LATENCY + 8);
+
+  /* Asked for a cold start */
+  failed |= slave("TI_INIT_COLD_START", TI_INIT_COLD_START, 0, LATENCY + 8);
+
+  /* Another board, other firmware, other fibers */
+  board(JVME_SIM_FIRMWARE, SERIAL + 1, LATENCY, 1 << 4);
+  failed |= slave("New serial number", 0, 0, LATENCY);
+  failed |= slave("New serial number, again", 0, 1, LATENCY);
+
+  board(JVME_SIM_FIRMWARE + 1, SERIAL + 1, LATENCY + 2, 1 << 4);
+  failed |= slave("New firmware", 0, 0, LATENCY + 2);
+
+  board(JVME_SIM_FIRMWARE + 1, SERIAL + 1, LATENCY + 4, (1 << 4) | (1 << 0));
+  failed |= slave("New fibers", 0, 0, LATENCY + 4);
+  failed |= slave("New fibers, again", 0, 1, LATENCY + 4);
+
+  /* TI Master */
+  board(JVME_SIM_FIRMWARE, SERIAL, LATENCY, 0x3);
+  if((tiInit(0, TI_READOUT_EXT_POLL, 0) != OK) || (tiGetTopology(&topo) != 0) ||
+     (tiInit(0, TI_READOUT_EXT_POLL, 0) != OK) || (tiGetTopology(&topo) != 1) ||
+     (topo.slaveFiberIn != 0) || (topo.connectedFibers != 0x3))
+    {
+      printf("ERROR: TI Master topology\n");
+      failed = 1;
+    }
+
+  /* No cache */
+  tiSetTopologyCache_preInit(NULL);
+  if((tiInit(0, TI_READOUT_EXT_POLL, 0) != OK) || (tiGetTopology(NULL) != 0))
+    {
+      printf("ERROR: Warm start without the topology cache\n");
+      failed = 1;
+    }
+
+  jvmeSimFree();
+  unlink(CACHE);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiTopologyTest "
+  End:
+*/
@@ -0,0 +1,234 @@
+/*
+ * File:
+ *    tiTraceTest.c
+ *
+ * Description:
+ *    Check the hot path tracing, using the simulated VME backend.
+ *      - a thread records more spans than its ring holds: expect the
+ *        most recent ones in the dump (all but the oldest record, which
+ *        the dump cannot tell from one being overwritten)
+ *      - tiIntAck spans from the library trace points
+ *      - dumps while a thread records: expect no gap and no record out
+ *        of order in the dumped ring, and marks in at least one dump (a
+ *        dump drops the whole ring if the writer laps it during the copy)
+ *      - Chrome trace conversion and span summary
+ *      - cost of a trace point, and of the counter read it includes
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiTrace.h"
+#include "jvmeSim.h"
+
+#define TRACEFILE  "/tmp/tiTraceTest.trace"
+#define JSONFILE   "/tmp/tiTraceTest.json"
+
+#define POINT_WORK      (TI_TRACE_USER)
+#define POINT_WORK_END  (TI_TRACE_USER + 1)
+#define POINT_MARK      (TI_TRACE_USER + 2)
+#define POINT_COST      (TI_TRACE_USER + 3)
+
+#define NWORK   20000
+#define NACK    100
+#define NCOST   1000000
+
+static volatile int marking = 1;
+static volatile uint32_t nmarked = 0;
+static double costNs = 0., clockNs = 0.;
+
+static void *
+worker(void *arg)
+{
+  int iwork;
+
+  prctl(PR_SET_NAME, "worker");
+  for(iwork = 0; iwork < NWORK; iwork++)
+    {
+      TI_TRACE_POINT(POINT_WORK, iwork);
+      TI_TRACE_POINT(POINT_WORK_END, iwork);
+    }
+
+  return NULL;
+}
+
+static void *
+marker(void *arg)
+{
+  uint32_t imark = 0;
+
+  prctl(PR_SET_NAME, "marker");
+  while(marking)
+    {
+      TI_TRACE_POINT(POINT_MARK, imark++);
+      nmarked = imark;
+    }
+
+  return NULL;
+}
+
+static void *
+cost(void *arg)
+{
+  struct timespec start, end;
+  volatile uint64_t tsc = 0;
+  int ipoint;
+
+  prctl(PR_SET_NAME, "cost");
+  TI_TRACE_POINT(POINT_COST, 0);  /* attach */
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(ipoint = 0; ipoint < NCOST; ipoint++)
+    TI_TRACE_POINT(POINT_COST, ipoint);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  costNs = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / NCOST;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(ipoint = 0; ipoint < NCOST; ipoint++)
+    tsc += tiTraceClock();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  clockNs = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / NCOST;
+
+  return NULL;
+}
+
+/* Marks of the marker thread in the JSON file: consecutive, and how many */
+static int
+checkMarks(int *nmarks)
+{
+  char line[512];
+  unsigned int arg = 0, last = 0;
+  int first = 1, rval = 1;
+  FILE *f = fopen(JSONFILE, "r");
+
+  *nmarks = 0;
+  if(f == NULL)
+    return 0;
+
+  while(fgets(line, sizeof(line), f) != NULL)
+    {
+      if(strstr(line, "\"name\":\"mark\"") == NULL)
+	continue;
+      if(sscanf(strstr(line, "\"arg\":"), "\"arg\":%u", &arg) != 1)
+	rval = 0;
+      if(!first && (arg != last + 1))
+	rval = 0;
+      first = 0;
+      last = arg;
+      (*nmarks)++;
+    }
+  fclose(f);
+
+  return rval;
+}
+
+int
+main(int argc, char *argv[])
+{
+  tiTraceSpan span[TI_TRACE_NPOINTS + 1];
+  pthread_t thread;
+  int failed = 0, iack, nspans, ispan, ndump, nevents, nmarks = 0, idump;
+  int markedDumps = 0;
+  int foundWork = 0, foundAck = 0;
+
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    {
+      printf("ERROR: jvmeSimInit failed\n");
+      exit(1);
+    }
+
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    {
+      printf("ERROR: tiInit failed\n");
+      exit(1);
+    }
+
+  tiTraceInit();
+  tiTraceDefine(POINT_WORK, "work", TI_TRACE_BEGIN);
+  tiTraceDefine(POINT_WORK_END, "work", TI_TRACE_END);
+  tiTraceDefine(POINT_MARK, "mark", TI_TRACE_INSTANT);
+  tiTraceDefine(POINT_COST, "cost", TI_TRACE_INSTANT);
+
+  pthread_create(&thread, NULL, worker, NULL);
+  pthread_join(thread, NULL);
+
+  for(iack = 0; iack < NACK; iack++)
+    tiIntAck();
+
+  pthread_create(&thread, NULL, cost, NULL);
+  pthread_join(thread, NULL);
+  printf("Trace point: %.1f ns (counter read %.1f ns)\n", costNs, clockNs);
+  if(costNs > 200.)
+    {
+      printf("ERROR: Trace point takes %.1f ns\n", costNs);
+      failed = 1;
+    }
+
+  /* Dump while recording */
+  pthread_create(&thread, NULL, marker, NULL);
+  while(nmarked < 1000)
+    ;
+  for(idump = 0; idump < 3; idump++)
+    {
+      ndump = tiTraceDump(TRACEFILE);
+      nevents = tiTraceConvert(TRACEFILE, JSONFILE);
+      if((ndump <= 0) || (nevents != ndump) || !checkMarks(&nmarks) ||
+	 (nmarks > TI_TRACE_RING))
+	{
+	  printf("ERROR: Dump %d: %d records, %d events, %d marks\n",
+		 idump, ndump, nevents, nmarks);
+	  failed = 1;
+	}
+      if(nmarks > 0)
+	markedDumps++;
+    }
+  if(markedDumps == 0)
+    {
+      printf("ERROR: No marks in any dump\n");
+      failed = 1;
+    }
+  marking = 0;
+  pthread_join(thread, NULL);
+
+  /* Spans */
+  tiTraceEnable(0);
+  tiTraceDump(TRACEFILE);
+  tiTracePrintSummary(TRACEFILE);
+  nspans = tiTraceSummary(TRACEFILE, span, TI_TRACE_NPOINTS + 1);
+  for(ispan = 0; ispan < nspans; ispan++)
+    {
+      if(strcmp(span[ispan].name, "work") == 0)
+	foundWork = (span[ispan].count == TI_TRACE_RING / 2 - 1);
+      if(strcmp(span[ispan].name, "tiIntAck") == 0)
+	foundAck = (span[ispan].count == NACK) && (span[ispan].min >= 0.) &&
+	  (span[ispan].max >= span[ispan].mean);
+    }
+  if(!foundWork || !foundAck)
+    {
+      printf("ERROR: Spans: work %s, tiIntAck %s\n",
+	     foundWork ? "ok" : "wrong", foundAck ? "ok" : "wrong");
+      failed = 1;
+    }
+
+  remove(TRACEFILE);
+  remove(JSONFILE);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiTraceTest "
+  End:
+*/
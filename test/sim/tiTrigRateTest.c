@@ -0,0 +1,148 @@
+/*
+ * File:
+ *    tiTrigRateTest.c
+ *
+ * Description:
+ *    Check the trigger rate analyzer with synthetic trigger banks.
+ *    No TI is needed.
+ *      - Poisson triggers held off by rule 1 only: the offered rate is
+ *        recovered and all the loss is put on the holdoff
+ *      - adding a readout busy after every block: the offered rate is
+ *        unchanged and the extra loss goes to other busy
+ *      - bursts are counted
+ *      - format 1 timestamps carried across the 32 bit wrap
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiDecode.h"
+#include "tiRuleSim.h"
+#include "tiTrigRate.h"
+
+#define NTRIG    200000
+#define RATE     100000.
+#define HOLDOFF  4800.
+#define BLOCK    4
+
+/* Accept Poisson triggers with a holdoff, and a busy after every block.
+   Feed them as format 3 (evlen 3) or format 1 (evlen 2) trigger banks. */
+static int
+feed(const uint64_t *t_ns, int n, double busy_ns, int evlen, uint64_t offset)
+{
+  uint32_t bank[2 + BLOCK * 4];
+  uint64_t ts = 0, next = 0;
+  int itrig, iev = 0, naccepted = 0;
+
+  tiDecodeSetEventFormat((evlen == 3) ? 3 : 1);
+
+  for(itrig = 0; itrig < n; itrig++)
+    {
+      if(t_ns[itrig] < next)
+	continue;
+
+      next = t_ns[itrig] + (uint64_t)HOLDOFF;
+      ts = offset + t_ns[itrig] / 4;
+
+      bank[2 + (evlen + 1) * iev] = (1 << 24) | (0x01 << 16) | evlen;
+      bank[3 + (evlen + 1) * iev] = naccepted + 1;
+      bank[4 + (evlen + 1) * iev] = ts & 0xFFFFFFFF;
+      if(evlen == 3)
+	bank[5 + (evlen + 1) * iev] = (ts >> 32) & 0xFFFF;
+      naccepted++;
+
+      if(++iev == BLOCK)
+	{
+	  bank[0] = 1 + BLOCK * (evlen + 1);
+	  bank[1] = 0xFF102000 | BLOCK;
+	  if(tiTrigRateFeed(bank, bank[0] + 1) != BLOCK)
+	    return ERROR;
+	  if(busy_ns > HOLDOFF)
+	    next = t_ns[itrig] + (uint64_t)busy_ns;
+	  iev = 0;
+	}
+    }
+
+  return naccepted;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static uint64_t t_ns[NTRIG];
+  uint64_t ts[64];
+  tiTrigRateStats stats;
+  int failed = 0, its;
+
+  printf("\nJLAB TI Trigger Rate Analyzer\n");
+  printf("----------------------------\n");
+
+  tiRuleSimPoisson(RATE, NTRIG, 7, t_ns);
+
+  /* Holdoff only */
+  tiTrigRateInit(0, 0);
+  tiTrigRateSetHoldoff(HOLDOFF);
+  feed(t_ns, NTRIG, 0, 3, 0);
+  tiTrigRateGetStats(&stats);
+  tiTrigRatePrint();
+  if((fabs(stats.freeRate - RATE) > 0.05 * RATE) ||
+     (fabs(stats.otherLoss) > 0.03) ||
+     (fabs(stats.ruleLoss - 0.48 / 1.48) > 0.03))
+    {
+      printf("ERROR: Holdoff only: offered %.0f Hz, rule loss %.3f, other %.3f\n",
+	     stats.freeRate, stats.ruleLoss, stats.otherLoss);
+      failed = 1;
+    }
+
+  /* 20 us busy after every block */
+  tiTrigRateInit(0, 0);
+  tiTrigRateSetHoldoff(HOLDOFF);
+  feed(t_ns, NTRIG, 20000, 3, 0);
+  tiTrigRateGetStats(&stats);
+  printf("Readout busy: offered %.0f Hz, lost %.3f (rules %.3f, other %.3f)\n",
+	 stats.freeRate, stats.lossFraction, stats.ruleLoss, stats.otherLoss);
+  if((fabs(stats.freeRate - RATE) > 0.1 * RATE) || (stats.otherLoss < 0.1))
+    {
+      printf("ERROR: Readout busy not separated from the holdoff\n");
+      failed = 1;
+    }
+
+  /* 10 bursts of 5 triggers, 100 ns apart, every 1 ms */
+  tiTrigRateInit(1000, 3);
+  for(its = 0; its < 50; its++)
+    ts[its] = (250000 * (its / 5) + 25 * (its % 5));
+  tiTrigRateFeedTimestamps(ts, 50);
+  tiTrigRateGetStats(&stats);
+  if((stats.nbursts != 10) || (stats.maxBurst != 5))
+    {
+      printf("ERROR: %llu bursts, longest %d (expected 10, 5)\n",
+	     (unsigned long long)stats.nbursts, stats.maxBurst);
+      failed = 1;
+    }
+
+  /* Format 1, starting just below the 32 bit wrap */
+  tiTrigRateInit(0, 0);
+  feed(t_ns, 1000, 0, 2, 0xFFFF0000ULL);
+  tiTrigRateGetStats(&stats);
+  if(fabs(stats.elapsed - (t_ns[999] - t_ns[0]) * 1e-9) > 1e-4)
+    {
+      printf("ERROR: Format 1 elapsed %.6f s, expected about %.6f s\n",
+	     stats.elapsed, (t_ns[999] - t_ns[0]) * 1e-9);
+      failed = 1;
+    }
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiTrigRateTest "
+  End:
+*/
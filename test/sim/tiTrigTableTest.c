@@ -0,0 +1,163 @@
+/*
+ * File:
+ *    tiTrigTableTest.c
+ *
+ * Description:
+ *    Check the trigger table compiler, using the simulated VME backend.
+ *      - the predefined tables, and random ones, written as rules
+ *        compile back to the same tables
+ *      - first matching rule, event types and sync
+ *      - invalid rules are rejected
+ *      - TRIGGER_TABLE_EXPR from an ini file is loaded into the TI
+ *
+ *    Returns 0 if successful.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiConfig.h"
+#include "tiTrigTable.h"
+#include "jvmeSim.h"
+
+#define ENTRY(_table, _pat) (((_table)[(_pat) / 4] >> (((_pat) % 4) * 8)) & 0xFF)
+
+int
+main(int argc, char *argv[])
+{
+  volatile struct TI_A24RegStruct *regs = NULL;
+  const char *bad[] =
+    {
+      "TS7 -> trig1",
+      "TS1 -> trig3",
+      "TS1 -> trig1 type 64",
+      "TS1 & (TS2 -> trig1",
+      "TS1 trig1",
+      "TS1 -> trig1 TS2 -> trig2",
+      ""
+    };
+  unsigned int table[16], check[16];
+  char expr[4096], inifile[256];
+  FILE *f = NULL;
+  int failed = 0, mode, ipat, ibad, itable;
+
+  printf("\nJLAB TI Trigger Table Compiler\n");
+  printf("----------------------------\n");
+
+  /* Predefined tables */
+  for(mode = 0; mode < 4; mode++)
+    {
+      tiTriggerTablePredefinedConfig(mode);
+      tiGetTriggerTable(table);
+      if((tiTriggerTableDecompile(table, expr, sizeof(expr)) == ERROR) ||
+	 (tiTriggerTableCompile(expr, check) != OK) ||
+	 (memcmp(table, check, sizeof(table)) != 0))
+	{
+	  printf("ERROR: Mode %d does not compile back from\n%s", mode, expr);
+	  failed = 1;
+	}
+      else
+	printf("Mode %d:\n%s", mode, expr);
+    }
+
+  /* Random tables, a few distinct entries each */
+  srand(1);
+  for(itable = 0; itable < 200; itable++)
+    {
+      unsigned int entries[4];
+      for(ibad = 0; ibad < 4; ibad++)
+	entries[ibad] = rand() & 0xFF;
+
+      memset(table, 0, sizeof(table));
+      for(ipat = 1; ipat < 64; ipat++)
+	table[ipat / 4] |= ((itable & 1) ? ((rand() % 4) << 6 | ipat) : entries[rand() % 4])
+	  << ((ipat % 4) * 8);
+
+      if((tiTriggerTableDecompile(table, expr, sizeof(expr)) == ERROR) ||
+	 (tiTriggerTableCompile(expr, check) != OK) ||
+	 (memcmp(table, check, sizeof(table)) != 0))
+	{
+	  printf("ERROR: Random table %d does not compile back from\n%s", itable, expr);
+	  failed = 1;
+	  break;
+	}
+    }
+
+  /* First match wins, explicit and default event types */
+  if(tiTriggerTableCompile("TS1 & !TS3 -> trig1 type 5; TS4|TS5 -> sync\n"
+			   "# playback\n"
+			   "TS6 -> trig2 type 0x3f", table) != OK)
+    failed = 1;
+  else if((ENTRY(table, 0x01) != 0x45) || (ENTRY(table, 0x05) != 0) ||
+	  (ENTRY(table, 0x09) != 0x45) || (ENTRY(table, 0x0C) != 0xCC) ||
+	  (ENTRY(table, 0x20) != 0xBF) || (ENTRY(table, 0x00) != 0))
+    {
+      printf("ERROR: Unexpected entries 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x\n",
+	     ENTRY(table, 0x01), ENTRY(table, 0x05), ENTRY(table, 0x09),
+	     ENTRY(table, 0x0C), ENTRY(table, 0x20));
+      failed = 1;
+    }
+
+  for(ibad = 0; bad[ibad][0] != '\0'; ibad++)
+    {
+      if(tiTriggerTableCompile(bad[ibad], table) != ERROR)
+	{
+	  printf("ERROR: Accepted \"%s\"\n", bad[ibad]);
+	  failed = 1;
+	}
+    }
+
+  /* From the ini file into the TI */
+  if(jvmeSimInit(JVME_SIM_A24_ADDR, JVME_SIM_FIRMWARE) != OK)
+    exit(1);
+  if(tiInit(JVME_SIM_A24_ADDR, TI_READOUT_EXT_POLL, 0) != OK)
+    exit(1);
+  regs = (volatile struct TI_A24RegStruct *)jvmeSimRegisters();
+
+  snprintf(inifile, sizeof(inifile), "/tmp/tiTrigTableTest.%d.ini", (int)getpid());
+  f = fopen(inifile, "w");
+  if(f == NULL)
+    exit(1);
+  fprintf(f, "[general]\n");
+  fprintf(f, "TRIGGER_TABLE_EXPR= (TS1 | TS2) & !TS3 -> trig1 type 1\n");
+  fprintf(f, "   TS3 -> trig2 type 2\n");
+  fclose(f);
+
+  if(tiConfig(inifile) != OK)
+    {
+      printf("ERROR: tiConfig(%s) failed\n", inifile);
+      failed = 1;
+    }
+  unlink(inifile);
+
+  tiTriggerTableCompile("(TS1 | TS2) & !TS3 -> trig1 type 1\nTS3 -> trig2 type 2", check);
+  if(tiGetTriggerTableMode() != 4)
+    {
+      printf("ERROR: Trigger table mode %d (expected 4)\n", tiGetTriggerTableMode());
+      failed = 1;
+    }
+  for(ipat = 0; ipat < 16; ipat++)
+    {
+      if(regs->trigTable[ipat] != check[ipat])
+	{
+	  printf("ERROR: trigTable[%d] = 0x%08x (expected 0x%08x)\n",
+		 ipat, regs->trigTable[ipat], check[ipat]);
+	  failed = 1;
+	}
+    }
+  tiPrintTriggerTableExpr();
+  tiConfigFree();
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiTrigTableTest "
+  End:
+*/
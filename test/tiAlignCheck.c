@@ -0,0 +1,151 @@
+/*
+ * File:
+ *    tiAlignCheck.c
+ *
+ * Description:
+ *    Check the event alignment of several crates: merge the trigger data
+ *    of their TIs by event number, compare the timestamps, and report the
+ *    first divergence.
+ *
+ *    Usage:
+ *      tiAlignCheck [-t TICKS] [-n EVENTS] [-f] [-F FORMAT] SOURCE SOURCE [SOURCE ...]
+ *
+ *        -t        timestamp tolerance, 4 ns ticks (default: 0)
+ *        -n        stop after this many event numbers
+ *        -f        stop at the first divergence
+ *        -F        event format of the trigger banks (default: 3)
+ *
+ *      SOURCE is a file of trigger banks, a trigger archive directory, or
+ *      HOST:PORT to read trigger banks from a TCP connection.
+ *
+ *    Returns 0 if the crates are aligned.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include "jvme.h"
+#include "tiDecode.h"
+#include "tiAlign.h"
+
+static void
+usage(const char *name)
+{
+  printf("Usage: %s [-t TICKS] [-n EVENTS] [-f] [-F FORMAT] SOURCE SOURCE [SOURCE ...]\n", name);
+  printf("   -t TICKS   timestamp tolerance, 4 ns ticks (default: 0)\n");
+  printf("   -n EVENTS  stop after this many event numbers\n");
+  printf("   -f         stop at the first divergence\n");
+  printf("   -F FORMAT  event format of the trigger banks (default: 3)\n");
+  printf(" SOURCE: file of trigger banks, trigger archive directory, or HOST:PORT\n");
+}
+
+/* Connect to HOST:PORT.  Returns the socket, or -1 */
+static int
+connectTo(const char *source)
+{
+  struct addrinfo hints, *res, *ai;
+  char host[256], *port;
+  int fd = -1;
+
+  snprintf(host, sizeof(host), "%s", source);
+  port = strrchr(host, ':');
+  if(port == NULL)
+    return -1;
+  *port++ = '\0';
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if(getaddrinfo(host, port, &hints, &res) != 0)
+    return -1;
+
+  for(ai = res; ai != NULL; ai = ai->ai_next)
+    {
+      fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if(fd < 0)
+	continue;
+      if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+	break;
+      close(fd);
+      fd = -1;
+    }
+  freeaddrinfo(res);
+
+  return fd;
+}
+
+int
+main(int argc, char *argv[])
+{
+  tiAlignStats stats;
+  struct stat st;
+  unsigned long long maxEvents = 0;
+  unsigned int tolerance = 0;
+  int stopAtFirst = 0, opt, iarg, fd, rval;
+
+  while((opt = getopt(argc, argv, "t:n:fF:h")) != -1)
+    {
+      switch(opt)
+	{
+	case 't': tolerance = strtoul(optarg, NULL, 0); break;
+	case 'n': maxEvents = strtoull(optarg, NULL, 0); break;
+	case 'f': stopAtFirst = 1; break;
+	case 'F':
+	  if(tiDecodeSetEventFormat(atoi(optarg)) != OK)
+	    exit(1);
+	  break;
+	default:
+	  usage(argv[0]);
+	  exit(1);
+	}
+    }
+
+  if(argc - optind < 2)
+    {
+      usage(argv[0]);
+      exit(1);
+    }
+
+  tiAlignInit(tolerance);
+
+  for(iarg = optind; iarg < argc; iarg++)
+    {
+      if(stat(argv[iarg], &st) == 0)
+	{
+	  if(S_ISDIR(st.st_mode))
+	    rval = tiAlignAddArchive(NULL, argv[iarg]);
+	  else
+	    rval = tiAlignAddFile(NULL, argv[iarg]);
+	}
+      else
+	{
+	  fd = connectTo(argv[iarg]);
+	  if(fd < 0)
+	    {
+	      printf("ERROR: Unable to open or connect to %s\n", argv[iarg]);
+	      exit(1);
+	    }
+	  rval = tiAlignAddStream(argv[iarg], fd);
+	}
+
+      if(rval == ERROR)
+	exit(1);
+    }
+
+  rval = tiAlignRun(maxEvents, stopAtFirst, &stats);
+  tiAlignPrintStats(&stats);
+  tiAlignClose();
+
+  exit((rval == OK) ? 0 : 1);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiAlignCheck "
+  End:
+*/
@@ -0,0 +1,311 @@
+/*
+ * File:
+ *    tiConfigFanout.c
+ *
+ * Description:
+ *    Configure and verify many TIs in parallel, each from its own ini file.
+ *
+ *    The TI library keeps one module per process, so each board is
+ *    configured in its own (forked) process.  Timing and verification
+ *    results are returned to the parent through a pipe.
+ *
+ *    Usage:
+ *      tiConfigFanout [-n max_parallel] [-s] ADDR[/MODE]=FILE [ADDR[/MODE]=FILE ...]
+ *
+ *        ADDR  slot number (< 22) or VME A24 address of the TI
+ *        MODE  tiInit readout mode (default: TI_READOUT_EXT_POLL)
+ *        FILE  ini file for the board
+ *        -s    use the simulated VME backend (only when built in test/sim)
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiConfig.h"
+#ifdef TI_SIM
+#include "jvmeSim.h"
+#endif
+
+#define MAX_BOARDS 64
+
+typedef struct
+{
+  unsigned int addr;
+  int          mode;
+  char         filename[256];
+} board_t;
+
+typedef struct
+{
+  int32_t init_rval;
+  int32_t config_rval;
+  int32_t verify_rval;	/* number of mismatched settings, or ERROR */
+  double  init_ms;
+  double  config_ms;
+  double  verify_ms;
+} result_t;
+
+static int useSim = 0;
+
+static double
+msSince(struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return 1e3 * (now.tv_sec - start->tv_sec) + 1e-6 * (now.tv_nsec - start->tv_nsec);
+}
+
+/* Configure a single board.  Runs in the child process. */
+static void
+configureBoard(board_t *board, result_t *result)
+{
+  struct timespec start;
+
+  memset(result, 0, sizeof(result_t));
+  result->config_rval = ERROR;
+  result->verify_rval = ERROR;
+
+#ifdef TI_SIM
+  if(useSim)
+    jvmeSimInit(board->addr, JVME_SIM_FIRMWARE);
+  else
+#endif
+    vmeOpenDefaultWindows();
+
+  /* Not holding vmeBusLock here, that would serialize all of the boards */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  result->init_rval = tiInit(board->addr, board->mode, 0);
+  result->init_ms = msSince(&start);
+  if(result->init_rval != OK)
+    goto CLOSE;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  result->config_rval = tiConfig(board->filename);
+  result->config_ms = msSince(&start);
+  if(result->config_rval != OK)
+    goto CLOSE;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  result->verify_rval = tiConfigVerify();
+  result->verify_ms = msSince(&start);
+
+  tiConfigFree();
+
+ CLOSE:
+#ifdef TI_SIM
+  if(useSim)
+    jvmeSimFree();
+  else
+#endif
+    vmeCloseDefaultWindows();
+}
+
+static int
+parseBoard(const char *arg, board_t *board)
+{
+  const char *eq = strchr(arg, '=');
+  char *end = NULL;
+
+  if(eq == NULL)
+    return ERROR;
+
+  board->addr = strtoul(arg, &end, 0);
+  board->mode = TI_READOUT_EXT_POLL;
+  if(*end == '/')
+    board->mode = strtol(end + 1, &end, 0);
+  if(end != eq)
+    return ERROR;
+
+  if(board->addr < 22)
+    board->addr = board->addr << 19;
+
+  strncpy(board->filename, eq + 1, sizeof(board->filename) - 1);
+  board->filename[sizeof(board->filename) - 1] = '\0';
+
+  return OK;
+}
+
+static void
+usage(const char *name)
+{
+  printf("Usage: %s [-n max_parallel] [-s] ADDR[/MODE]=FILE [ADDR[/MODE]=FILE ...]\n", name);
+  printf("   ADDR  slot number (< 22) or VME A24 address of the TI\n");
+  printf("   MODE  tiInit readout mode (default: %d)\n", TI_READOUT_EXT_POLL);
+  printf("   FILE  ini file for the board\n");
+  printf("   -n    maximum number of boards configured at the same time (default: all)\n");
+  printf("   -s    use the simulated VME backend\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  board_t boards[MAX_BOARDS];
+  result_t results[MAX_BOARDS];
+  pid_t pids[MAX_BOARDS];
+  int pipes[MAX_BOARDS][2];
+  int nboards = 0, maxParallel = MAX_BOARDS, nrunning = 0, inext = 0, ib, opt;
+  int nfailed = 0;
+  double sum_ms = 0, wall_ms = 0;
+  struct timespec start;
+
+  while((opt = getopt(argc, argv, "n:sh")) != -1)
+    {
+      switch(opt)
+	{
+	case 'n':
+	  maxParallel = atoi(optarg);
+	  if(maxParallel <= 0)
+	    maxParallel = 1;
+	  break;
+
+	case 's':
+#ifdef TI_SIM
+	  useSim = 1;
+#else
+	  printf("ERROR: Simulated backend not available in this build\n");
+	  exit(1);
+#endif
+	  break;
+
+	default:
+	  usage(argv[0]);
+	  exit(1);
+	}
+    }
+
+  for(; (optind < argc) && (nboards < MAX_BOARDS); optind++)
+    {
+      if(parseBoard(argv[optind], &boards[nboards]) != OK)
+	{
+	  printf("ERROR: Invalid board specification: %s\n", argv[optind]);
+	  usage(argv[0]);
+	  exit(1);
+	}
+      nboards++;
+    }
+
+  if(nboards == 0)
+    {
+      usage(argv[0]);
+      exit(1);
+    }
+
+  printf("\nJLAB TI Config fan-out: %d board(s), %d at a time\n",
+	 nboards, (maxParallel < nboards) ? maxParallel : nboards);
+  printf("----------------------------\n");
+
+  memset(results, 0, sizeof(results));
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  /* Start children, up to maxParallel at a time, in order */
+  while((inext < nboards) || (nrunning > 0))
+    {
+      if((inext < nboards) && (nrunning < maxParallel))
+	{
+	  if(pipe(pipes[inext]) < 0)
+	    {
+	      perror("pipe");
+	      exit(1);
+	    }
+
+	  fflush(stdout);
+	  pids[inext] = fork();
+	  if(pids[inext] < 0)
+	    {
+	      perror("fork");
+	      exit(1);
+	    }
+
+	  if(pids[inext] == 0)
+	    {
+	      result_t result;
+
+	      close(pipes[inext][0]);
+	      configureBoard(&boards[inext], &result);
+	      if(write(pipes[inext][1], &result, sizeof(result)) != sizeof(result))
+		perror("write");
+	      close(pipes[inext][1]);
+	      _exit(0);
+	    }
+
+	  close(pipes[inext][1]);
+	  inext++;
+	  nrunning++;
+	  continue;
+	}
+
+      /* Wait for any of them to finish */
+      {
+	int status = 0;
+	pid_t done = wait(&status);
+
+	if(done < 0)
+	  break;
+
+	for(ib = 0; ib < inext; ib++)
+	  {
+	    if(pids[ib] == done)
+	      {
+		results[ib].init_rval = ERROR;
+		results[ib].config_rval = ERROR;
+		results[ib].verify_rval = ERROR;
+		if(read(pipes[ib][0], &results[ib], sizeof(result_t)) != sizeof(result_t))
+		  printf("ERROR: No result from board 0x%06x (%s)\n",
+			 boards[ib].addr, boards[ib].filename);
+		close(pipes[ib][0]);
+		nrunning--;
+		break;
+	      }
+	  }
+      }
+    }
+
+  wall_ms = msSince(&start);
+
+  printf("\n");
+  printf("  Address   Init(ms) Config(ms) Verify(ms)  Status   File\n");
+  printf("--------------------------------------------------------------------------------\n");
+  for(ib = 0; ib < nboards; ib++)
+    {
+      result_t *r = &results[ib];
+      const char *status = "OK";
+
+      if(r->init_rval != OK)
+	status = "INIT ERR";
+      else if(r->config_rval != OK)
+	status = "CFG ERR";
+      else if(r->verify_rval == ERROR)
+	status = "RD ERR";
+      else if(r->verify_rval > 0)
+	status = "MISMATCH";
+
+      if(strcmp(status, "OK") != 0)
+	nfailed++;
+
+      sum_ms += r->init_ms + r->config_ms + r->verify_ms;
+
+      printf("  0x%06x  %9.1f  %9.1f  %9.1f  %-8s %s\n",
+	     boards[ib].addr, r->init_ms, r->config_ms, r->verify_ms,
+	     status, boards[ib].filename);
+    }
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Total: %.1f ms  (%.1f ms if done serially)   %d of %d board(s) failed\n\n",
+	 wall_ms, sum_ms, nfailed, nboards);
+
+  exit(nfailed ? 1 : 0);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiConfigFanout "
+  End:
+*/
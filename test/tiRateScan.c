@@ -0,0 +1,118 @@
+/*
+ * File:
+ *    tiRateScan.c
+ *
+ * Description:
+ *    Throughput versus offered rate with the TI internal pulser.
+ *
+ *    Attaches to a TI that is already configured and taking data (with
+ *    the pulser as trigger source), steps the pulser through the rates
+ *    and prints (or writes) the accepted rate, live time and dominant
+ *    busy source at each rate.
+ *
+ *    Usage:
+ *      tiRateScan [-a ADDR] [-x] [-d DWELL_MS] [-o CSVFILE] [-l START,STOP,N] [RATE ...]
+ *
+ *        -a ADDR   slot number (< 22) or VME A24 address of the TI (default: 0, find it)
+ *        -x        use the random pulser instead of the fixed period pulser
+ *        -d        time at each rate in ms (default 1000)
+ *        -o        write the curve to CSVFILE
+ *        -l        N rates, logarithmically spaced from START to STOP Hz
+ *        RATE      rates in Hz
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <math.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiRateScan.h"
+
+#define MAX_RATES 256
+
+static void
+usage(const char *name)
+{
+  printf("Usage: %s [-a ADDR] [-x] [-d DWELL_MS] [-o CSVFILE] [-l START,STOP,N] [RATE ...]\n",
+	 name);
+  printf("   -a ADDR   slot number (< 22) or VME A24 address of the TI\n");
+  printf("   -x        random pulser (default: fixed period pulser)\n");
+  printf("   -d MS     time at each rate (default 1000)\n");
+  printf("   -o FILE   write the curve as comma separated values\n");
+  printf("   -l START,STOP,N  N logarithmically spaced rates (Hz)\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  static double rates[MAX_RATES];
+  static tiRateScanStep steps[MAX_RATES];
+  unsigned int addr = 0;
+  double start = 0, stop = 0;
+  int pulser = TI_RATESCAN_FIXED, dwell = 1000, nrates = 0, nlog = 0, opt, irate, nsteps = 0;
+  char *outfile = NULL;
+
+  while((opt = getopt(argc, argv, "a:xd:o:l:h")) != -1)
+    {
+      switch(opt)
+	{
+	case 'a': addr = strtoul(optarg, NULL, 0); break;
+	case 'x': pulser = TI_RATESCAN_RANDOM; break;
+	case 'd': dwell = atoi(optarg); break;
+	case 'o': outfile = optarg; break;
+	case 'l':
+	  if((sscanf(optarg, "%lf,%lf,%d", &start, &stop, &nlog) != 3) ||
+	     (start <= 0) || (stop <= 0) || (nlog < 1) || (nlog > MAX_RATES))
+	    {
+	      usage(argv[0]);
+	      exit(1);
+	    }
+	  for(irate = 0; irate < nlog; irate++)
+	    rates[nrates++] = (nlog == 1) ? start :
+	      start * pow(stop / start, (double)irate / (nlog - 1));
+	  break;
+
+	default:
+	  usage(argv[0]);
+	  exit(1);
+	}
+    }
+
+  for(; (optind < argc) && (nrates < MAX_RATES); optind++)
+    rates[nrates++] = atof(argv[optind]);
+
+  if(nrates == 0)
+    {
+      usage(argv[0]);
+      exit(1);
+    }
+
+  if(vmeOpenDefaultWindows() != OK)
+    exit(1);
+
+  /* Attach to the running TI, without changing its configuration */
+  if(tiInit(addr, TI_READOUT_EXT_POLL, TI_INIT_NO_INIT) != OK)
+    goto CLOSE;
+
+  nsteps = tiRateScanRun(pulser, rates, nrates, dwell, steps);
+  if(nsteps > 0)
+    {
+      tiRateScanPrint(steps, nsteps);
+      if(outfile)
+	tiRateScanWrite(outfile, steps, nsteps);
+    }
+
+ CLOSE:
+  vmeCloseDefaultWindows();
+
+  exit((nsteps == nrates) ? 0 : 1);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiRateScan "
+  End:
+*/
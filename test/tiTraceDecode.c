@@ -0,0 +1,82 @@
+/*
+ * File:
+ *    tiTraceDecode.c
+ *
+ * Description:
+ *    Decode a binary trace file from tiTraceDump.  Writes it in the
+ *    Chrome trace event format (open with chrome://tracing or
+ *    ui.perfetto.dev), and prints the latency of each span.
+ *
+ *    Usage:
+ *      tiTraceDecode [-s] [-o JSONFILE] TRACEFILE
+ *
+ *        -s        only print the span latencies
+ *        -o        Chrome trace output (default: TRACEFILE.json)
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "jvme.h"
+#include "tiTrace.h"
+
+static void
+usage(const char *name)
+{
+  printf("Usage: %s [-s] [-o JSONFILE] TRACEFILE\n", name);
+  printf("   -s        only print the span latencies\n");
+  printf("   -o FILE   Chrome trace output (default: TRACEFILE.json)\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *tracefile = NULL, *jsonfile = NULL, defjson[1024];
+  int summaryOnly = 0, opt, nevents = 0;
+
+  while((opt = getopt(argc, argv, "so:h")) != -1)
+    {
+      switch(opt)
+	{
+	case 's': summaryOnly = 1; break;
+	case 'o': jsonfile = optarg; break;
+	default:
+	  usage(argv[0]);
+	  exit(1);
+	}
+    }
+
+  if(optind != argc - 1)
+    {
+      usage(argv[0]);
+      exit(1);
+    }
+  tracefile = argv[optind];
+
+  if(!summaryOnly)
+    {
+      if(jsonfile == NULL)
+	{
+	  snprintf(defjson, sizeof(defjson), "%s.json", tracefile);
+	  jsonfile = defjson;
+	}
+
+      nevents = tiTraceConvert(tracefile, jsonfile);
+      if(nevents == ERROR)
+	exit(1);
+      printf("Wrote %d events to %s\n", nevents, jsonfile);
+    }
+
+  if(tiTracePrintSummary(tracefile) != OK)
+    exit(1);
+
+  exit(0);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiTraceDecode "
+  End:
+*/
@@ -0,0 +1,226 @@
+/*
+ * File:
+ *    tiTriggerRuleSim.c
+ *
+ * Description:
+ *    Offline model of the TI trigger rules.  Computes the accepted rate,
+ *    dead time and front end buffer occupancy of a rule set, for Poisson
+ *    triggers or recorded trigger times, and optionally searches for the
+ *    rule set with the highest accepted rate that does not overflow the
+ *    front end buffers.  No TI is needed.
+ *
+ *    Usage:
+ *      tiTriggerRuleSim [-r RATE -n N] [-f TEXTFILE] [-b BANKFILE [-F FORMAT]]
+ *                       [-1 V[,T[,M]]] ... [-4 V[,T[,M]]]
+ *                       [-d DEPTH] [-t READOUT_NS] [-o]
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiDecode.h"
+#include "tiRuleSim.h"
+
+#define MAX_TRIGGERS (4*1024*1024)
+
+static void
+usage(const char *name)
+{
+  printf("Usage: %s [options]\n", name);
+  printf(" Trigger times (one of):\n");
+  printf("   -r RATE       Poisson triggers at RATE Hz (default 100000)\n");
+  printf("   -n N          number of Poisson triggers (default 200000)\n");
+  printf("   -s SEED       random seed\n");
+  printf("   -f TEXTFILE   arrival times in ns, one per line\n");
+  printf("   -b BANKFILE   trigger banks from tiReadTriggerBlock (binary, event format 1 or 3)\n");
+  printf("   -F FORMAT     event format of BANKFILE (default 3)\n");
+  printf(" Rules:\n");
+  printf("   -1..-4 V[,T[,M]]  rule value, timestep (0-2) and minimum (rules 2-4)\n");
+  printf("   -o            search for the best rule set instead\n");
+  printf(" Front end:\n");
+  printf("   -d DEPTH      buffer depth in events (default 4)\n");
+  printf("   -t NS         readout time per event in ns (default 8000)\n");
+}
+
+static int
+readText(const char *filename, uint64_t *t_ns, int max)
+{
+  FILE *f = fopen(filename, "r");
+  unsigned long long t = 0;
+  int n = 0;
+
+  if(f == NULL)
+    {
+      perror("fopen");
+      return ERROR;
+    }
+
+  while((n < max) && (fscanf(f, "%llu", &t) == 1))
+    t_ns[n++] = t;
+
+  fclose(f);
+  return n;
+}
+
+static int
+readBanks(const char *filename, uint64_t *t_ns, int max)
+{
+  FILE *f = fopen(filename, "rb");
+  uint32_t *data = NULL;
+  long size = 0;
+  int nwords = 0, n = 0, i;
+
+  if(f == NULL)
+    {
+      perror("fopen");
+      return ERROR;
+    }
+
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  data = (uint32_t *)malloc(size);
+  if(data == NULL)
+    {
+      fclose(f);
+      return ERROR;
+    }
+  nwords = fread(data, sizeof(uint32_t), size / sizeof(uint32_t), f);
+  fclose(f);
+
+  n = tiDecodeTimestamps(data, nwords, t_ns, max);
+  free(data);
+
+  /* 4 ns ticks, relative to the first trigger */
+  for(i = n - 1; i >= 0; i--)
+    t_ns[i] = (t_ns[i] - t_ns[0]) * TI_DECODE_TIMESTAMP_NS;
+
+  return n;
+}
+
+static int
+parseRule(const char *arg, tiRuleSet *rules, int irule)
+{
+  int v = 0, t = 0, m = 0, nf = 0;
+
+  nf = sscanf(arg, "%d,%d,%d", &v, &t, &m);
+  if(nf < 1)
+    return ERROR;
+
+  rules->value[irule] = v;
+  rules->timestep[irule] = (nf > 1) ? t : 0;
+  rules->minValue[irule] = (nf > 2) ? m : 0;
+
+  return OK;
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64_t *t_ns = NULL;
+  tiRuleSet rules, best;
+  tiRuleSimResult result;
+  double rate = 100000, readout = 8000;
+  int n = 200000, depth = 4, optimize = 0, opt, ntrig = 0;
+  uint32_t seed = 0;
+  char *textfile = NULL, *bankfile = NULL;
+
+  memset(&rules, 0, sizeof(rules));
+
+  while((opt = getopt(argc, argv, "r:n:s:f:b:F:1:2:3:4:od:t:h")) != -1)
+    {
+      switch(opt)
+	{
+	case 'r': rate = atof(optarg); break;
+	case 'n': n = atoi(optarg); break;
+	case 's': seed = strtoul(optarg, NULL, 0); break;
+	case 'f': textfile = optarg; break;
+	case 'b': bankfile = optarg; break;
+	case 'F':
+	  if(tiDecodeSetEventFormat(atoi(optarg)) != OK)
+	    exit(1);
+	  break;
+	case 'o': optimize = 1; break;
+	case 'd': depth = atoi(optarg); break;
+	case 't': readout = atof(optarg); break;
+
+	case '1':
+	case '2':
+	case '3':
+	case '4':
+	  if(parseRule(optarg, &rules, opt - '1') != OK)
+	    {
+	      usage(argv[0]);
+	      exit(1);
+	    }
+	  break;
+
+	default:
+	  usage(argv[0]);
+	  exit(1);
+	}
+    }
+
+  if((n <= 0) || (n > MAX_TRIGGERS))
+    n = MAX_TRIGGERS;
+
+  t_ns = (uint64_t *)malloc(MAX_TRIGGERS * sizeof(uint64_t));
+  if(t_ns == NULL)
+    {
+      perror("malloc");
+      exit(1);
+    }
+
+  if(textfile)
+    ntrig = readText(textfile, t_ns, MAX_TRIGGERS);
+  else if(bankfile)
+    ntrig = readBanks(bankfile, t_ns, MAX_TRIGGERS);
+  else if(tiRuleSimPoisson(rate, n, seed, t_ns) == OK)
+    ntrig = n;
+
+  if(ntrig <= 0)
+    {
+      printf("ERROR: No trigger times\n");
+      free(t_ns);
+      exit(1);
+    }
+
+  printf("\nJLAB TI Trigger Rule Model\n");
+  printf("----------------------------\n");
+  printf("  %d triggers, front end depth %d, readout %.0f ns\n", ntrig, depth, readout);
+
+  if(optimize)
+    {
+      if(tiRuleSimOptimize(t_ns, ntrig, depth, readout, &best, &result) != OK)
+	{
+	  free(t_ns);
+	  exit(1);
+	}
+      printf("\n Best rule set:\n");
+      tiRuleSimPrint(&best, &result);
+    }
+  else
+    {
+      if(tiRuleSimRun(&rules, t_ns, ntrig, depth, readout, &result) != OK)
+	{
+	  free(t_ns);
+	  exit(1);
+	}
+      tiRuleSimPrint(&rules, &result);
+    }
+
+  free(t_ns);
+  exit(0);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k tiTriggerRuleSim "
+  End:
+*/
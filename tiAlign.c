@@ -0,0 +1,658 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Cross-crate event alignment check (Linux).
+ *
+ *     Sources, one per TI:
+ *       stream   trigger banks as returned by tiReadTriggerBlock (bank
+ *                length word first, host byte order), read from a file
+ *                descriptor: a file, a pipe or a socket
+ *       archive  a trigger archive directory (tiArchiveStart)
+ *
+ *     Each source is read in batches of event numbers and timestamps.  The
+ *     head event of every source is kept in a min-heap on the event
+ *     number: the sources holding the smallest event number are popped
+ *     together, compared, advanced and pushed back.  The check starts at
+ *     the first event number found in every source (captures start at
+ *     different times), and stops when a source ends.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiDecode.h"
+#include "tiArchive.h"
+#include "tiAlign.h"
+
+/**
+ * @defgroup Align Cross-Crate Alignment
+ *   Merge the trigger data of several TIs by event number, and check
+ *   that their timestamps agree.
+ */
+
+#define TI_ALIGN_STREAM    0
+#define TI_ALIGN_ARCHIVE   1
+
+#define TI_ALIGN_BUFWORDS  (256*1024)  /* stream read buffer, largest bank */
+#define TI_ALIGN_BATCH     4096        /* events decoded at a time */
+#define TI_ALIGN_MAXLEVEL  256         /* events in a bank */
+
+typedef struct tiAlignSource
+{
+  char            name[TI_ALIGN_NAMELEN];
+  int             type;
+  int             ended;
+  int             failed;
+
+  /* Events of the current batch */
+  const uint64_t *evnum;
+  const uint64_t *timestamp;
+  uint32_t        n, pos;
+  int             noTimestamp;
+
+  /* stream */
+  int             fd, ownFd;
+  uint32_t       *words;
+  size_t          nbytes;        /* bytes in words */
+  uint32_t        wpos;          /* next bank */
+  uint64_t       *evbuf, *tsbuf;
+
+  /* archive */
+  tiArchiveReader reader;
+  int             chunk;
+} tiAlignSource;
+
+typedef struct tiAlignHead
+{
+  uint64_t evnum;
+  int      src;
+} tiAlignHead;
+
+static tiAlignSource *alSource[TI_ALIGN_MAXSOURCES];
+static int            alNsources = 0;
+static uint32_t       alTolerance = 0;
+
+static tiAlignHead    alHeap[TI_ALIGN_MAXSOURCES];
+static int            alHeapSize = 0;
+
+/**
+ * @ingroup Align
+ * @brief Start a new check, without sources
+ *
+ * @param tolerance  Largest timestamp difference accepted (4 ns ticks)
+ *
+ * @return OK
+ */
+int
+tiAlignInit(uint32_t tolerance)
+{
+  tiAlignClose();
+  alTolerance = tolerance;
+
+  return OK;
+}
+
+static tiAlignSource *
+tiAlignNewSource(const char *name, int type)
+{
+  tiAlignSource *s;
+
+  if(alNsources >= TI_ALIGN_MAXSOURCES)
+    {
+      printf("%s: ERROR: Too many sources (%d)\n", __func__, TI_ALIGN_MAXSOURCES);
+      return NULL;
+    }
+
+  s = (tiAlignSource *)calloc(1, sizeof(tiAlignSource));
+  if(s == NULL)
+    {
+      printf("%s: ERROR: Unable to allocate source\n", __func__);
+      return NULL;
+    }
+
+  snprintf(s->name, sizeof(s->name), "%s", name ? name : "");
+  s->type = type;
+  s->fd = -1;
+
+  return s;
+}
+
+static void
+tiAlignFreeSource(tiAlignSource *s)
+{
+  if(s->type == TI_ALIGN_ARCHIVE)
+    tiArchiveClose(&s->reader);
+  if(s->ownFd && (s->fd >= 0))
+    close(s->fd);
+  if(s->words)
+    free(s->words);
+  if(s->evbuf)
+    free(s->evbuf);
+  if(s->tsbuf)
+    free(s->tsbuf);
+  free(s);
+}
+
+/**
+ * @ingroup Align
+ * @brief Add a source of trigger banks read from a file descriptor
+ *
+ * @param name  Name used in the report
+ * @param fd    File, pipe or socket.  Not closed by tiAlignClose.
+ *
+ * @return Source number if successful, otherwise ERROR
+ */
+int
+tiAlignAddStream(const char *name, int fd)
+{
+  tiAlignSource *s;
+
+  if(fd < 0)
+    {
+      printf("%s: ERROR: Invalid file descriptor\n", __func__);
+      return ERROR;
+    }
+
+  s = tiAlignNewSource(name, TI_ALIGN_STREAM);
+  if(s == NULL)
+    return ERROR;
+
+  s->fd = fd;
+  s->words = (uint32_t *)malloc(TI_ALIGN_BUFWORDS * sizeof(uint32_t));
+  s->evbuf = (uint64_t *)malloc(TI_ALIGN_BATCH * sizeof(uint64_t));
+  s->tsbuf = (uint64_t *)malloc(TI_ALIGN_BATCH * sizeof(uint64_t));
+  if((s->words == NULL) || (s->evbuf == NULL) || (s->tsbuf == NULL))
+    {
+      printf("%s: ERROR: Unable to allocate buffers\n", __func__);
+      tiAlignFreeSource(s);
+      return ERROR;
+    }
+  s->evnum = s->evbuf;
+  s->timestamp = s->tsbuf;
+
+  alSource[alNsources] = s;
+
+  return alNsources++;
+}
+
+/**
+ * @ingroup Align
+ * @brief Add a source of trigger banks read from a file
+ *
+ * @param name      Name used in the report, filename if NULL
+ * @param filename  File of trigger banks
+ *
+ * @return Source number if successful, otherwise ERROR
+ */
+int
+tiAlignAddFile(const char *name, const char *filename)
+{
+  int fd, isrc;
+
+  if(filename == NULL)
+    {
+      printf("%s: ERROR: Invalid filename\n", __func__);
+      return ERROR;
+    }
+
+  fd = open(filename, O_RDONLY);
+  if(fd < 0)
+    {
+      printf("%s: ERROR: Unable to open %s\n", __func__, filename);
+      return ERROR;
+    }
+
+  isrc = tiAlignAddStream(name ? name : filename, fd);
+  if(isrc == ERROR)
+    {
+      close(fd);
+      return ERROR;
+    }
+  alSource[isrc]->ownFd = 1;
+
+  return isrc;
+}
+
+/**
+ * @ingroup Align
+ * @brief Add a trigger archive as a source
+ *
+ * @param name  Name used in the report, dir if NULL
+ * @param dir   Archive directory
+ *
+ * @return Source number if successful, otherwise ERROR
+ */
+int
+tiAlignAddArchive(const char *name, const char *dir)
+{
+  tiAlignSource *s;
+
+  s = tiAlignNewSource(name ? name : dir, TI_ALIGN_ARCHIVE);
+  if(s == NULL)
+    return ERROR;
+
+  if(tiArchiveOpen(dir, &s->reader) != OK)
+    {
+      free(s);
+      return ERROR;
+    }
+  s->chunk = -1;
+
+  alSource[alNsources] = s;
+
+  return alNsources++;
+}
+
+/**
+ * @ingroup Align
+ * @brief Remove the sources, closing the files opened by tiAlignAddFile
+ *
+ * @return OK
+ */
+int
+tiAlignClose()
+{
+  int isrc;
+
+  for(isrc = 0; isrc < alNsources; isrc++)
+    tiAlignFreeSource(alSource[isrc]);
+  alNsources = 0;
+  alHeapSize = 0;
+
+  return OK;
+}
+
+/* Read more of the stream, after the unused words.  Returns bytes read,
+   0 at the end of the stream, -1 on error */
+static ssize_t
+tiAlignFill(tiAlignSource *s)
+{
+  size_t keep = s->nbytes - s->wpos * sizeof(uint32_t);
+  ssize_t r;
+
+  if(s->wpos > 0)
+    {
+      memmove(s->words, &s->words[s->wpos], keep);
+      s->nbytes = keep;
+      s->wpos = 0;
+    }
+
+  do
+    r = read(s->fd, (uint8_t *)s->words + s->nbytes,
+	     TI_ALIGN_BUFWORDS * sizeof(uint32_t) - s->nbytes);
+  while((r < 0) && (errno == EINTR));
+
+  if(r > 0)
+    s->nbytes += r;
+
+  return r;
+}
+
+static void
+tiAlignRefillStream(tiAlignSource *s)
+{
+  tiDecodedEvent ev[TI_ALIGN_MAXLEVEL];
+  uint32_t avail, blen;
+  int nev, nused, iev;
+  ssize_t r;
+
+  s->n = s->pos = 0;
+
+  while(s->n + TI_ALIGN_MAXLEVEL <= TI_ALIGN_BATCH)
+    {
+      avail = s->nbytes / sizeof(uint32_t) - s->wpos;
+      if(avail >= 1)
+	{
+	  blen = s->words[s->wpos];
+	  if(blen >= TI_ALIGN_BUFWORDS)
+	    {
+	      printf("%s: ERROR: %s: Invalid bank length (%u)\n", __func__, s->name, blen);
+	      s->failed = s->ended = 1;
+	      return;
+	    }
+
+	  if(blen + 1 <= avail)
+	    {
+	      nev = tiDecodeTriggerBank(&s->words[s->wpos], avail, ev, TI_ALIGN_MAXLEVEL, &nused);
+	      if(nev == ERROR)
+		{
+		  printf("%s: ERROR: %s: Invalid trigger bank\n", __func__, s->name);
+		  s->failed = s->ended = 1;
+		  return;
+		}
+
+	      for(iev = 0; iev < nev; iev++)
+		{
+		  s->evbuf[s->n] = ev[iev].evnum;
+		  s->tsbuf[s->n] = ev[iev].timestamp;
+		  if(!ev[iev].hasTimestamp)
+		    s->noTimestamp = 1;
+		  s->n++;
+		}
+	      s->wpos += nused;
+	      continue;
+	    }
+	}
+
+      /* Hand over the events decoded, before waiting for more */
+      if(s->n > 0)
+	return;
+
+      r = tiAlignFill(s);
+      if(r <= 0)
+	{
+	  if((r < 0) || (s->nbytes != s->wpos * sizeof(uint32_t)))
+	    {
+	      printf("%s: ERROR: %s: %s\n", __func__, s->name,
+		     (r < 0) ? strerror(errno) : "Stream ends inside a bank");
+	      s->failed = 1;
+	    }
+	  s->ended = 1;
+	  return;
+	}
+    }
+}
+
+static void
+tiAlignRefillArchive(tiAlignSource *s)
+{
+  tiArchiveColumns cols;
+
+  s->n = s->pos = 0;
+
+  if(++s->chunk >= s->reader.nchunks)
+    {
+      s->ended = 1;
+      return;
+    }
+
+  tiArchiveChunk(&s->reader, s->chunk, &cols);
+  s->evnum = cols.evnum;
+  s->timestamp = cols.timestamp;
+  s->n = cols.rows;
+}
+
+/* Make the head event of the source available.  Returns 0 at the end */
+static inline int
+tiAlignNext(tiAlignSource *s)
+{
+  while(s->pos >= s->n)
+    {
+      if(s->ended)
+	return 0;
+      if(s->type == TI_ALIGN_STREAM)
+	tiAlignRefillStream(s);
+      else
+	tiAlignRefillArchive(s);
+    }
+
+  return 1;
+}
+
+static inline int
+tiAlignHeadLess(const tiAlignHead *a, const tiAlignHead *b)
+{
+  return (a->evnum < b->evnum) || ((a->evnum == b->evnum) && (a->src < b->src));
+}
+
+static inline void
+tiAlignPush(uint64_t evnum, int src)
+{
+  int i = alHeapSize++, parent;
+  tiAlignHead h = { evnum, src };
+
+  while(i > 0)
+    {
+      parent = (i - 1) / 2;
+      if(!tiAlignHeadLess(&h, &alHeap[parent]))
+	break;
+      alHeap[i] = alHeap[parent];
+      i = parent;
+    }
+  alHeap[i] = h;
+}
+
+static inline tiAlignHead
+tiAlignPop()
+{
+  tiAlignHead top = alHeap[0], last = alHeap[--alHeapSize];
+  int i = 0, child;
+
+  while((child = 2 * i + 1) < alHeapSize)
+    {
+      if((child + 1 < alHeapSize) && tiAlignHeadLess(&alHeap[child + 1], &alHeap[child]))
+	child++;
+      if(!tiAlignHeadLess(&alHeap[child], &last))
+	break;
+      alHeap[i] = alHeap[child];
+      i = child;
+    }
+  alHeap[i] = last;
+
+  return top;
+}
+
+static void
+tiAlignDiverge(tiAlignStats *stats, int kind, int src, uint64_t evnum, uint64_t timestamp,
+	       int refSource, uint64_t reference)
+{
+  switch(kind)
+    {
+    case TI_ALIGN_MISSING:   stats->missing++;   break;
+    case TI_ALIGN_TIMESTAMP: stats->timestamp++; break;
+    case TI_ALIGN_ORDER:     stats->order++;     break;
+    }
+
+  if(stats->diverged)
+    return;
+
+  stats->diverged = 1;
+  stats->first.kind = kind;
+  stats->first.source = src;
+  stats->first.evnum = evnum;
+  stats->first.timestamp = timestamp;
+  stats->first.refSource = refSource;
+  stats->first.reference = reference;
+}
+
+/**
+ * @ingroup Align
+ * @brief Merge the sources by event number and check their alignment
+ *
+ * @param maxEvents    Stop after this many event numbers (0: until a source ends)
+ * @param stopAtFirst  Stop at the first divergence
+ * @param stats        Where to store the results
+ *
+ * @return OK if the sources are aligned, ERROR if they diverge or on error
+ */
+int
+tiAlignRun(uint64_t maxEvents, int stopAtFirst, tiAlignStats *stats)
+{
+  tiAlignSource *s;
+  tiAlignHead h;
+  struct timespec t0, t1;
+  int matched[TI_ALIGN_MAXSOURCES], present[TI_ALIGN_MAXSOURCES];
+  int isrc, im, nmatched, ref, alive, ok, failed = 0;
+  uint64_t evnum, refTs, ts, diff;
+
+  if((stats == NULL) || (alNsources < 2))
+    {
+      printf("%s: ERROR: Need at least 2 sources\n", __func__);
+      return ERROR;
+    }
+
+  memset(stats, 0, sizeof(*stats));
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  /* Start at the first event number found in every source */
+  for(isrc = 0; isrc < alNsources; isrc++)
+    {
+      s = alSource[isrc];
+      if(!tiAlignNext(s))
+	{
+	  printf("%s: ERROR: %s: No events\n", __func__, s->name);
+	  return ERROR;
+	}
+      if(s->evnum[s->pos] > stats->firstEvnum)
+	stats->firstEvnum = s->evnum[s->pos];
+    }
+
+  alHeapSize = 0;
+  alive = 1;
+  for(isrc = 0; isrc < alNsources; isrc++)
+    {
+      s = alSource[isrc];
+      while(tiAlignNext(s) && (s->evnum[s->pos] < stats->firstEvnum))
+	s->pos++;
+      if(s->pos >= s->n)
+	alive = 0;
+      else
+	tiAlignPush(s->evnum[s->pos], isrc);
+      present[isrc] = 0;
+    }
+
+  while(alive && ((maxEvents == 0) || (stats->events < maxEvents)))
+    {
+      /* Sources with the smallest event number */
+      evnum = alHeap[0].evnum;
+      nmatched = 0;
+      while((alHeapSize > 0) && (alHeap[0].evnum == evnum))
+	{
+	  h = tiAlignPop();
+	  matched[nmatched++] = h.src;
+	  present[h.src] = 1;
+	}
+      stats->events++;
+      ok = 1;
+
+      ref = matched[0];
+      s = alSource[ref];
+      refTs = s->timestamp[s->pos];
+
+      if(nmatched < alNsources)
+	{
+	  for(isrc = 0; isrc < alNsources; isrc++)
+	    if(!present[isrc])
+	      tiAlignDiverge(stats, TI_ALIGN_MISSING, isrc, evnum, 0, ref, refTs);
+	  ok = 0;
+	}
+
+      for(im = 1; im < nmatched; im++)
+	{
+	  s = alSource[matched[im]];
+	  if(s->noTimestamp || alSource[ref]->noTimestamp)
+	    continue;
+	  ts = s->timestamp[s->pos];
+	  diff = (ts > refTs) ? (ts - refTs) : (refTs - ts);
+	  if(diff > alTolerance)
+	    {
+	      tiAlignDiverge(stats, TI_ALIGN_TIMESTAMP, matched[im], evnum, ts, ref, refTs);
+	      ok = 0;
+	    }
+	}
+
+      if(ok)
+	stats->aligned++;
+
+      /* Advance past the event number */
+      for(im = 0; im < nmatched; im++)
+	{
+	  isrc = matched[im];
+	  s = alSource[isrc];
+	  present[isrc] = 0;
+	  s->pos++;
+	  while(tiAlignNext(s) && (s->evnum[s->pos] <= evnum))
+	    {
+	      tiAlignDiverge(stats, TI_ALIGN_ORDER, isrc, s->evnum[s->pos], s->timestamp[s->pos],
+			     isrc, evnum);
+	      s->pos++;
+	    }
+	  if(s->pos >= s->n)
+	    alive = 0;
+	  else
+	    tiAlignPush(s->evnum[s->pos], isrc);
+	}
+
+      if(stopAtFirst && stats->diverged)
+	break;
+    }
+
+  for(isrc = 0; isrc < alNsources; isrc++)
+    if(alSource[isrc]->failed)
+      failed = 1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  stats->elapsed_s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+  return (failed || stats->diverged) ? ERROR : OK;
+}
+
+static const char *
+tiAlignSourceName(int isrc)
+{
+  return ((isrc >= 0) && (isrc < alNsources)) ? alSource[isrc]->name : "?";
+}
+
+/**
+ * @ingroup Align
+ * @brief Print the results of tiAlignRun
+ *
+ * @param stats  From tiAlignRun
+ */
+void
+tiAlignPrintStats(const tiAlignStats *stats)
+{
+  const tiAlignDivergence *d;
+  static const char *kind[] = { "", "Missing", "Timestamp", "Order" };
+  int isrc;
+
+  if(stats == NULL)
+    return;
+
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Alignment of %d sources, timestamp tolerance %u ticks\n", alNsources, alTolerance);
+  for(isrc = 0; isrc < alNsources; isrc++)
+    printf("    %2d  %s%s\n", isrc, alSource[isrc]->name,
+	   alSource[isrc]->failed ? "  (read error)" : "");
+  printf("\n");
+  printf("  First event number   %llu\n", (unsigned long long)stats->firstEvnum);
+  printf("  Event numbers        %llu  (%.2f M/s)\n", (unsigned long long)stats->events,
+	 (stats->elapsed_s > 0.) ? (stats->events / stats->elapsed_s * 1e-6) : 0.);
+  printf("  Aligned              %llu\n", (unsigned long long)stats->aligned);
+  printf("  Missing              %llu\n", (unsigned long long)stats->missing);
+  printf("  Timestamp            %llu\n", (unsigned long long)stats->timestamp);
+  printf("  Order                %llu\n", (unsigned long long)stats->order);
+
+  if(stats->diverged)
+    {
+      d = &stats->first;
+      printf("\n  First divergence: %s at event number %llu\n", kind[d->kind],
+	     (unsigned long long)d->evnum);
+      switch(d->kind)
+	{
+	case TI_ALIGN_MISSING:
+	  printf("    %-24s timestamp 0x%012llx\n", tiAlignSourceName(d->refSource),
+		 (unsigned long long)d->reference);
+	  printf("    %-24s missing\n", tiAlignSourceName(d->source));
+	  break;
+	case TI_ALIGN_TIMESTAMP:
+	  printf("    %-24s timestamp 0x%012llx\n", tiAlignSourceName(d->refSource),
+		 (unsigned long long)d->reference);
+	  printf("    %-24s timestamp 0x%012llx  (%+lld ticks)\n", tiAlignSourceName(d->source),
+		 (unsigned long long)d->timestamp,
+		 (long long)(d->timestamp - d->reference));
+	  break;
+	case TI_ALIGN_ORDER:
+	  printf("    %-24s event number %llu after %llu\n", tiAlignSourceName(d->source),
+		 (unsigned long long)d->evnum, (unsigned long long)d->reference);
+	  break;
+	}
+    }
+  printf("--------------------------------------------------------------------------------\n");
+}
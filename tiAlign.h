@@ -0,0 +1,58 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Cross-crate event alignment check (Linux).  The trigger data of
+ *     several TIs (trigger bank streams from files or sockets, or trigger
+ *     archives) are merged by event number with a k-way heap.  Every
+ *     event number must be found in every source, with the same timestamp
+ *     within a tolerance.  The first divergence is kept, with the counts
+ *     of each kind.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define TI_ALIGN_MAXSOURCES  64
+#define TI_ALIGN_NAMELEN     64
+
+/* Divergences */
+#define TI_ALIGN_MISSING     1   /* event number not in the source */
+#define TI_ALIGN_TIMESTAMP   2   /* timestamp differs from the reference */
+#define TI_ALIGN_ORDER       3   /* event number not increasing in the source */
+
+typedef struct tiAlignDivergence
+{
+  int      kind;
+  int      source;
+  uint64_t evnum;
+  uint64_t timestamp;    /* of the source */
+  int      refSource;    /* lowest source with the event number */
+  uint64_t reference;    /* its timestamp (TI_ALIGN_ORDER: event number before) */
+} tiAlignDivergence;
+
+typedef struct tiAlignStats
+{
+  uint64_t          events;       /* event numbers merged */
+  uint64_t          aligned;      /* in every source, timestamps matching */
+  uint64_t          missing;
+  uint64_t          timestamp;
+  uint64_t          order;
+  uint64_t          firstEvnum;   /* first event number found in every source */
+  int               diverged;     /* first is valid */
+  tiAlignDivergence first;
+  double            elapsed_s;
+} tiAlignStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int  tiAlignInit(uint32_t tolerance);
+  int  tiAlignAddStream(const char *name, int fd);
+  int  tiAlignAddFile(const char *name, const char *filename);
+  int  tiAlignAddArchive(const char *name, const char *dir);
+  int  tiAlignRun(uint64_t maxEvents, int stopAtFirst, tiAlignStats *stats);
+  void tiAlignPrintStats(const tiAlignStats *stats);
+  int  tiAlignClose();
+#ifdef __cplusplus
+}
+#endif
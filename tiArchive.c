@@ -0,0 +1,770 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Columnar archive of the decoded triggers (Linux).
+ *
+ *     Each column is a file in the archive directory (evnum.col,
+ *     timestamp.col, evtype.col, tsinputs.col), in host byte order:
+ *       header   TI_ARCHIVE_RESERVE bytes: "TIARCH01", version, column,
+ *                width, chunk rows, creation time
+ *       chunks   TI_ARCHIVE_CHUNK_ROWS values, then a TI_ARCHIVE_RESERVE
+ *                footer: "TIARFOOT", chunk, rows, first row, min and max
+ *
+ *     The writer maps the chunk being filled (values and footer) and
+ *     stores the values in place; the file is extended a chunk at a time.
+ *     Chunks start on 4 KiB boundaries, not on page boundaries with
+ *     larger pages: the mapping starts at the page the chunk starts in.
+ *     The footer is written when the chunk is full, on tiArchiveFlush and
+ *     tiArchiveStop, so a reader (or a writer that starts again on the
+ *     same directory) sees every row up to the last footer.
+ *
+ *     The reader maps the whole column files and walks the footers.
+ *     Chunks are addressed directly, so scans and event lookups run over
+ *     the mapped values.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiArchive.h"
+
+/**
+ * @defgroup Archive Trigger Archive
+ *   Memory mapped columnar archive of the decoded triggers, and its reader.
+ */
+
+#define TI_ARCHIVE_MAGIC        "TIARCH01"
+#define TI_ARCHIVE_FOOTER_MAGIC "TIARFOOT"
+#define TI_ARCHIVE_VERSION      1
+
+typedef struct tiArchiveFileHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t column;
+  uint32_t width;
+  uint32_t chunkRows;
+  double   created;
+} tiArchiveFileHeader;
+
+typedef struct tiArchiveFooter
+{
+  char     magic[8];
+  uint32_t chunk;
+  uint32_t rows;
+  uint64_t firstRow;
+  uint64_t min;
+  uint64_t max;
+} tiArchiveFooter;
+
+static const char     *arName[TI_ARCHIVE_NCOLUMNS]  = { "evnum", "timestamp", "evtype", "tsinputs" };
+static const uint32_t  arWidth[TI_ARCHIVE_NCOLUMNS] = { 8, 8, 1, 4 };
+
+/* Writer */
+static int       arRunning = 0;
+static int       arFd[TI_ARCHIVE_NCOLUMNS];
+static uint8_t  *arChunk[TI_ARCHIVE_NCOLUMNS];    /* mapped values and footer */
+static uint8_t  *arMap[TI_ARCHIVE_NCOLUMNS];      /* from the page arChunk is in */
+static size_t    arMapSize[TI_ARCHIVE_NCOLUMNS];
+static long      arPageSize = 4096;
+static int       arNchunk = 0;                    /* chunk being filled */
+static uint32_t  arRows = 0;                      /* rows in it */
+static uint64_t  arFirstRow = 0;
+static uint64_t  arMin[TI_ARCHIVE_NCOLUMNS], arMax[TI_ARCHIVE_NCOLUMNS];
+
+static size_t
+tiArchiveStride(int col)
+{
+  return (size_t)TI_ARCHIVE_CHUNK_ROWS * arWidth[col] + TI_ARCHIVE_RESERVE;
+}
+
+static off_t
+tiArchiveChunkOffset(int col, int chunk)
+{
+  return TI_ARCHIVE_RESERVE + (off_t)chunk * tiArchiveStride(col);
+}
+
+static uint64_t
+tiArchiveValue(int col, const uint8_t *values, uint32_t row)
+{
+  switch(col)
+    {
+    case TI_ARCHIVE_EVNUM:
+    case TI_ARCHIVE_TIMESTAMP:
+      return ((const uint64_t *)values)[row];
+    case TI_ARCHIVE_EVTYPE:
+      return values[row];
+    default:
+      return ((const uint32_t *)values)[row];
+    }
+}
+
+static void
+tiArchiveWriteFooter(int col)
+{
+  tiArchiveFooter *f =
+    (tiArchiveFooter *)(arChunk[col] + (size_t)TI_ARCHIVE_CHUNK_ROWS * arWidth[col]);
+
+  memcpy(f->magic, TI_ARCHIVE_FOOTER_MAGIC, 8);
+  f->chunk = arNchunk;
+  f->rows = arRows;
+  f->firstRow = arFirstRow;
+  f->min = arMin[col];
+  f->max = arMax[col];
+}
+
+/* Map the chunk arNchunk of every column, extending the files */
+static int
+tiArchiveMapChunk()
+{
+  struct stat st;
+  off_t offset, end, delta;
+  int col;
+
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    {
+      offset = tiArchiveChunkOffset(col, arNchunk);
+      end = offset + tiArchiveStride(col);
+
+      if((fstat(arFd[col], &st) != 0) ||
+	 ((st.st_size < end) && (ftruncate(arFd[col], end) != 0)))
+	{
+	  printf("%s: ERROR: Unable to extend %s.col\n", __func__, arName[col]);
+	  perror("ftruncate");
+	  return ERROR;
+	}
+
+      /* mmap offsets are in pages */
+      delta = offset % arPageSize;
+      arMapSize[col] = tiArchiveStride(col) + delta;
+      arMap[col] = (uint8_t *)mmap(NULL, arMapSize[col], PROT_READ | PROT_WRITE,
+				   MAP_SHARED, arFd[col], offset - delta);
+      if(arMap[col] == MAP_FAILED)
+	{
+	  arMap[col] = NULL;
+	  printf("%s: ERROR: Unable to map %s.col\n", __func__, arName[col]);
+	  perror("mmap");
+	  return ERROR;
+	}
+      arChunk[col] = arMap[col] + delta;
+    }
+
+  return OK;
+}
+
+static void
+tiArchiveUnmapChunk()
+{
+  int col;
+
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    {
+      if(arMap[col])
+	munmap(arMap[col], arMapSize[col]);
+      arMap[col] = NULL;
+      arChunk[col] = NULL;
+    }
+}
+
+static void
+tiArchiveResetRange()
+{
+  int col;
+
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    {
+      arMin[col] = UINT64_MAX;
+      arMax[col] = 0;
+    }
+}
+
+/* Find where a previous writer stopped, from the footers of the first
+   column.  Sets arNchunk, arRows and arFirstRow. */
+static void
+tiArchiveResume()
+{
+  tiArchiveFooter f;
+  struct stat st;
+  off_t offset;
+  int chunk = 0;
+
+  arNchunk = 0;
+  arRows = 0;
+  arFirstRow = 0;
+
+  if(fstat(arFd[0], &st) != 0)
+    return;
+
+  while(1)
+    {
+      offset = tiArchiveChunkOffset(0, chunk);
+      if(offset + (off_t)tiArchiveStride(0) > st.st_size)
+	break;
+
+      if((pread(arFd[0], &f, sizeof(f), offset + (off_t)TI_ARCHIVE_CHUNK_ROWS * arWidth[0])
+	  != sizeof(f)) ||
+	 (memcmp(f.magic, TI_ARCHIVE_FOOTER_MAGIC, 8) != 0) ||
+	 (f.chunk != (uint32_t)chunk) || (f.rows > TI_ARCHIVE_CHUNK_ROWS))
+	break;
+
+      if(f.rows < TI_ARCHIVE_CHUNK_ROWS)
+	{
+	  /* Continue filling it */
+	  arNchunk = chunk;
+	  arRows = f.rows;
+	  arFirstRow = f.firstRow;
+	  return;
+	}
+
+      chunk++;
+      arFirstRow = f.firstRow + f.rows;
+    }
+
+  arNchunk = chunk;
+}
+
+/**
+ * @ingroup Archive
+ * @brief Start writing the archive.  An archive already in the directory
+ *        is appended to, after its last footer.
+ *
+ * @param dir  Archive directory, created if needed
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiArchiveStart(const char *dir)
+{
+  tiArchiveFileHeader header, found;
+  struct timespec now;
+  char path[1024];
+  int col, valid = 1;
+  uint32_t row;
+
+  if(dir == NULL)
+    {
+      printf("%s: ERROR: Invalid directory\n", __func__);
+      return ERROR;
+    }
+
+  if(arRunning)
+    {
+      printf("%s: ERROR: Archive already open\n", __func__);
+      return ERROR;
+    }
+
+  if((mkdir(dir, 0755) != 0) && (errno != EEXIST))
+    {
+      printf("%s: ERROR: Unable to create %s\n", __func__, dir);
+      perror("mkdir");
+      return ERROR;
+    }
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  arPageSize = sysconf(_SC_PAGESIZE);
+  if(arPageSize <= 0)
+    arPageSize = 4096;
+
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    {
+      arMap[col] = NULL;
+      arChunk[col] = NULL;
+      snprintf(path, sizeof(path), "%s/%s.col", dir, arName[col]);
+      arFd[col] = open(path, O_RDWR | O_CREAT, 0644);
+      if(arFd[col] < 0)
+	{
+	  printf("%s: ERROR: Unable to open %s\n", __func__, path);
+	  perror("open");
+	  while(--col >= 0)
+	    close(arFd[col]);
+	  return ERROR;
+	}
+
+      memset(&header, 0, sizeof(header));
+      memcpy(header.magic, TI_ARCHIVE_MAGIC, 8);
+      header.version = TI_ARCHIVE_VERSION;
+      header.column = col;
+      header.width = arWidth[col];
+      header.chunkRows = TI_ARCHIVE_CHUNK_ROWS;
+      header.created = now.tv_sec + now.tv_nsec * 1e-9;
+
+      if((pread(arFd[col], &found, sizeof(found), 0) != sizeof(found)) ||
+	 (memcmp(found.magic, header.magic, 8) != 0) || (found.version != header.version) ||
+	 (found.column != header.column) || (found.width != header.width) ||
+	 (found.chunkRows != header.chunkRows))
+	valid = 0;
+    }
+
+  if(valid)
+    tiArchiveResume();
+  else
+    {
+      /* New archive */
+      for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+	{
+	  memset(&header, 0, sizeof(header));
+	  memcpy(header.magic, TI_ARCHIVE_MAGIC, 8);
+	  header.version = TI_ARCHIVE_VERSION;
+	  header.column = col;
+	  header.width = arWidth[col];
+	  header.chunkRows = TI_ARCHIVE_CHUNK_ROWS;
+	  header.created = now.tv_sec + now.tv_nsec * 1e-9;
+	  if((ftruncate(arFd[col], 0) != 0) || (ftruncate(arFd[col], TI_ARCHIVE_RESERVE) != 0) ||
+	     (pwrite(arFd[col], &header, sizeof(header), 0) != sizeof(header)))
+	    {
+	      printf("%s: ERROR: Unable to write the %s header\n", __func__, arName[col]);
+	      for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+		close(arFd[col]);
+	      return ERROR;
+	    }
+	}
+      arNchunk = 0;
+      arRows = 0;
+      arFirstRow = 0;
+    }
+
+  if(tiArchiveMapChunk() != OK)
+    {
+      tiArchiveUnmapChunk();
+      for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+	close(arFd[col]);
+      return ERROR;
+    }
+
+  /* Range of the rows already in the chunk */
+  tiArchiveResetRange();
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    for(row = 0; row < arRows; row++)
+      {
+	uint64_t v = tiArchiveValue(col, arChunk[col], row);
+
+	if(v < arMin[col])
+	  arMin[col] = v;
+	if(v > arMax[col])
+	  arMax[col] = v;
+      }
+
+  arRunning = 1;
+
+  return OK;
+}
+
+/* The chunk is full: close it with its footer and map the next one */
+static int
+tiArchiveNextChunk()
+{
+  int col;
+
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    tiArchiveWriteFooter(col);
+  tiArchiveUnmapChunk();
+
+  arFirstRow += arRows;
+  arNchunk++;
+  arRows = 0;
+  tiArchiveResetRange();
+
+  return tiArchiveMapChunk();
+}
+
+/**
+ * @ingroup Archive
+ * @brief Append decoded triggers to the archive
+ *
+ * @param event    Decoded triggers (tiDecodeTriggerBank)
+ * @param nevents  Number of them
+ *
+ * @return Number of triggers appended if successful, otherwise ERROR
+ */
+int
+tiArchiveAppend(const tiDecodedEvent *event, int nevents)
+{
+  uint64_t *evnum, *timestamp;
+  uint8_t  *evtype;
+  uint32_t *tsInputs;
+  uint64_t v;
+  int iev;
+
+  if(!arRunning)
+    {
+      printf("%s: ERROR: Archive not open\n", __func__);
+      return ERROR;
+    }
+
+  if((event == NULL) || (nevents < 0))
+    {
+      printf("%s: ERROR: Invalid events\n", __func__);
+      return ERROR;
+    }
+
+  for(iev = 0; iev < nevents; iev++)
+    {
+      if(arRows == TI_ARCHIVE_CHUNK_ROWS)
+	{
+	  if(tiArchiveNextChunk() != OK)
+	    {
+	      printf("%s: ERROR: Unable to start chunk %d, archive closed\n",
+		     __func__, arNchunk);
+	      tiArchiveStop();
+	      return ERROR;
+	    }
+	}
+
+      evnum     = (uint64_t *)arChunk[TI_ARCHIVE_EVNUM];
+      timestamp = (uint64_t *)arChunk[TI_ARCHIVE_TIMESTAMP];
+      evtype    = arChunk[TI_ARCHIVE_EVTYPE];
+      tsInputs  = (uint32_t *)arChunk[TI_ARCHIVE_TSINPUTS];
+
+      evnum[arRows]     = event[iev].evnum;
+      timestamp[arRows] = event[iev].hasTimestamp ? event[iev].timestamp : 0;
+      evtype[arRows]    = event[iev].evtype;
+      tsInputs[arRows]  = event[iev].hasTSInputs ? event[iev].tsInputs : 0;
+
+#define TI_ARCHIVE_RANGE(_col, _v)		\
+      v = (_v);					\
+      if(v < arMin[_col]) arMin[_col] = v;	\
+      if(v > arMax[_col]) arMax[_col] = v;
+
+      TI_ARCHIVE_RANGE(TI_ARCHIVE_EVNUM, evnum[arRows]);
+      TI_ARCHIVE_RANGE(TI_ARCHIVE_TIMESTAMP, timestamp[arRows]);
+      TI_ARCHIVE_RANGE(TI_ARCHIVE_EVTYPE, evtype[arRows]);
+      TI_ARCHIVE_RANGE(TI_ARCHIVE_TSINPUTS, tsInputs[arRows]);
+#undef TI_ARCHIVE_RANGE
+
+      arRows++;
+    }
+
+  return nevents;
+}
+
+/**
+ * @ingroup Archive
+ * @brief Decode trigger banks and append their triggers to the archive
+ *
+ * @param data    Trigger banks, as for tiDecodeTriggerBank
+ * @param nwords  Number of words in data
+ *
+ * @return Number of triggers appended if successful, otherwise ERROR
+ */
+int
+tiArchiveWriteBank(const uint32_t *data, int nwords)
+{
+  tiDecodedEvent event[256];
+  int iword = 0, nused = 0, nev, ntotal = 0;
+
+  while(iword < nwords)
+    {
+      nev = tiDecodeTriggerBank(&data[iword], nwords - iword, event, 256, &nused);
+      if(nev == ERROR)
+	return ERROR;
+
+      if(tiArchiveAppend(event, nev) == ERROR)
+	return ERROR;
+
+      ntotal += nev;
+      iword += nused;
+    }
+
+  return ntotal;
+}
+
+/**
+ * @ingroup Archive
+ * @brief Write the footer of the chunk being filled, and schedule the
+ *        write back of the archive.  Readers then see every row appended.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiArchiveFlush()
+{
+  int col;
+
+  if(!arRunning)
+    return ERROR;
+
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    {
+      tiArchiveWriteFooter(col);
+      msync(arMap[col], arMapSize[col], MS_ASYNC);
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup Archive
+ * @brief Write the last footer and close the archive
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiArchiveStop()
+{
+  int col, rval = OK;
+
+  if(!arRunning)
+    return OK;
+
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    {
+      /* Not mapped if the next chunk could not be */
+      if(arChunk[col] == NULL)
+	continue;
+      if(arRows > 0)
+	tiArchiveWriteFooter(col);
+      if(msync(arMap[col], arMapSize[col], MS_SYNC) != 0)
+	rval = ERROR;
+    }
+  tiArchiveUnmapChunk();
+
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    {
+      /* Nothing in the last chunk */
+      if(arRows == 0)
+	{
+	  if(ftruncate(arFd[col], tiArchiveChunkOffset(col, arNchunk)) != 0)
+	    rval = ERROR;
+	}
+      close(arFd[col]);
+    }
+
+  arRunning = 0;
+
+  if(rval != OK)
+    printf("%s: ERROR: Writing the archive\n", __func__);
+
+  return rval;
+}
+
+/**
+ * @ingroup Archive
+ * @brief Return the number of triggers in the archive being written
+ */
+uint64_t
+tiArchiveGetRows()
+{
+  return arRunning ? (arFirstRow + arRows) : 0;
+}
+
+static const tiArchiveFooter *
+tiArchiveReaderFooter(const tiArchiveReader *reader, int col, int chunk)
+{
+  return (const tiArchiveFooter *)(reader->map[col] + tiArchiveChunkOffset(col, chunk)
+				   + (size_t)TI_ARCHIVE_CHUNK_ROWS * arWidth[col]);
+}
+
+/**
+ * @ingroup Archive
+ * @brief Map an archive for reading.  Chunks still being filled are
+ *        included up to their last footer.
+ *
+ * @param dir     Archive directory
+ * @param reader  Open archive, to pass to the other reader routines
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiArchiveOpen(const char *dir, tiArchiveReader *reader)
+{
+  const tiArchiveFileHeader *header;
+  const tiArchiveFooter *f;
+  struct stat st;
+  char path[1024];
+  int col, fd, chunk, nchunks;
+  uint64_t rows;
+
+  if((dir == NULL) || (reader == NULL))
+    {
+      printf("%s: ERROR: Invalid arguments\n", __func__);
+      return ERROR;
+    }
+
+  memset(reader, 0, sizeof(*reader));
+  reader->nchunks = -1;
+
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    {
+      snprintf(path, sizeof(path), "%s/%s.col", dir, arName[col]);
+      fd = open(path, O_RDONLY);
+      if((fd < 0) || (fstat(fd, &st) != 0) || (st.st_size < TI_ARCHIVE_RESERVE))
+	{
+	  printf("%s: ERROR: Unable to open %s\n", __func__, path);
+	  if(fd >= 0)
+	    close(fd);
+	  tiArchiveClose(reader);
+	  return ERROR;
+	}
+
+      reader->map[col] = (uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      if(reader->map[col] == MAP_FAILED)
+	{
+	  reader->map[col] = NULL;
+	  printf("%s: ERROR: Unable to map %s\n", __func__, path);
+	  tiArchiveClose(reader);
+	  return ERROR;
+	}
+      reader->mapSize[col] = st.st_size;
+
+      header = (const tiArchiveFileHeader *)reader->map[col];
+      if((memcmp(header->magic, TI_ARCHIVE_MAGIC, 8) != 0) ||
+	 (header->version != TI_ARCHIVE_VERSION) || (header->column != (uint32_t)col) ||
+	 (header->width != arWidth[col]) || (header->chunkRows != TI_ARCHIVE_CHUNK_ROWS))
+	{
+	  printf("%s: ERROR: %s is not an archive column\n", __func__, path);
+	  tiArchiveClose(reader);
+	  return ERROR;
+	}
+
+      /* Chunks with a footer, up to the first that is not full */
+      for(chunk = 0; ; chunk++)
+	{
+	  if(tiArchiveChunkOffset(col, chunk) + tiArchiveStride(col) > reader->mapSize[col])
+	    break;
+	  f = tiArchiveReaderFooter(reader, col, chunk);
+	  if((memcmp(f->magic, TI_ARCHIVE_FOOTER_MAGIC, 8) != 0) ||
+	     (f->chunk != (uint32_t)chunk) || (f->rows > TI_ARCHIVE_CHUNK_ROWS))
+	    break;
+	  if(f->rows < TI_ARCHIVE_CHUNK_ROWS)
+	    {
+	      chunk++;
+	      break;
+	    }
+	}
+      nchunks = chunk;
+
+      if((reader->nchunks < 0) || (nchunks < reader->nchunks))
+	reader->nchunks = nchunks;
+    }
+
+  /* Rows present in every column */
+  rows = 0;
+  for(chunk = 0; chunk < reader->nchunks; chunk++)
+    {
+      tiArchiveColumns cols;
+
+      tiArchiveChunk(reader, chunk, &cols);
+      rows += cols.rows;
+    }
+  reader->rows = rows;
+
+  return OK;
+}
+
+/**
+ * @ingroup Archive
+ * @brief Unmap an archive opened with tiArchiveOpen
+ *
+ * @return OK
+ */
+int
+tiArchiveClose(tiArchiveReader *reader)
+{
+  int col;
+
+  if(reader == NULL)
+    return ERROR;
+
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    {
+      if(reader->map[col])
+	munmap(reader->map[col], reader->mapSize[col]);
+      reader->map[col] = NULL;
+      reader->mapSize[col] = 0;
+    }
+  reader->nchunks = 0;
+  reader->rows = 0;
+
+  return OK;
+}
+
+/**
+ * @ingroup Archive
+ * @brief Return the columns of one chunk, pointing into the mapped files
+ *
+ * @param reader  Open archive
+ * @param chunk   0 to reader->nchunks - 1
+ * @param cols    Where to store the column pointers and ranges
+ *
+ * @return Number of rows in the chunk if successful, otherwise ERROR
+ */
+int
+tiArchiveChunk(const tiArchiveReader *reader, int chunk, tiArchiveColumns *cols)
+{
+  const tiArchiveFooter *f;
+  int col;
+
+  if((reader == NULL) || (cols == NULL) || (chunk < 0) || (chunk >= reader->nchunks))
+    return ERROR;
+
+  memset(cols, 0, sizeof(*cols));
+  cols->rows = TI_ARCHIVE_CHUNK_ROWS;
+  for(col = 0; col < TI_ARCHIVE_NCOLUMNS; col++)
+    {
+      f = tiArchiveReaderFooter(reader, col, chunk);
+      if(f->rows < cols->rows)
+	cols->rows = f->rows;
+      cols->firstRow = f->firstRow;
+    }
+
+  cols->evnum     = (const uint64_t *)(reader->map[TI_ARCHIVE_EVNUM] +
+				       tiArchiveChunkOffset(TI_ARCHIVE_EVNUM, chunk));
+  cols->timestamp = (const uint64_t *)(reader->map[TI_ARCHIVE_TIMESTAMP] +
+				       tiArchiveChunkOffset(TI_ARCHIVE_TIMESTAMP, chunk));
+  cols->evtype    = (const uint8_t *)(reader->map[TI_ARCHIVE_EVTYPE] +
+				      tiArchiveChunkOffset(TI_ARCHIVE_EVTYPE, chunk));
+  cols->tsInputs  = (const uint32_t *)(reader->map[TI_ARCHIVE_TSINPUTS] +
+				       tiArchiveChunkOffset(TI_ARCHIVE_TSINPUTS, chunk));
+
+  f = tiArchiveReaderFooter(reader, TI_ARCHIVE_EVNUM, chunk);
+  cols->evnumMin = f->min;
+  cols->evnumMax = f->max;
+  f = tiArchiveReaderFooter(reader, TI_ARCHIVE_TIMESTAMP, chunk);
+  cols->timestampMin = f->min;
+  cols->timestampMax = f->max;
+
+  return cols->rows;
+}
+
+/**
+ * @ingroup Archive
+ * @brief Find the row of an event number.  Chunks are skipped with the
+ *        event number range of their footer.
+ *
+ * @param reader  Open archive
+ * @param evnum   Event number
+ *
+ * @return Row of the first trigger with this event number, -1 if not found
+ */
+int64_t
+tiArchiveFindEvent(const tiArchiveReader *reader, uint64_t evnum)
+{
+  tiArchiveColumns cols;
+  uint32_t row;
+  int chunk;
+
+  if(reader == NULL)
+    return -1;
+
+  for(chunk = 0; chunk < reader->nchunks; chunk++)
+    {
+      tiArchiveChunk(reader, chunk, &cols);
+      if((evnum < cols.evnumMin) || (evnum > cols.evnumMax))
+	continue;
+
+      for(row = 0; row < cols.rows; row++)
+	if(cols.evnum[row] == evnum)
+	  return cols.firstRow + row;
+    }
+
+  return -1;
+}
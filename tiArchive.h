@@ -0,0 +1,65 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Columnar archive of the decoded triggers (Linux): event number,
+ *     timestamp, event type and TS input bits, each in a file of fixed
+ *     width values, appended through mmap in chunks of
+ *     TI_ARCHIVE_CHUNK_ROWS.  Every chunk ends with a footer (rows,
+ *     first row, min / max of the column) that the reader uses as the
+ *     index.  The reader maps the column files, and reads the values in
+ *     place.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "tiDecode.h"
+
+#define TI_ARCHIVE_CHUNK_ROWS  65536
+#define TI_ARCHIVE_RESERVE     4096    /* file header, chunk footer */
+
+/* Columns, one file each in the archive directory */
+#define TI_ARCHIVE_EVNUM       0       /* uint64_t */
+#define TI_ARCHIVE_TIMESTAMP   1       /* uint64_t, 4 ns ticks */
+#define TI_ARCHIVE_EVTYPE      2       /* uint8_t */
+#define TI_ARCHIVE_TSINPUTS    3       /* uint32_t */
+#define TI_ARCHIVE_NCOLUMNS    4
+
+/* Columns of one chunk, from tiArchiveChunk */
+typedef struct tiArchiveColumns
+{
+  uint64_t        firstRow;
+  uint32_t        rows;
+  const uint64_t *evnum;
+  const uint64_t *timestamp;
+  const uint8_t  *evtype;
+  const uint32_t *tsInputs;
+  uint64_t        evnumMin, evnumMax;
+  uint64_t        timestampMin, timestampMax;
+} tiArchiveColumns;
+
+/* Open archive, from tiArchiveOpen */
+typedef struct tiArchiveReader
+{
+  uint64_t  rows;         /* up to the last footer of each column */
+  int       nchunks;
+  uint8_t  *map[TI_ARCHIVE_NCOLUMNS];
+  size_t    mapSize[TI_ARCHIVE_NCOLUMNS];
+} tiArchiveReader;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int      tiArchiveStart(const char *dir);
+  int      tiArchiveStop();
+  int      tiArchiveAppend(const tiDecodedEvent *event, int nevents);
+  int      tiArchiveWriteBank(const uint32_t *data, int nwords);
+  int      tiArchiveFlush();
+  uint64_t tiArchiveGetRows();
+
+  int      tiArchiveOpen(const char *dir, tiArchiveReader *reader);
+  int      tiArchiveClose(tiArchiveReader *reader);
+  int      tiArchiveChunk(const tiArchiveReader *reader, int chunk, tiArchiveColumns *cols);
+  int64_t  tiArchiveFindEvent(const tiArchiveReader *reader, uint64_t evnum);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,652 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Block level autotuner.
+ *
+ *     Each update measures, over the interval since the previous one:
+ *       - the accepted trigger rate, from the event counter and the live
+ *         and busy timers (tiDeadTimeUpdate).  The offered rate is the
+ *         accepted rate over the live fraction.
+ *       - the readout service time per block, from the readout list
+ *         (tiAutoTuneReadoutStart/End around the block readout, or
+ *         tiAutoTuneAddService)
+ *     The service time is modelled as overhead + perEvent x block level,
+ *     fitted over the block levels measured so far.
+ *
+ *     For a block level B, blocks arrive at R/B and the readout is busy
+ *     a fraction rho = R/B x S(B).  With a buffer level of K blocks, the
+ *     fraction of triggers lost to a full buffer is the M/M/1/K blocking
+ *     probability.  The dead time measured beyond that of the model is
+ *     kept as a constant (trigger rules, holdoff, other busy sources).
+ *     The event building latency is the time to fill a block (B/R) and
+ *     read it out, including the wait behind blocks in the buffer.
+ *
+ *     The proposal is the smallest block level that reaches the live
+ *     time target within the latency limit, or else the one with the
+ *     most live time within the limit.  It is applied, when asked, after
+ *     two updates in a row proposed it, as a broadcast that takes effect
+ *     at the next sync event (tiBlockLevelSchedule).  The update does not
+ *     wait for it: later updates check the block level, and nothing else
+ *     is broadcast until it is current or timeout_ms has passed.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiDeadTime.h"
+#include "tiBlockLevel.h"
+#include "tiAutoTune.h"
+
+/**
+ * @defgroup AutoTune Block Level Autotuner
+ *   Block level from the measured trigger rate, readout time and live time.
+ */
+
+#define TI_AUTOTUNE_NLEVELS     (TI_BLOCKLEVEL_MASK + 1)
+#define TI_AUTOTUNE_MIN_GAIN    1e-4   /* live fraction worth a larger block level */
+
+static tiAutoTuneConfig atConfig =
+  {
+    .liveTarget = 0.95,
+    .maxLatency = 0.1,
+    .minBlockLevel = 1,
+    .maxBlockLevel = TI_BLOCKLEVEL_MASK,
+    .bufferLevel = -1,
+    .overhead = 0.5,
+    .timeout_ms = 2000
+  };
+
+static tiDeadTimeState atDtState;
+static tiAutoTuneStatus atStatus;
+static int atPrimed = 0, atLastBlockLevel = 0, atLastProposed = 0;
+static int atPendingLevel = 0;                 /* broadcast, not current yet */
+static struct timespec atPendingStart;
+static unsigned long long atLastEvents = 0;
+static uint64_t atLastServiceNs = 0, atLastServiceBlocks = 0;
+static double atSumService[TI_AUTOTUNE_NLEVELS];  /* seconds, per block level */
+static double atSumBlocks[TI_AUTOTUNE_NLEVELS];
+
+/* Written by the readout */
+static uint64_t atServiceNs = 0, atServiceBlocks = 0;
+static struct timespec atReadoutStart;
+
+static pthread_mutex_t atMutex = PTHREAD_MUTEX_INITIALIZER;
+#define ATLOCK     if(pthread_mutex_lock(&atMutex)<0) perror("pthread_mutex_lock");
+#define ATUNLOCK   if(pthread_mutex_unlock(&atMutex)<0) perror("pthread_mutex_unlock");
+
+static pthread_t atThread;
+static volatile int atThreadStop = 0, atThreadRunning = 0, atThreadPeriod = 1000;
+static volatile int atThreadApply = 0;
+
+/**
+ * @ingroup AutoTune
+ * @brief Configure the autotuner, and start measuring from now.
+ *
+ * @param config  Configuration, NULL for the defaults
+ *                (95% live, 100 ms latency, block level 1-255, buffer level kept)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiAutoTuneInit(const tiAutoTuneConfig *config)
+{
+  if(config != NULL)
+    {
+      if((config->liveTarget <= 0.) || (config->liveTarget > 1.) ||
+	 (config->maxLatency <= 0.))
+	{
+	  printf("%s: ERROR: Invalid live target (%g) or latency limit (%g)\n",
+		 __func__, config->liveTarget, config->maxLatency);
+	  return ERROR;
+	}
+
+      if((config->minBlockLevel < 1) || (config->maxBlockLevel > TI_BLOCKLEVEL_MASK) ||
+	 (config->minBlockLevel > config->maxBlockLevel))
+	{
+	  printf("%s: ERROR: Invalid block level range (%d - %d)\n",
+		 __func__, config->minBlockLevel, config->maxBlockLevel);
+	  return ERROR;
+	}
+
+      if((config->bufferLevel > TI_BLOCKBUFFER_BUFFERLEVEL_MASK) ||
+	 (config->overhead < 0.) || (config->overhead > 1.))
+	{
+	  printf("%s: ERROR: Invalid buffer level (%d) or overhead (%g)\n",
+		 __func__, config->bufferLevel, config->overhead);
+	  return ERROR;
+	}
+    }
+
+  ATLOCK;
+  if(config != NULL)
+    atConfig = *config;
+
+  memset(&atStatus, 0, sizeof(atStatus));
+  memset(atSumService, 0, sizeof(atSumService));
+  memset(atSumBlocks, 0, sizeof(atSumBlocks));
+  atPrimed = 0;
+  atLastProposed = 0;
+  atPendingLevel = 0;
+  tiDeadTimeInit(&atDtState);
+  ATUNLOCK;
+
+  /* First update only primes the counters */
+  return tiAutoTuneUpdate(0, NULL);
+}
+
+/**
+ * @ingroup AutoTune
+ * @brief Mark the start of a block readout.  Call from the readout
+ *        routine, before reading the block.
+ */
+void
+tiAutoTuneReadoutStart()
+{
+  clock_gettime(CLOCK_MONOTONIC, &atReadoutStart);
+}
+
+/**
+ * @ingroup AutoTune
+ * @brief Mark the end of a block readout started with
+ *        tiAutoTuneReadoutStart.
+ */
+void
+tiAutoTuneReadoutEnd()
+{
+  struct timespec now;
+  int64_t ns = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ns = (int64_t)(now.tv_sec - atReadoutStart.tv_sec) * 1000000000
+    + (now.tv_nsec - atReadoutStart.tv_nsec);
+  if(ns < 0)
+    ns = 0;
+
+  __atomic_fetch_add(&atServiceNs, (uint64_t)ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&atServiceBlocks, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @ingroup AutoTune
+ * @brief Add readout service time measured by the caller
+ *
+ * @param nblocks  Blocks read out
+ * @param seconds  Time spent reading them out
+ */
+void
+tiAutoTuneAddService(uint32_t nblocks, double seconds)
+{
+  if(seconds < 0.)
+    seconds = 0.;
+
+  __atomic_fetch_add(&atServiceNs, (uint64_t)(seconds * 1e9), __ATOMIC_RELAXED);
+  __atomic_fetch_add(&atServiceBlocks, nblocks, __ATOMIC_RELAXED);
+}
+
+/* Fraction of blocks lost to a full buffer of K blocks (M/M/1/K).
+   K = 0 is no limit. */
+static double
+tiAutoTuneBlocking(double rho, int K)
+{
+  double r = 0.;
+
+  if(K <= 0)
+    return (rho < 1.) ? 0. : 1. - 1. / rho;
+
+  if(fabs(rho - 1.) < 1e-9)
+    return 1. / (K + 1);
+
+  if(rho < 1.)
+    return (1. - rho) * pow(rho, K) / (1. - pow(rho, K + 1));
+
+  r = 1. / rho;
+  return (1. - r) / (1. - pow(r, K + 1));
+}
+
+/* Service time model, weighted least squares over the block levels measured */
+static void
+tiAutoTuneFit(int blockLevel, double service, double *overhead, double *perEvent)
+{
+  double w = 0., sw = 0., swB = 0., swY = 0., sxx = 0., sxy = 0., swBY = 0., swBB = 0.;
+  double Bm = 0., Ym = 0., y = 0.;
+  int ilevel, nlevels = 0;
+
+  for(ilevel = 1; ilevel < TI_AUTOTUNE_NLEVELS; ilevel++)
+    {
+      if(atSumBlocks[ilevel] <= 0.)
+	continue;
+      w = atSumBlocks[ilevel];
+      y = atSumService[ilevel] / w;
+      sw += w;
+      swB += w * ilevel;
+      swY += w * y;
+      swBY += w * ilevel * y;
+      swBB += w * ilevel * ilevel;
+      nlevels++;
+    }
+
+  if(nlevels < 2)
+    {
+      /* One block level: split it with the configured overhead fraction */
+      if(nlevels == 1)
+	{
+	  for(ilevel = 1; atSumBlocks[ilevel] <= 0.; ilevel++)
+	    ;
+	  blockLevel = ilevel;
+	  service = atSumService[ilevel] / atSumBlocks[ilevel];
+	}
+      *overhead = atConfig.overhead * service;
+      *perEvent = (blockLevel > 0) ? (1. - atConfig.overhead) * service / blockLevel : 0.;
+      return;
+    }
+
+  Bm = swB / sw;
+  Ym = swY / sw;
+  for(ilevel = 1; ilevel < TI_AUTOTUNE_NLEVELS; ilevel++)
+    {
+      if(atSumBlocks[ilevel] <= 0.)
+	continue;
+      w = atSumBlocks[ilevel];
+      y = atSumService[ilevel] / w;
+      sxx += w * (ilevel - Bm) * (ilevel - Bm);
+      sxy += w * (ilevel - Bm) * (y - Ym);
+    }
+
+  *perEvent = sxy / sxx;
+  *overhead = Ym - *perEvent * Bm;
+
+  if(*perEvent < 0.)
+    {
+      *perEvent = 0.;
+      *overhead = Ym;
+    }
+  else if(*overhead < 0.)
+    {
+      *overhead = 0.;
+      *perEvent = swBY / swBB;
+    }
+}
+
+/**
+ * @ingroup AutoTune
+ * @brief Predicted live fraction and event building latency at a block
+ *        level, from the model of an update.
+ *
+ * @param status      Status from tiAutoTuneUpdate
+ * @param blockLevel  Block level
+ * @param live        If not NULL, where to store the live fraction
+ * @param latency     If not NULL, where to store the latency (seconds)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiAutoTunePredict(const tiAutoTuneStatus *status, int blockLevel,
+		  double *live, double *latency)
+{
+  double S = 0., rho = 0., wait = 0., l = 0.;
+  int K = 0;
+
+  if((status == NULL) || (blockLevel < 1) || (status->offered <= 0.))
+    return ERROR;
+
+  K = (atConfig.bufferLevel >= 0) ? atConfig.bufferLevel : status->bufferLevel;
+  S = status->overhead + status->perEvent * blockLevel;
+  rho = status->offered / blockLevel * S;
+
+  l = 1. - status->baseDead - tiAutoTuneBlocking(rho, K);
+  if(live != NULL)
+    *live = (l > 0.) ? l : 0.;
+
+  if(rho < 1.)
+    {
+      wait = S / (1. - rho);
+      if((K > 0) && (wait > K * S))
+	wait = K * S;
+    }
+  else
+    wait = (K > 0) ? K * S : HUGE_VAL;
+
+  if(latency != NULL)
+    *latency = blockLevel / status->offered + wait;
+
+  return OK;
+}
+
+/* Smallest block level reaching the live target within the latency limit */
+static void
+tiAutoTunePropose(tiAutoTuneStatus *status)
+{
+  double live = 0., latency = 0., bestLive = -1., bestLatency = HUGE_VAL;
+  int bl, best = 0, fastest = 0;
+
+  status->proposed = 0;
+  status->liveMet = 0;
+  status->latencyMet = 0;
+
+  for(bl = atConfig.minBlockLevel; bl <= atConfig.maxBlockLevel; bl++)
+    {
+      if(tiAutoTunePredict(status, bl, &live, &latency) != OK)
+	return;
+
+      if(latency > atConfig.maxLatency)
+	{
+	  if(latency < bestLatency)
+	    {
+	      bestLatency = latency;
+	      fastest = bl;
+	    }
+	  continue;
+	}
+
+      if(live >= atConfig.liveTarget)
+	{
+	  best = bl;
+	  status->liveMet = 1;
+	  break;
+	}
+
+      if(live > bestLive + TI_AUTOTUNE_MIN_GAIN)
+	{
+	  bestLive = live;
+	  best = bl;
+	}
+    }
+
+  if(best > 0)
+    status->latencyMet = 1;
+  else
+    best = fastest;
+
+  status->proposed = best;
+  tiAutoTunePredict(status, best, &status->predictedLive, &status->predictedLatency);
+}
+
+/**
+ * @ingroup AutoTune
+ * @brief Measure the interval since the previous update, and propose a
+ *        block level.
+ *
+ * @param apply   If 1, broadcast the proposed block level (and configured
+ *                buffer level) for the next sync event, once two updates
+ *                in a row proposed it
+ * @param status  If not NULL, where to store the status of this update
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiAutoTuneUpdate(int apply, tiAutoTuneStatus *status)
+{
+  tiAutoTuneStatus s;
+  tiDeadTime dt;
+  tiBlockLevelPlan plan;
+  struct timespec now;
+  unsigned long long events = 0;
+  uint64_t serviceNs = 0, serviceBlocks = 0;
+  double seconds = 0.;
+  int rval = OK;
+
+  memset(&s, 0, sizeof(s));
+
+  ATLOCK;
+  if(tiDeadTimeUpdate(&atDtState, &dt) != OK)
+    {
+      ATUNLOCK;
+      return ERROR;
+    }
+
+  events = tiGetEventCounter();
+  s.blockLevel = tiGetCurrentBlockLevel();
+  s.bufferLevel = tiGetBlockBufferLevel();
+  if((s.blockLevel == ERROR) || (s.bufferLevel == ERROR))
+    {
+      ATUNLOCK;
+      return ERROR;
+    }
+
+  serviceNs = __atomic_load_n(&atServiceNs, __ATOMIC_RELAXED);
+  serviceBlocks = __atomic_load_n(&atServiceBlocks, __ATOMIC_RELAXED);
+
+  if(atPrimed && (dt.interval > 0.))
+    {
+      s.interval = dt.interval;
+      s.accepted = (events - atLastEvents) / dt.interval;
+      s.live = dt.live;
+      s.offered = (dt.live > 0.) ? s.accepted / dt.live : s.accepted;
+
+      s.nblocks = serviceBlocks - atLastServiceBlocks;
+      if(s.nblocks > 0)
+	{
+	  seconds = (serviceNs - atLastServiceNs) * 1e-9;
+	  s.service = seconds / s.nblocks;
+
+	  /* Only intervals spent at one block level go into the fit */
+	  if(s.blockLevel == atLastBlockLevel)
+	    {
+	      atSumService[s.blockLevel] += seconds;
+	      atSumBlocks[s.blockLevel] += s.nblocks;
+	    }
+	}
+
+      tiAutoTuneFit(s.blockLevel, s.service, &s.overhead, &s.perEvent);
+
+      s.baseDead = (1. - s.live) -
+	tiAutoTuneBlocking(s.offered / s.blockLevel * s.service, s.bufferLevel);
+      if(s.baseDead < 0.)
+	s.baseDead = 0.;
+
+      if((s.offered > 0.) && ((s.overhead > 0.) || (s.perEvent > 0.)))
+	tiAutoTunePropose(&s);
+    }
+
+  /* Change broadcast by an earlier update */
+  if(atPendingLevel > 0)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if(s.blockLevel == atPendingLevel)
+	atPendingLevel = 0;
+      else if(((now.tv_sec - atPendingStart.tv_sec) * 1000 +
+	       (now.tv_nsec - atPendingStart.tv_nsec) / 1000000) > atConfig.timeout_ms)
+	{
+	  printf("%s: WARN: Block level %d not current after %d ms\n",
+		 __func__, atPendingLevel, atConfig.timeout_ms);
+	  atPendingLevel = 0;
+	}
+    }
+
+  atPrimed = 1;
+  atLastEvents = events;
+  atLastServiceNs = serviceNs;
+  atLastServiceBlocks = serviceBlocks;
+  atLastBlockLevel = s.blockLevel;
+
+  if(apply && (atPendingLevel == 0) && (s.proposed > 0) && (s.proposed == atLastProposed) &&
+     ((s.proposed != s.blockLevel) ||
+      ((atConfig.bufferLevel >= 0) && (atConfig.bufferLevel != s.bufferLevel))))
+    {
+      if((tiBlockLevelPlanMake(&plan, s.proposed, atConfig.bufferLevel,
+			       TI_BLCHANGE_SYNCEVENT) == ERROR) ||
+	 (tiBlockLevelSchedule(&plan) != OK))
+	rval = ERROR;
+      else
+	{
+	  printf("%s: INFO: Block level %d -> %d (live %.1f%% -> %.1f%%, latency %.2f ms)\n",
+		 __func__, s.blockLevel, s.proposed, 100. * s.live,
+		 100. * s.predictedLive, 1e3 * s.predictedLatency);
+	  s.applied = 1;
+
+	  /* The buffer level takes effect right away */
+	  if(plan.steps & TI_BLPLAN_BLOCKLEVEL)
+	    {
+	      atPendingLevel = s.proposed;
+	      clock_gettime(CLOCK_MONOTONIC, &atPendingStart);
+	    }
+	}
+    }
+  atLastProposed = s.proposed;
+
+  atStatus = s;
+  ATUNLOCK;
+
+  if(status != NULL)
+    *status = s;
+
+  return rval;
+}
+
+static void *
+tiAutoTuneThread(void *arg)
+{
+  struct timespec period;
+
+  period.tv_sec  = atThreadPeriod / 1000;
+  period.tv_nsec = (atThreadPeriod % 1000) * 1000000;
+
+  while(!atThreadStop)
+    {
+      nanosleep(&period, NULL);
+
+      if(atThreadStop)
+	break;
+
+      if(tiAutoTuneUpdate(atThreadApply, NULL) == ERROR)
+	printf("%s: WARN: Update failed\n", __func__);
+    }
+
+  printf("%s: Autotuner stopped\n", __func__);
+  return NULL;
+}
+
+/**
+ * @ingroup AutoTune
+ * @brief Update in a background thread
+ *
+ * @param period_ms  Time between updates (ms)
+ * @param apply      1 to apply the proposals, 0 to only propose
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiAutoTuneStart(int period_ms, int apply)
+{
+  int status = 0;
+
+  if(period_ms <= 0)
+    {
+      printf("%s: ERROR: Invalid period (%d ms)\n", __func__, period_ms);
+      return ERROR;
+    }
+
+  if(atThreadRunning)
+    {
+      printf("%s: ERROR: Autotuner already running\n", __func__);
+      return ERROR;
+    }
+
+  atThreadPeriod = period_ms;
+  atThreadApply = apply;
+  atThreadStop = 0;
+  status = pthread_create(&atThread, NULL, tiAutoTuneThread, NULL);
+  if(status != 0)
+    {
+      printf("%s: ERROR: Unable to start autotuner thread (%d)\n", __func__, status);
+      return ERROR;
+    }
+  atThreadRunning = 1;
+
+  return OK;
+}
+
+/**
+ * @ingroup AutoTune
+ * @brief Stop the background thread.  Returns after the current period
+ *        has elapsed.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiAutoTuneStop()
+{
+  if(!atThreadRunning)
+    return OK;
+
+  atThreadStop = 1;
+  pthread_join(atThread, NULL);
+  atThreadRunning = 0;
+
+  return OK;
+}
+
+/**
+ * @ingroup AutoTune
+ * @brief Copy the status of the last update
+ *
+ * @param status  Where to store the status
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiAutoTuneGetStatus(tiAutoTuneStatus *status)
+{
+  if(status == NULL)
+    {
+      printf("%s: ERROR: Invalid destination\n", __func__);
+      return ERROR;
+    }
+
+  ATLOCK;
+  *status = atStatus;
+  ATUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup AutoTune
+ * @brief Print the status of an update
+ *
+ * @param status  Status to print, NULL for the last update
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiAutoTunePrint(const tiAutoTuneStatus *status)
+{
+  tiAutoTuneStatus s;
+
+  if(status == NULL)
+    {
+      tiAutoTuneGetStatus(&s);
+      status = &s;
+    }
+
+  printf("\n");
+  printf(" Block Level Autotuner\n");
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Interval           %10.3f s\n", status->interval);
+  printf("  Trigger rate       %10.1f Hz accepted, %.1f Hz offered\n",
+	 status->accepted, status->offered);
+  printf("  Live time          %10.2f %%\n", 100. * status->live);
+  printf("  Readout            %10.2f us/block  (%u blocks)\n",
+	 1e6 * status->service, status->nblocks);
+  printf("  Model              %10.2f us + %.3f us/event, %.2f%% other dead time\n",
+	 1e6 * status->overhead, 1e6 * status->perEvent, 100. * status->baseDead);
+  printf("  Block level        %10d  (buffer level %d)\n",
+	 status->blockLevel, status->bufferLevel);
+  if(status->proposed > 0)
+    {
+      printf("  Proposed           %10d  live %.2f%% %s, latency %.3f ms %s%s\n",
+	     status->proposed, 100. * status->predictedLive,
+	     status->liveMet ? "(met)" : "(not met)",
+	     1e3 * status->predictedLatency,
+	     status->latencyMet ? "(met)" : "(not met)",
+	     status->applied ? ", applied" : "");
+    }
+  else
+    printf("  Proposed           %10s\n", "none");
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n");
+
+  return OK;
+}
@@ -0,0 +1,70 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Block level autotuner.  Measures the trigger rate, readout service
+ *     time per block and live time, and proposes (or applies, at a sync
+ *     event) the block level that meets a live time target within an
+ *     event building latency limit.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+typedef struct tiAutoTuneConfig
+{
+  double liveTarget;     /* live fraction to reach, e.g. 0.95 */
+  double maxLatency;     /* seconds, event building latency limit */
+  int    minBlockLevel;
+  int    maxBlockLevel;
+  int    bufferLevel;    /* block buffer level to set with the block level, -1: keep */
+  double overhead;       /* fraction of the service time per block that does not
+			    depend on the block level, until two block levels
+			    have been measured */
+  int    timeout_ms;     /* to see a change current before another is broadcast,
+			    should cover the sync event interval */
+} tiAutoTuneConfig;
+
+typedef struct tiAutoTuneStatus
+{
+  /* Measured over the last interval */
+  double   interval;     /* seconds */
+  double   accepted;     /* Hz, from the event counter */
+  double   offered;      /* Hz, accepted / live */
+  double   live;         /* live fraction */
+  double   service;      /* seconds per block, readout */
+  uint32_t nblocks;      /* blocks read out */
+  int      blockLevel;
+  int      bufferLevel;
+
+  /* Service time model: overhead + perEvent x block level */
+  double   overhead;     /* seconds */
+  double   perEvent;     /* seconds */
+  double   baseDead;     /* dead fraction not from the readout */
+
+  /* Proposal */
+  int      proposed;     /* block level, 0 if none */
+  double   predictedLive;
+  double   predictedLatency;  /* seconds */
+  int      liveMet;      /* 1 if the proposal meets liveTarget */
+  int      latencyMet;   /* 1 if the proposal meets maxLatency */
+  int      applied;      /* 1 if the proposal was broadcast in this update.
+			    It is current at the next sync event */
+} tiAutoTuneStatus;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int  tiAutoTuneInit(const tiAutoTuneConfig *config);
+  void tiAutoTuneReadoutStart();
+  void tiAutoTuneReadoutEnd();
+  void tiAutoTuneAddService(uint32_t nblocks, double seconds);
+  int  tiAutoTunePredict(const tiAutoTuneStatus *status, int blockLevel,
+			 double *live, double *latency);
+  int  tiAutoTuneUpdate(int apply, tiAutoTuneStatus *status);
+  int  tiAutoTuneStart(int period_ms, int apply);
+  int  tiAutoTuneStop();
+  int  tiAutoTuneGetStatus(tiAutoTuneStatus *status);
+  int  tiAutoTunePrint(const tiAutoTuneStatus *status);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,490 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Coordinated block level / block buffer level change.
+ *
+ *     tiBlockLevelPlanMake reads the current levels and the slave ports
+ *     once, and keeps only the steps needed to reach the target.
+ *     tiBlockLevelApply then issues them with one locked register
+ *     sequence (tiBroadcastBlockBufferLevel), without the delays of
+ *     tiSyncReset(1) / tiUserSyncReset(0,1):
+ *       TI_BLCHANGE_PAUSED:    SyncReset Resync (event numbers are kept),
+ *                              then the broadcast.  The block level is
+ *                              current right away.  Triggers must be
+ *                              stopped, and no block waiting for readout.
+ *       TI_BLCHANGE_SYNCEVENT: the broadcast only.  The block level
+ *                              becomes current at the next sync event.
+ *     A change of buffer level alone takes effect right away, in both
+ *     cases, and needs no SyncReset.
+ *
+ *     The block level of every connected slave port is then polled in
+ *     the same loop until it matches the target, so the wait is that of
+ *     the slowest slave.  Buffer levels of the slaves cannot be read back
+ *     from the master.  tiBlockLevelSchedule issues the steps without
+ *     this wait, for callers that confirm later.
+ *
+ *     The controller picks the block level from a table of trigger rate
+ *     thresholds, with hysteresis, and changes it when the rate moves to
+ *     another entry.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiBlockLevel.h"
+
+/**
+ * @defgroup BlockLevel Block Level Change
+ *   Change block level and buffer level together during a run.
+ */
+
+#define TI_BLOCKLEVEL_POLL_NS  100000   /* between confirmation passes */
+
+static tiBlockLevelCtrlLevel blLevels[TI_BLCTRL_MAX_LEVELS];
+static int    blNLevels = 0;
+static int    blCurrent = -1;
+static double blHysteresis = 0.;
+
+static pthread_mutex_t blMutex = PTHREAD_MUTEX_INITIALIZER;
+#define BLLOCK     if(pthread_mutex_lock(&blMutex)<0) perror("pthread_mutex_lock");
+#define BLUNLOCK   if(pthread_mutex_unlock(&blMutex)<0) perror("pthread_mutex_unlock");
+
+static int
+tiBlockLevelElapsed(const struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+/**
+ * @ingroup BlockLevel
+ * @brief Make the transition plan to a block level and buffer level
+ *
+ * @param plan         Where to store the plan
+ * @param blockLevel   Target block level (1-255), 0 to keep the current one
+ * @param bufferLevel  Target block buffer level (0-255), -1 to keep the current one
+ * @param when         TI_BLCHANGE_PAUSED or TI_BLCHANGE_SYNCEVENT
+ *
+ * @return Number of steps in the plan (0: nothing to change), otherwise ERROR
+ */
+int
+tiBlockLevelPlanMake(tiBlockLevelPlan *plan, int blockLevel, int bufferLevel, int when)
+{
+  int nextBlockLevel = 0, slaveMask = 0, connected = 0, nsteps = 0;
+
+  if(plan == NULL)
+    {
+      printf("%s: ERROR: Invalid plan\n", __func__);
+      return ERROR;
+    }
+
+  if((blockLevel < 0) || (blockLevel > TI_BLOCKLEVEL_MASK))
+    {
+      printf("%s: ERROR: Invalid block level (%d)\n", __func__, blockLevel);
+      return ERROR;
+    }
+
+  if(bufferLevel > TI_BLOCKBUFFER_BUFFERLEVEL_MASK)
+    {
+      printf("%s: ERROR: Invalid buffer level (%d)\n", __func__, bufferLevel);
+      return ERROR;
+    }
+
+  if((when != TI_BLCHANGE_PAUSED) && (when != TI_BLCHANGE_SYNCEVENT))
+    {
+      printf("%s: ERROR: Invalid when (%d)\n", __func__, when);
+      return ERROR;
+    }
+
+  memset(plan, 0, sizeof(tiBlockLevelPlan));
+  plan->when = when;
+
+  plan->fromBlockLevel = tiGetCurrentBlockLevel();
+  nextBlockLevel = tiGetNextBlockLevel();
+  plan->fromBufferLevel = tiGetBlockBufferLevel();
+  if((plan->fromBlockLevel == ERROR) || (nextBlockLevel == ERROR) ||
+     (plan->fromBufferLevel == ERROR))
+    return ERROR;
+
+  plan->blockLevel = (blockLevel == 0) ? plan->fromBlockLevel : blockLevel;
+  plan->bufferLevel = (bufferLevel < 0) ? plan->fromBufferLevel : bufferLevel;
+
+  if((plan->blockLevel != plan->fromBlockLevel) || (plan->blockLevel != nextBlockLevel))
+    {
+      plan->steps |= TI_BLPLAN_BLOCKLEVEL;
+      if(when == TI_BLCHANGE_PAUSED)
+	plan->steps |= TI_BLPLAN_SYNCRESET;
+    }
+
+  if(plan->bufferLevel != plan->fromBufferLevel)
+    plan->steps |= TI_BLPLAN_BUFFERLEVEL;
+
+  /* Slaves to confirm */
+  slaveMask = tiGetSlaveMask();
+  if(slaveMask > 0)
+    {
+      connected = tiGetConnectedFiberMask();
+      if(connected == ERROR)
+	return ERROR;
+
+      if(slaveMask & ~connected)
+	printf("%s: WARN: Slave ports 0x%x not connected.  Not confirmed.\n",
+	       __func__, slaveMask & ~connected);
+
+      plan->fiberMask = slaveMask & connected;
+    }
+
+  if(plan->steps & TI_BLPLAN_SYNCRESET)
+    nsteps++;
+  if(plan->steps & TI_BLPLAN_BUFFERLEVEL)
+    nsteps++;
+  if(plan->steps & TI_BLPLAN_BLOCKLEVEL)
+    nsteps++;
+
+  return nsteps;
+}
+
+/**
+ * @ingroup BlockLevel
+ * @brief Wait for the block level of the TI and every connected slave
+ *        port in the plan to reach the target.
+ *
+ * @param plan        Plan, as applied.  pendingMask is left with the ports
+ *                    not confirmed.
+ * @param timeout_ms  Time to wait (milliseconds)
+ *
+ * @return OK if all confirmed, otherwise ERROR
+ */
+int
+tiBlockLevelConfirm(tiBlockLevelPlan *plan, int timeout_ms)
+{
+  struct timespec start, poll = {0, TI_BLOCKLEVEL_POLL_NS};
+  int port, local = 1, bl = 0;
+
+  if(plan == NULL)
+    {
+      printf("%s: ERROR: Invalid plan\n", __func__);
+      return ERROR;
+    }
+
+  plan->pendingMask = 0;
+  if(!(plan->steps & TI_BLPLAN_BLOCKLEVEL))
+    return OK;
+
+  plan->pendingMask = plan->fiberMask;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while(1)
+    {
+      if(local)
+	{
+	  bl = tiGetCurrentBlockLevel();
+	  if(bl == ERROR)
+	    return ERROR;
+	  if(bl == plan->blockLevel)
+	    local = 0;
+	}
+
+      for(port = 1; port <= 8; port++)
+	{
+	  if(!(plan->pendingMask & (1 << (port - 1))))
+	    continue;
+
+	  if(tiGetSlaveBlocklevel(port) == plan->blockLevel)
+	    plan->pendingMask &= ~(1 << (port - 1));
+	}
+
+      if(!local && (plan->pendingMask == 0))
+	return OK;
+
+      if(tiBlockLevelElapsed(&start) >= timeout_ms * 1000)
+	break;
+
+      nanosleep(&poll, NULL);
+    }
+
+  printf("%s: ERROR: Block level %d not confirmed after %d ms:",
+	 __func__, plan->blockLevel, timeout_ms);
+  if(local)
+    printf(" TI (%d)", bl);
+  for(port = 1; port <= 8; port++)
+    if(plan->pendingMask & (1 << (port - 1)))
+      printf(" Fiber %d (%d)", port, tiGetSlaveBlocklevel(port));
+  printf("\n");
+
+  return ERROR;
+}
+
+/**
+ * @ingroup BlockLevel
+ * @brief Issue the steps of a plan from tiBlockLevelPlanMake, without
+ *        waiting for them to take effect.  @sa tiBlockLevelConfirm
+ *
+ * @param plan  Plan to issue
+ *
+ * @return OK if issued, otherwise ERROR
+ */
+int
+tiBlockLevelSchedule(tiBlockLevelPlan *plan)
+{
+  if(plan == NULL)
+    {
+      printf("%s: ERROR: Invalid plan\n", __func__);
+      return ERROR;
+    }
+
+  plan->pendingMask = 0;
+  plan->elapsed_us = 0;
+  if(plan->steps == 0)
+    return OK;
+
+  if((plan->when == TI_BLCHANGE_PAUSED) && (tiBReady() != 0))
+    {
+      printf("%s: ERROR: Blocks waiting for readout.  Not paused.\n", __func__);
+      return ERROR;
+    }
+
+  if(plan->steps & TI_BLPLAN_SYNCRESET)
+    tiSyncResetResync();
+
+  return tiBroadcastBlockBufferLevel((plan->steps & TI_BLPLAN_BLOCKLEVEL) ? plan->blockLevel : 0,
+				     (plan->steps & TI_BLPLAN_BUFFERLEVEL) ? plan->bufferLevel : -1);
+}
+
+/**
+ * @ingroup BlockLevel
+ * @brief Apply a plan from tiBlockLevelPlanMake, and confirm it.
+ *
+ * @param plan        Plan to apply
+ * @param timeout_ms  Time to wait for the confirmation (milliseconds).
+ *                    With TI_BLCHANGE_SYNCEVENT, this should cover the
+ *                    sync event interval.
+ *
+ * @return OK if applied and confirmed, otherwise ERROR
+ */
+int
+tiBlockLevelApply(tiBlockLevelPlan *plan, int timeout_ms)
+{
+  struct timespec start;
+  int rval = OK;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if(tiBlockLevelSchedule(plan) != OK)
+    return ERROR;
+  if(plan->steps == 0)
+    return OK;
+
+  rval = tiBlockLevelConfirm(plan, timeout_ms);
+  plan->elapsed_us = tiBlockLevelElapsed(&start);
+
+  return rval;
+}
+
+/**
+ * @ingroup BlockLevel
+ * @brief Print a plan, and the result if it was applied
+ *
+ * @param plan  Plan to print
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiBlockLevelPlanPrint(const tiBlockLevelPlan *plan)
+{
+  int port;
+
+  if(plan == NULL)
+    return ERROR;
+
+  printf("\n");
+  printf(" Block Level Change (%s)\n",
+	 (plan->when == TI_BLCHANGE_PAUSED) ? "paused" : "at sync event");
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Block level   %3d -> %3d\n", plan->fromBlockLevel, plan->blockLevel);
+  printf("  Buffer level  %3d -> %3d\n", plan->fromBufferLevel, plan->bufferLevel);
+  printf("  Steps        ");
+  if(plan->steps == 0)
+    printf(" none");
+  if(plan->steps & TI_BLPLAN_SYNCRESET)
+    printf(" SyncReset");
+  if(plan->steps & TI_BLPLAN_BUFFERLEVEL)
+    printf(" BufferLevel");
+  if(plan->steps & TI_BLPLAN_BLOCKLEVEL)
+    printf(" BlockLevel");
+  printf("\n");
+  printf("  Confirm      ");
+  if(plan->fiberMask == 0)
+    printf(" TI only");
+  for(port = 1; port <= 8; port++)
+    if(plan->fiberMask & (1 << (port - 1)))
+      printf(" %d%s", port, (plan->pendingMask & (1 << (port - 1))) ? "(pending)" : "");
+  printf("\n");
+  if(plan->elapsed_us > 0)
+    printf("  Elapsed       %d us\n", plan->elapsed_us);
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n");
+
+  return OK;
+}
+
+/**
+ * @ingroup BlockLevel
+ * @brief Configure the controller table
+ *
+ * @param levels      Levels, in increasing minRate
+ * @param nlevels     Number of levels (1-TI_BLCTRL_MAX_LEVELS)
+ * @param hysteresis  Fraction of minRate the rate must be above to move
+ *                    up to a level, or below to move down from it
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiBlockLevelCtrlConfig(const tiBlockLevelCtrlLevel *levels, int nlevels, double hysteresis)
+{
+  int ilevel;
+
+  if((levels == NULL) || (nlevels < 1) || (nlevels > TI_BLCTRL_MAX_LEVELS))
+    {
+      printf("%s: ERROR: Invalid levels (%d)\n", __func__, nlevels);
+      return ERROR;
+    }
+
+  if((hysteresis < 0.) || (hysteresis >= 1.))
+    {
+      printf("%s: ERROR: Invalid hysteresis (%g)\n", __func__, hysteresis);
+      return ERROR;
+    }
+
+  for(ilevel = 0; ilevel < nlevels; ilevel++)
+    {
+      if((levels[ilevel].blockLevel < 1) ||
+	 (levels[ilevel].blockLevel > TI_BLOCKLEVEL_MASK) ||
+	 (levels[ilevel].bufferLevel > TI_BLOCKBUFFER_BUFFERLEVEL_MASK))
+	{
+	  printf("%s: ERROR: Invalid level %d (block %d, buffer %d)\n",
+		 __func__, ilevel, levels[ilevel].blockLevel, levels[ilevel].bufferLevel);
+	  return ERROR;
+	}
+
+      if((ilevel > 0) && (levels[ilevel].minRate <= levels[ilevel - 1].minRate))
+	{
+	  printf("%s: ERROR: minRate of level %d not above level %d\n",
+		 __func__, ilevel, ilevel - 1);
+	  return ERROR;
+	}
+    }
+
+  BLLOCK;
+  memcpy(blLevels, levels, nlevels * sizeof(tiBlockLevelCtrlLevel));
+  blNLevels = nlevels;
+  blHysteresis = hysteresis;
+  blCurrent = -1;
+  BLUNLOCK;
+
+  return OK;
+}
+
+static int
+tiBlockLevelCtrlIndex(double rate, double scale)
+{
+  int ilevel, rval = 0;
+
+  for(ilevel = 1; ilevel < blNLevels; ilevel++)
+    if(rate >= blLevels[ilevel].minRate * scale)
+      rval = ilevel;
+
+  return rval;
+}
+
+/**
+ * @ingroup BlockLevel
+ * @brief Controller level for a trigger rate, from the current level
+ *        and the hysteresis.
+ *
+ * @param rate  Trigger rate (Hz)
+ * @return Level index if successful, otherwise ERROR
+ */
+int
+tiBlockLevelCtrlSelect(double rate)
+{
+  int rval = 0, up = 0;
+
+  BLLOCK;
+  if(blNLevels == 0)
+    {
+      BLUNLOCK;
+      printf("%s: ERROR: Controller not configured\n", __func__);
+      return ERROR;
+    }
+
+  if(blCurrent < 0)
+    rval = tiBlockLevelCtrlIndex(rate, 1.);
+  else
+    {
+      up = tiBlockLevelCtrlIndex(rate, 1. + blHysteresis);
+      if(up > blCurrent)
+	rval = up;
+      else if(rate < blLevels[blCurrent].minRate * (1. - blHysteresis))
+	rval = tiBlockLevelCtrlIndex(rate, 1.);
+      else
+	rval = blCurrent;
+    }
+  BLUNLOCK;
+
+  return rval;
+}
+
+/**
+ * @ingroup BlockLevel
+ * @brief Change to the controller level for a trigger rate, if it is not
+ *        the current one.
+ *
+ * @param rate        Trigger rate (Hz)
+ * @param when        TI_BLCHANGE_PAUSED or TI_BLCHANGE_SYNCEVENT
+ * @param timeout_ms  Time to wait for the confirmation (milliseconds)
+ *
+ * @return Level index if successful, otherwise ERROR
+ */
+int
+tiBlockLevelCtrlUpdate(double rate, int when, int timeout_ms)
+{
+  tiBlockLevelPlan plan;
+  int ilevel;
+
+  ilevel = tiBlockLevelCtrlSelect(rate);
+  if(ilevel == ERROR)
+    return ERROR;
+
+  BLLOCK;
+  if(ilevel == blCurrent)
+    {
+      BLUNLOCK;
+      return ilevel;
+    }
+
+  if(tiBlockLevelPlanMake(&plan, blLevels[ilevel].blockLevel,
+			  blLevels[ilevel].bufferLevel, when) == ERROR)
+    {
+      BLUNLOCK;
+      return ERROR;
+    }
+
+  if(tiBlockLevelApply(&plan, timeout_ms) != OK)
+    {
+      BLUNLOCK;
+      return ERROR;
+    }
+
+  printf("%s: INFO: %.1f Hz: Block level %d -> %d, buffer level %d -> %d (%d us)\n",
+	 __func__, rate, plan.fromBlockLevel, plan.blockLevel,
+	 plan.fromBufferLevel, plan.bufferLevel, plan.elapsed_us);
+  blCurrent = ilevel;
+  BLUNLOCK;
+
+  return ilevel;
+}
@@ -0,0 +1,59 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Coordinated block level / block buffer level change.  A transition
+ *     plan is made ahead of time, then applied while the run is paused
+ *     or at the next sync event, and confirmed on every connected slave.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* When the change takes effect */
+#define TI_BLCHANGE_PAUSED     0   /* now, with a SyncReset Resync.  Triggers must be stopped */
+#define TI_BLCHANGE_SYNCEVENT  1   /* at the next sync event */
+
+/* Steps of a plan */
+#define TI_BLPLAN_SYNCRESET    (1<<0)
+#define TI_BLPLAN_BUFFERLEVEL  (1<<1)
+#define TI_BLPLAN_BLOCKLEVEL   (1<<2)
+
+#define TI_BLCTRL_MAX_LEVELS   8
+
+typedef struct tiBlockLevelPlan
+{
+  int      when;           /* TI_BLCHANGE_* */
+  int      blockLevel;     /* target */
+  int      bufferLevel;    /* target */
+  int      fromBlockLevel; /* current, when planned */
+  int      fromBufferLevel;
+  uint32_t steps;          /* TI_BLPLAN_*, empty if nothing to change */
+  uint32_t fiberMask;      /* slave ports to confirm (bit 0 = Fiber 1) */
+
+  /* Filled by tiBlockLevelApply */
+  uint32_t pendingMask;    /* ports not confirmed at the timeout */
+  int      elapsed_us;     /* from the first write to the confirmation */
+} tiBlockLevelPlan;
+
+typedef struct tiBlockLevelCtrlLevel
+{
+  double minRate;          /* Hz, lowest trigger rate for this level */
+  int    blockLevel;
+  int    bufferLevel;
+} tiBlockLevelCtrlLevel;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int tiBlockLevelPlanMake(tiBlockLevelPlan *plan, int blockLevel, int bufferLevel, int when);
+  int tiBlockLevelSchedule(tiBlockLevelPlan *plan);
+  int tiBlockLevelApply(tiBlockLevelPlan *plan, int timeout_ms);
+  int tiBlockLevelConfirm(tiBlockLevelPlan *plan, int timeout_ms);
+  int tiBlockLevelPlanPrint(const tiBlockLevelPlan *plan);
+
+  int tiBlockLevelCtrlConfig(const tiBlockLevelCtrlLevel *levels, int nlevels, double hysteresis);
+  int tiBlockLevelCtrlSelect(double rate);
+  int tiBlockLevelCtrlUpdate(double rate, int when, int timeout_ms);
+#ifdef __cplusplus
+}
+#endif
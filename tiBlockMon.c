@@ -0,0 +1,346 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Block pipeline depth tracker for the TI Master.
+ *
+ *     Each sample reads all block status words with tiBlockStatusAll and
+ *     fills, for every watched port, a histogram of the blocks needing
+ *     acknowledge.  The port with strictly the most blocks needing
+ *     acknowledge is counted as the slowest ROC of that sample.  The
+ *     sampler can run in its own thread (tiBlockMonStart).
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiBlockMon.h"
+
+/**
+ * @defgroup BlockMon Block Pipeline Monitor
+ *   Per port history of the block pipeline depth.
+ */
+
+static pthread_mutex_t bmMutex = PTHREAD_MUTEX_INITIALIZER;
+#define BMLOCK     if(pthread_mutex_lock(&bmMutex)<0) perror("pthread_mutex_lock");
+#define BMUNLOCK   if(pthread_mutex_unlock(&bmMutex)<0) perror("pthread_mutex_unlock");
+
+static tiBlockMonPort bmPort[TI_BLOCKMON_NPORTS];
+static double   bmSumNeedAck[TI_BLOCKMON_NPORTS];
+static uint32_t bmPortMask = 0;
+
+/* Slowest port of the most recent samples (-1 = none) */
+static int      bmRecent[TI_BLOCKMON_RECENT];
+static int      bmRecentHead = 0;
+
+static pthread_t bmThread;
+static int       bmThreadRunning = 0;
+static volatile int bmThreadStop = 0;
+static volatile int bmThreadDone = 0;  /* thread exited, not joined yet */
+static int       bmThreadPeriod = 0;   /* ms */
+
+/**
+ * @ingroup BlockMon
+ * @brief Clear the histograms and select the ports to watch
+ *
+ * @param portMask Mask of ports to watch.  Bit 0: Loopback, bit n: Fiber n.
+ *                 If 0, the Loopback and the added TI Slaves are used.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiBlockMonInit(uint32_t portMask)
+{
+  int slaveMask = 0, isamp;
+
+  if(portMask == 0)
+    {
+      slaveMask = tiGetSlaveMask();
+      if(slaveMask == ERROR)
+	return ERROR;
+      portMask = 0x1 | (slaveMask << 1);
+    }
+
+  BMLOCK;
+  memset((void *)bmPort, 0, sizeof(bmPort));
+  memset((void *)bmSumNeedAck, 0, sizeof(bmSumNeedAck));
+  for(isamp = 0; isamp < TI_BLOCKMON_RECENT; isamp++)
+    bmRecent[isamp] = -1;
+  bmRecentHead = 0;
+  bmPortMask = portMask & 0x1FF;
+  BMUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup BlockMon
+ * @brief Take one sample of the block status of the watched ports
+ *
+ * @return Slowest port of this sample, -1 if none, ERROR on error
+ */
+int
+tiBlockMonSample()
+{
+  unsigned int status[TI_BLOCKMON_NPORTS];
+  uint32_t needAck = 0, maxNeedAck = 0;
+  int iport, slowest = -1, nmax = 0, old = 0;
+  tiBlockMonPort *p;
+
+  if(tiBlockStatusAll(status) != OK)
+    return ERROR;
+
+  BMLOCK;
+  for(iport = 0; iport < TI_BLOCKMON_NPORTS; iport++)
+    {
+      if((bmPortMask & (1 << iport)) == 0)
+	continue;
+
+      p = &bmPort[iport];
+      needAck = (status[iport] & TI_BLOCKSTATUS_NBLOCKS_NEEDACK0)>>8;
+
+      p->nsamples++;
+      p->lastReady = status[iport] & TI_BLOCKSTATUS_NBLOCKS_READY0;
+      p->lastNeedAck = needAck;
+      p->histo[(needAck < TI_BLOCKMON_NBINS) ? needAck : (TI_BLOCKMON_NBINS - 1)]++;
+      if(needAck > p->maxNeedAck)
+	p->maxNeedAck = needAck;
+      bmSumNeedAck[iport] += needAck;
+      p->meanNeedAck = bmSumNeedAck[iport] / p->nsamples;
+
+      if(needAck > maxNeedAck)
+	{
+	  maxNeedAck = needAck;
+	  slowest = iport;
+	  nmax = 1;
+	}
+      else if((needAck == maxNeedAck) && (needAck > 0))
+	nmax++;
+    }
+
+  /* Only a port strictly behind all others is the slowest */
+  if(nmax != 1)
+    slowest = -1;
+
+  old = bmRecent[bmRecentHead];
+  if(old >= 0)
+    bmPort[old].slowestRecent--;
+  bmRecent[bmRecentHead] = slowest;
+  bmRecentHead = (bmRecentHead + 1) % TI_BLOCKMON_RECENT;
+
+  if(slowest >= 0)
+    {
+      bmPort[slowest].slowest++;
+      bmPort[slowest].slowestRecent++;
+    }
+  BMUNLOCK;
+
+  return slowest;
+}
+
+static void *
+tiBlockMonThread(void *arg)
+{
+  struct timespec period;
+
+  period.tv_sec  = bmThreadPeriod / 1000;
+  period.tv_nsec = (bmThreadPeriod % 1000) * 1000000;
+
+  while(!bmThreadStop)
+    {
+      if(tiBlockMonSample() == ERROR)
+	break;
+
+      nanosleep(&period, NULL);
+    }
+
+  printf("%s: Sampling stopped\n", __func__);
+  bmThreadDone = 1;
+  return NULL;
+}
+
+/**
+ * @ingroup BlockMon
+ * @brief Start sampling in a background thread
+ *
+ * @param period_ms  Time between samples (ms)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiBlockMonStart(int period_ms)
+{
+  int status = 0;
+
+  if(period_ms <= 0)
+    {
+      printf("%s: ERROR: Invalid period (%d ms)\n", __func__, period_ms);
+      return ERROR;
+    }
+
+  /* Sampler that stopped on an error */
+  if(bmThreadRunning && bmThreadDone)
+    {
+      pthread_join(bmThread, NULL);
+      bmThreadRunning = 0;
+    }
+
+  if(bmThreadRunning)
+    {
+      printf("%s: ERROR: Sampler already running\n", __func__);
+      return ERROR;
+    }
+
+  bmThreadPeriod = period_ms;
+  bmThreadStop = 0;
+  bmThreadDone = 0;
+  status = pthread_create(&bmThread, NULL, tiBlockMonThread, NULL);
+  if(status != 0)
+    {
+      printf("%s: ERROR: Unable to start sampler thread (%d)\n", __func__, status);
+      return ERROR;
+    }
+  bmThreadRunning = 1;
+
+  return OK;
+}
+
+/**
+ * @ingroup BlockMon
+ * @brief Stop the background sampler thread.  Returns after the current
+ *        period has elapsed.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiBlockMonStop()
+{
+  if(!bmThreadRunning)
+    return OK;
+
+  bmThreadStop = 1;
+  pthread_join(bmThread, NULL);
+  bmThreadRunning = 0;
+
+  return OK;
+}
+
+/**
+ * @ingroup BlockMon
+ * @brief Copy the histogram and statistics of a port
+ *
+ * @param port   0: Loopback, 1-8: Fiber 1-8
+ * @param stats  Where to store the statistics
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiBlockMonGetPort(int port, tiBlockMonPort *stats)
+{
+  if((port < 0) || (port >= TI_BLOCKMON_NPORTS) || (stats == NULL))
+    {
+      printf("%s: ERROR: Invalid port (%d) or destination\n", __func__, port);
+      return ERROR;
+    }
+
+  BMLOCK;
+  *stats = bmPort[port];
+  BMUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup BlockMon
+ * @brief Return the port most often the slowest in the recent samples
+ *
+ * @param count  If not NULL, where to store the number of recent samples
+ *               in which that port was the slowest
+ *
+ * @return Port (0: Loopback, 1-8: Fiber 1-8), or -1 if no port has been behind
+ */
+int
+tiBlockMonSlowest(uint32_t *count)
+{
+  uint32_t maxCount = 0;
+  int iport, rval = -1;
+
+  BMLOCK;
+  for(iport = 0; iport < TI_BLOCKMON_NPORTS; iport++)
+    {
+      if(bmPort[iport].slowestRecent > maxCount)
+	{
+	  maxCount = bmPort[iport].slowestRecent;
+	  rval = iport;
+	}
+    }
+  BMUNLOCK;
+
+  if(count)
+    *count = maxCount;
+
+  return rval;
+}
+
+/**
+ * @ingroup BlockMon
+ * @brief Print the pipeline statistics of each watched port to standard out
+ *
+ * @return OK
+ */
+int
+tiBlockMonPrintStatus()
+{
+  tiBlockMonPort stats;
+  uint32_t mask = 0, count = 0;
+  int iport, ibin, slowest = -1;
+  char name[20];
+
+  BMLOCK;
+  mask = bmPortMask;
+  BMUNLOCK;
+
+  printf("\n");
+  printf(" Block Pipeline Monitor\n");
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Port      Samples  Ready  NeedAck   Mean    Max   Slowest (recent)\n");
+  printf("--------------------------------------------------------------------------------\n");
+
+  for(iport = 0; iport < TI_BLOCKMON_NPORTS; iport++)
+    {
+      if((mask & (1 << iport)) == 0)
+	continue;
+
+      tiBlockMonGetPort(iport, &stats);
+      if(iport == 0)
+	sprintf(name, "Loopback");
+      else
+	sprintf(name, "Fiber %d", iport);
+
+      printf("  %-8s  %7d  %5d  %7d  %5.2f  %5d   %7d (%d)\n",
+	     name, stats.nsamples, stats.lastReady, stats.lastNeedAck,
+	     stats.meanNeedAck, stats.maxNeedAck,
+	     stats.slowest, stats.slowestRecent);
+
+      printf("            histo:");
+      for(ibin = 0; ibin <= stats.maxNeedAck && ibin < TI_BLOCKMON_NBINS; ibin++)
+	printf(" %d", stats.histo[ibin]);
+      printf("\n");
+    }
+
+  slowest = tiBlockMonSlowest(&count);
+  printf("--------------------------------------------------------------------------------\n");
+  if(slowest < 0)
+    printf("  No port behind in the last %d samples\n", TI_BLOCKMON_RECENT);
+  else if(slowest == 0)
+    printf("  Slowest: Loopback (%d of the last %d samples)\n", count, TI_BLOCKMON_RECENT);
+  else
+    printf("  Slowest: Fiber %d (%d of the last %d samples)\n", slowest, count, TI_BLOCKMON_RECENT);
+  if(bmThreadRunning)
+    printf("  Sampler: %s\n", bmThreadDone ? "stopped on an error" : "running");
+  printf("\n");
+
+  return OK;
+}
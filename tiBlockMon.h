@@ -0,0 +1,41 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Block pipeline depth tracker for the TI Master.  Samples the block
+ *     status of the loopback and fiber ports, histograms the number of
+ *     blocks waiting for acknowledge on each port, and attributes each
+ *     sample to the slowest ROC.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define TI_BLOCKMON_NPORTS    9   /* 0: Loopback, 1-8: Fiber 1-8 */
+#define TI_BLOCKMON_NBINS    32   /* occupancy bins, the last includes overflow */
+#define TI_BLOCKMON_RECENT   64   /* samples in the recent slowest ROC window */
+
+typedef struct tiBlockMonPort
+{
+  uint32_t nsamples;
+  uint32_t histo[TI_BLOCKMON_NBINS];  /* blocks needing acknowledge */
+  uint32_t maxNeedAck;
+  double   meanNeedAck;
+  uint32_t lastReady;
+  uint32_t lastNeedAck;
+  uint32_t slowest;        /* samples where this port was the slowest */
+  uint32_t slowestRecent;  /* ... within the last TI_BLOCKMON_RECENT samples */
+} tiBlockMonPort;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int tiBlockMonInit(uint32_t portMask);
+  int tiBlockMonSample();
+  int tiBlockMonStart(int period_ms);
+  int tiBlockMonStop();
+  int tiBlockMonGetPort(int port, tiBlockMonPort *stats);
+  int tiBlockMonSlowest(uint32_t *count);
+  int tiBlockMonPrintStatus();
+#ifdef __cplusplus
+}
+#endif
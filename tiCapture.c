@@ -0,0 +1,459 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Capture and replay of the readout data stream (Linux).
+ *
+ *     The capture hooks (called from tiReadBlock and tiBReady, when
+ *     tiCaptureEnabled) copy the record and its words into a byte ring
+ *     and return; a record that does not fit is dropped and counted.
+ *     The writer thread moves what is queued to the file, so readout
+ *     never waits on the disk.
+ *
+ *     Capture file (host byte order):
+ *       header   "TICAPT01", version, block level, start time,
+ *                duration (ns) and number of records (set at the stop)
+ *       records  tiCaptureRecord, followed by nwords words as read
+ *                from the FIFO (big endian, as the TI delivers them)
+ *
+ *     tiCaptureReplay reads the records back and passes each one to a
+ *     feed routine, at the recorded time (scaled by the speed), or as
+ *     fast as the feed takes them.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiCapture.h"
+
+/**
+ * @defgroup Capture Readout Capture and Replay
+ *   Record the data stream delivered to the readout, and play it back.
+ */
+
+#define TI_CAPTURE_MAGIC    "TICAPT01"
+#define TI_CAPTURE_VERSION  1
+#define TI_CAPTURE_MAXWORDS (1024*1024)
+
+typedef struct tiCaptureFileHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t blockLevel;
+  double   startTime;
+  uint64_t duration_ns;
+  uint64_t records;
+} tiCaptureFileHeader;
+
+volatile int tiCaptureEnabled = 0;
+
+static uint8_t        cpRing[TI_CAPTURE_RING];
+static uint64_t       cpHead = 0, cpTail = 0;   /* bytes queued, written */
+static tiCaptureStats cpStats;
+static uint64_t       cpStart = 0;              /* CLOCK_MONOTONIC (ns) */
+static FILE          *cpFile = NULL;
+static tiCaptureFileHeader cpHeader;
+
+static pthread_mutex_t cpMutex = PTHREAD_MUTEX_INITIALIZER;
+#define CPLOCK     if(pthread_mutex_lock(&cpMutex)<0) perror("pthread_mutex_lock");
+#define CPUNLOCK   if(pthread_mutex_unlock(&cpMutex)<0) perror("pthread_mutex_unlock");
+
+static pthread_t    cpThread;
+static volatile int cpThreadStop = 0;
+
+static uint64_t
+tiCaptureNow()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Copy into the ring at pos, wrapping around */
+static void
+tiCaptureCopy(uint64_t pos, const void *src, uint32_t len)
+{
+  uint32_t offset = pos & (TI_CAPTURE_RING - 1), first;
+
+  first = TI_CAPTURE_RING - offset;
+  if(first >= len)
+    memcpy(&cpRing[offset], src, len);
+  else
+    {
+      memcpy(&cpRing[offset], src, first);
+      memcpy(cpRing, (const uint8_t *)src + first, len - first);
+    }
+}
+
+static void
+tiCapturePut(tiCaptureRecord *rec, volatile unsigned int *data, int ndata,
+	     const unsigned int *extra, int nextra)
+{
+  uint32_t len, queued;
+  uint64_t head;
+
+  rec->nwords = ndata + nextra;
+  len = sizeof(*rec) + rec->nwords * sizeof(uint32_t);
+
+  CPLOCK;
+  if(!tiCaptureEnabled)
+    {
+      CPUNLOCK;
+      return;
+    }
+
+  rec->time_ns = tiCaptureNow() - cpStart;
+  head = cpHead;
+  queued = head - __atomic_load_n(&cpTail, __ATOMIC_ACQUIRE);
+  if(queued + len > TI_CAPTURE_RING)
+    {
+      cpStats.dropped++;
+      CPUNLOCK;
+      return;
+    }
+
+  tiCaptureCopy(head, rec, sizeof(*rec));
+  head += sizeof(*rec);
+  if(ndata > 0)
+    {
+      tiCaptureCopy(head, (const void *)data, ndata * sizeof(uint32_t));
+      head += ndata * sizeof(uint32_t);
+    }
+  if(nextra > 0)
+    {
+      tiCaptureCopy(head, extra, nextra * sizeof(uint32_t));
+      head += nextra * sizeof(uint32_t);
+    }
+  __atomic_store_n(&cpHead, head, __ATOMIC_RELEASE);
+
+  cpStats.records++;
+  cpStats.bytes += len;
+  if(queued + len > cpStats.maxQueued)
+    cpStats.maxQueued = queued + len;
+  CPUNLOCK;
+}
+
+/**
+ * @ingroup Capture
+ * @brief Capture what a tiReadBlock call delivered.  Called by tiReadBlock.
+ *
+ * @param flags     TI_CAPTURE_READBLOCK, _TRIGGERBLOCK or _RECOVERY,
+ *                  with the rflag << TI_CAPTURE_RFLAG_SHIFT
+ * @param maxwords  nwrds requested
+ * @param data      Words read
+ * @param rval      tiReadBlock return value, and the words in data if > 0
+ * @param extra     Words read from the FIFO but not returned (filler)
+ * @param nextra    Number of them
+ */
+void
+tiCaptureBlock(int flags, int maxwords, volatile unsigned int *data, int rval,
+	       const unsigned int *extra, int nextra)
+{
+  tiCaptureRecord rec;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.type = TI_CAPTURE_BLOCK;
+  rec.flags = flags;
+  rec.value = rval;
+  rec.maxwords = maxwords;
+
+  tiCapturePut(&rec, data, (rval > 0) ? rval : 0, extra, nextra);
+}
+
+/**
+ * @ingroup Capture
+ * @brief Capture the blockBuffer register.  Called by tiBReady.
+ *
+ * @param blockBuffer  Value read
+ */
+void
+tiCaptureBReady(unsigned int blockBuffer)
+{
+  tiCaptureRecord rec;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.type = TI_CAPTURE_BREADY;
+  rec.value = blockBuffer;
+
+  tiCapturePut(&rec, NULL, 0, NULL, 0);
+}
+
+/* Write what is queued.  Returns the number of bytes */
+static uint64_t
+tiCaptureDrain()
+{
+  uint64_t head, tail, len;
+  uint32_t offset, first;
+
+  head = __atomic_load_n(&cpHead, __ATOMIC_ACQUIRE);
+  tail = cpTail;
+  len = head - tail;
+  if(len == 0)
+    return 0;
+
+  offset = tail & (TI_CAPTURE_RING - 1);
+  first = TI_CAPTURE_RING - offset;
+  if(first >= len)
+    fwrite(&cpRing[offset], 1, len, cpFile);
+  else
+    {
+      fwrite(&cpRing[offset], 1, first, cpFile);
+      fwrite(cpRing, 1, len - first, cpFile);
+    }
+
+  __atomic_store_n(&cpTail, head, __ATOMIC_RELEASE);
+
+  return len;
+}
+
+static void *
+tiCaptureThread(void *arg)
+{
+  struct timespec idle = {0, 1000000};
+
+  while(1)
+    {
+      if((tiCaptureDrain() == 0) && cpThreadStop)
+	break;
+
+      if(!cpThreadStop)
+	nanosleep(&idle, NULL);
+    }
+
+  return NULL;
+}
+
+/**
+ * @ingroup Capture
+ * @brief Start capturing the readout data stream to a file
+ *
+ * @param filename  Capture file, overwritten
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiCaptureStart(const char *filename)
+{
+  struct timespec now;
+  int status, bl;
+
+  if(filename == NULL)
+    {
+      printf("%s: ERROR: Invalid filename\n", __func__);
+      return ERROR;
+    }
+
+  if(cpFile != NULL)
+    {
+      printf("%s: ERROR: Capture already running\n", __func__);
+      return ERROR;
+    }
+
+  cpFile = fopen(filename, "wb");
+  if(cpFile == NULL)
+    {
+      printf("%s: ERROR: Unable to open %s\n", __func__, filename);
+      perror("fopen");
+      return ERROR;
+    }
+
+  bl = tiGetCurrentBlockLevel();
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  memset(&cpHeader, 0, sizeof(cpHeader));
+  memcpy(cpHeader.magic, TI_CAPTURE_MAGIC, 8);
+  cpHeader.version = TI_CAPTURE_VERSION;
+  cpHeader.blockLevel = (bl > 0) ? bl : 0;
+  cpHeader.startTime = now.tv_sec + now.tv_nsec * 1e-9;
+  fwrite(&cpHeader, sizeof(cpHeader), 1, cpFile);
+
+  memset(&cpStats, 0, sizeof(cpStats));
+  cpHead = 0;
+  cpTail = 0;
+  cpStart = tiCaptureNow();
+
+  cpThreadStop = 0;
+  status = pthread_create(&cpThread, NULL, tiCaptureThread, NULL);
+  if(status != 0)
+    {
+      printf("%s: ERROR: Unable to start writer thread (%d)\n", __func__, status);
+      fclose(cpFile);
+      cpFile = NULL;
+      return ERROR;
+    }
+
+  __atomic_store_n(&tiCaptureEnabled, 1, __ATOMIC_RELEASE);
+
+  return OK;
+}
+
+/**
+ * @ingroup Capture
+ * @brief Stop capturing, write what is queued and close the file
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiCaptureStop()
+{
+  if(cpFile == NULL)
+    return OK;
+
+  /* No record is being queued after this */
+  CPLOCK;
+  tiCaptureEnabled = 0;
+  CPUNLOCK;
+
+  cpThreadStop = 1;
+  pthread_join(cpThread, NULL);
+
+  cpHeader.duration_ns = tiCaptureNow() - cpStart;
+  cpHeader.records = cpStats.records;
+  fseek(cpFile, 0, SEEK_SET);
+  fwrite(&cpHeader, sizeof(cpHeader), 1, cpFile);
+
+  if(fclose(cpFile) != 0)
+    {
+      printf("%s: ERROR: Writing the capture file\n", __func__);
+      cpFile = NULL;
+      return ERROR;
+    }
+  cpFile = NULL;
+
+  return OK;
+}
+
+/**
+ * @ingroup Capture
+ * @brief Return the capture counters
+ *
+ * @param stats  Where to store them
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiCaptureGetStats(tiCaptureStats *stats)
+{
+  if(stats == NULL)
+    {
+      printf("%s: ERROR: Invalid destination\n", __func__);
+      return ERROR;
+    }
+
+  CPLOCK;
+  *stats = cpStats;
+  CPUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup Capture
+ * @brief Play back a capture file, passing each record to a feed routine
+ *
+ * @param filename  Capture file
+ * @param speed     1.0: at the recorded time, 2.0: twice as fast, ...
+ *                  0: as fast as the feed routine takes them
+ * @param feed      Called for each record.  Returning ERROR stops the replay.
+ * @param arg       Passed to feed
+ *
+ * @return Number of records played back if successful, otherwise ERROR
+ */
+int
+tiCaptureReplay(const char *filename, double speed, TICAPTUREFEED feed, void *arg)
+{
+  tiCaptureFileHeader header;
+  tiCaptureInfo info;
+  tiCaptureRecord rec;
+  uint32_t *words = NULL;
+  uint32_t maxwords = 0;
+  uint64_t start, target, now;
+  struct timespec wait;
+  FILE *f;
+  int nrec = 0, rval = OK;
+
+  if((filename == NULL) || (feed == NULL) || (speed < 0.))
+    {
+      printf("%s: ERROR: Invalid arguments\n", __func__);
+      return ERROR;
+    }
+
+  f = fopen(filename, "rb");
+  if(f == NULL)
+    {
+      printf("%s: ERROR: Unable to open %s\n", __func__, filename);
+      return ERROR;
+    }
+
+  if((fread(&header, sizeof(header), 1, f) != 1) ||
+     (memcmp(header.magic, TI_CAPTURE_MAGIC, 8) != 0) ||
+     (header.version != TI_CAPTURE_VERSION))
+    {
+      printf("%s: ERROR: %s is not a capture file\n", __func__, filename);
+      fclose(f);
+      return ERROR;
+    }
+
+  info.blockLevel = header.blockLevel;
+  info.startTime = header.startTime;
+  info.duration_ns = header.duration_ns;
+  info.records = header.records;
+
+  start = tiCaptureNow();
+  while(fread(&rec, sizeof(rec), 1, f) == 1)
+    {
+      if(rec.nwords > TI_CAPTURE_MAXWORDS)
+	{
+	  printf("%s: ERROR: Invalid record %d (%u words)\n", __func__, nrec, rec.nwords);
+	  rval = ERROR;
+	  break;
+	}
+
+      if(rec.nwords > maxwords)
+	{
+	  uint32_t *w = (uint32_t *)realloc(words, rec.nwords * sizeof(uint32_t));
+
+	  if(w == NULL)
+	    {
+	      printf("%s: ERROR: Unable to allocate %u words\n", __func__, rec.nwords);
+	      rval = ERROR;
+	      break;
+	    }
+	  words = w;
+	  maxwords = rec.nwords;
+	}
+
+      if((rec.nwords > 0) && (fread(words, sizeof(uint32_t), rec.nwords, f) != rec.nwords))
+	{
+	  printf("%s: ERROR: Record %d truncated\n", __func__, nrec);
+	  rval = ERROR;
+	  break;
+	}
+
+      if(speed > 0.)
+	{
+	  target = start + (uint64_t)(rec.time_ns / speed);
+	  now = tiCaptureNow();
+	  if(target > now)
+	    {
+	      wait.tv_sec = (target - now) / 1000000000;
+	      wait.tv_nsec = (target - now) % 1000000000;
+	      nanosleep(&wait, NULL);
+	    }
+	}
+
+      if(feed(&info, &rec, words, arg) == ERROR)
+	break;
+      nrec++;
+    }
+
+  if(words)
+    free(words);
+  fclose(f);
+
+  return (rval == OK) ? nrec : ERROR;
+}
@@ -0,0 +1,74 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Capture and replay of the readout data stream (Linux).  While
+ *     capturing, what tiReadBlock delivered (raw words, return value) and
+ *     the blockBuffer register read by tiBReady are queued, with their
+ *     time, and written to a binary file by a background thread.  The
+ *     file is played back, at the recorded or at maximum speed, through a
+ *     routine that feeds a (simulated) backend.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define TI_CAPTURE_RING      (4*1024*1024)  /* queued bytes, power of 2 */
+
+/* Record types */
+#define TI_CAPTURE_BREADY    1   /* value: blockBuffer register */
+#define TI_CAPTURE_BLOCK     2   /* value: tiReadBlock return, words: read from the FIFO */
+
+/* TI_CAPTURE_BLOCK flags: which tiReadBlock call, and its rflag */
+#define TI_CAPTURE_READBLOCK     0x0   /* called by the user */
+#define TI_CAPTURE_TRIGGERBLOCK  0x1   /* block read by tiReadTriggerBlock */
+#define TI_CAPTURE_RECOVERY      0x2   /* drain of the readout recovery */
+#define TI_CAPTURE_CALLER_MASK   0xF
+#define TI_CAPTURE_RFLAG_SHIFT   4
+
+typedef struct tiCaptureRecord
+{
+  uint16_t type;
+  uint16_t flags;
+  uint32_t nwords;     /* words that follow the record */
+  uint64_t time_ns;    /* since tiCaptureStart */
+  int32_t  value;
+  uint32_t maxwords;   /* TI_CAPTURE_BLOCK: nwrds requested */
+} tiCaptureRecord;
+
+/* From the file header */
+typedef struct tiCaptureInfo
+{
+  uint32_t blockLevel; /* when the capture started */
+  double   startTime;  /* CLOCK_REALTIME (s) */
+  uint64_t duration_ns;
+  uint64_t records;
+} tiCaptureInfo;
+
+typedef struct tiCaptureStats
+{
+  uint64_t records;    /* written */
+  uint64_t bytes;
+  uint64_t dropped;    /* queue full */
+  uint32_t maxQueued;  /* bytes */
+} tiCaptureStats;
+
+/* Called by tiCaptureReplay for each record, words in FIFO byte order */
+typedef int (*TICAPTUREFEED)(const tiCaptureInfo *info, const tiCaptureRecord *rec,
+			     const uint32_t *words, void *arg);
+
+extern volatile int tiCaptureEnabled;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int  tiCaptureStart(const char *filename);
+  int  tiCaptureStop();
+  int  tiCaptureGetStats(tiCaptureStats *stats);
+  void tiCaptureBlock(int flags, int maxwords, volatile unsigned int *data, int rval,
+		      const unsigned int *extra, int nextra);
+  void tiCaptureBReady(unsigned int blockBuffer);
+  int  tiCaptureReplay(const char *filename, double speed,
+		       TICAPTUREFEED feed, void *arg);
+#ifdef __cplusplus
+}
+#endif
@@ -5,6 +5,7 @@
 #include <string>
 #include <sstream>
 #include <memory>
+#include <set>
 #include "tiConfig.h"
 #include "INIReader.h"
 
@@ -12,6 +13,7 @@
 extern "C" {
 #include "jvme.h"
 #include "tiLib.h"
+#include "tiTrigTable.h"
 }
 #endif
 
@@ -154,7 +156,29 @@ const ti_param_map ti_pulser_def =
     { "RANDOM_ENABLE", -1 },
     { "RANDOM_PRESCALE", -1 },
   };
-static ti_param_map ti_pulser_ini = ti_pulser_def;
+static ti_param_map ti_pulser_ini = ti_pulser_def, ti_pulser_readback = ti_pulser_def;
+
+// User defined trigger table (TRIGGER_TABLE = 4), 16 pattern words
+const ti_param_map ti_table_def =
+  {
+    { "TABLE_WORD_0", -1 },
+    { "TABLE_WORD_1", -1 },
+    { "TABLE_WORD_2", -1 },
+    { "TABLE_WORD_3", -1 },
+    { "TABLE_WORD_4", -1 },
+    { "TABLE_WORD_5", -1 },
+    { "TABLE_WORD_6", -1 },
+    { "TABLE_WORD_7", -1 },
+    { "TABLE_WORD_8", -1 },
+    { "TABLE_WORD_9", -1 },
+    { "TABLE_WORD_10", -1 },
+    { "TABLE_WORD_11", -1 },
+    { "TABLE_WORD_12", -1 },
+    { "TABLE_WORD_13", -1 },
+    { "TABLE_WORD_14", -1 },
+    { "TABLE_WORD_15", -1 },
+  };
+static ti_param_map ti_table_ini = ti_table_def, ti_table_readback = ti_table_def;
 
 
 
@@ -169,6 +193,22 @@ tiConfigInitGlobals()
 }
 
 
+/**
+ * @brief Read one section of the ini into a ti_param_map, using the defaults for missing keys
+ */
+static void
+parseSection(INIReader *reader, const std::string &section,
+	     const ti_param_map &def, ti_param_map &out)
+{
+  ti_param_map::const_iterator pos = def.begin();
+
+  while(pos != def.end())
+    {
+      out[pos->first] = reader->GetInteger(section, pos->first, pos->second);
+      ++pos;
+    }
+}
+
 /**
  * @brief Write the Ini values to the local ti_param_map's
  */
@@ -182,43 +222,12 @@ parseIni()
   if(ir == NULL)
     return;
 
-  ti_param_map::const_iterator pos = ti_general_def.begin();
-
-  while(pos != ti_general_def.end())
-    {
-      ti_general_ini[pos->first] = ir->GetInteger("general", pos->first, pos->second);
-      ++pos;
-    }
-
-  pos = ti_slaves_def.begin();
-  while(pos != ti_slaves_def.end())
-    {
-      ti_slaves_ini[pos->first] = ir->GetInteger("slaves", pos->first, pos->second);
-      ++pos;
-    }
-
-  pos = ti_tsinputs_def.begin();
-  while(pos != ti_tsinputs_def.end())
-    {
-      ti_tsinputs_ini[pos->first] = ir->GetInteger("tsinputs", pos->first, pos->second);
-      ++pos;
-    }
-
-  pos = ti_rules_def.begin();
-  while(pos != ti_rules_def.end())
-    {
-      ti_rules_ini[pos->first] = ir->GetInteger("trigger_rules", pos->first, pos->second);
-      ++pos;
-    }
-
-  pos = ti_pulser_def.begin();
-  while(pos != ti_pulser_def.end())
-    {
-      ti_pulser_ini[pos->first] = ir->GetInteger("pulser", pos->first, pos->second);
-      ++pos;
-    }
-
-
+  parseSection(ir, "general", ti_general_def, ti_general_ini);
+  parseSection(ir, "slaves", ti_slaves_def, ti_slaves_ini);
+  parseSection(ir, "tsinputs", ti_tsinputs_def, ti_tsinputs_ini);
+  parseSection(ir, "trigger_rules", ti_rules_def, ti_rules_ini);
+  parseSection(ir, "pulser", ti_pulser_def, ti_pulser_ini);
+  parseSection(ir, "trigger_table", ti_table_def, ti_table_ini);
 }
 
 /**
@@ -276,6 +285,12 @@ tiConfigPrintParameters()
       ++pos;
     }
 
+  if((ir != NULL) && (ir->Get("general", "TRIGGER_TABLE_EXPR", "") != ""))
+    {
+      printf("[trigger table expression]\n");
+      printf("%s\n", ir->Get("general", "TRIGGER_TABLE_EXPR", "").c_str());
+    }
+
 
 }
 
@@ -306,7 +321,7 @@ param2ti()
   /////////////////
 
   CHECK_PARAM(ti_general_ini, "CRATE_ID");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetCrateID(param_val);
       if(ti_rval != OK)
@@ -327,7 +342,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "BLOCK_BUFFER_LEVEL");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetBlockBufferLevel(param_val);
       if(ti_rval != OK)
@@ -335,7 +350,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "INSTANT_BLOCKLEVEL_ENABLE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetInstantBlockLevelChange(param_val);
       if(ti_rval != OK)
@@ -343,7 +358,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "BROADCAST_BUFFER_LEVEL_ENABLE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiUseBroadcastBufferLevel(param_val);
       if(ti_rval != OK)
@@ -351,7 +366,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "BLOCK_LIMIT");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetBlockLimit(param_val);
       if(ti_rval != OK)
@@ -359,7 +374,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "TRIGGER_SOURCE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetTriggerSource(param_val);
       if(ti_rval != OK)
@@ -367,7 +382,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "SYNC_SOURCE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       uint32_t sync_set = 0;
       // Encode the selection for the routine input
@@ -396,73 +411,50 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "SYNC_RESET_TYPE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetSyncResetType(param_val);
       if(ti_rval != OK)
 	rval = ERROR;
     }
 
-  /* Busy Source, build a busy source mask */
+  /* Busy Source, build a busy source mask.
+     Any defined key replaces the library default with the mask */
+  const struct
+  {
+    const char *key;
+    uint32_t bit;
+  } busy_sources[] =
+    {
+      { "BUSY_SOURCE_SWA", TI_BUSY_SWA },
+      { "BUSY_SOURCE_SWB", TI_BUSY_SWB },
+      { "BUSY_SOURCE_P2", TI_BUSY_P2 },
+      { "BUSY_SOURCE_FP_TDC", TI_BUSY_FP_FTDC },
+      { "BUSY_SOURCE_FP_ADC", TI_BUSY_FP_FADC },
+      { "BUSY_SOURCE_FP", TI_BUSY_FP },
+      { "BUSY_SOURCE_LOOPBACK", TI_BUSY_LOOPBACK },
+      { "BUSY_SOURCE_FIBER1", TI_BUSY_HFBR1 },
+      { "BUSY_SOURCE_FIBER2", TI_BUSY_HFBR2 },
+      { "BUSY_SOURCE_FIBER3", TI_BUSY_HFBR3 },
+      { "BUSY_SOURCE_FIBER4", TI_BUSY_HFBR4 },
+      { "BUSY_SOURCE_FIBER5", TI_BUSY_HFBR5 },
+      { "BUSY_SOURCE_FIBER6", TI_BUSY_HFBR6 },
+      { "BUSY_SOURCE_FIBER7", TI_BUSY_HFBR7 },
+      { "BUSY_SOURCE_FIBER8", TI_BUSY_HFBR8 }
+    };
   uint32_t busy_source_mask = 0;
+  int32_t busy_source_defined = 0;
 
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_SWA");
-  if(param_val > 0)
-    busy_source_mask |= TI_BUSY_SWA;
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_SWB");
-  if(param_val > 0)
-    busy_source_mask |= TI_BUSY_SWB;
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_FP_TDC");
-  if(param_val > 0)
-    busy_source_mask |= TI_BUSY_FP_FTDC;
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_FP_ADC");
-  if(param_val > 0)
-    busy_source_mask |= TI_BUSY_FP_FADC;
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_FP");
-  if(param_val > 0)
-    busy_source_mask |= TI_BUSY_FP;
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_LOOPBACK");
-  if(param_val > 0)
-    busy_source_mask |= TI_BUSY_LOOPBACK;
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_FIBER1");
-  if(param_val > 0)
-    busy_source_mask |= (TI_BUSY_HFBR1 << 0);
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_FIBER2");
-  if(param_val > 0)
-    busy_source_mask |= (TI_BUSY_HFBR1 << 1);
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_FIBER3");
-  if(param_val > 0)
-    busy_source_mask |= (TI_BUSY_HFBR1 << 2);
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_FIBER4");
-  if(param_val > 0)
-    busy_source_mask |= (TI_BUSY_HFBR1 << 3);
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_FIBER5");
-  if(param_val > 0)
-    busy_source_mask |= (TI_BUSY_HFBR1 << 4);
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_FIBER6");
-  if(param_val > 0)
-    busy_source_mask |= (TI_BUSY_HFBR1 << 5);
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_FIBER7");
-  if(param_val > 0)
-    busy_source_mask |= (TI_BUSY_HFBR1 << 6);
-
-  CHECK_PARAM(ti_general_ini, "BUSY_SOURCE_FIBER8");
-  if(param_val > 0)
-    busy_source_mask |= (TI_BUSY_HFBR1 << 7);
+  for(auto &busy : busy_sources)
+    {
+      CHECK_PARAM(ti_general_ini, busy.key);
+      if(param_val >= 0)
+	busy_source_defined = 1;
+      if(param_val > 0)
+	busy_source_mask |= busy.bit;
+    }
 
-  if(busy_source_mask != 0)
+  if(busy_source_defined)
     {
       ti_rval = tiSetBusySource(busy_source_mask, 1);
       if(ti_rval != OK)
@@ -471,7 +463,7 @@ param2ti()
 
 
   CHECK_PARAM(ti_general_ini, "CLOCK_SOURCE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetClockSource(param_val);
       if(ti_rval != OK)
@@ -479,7 +471,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "PRESCALE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetPrescale(param_val);
       if(ti_rval != OK)
@@ -487,7 +479,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "EVENT_FORMAT");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetEventFormat(param_val);
       if(ti_rval != OK)
@@ -495,7 +487,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "FP_INPUT_READOUT_ENABLE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetFPInputReadout(param_val);
       if(ti_rval != OK)
@@ -503,7 +495,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "GO_OUTPUT_ENABLE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetGoOutput(param_val);
       if(ti_rval != OK)
@@ -527,7 +519,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "TRIGGER_LATCH_ON_LEVEL_ENABLE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetTriggerLatchOnLevel(param_val);
       if(ti_rval != OK)
@@ -535,7 +527,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "TRIGGER_OUTPUT_DELAY");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       int32_t delay = param_val, width = 0, delaystep = 0;
 
@@ -543,15 +535,18 @@ param2ti()
       width = param_val;
 
       CHECK_PARAM(ti_general_ini, "TRIGGER_OUTPUT_DELAYSTEP");
-      delaystep = param_val;
+      delaystep = (param_val > 0) ? 1 : 0;
 
-      ti_rval = tiSetTriggerPulse(1, delay, width, delaystep);
-      if(ti_rval != OK)
-	rval = ERROR;
+      if(width >= 0)
+	{
+	  ti_rval = tiSetTriggerPulse(1, delay, width, delaystep);
+	  if(ti_rval != OK)
+	    rval = ERROR;
+	}
     }
 
   CHECK_PARAM(ti_general_ini, "PROMPT_TRIGGER_WIDTH");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       int32_t width = param_val;
 
@@ -561,7 +556,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "SYNCRESET_DELAY");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       int32_t delay = param_val, width = 0, widthstep = 0;
 
@@ -569,13 +564,14 @@ param2ti()
       width = param_val;
 
       CHECK_PARAM(ti_general_ini, "SYNCRESET_WIDTHSTEP");
-      widthstep = param_val;
+      widthstep = (param_val > 0) ? 1 : 0;
 
-      tiSetSyncDelayWidth(delay, width, widthstep);
+      if(width >= 0)
+	tiSetSyncDelayWidth(delay, width, widthstep);
     }
 
   CHECK_PARAM(ti_general_ini, "EVENTTYPE_SCALERS_ENABLE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetEvTypeScalers(param_val);
       if(ti_rval != OK)
@@ -583,21 +579,21 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "SCALER_MODE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
-      int32_t control = 0;
+      int32_t mode = param_val, control = 0;
 
       CHECK_PARAM(ti_general_ini, "SCALER_MODE_CONTROL");
-      control = param_val;
+      control = (param_val > 0) ? param_val : 0;
 
-      ti_rval = tiSetScalerMode(param_val, control);
+      ti_rval = tiSetScalerMode(mode, control);
       if(ti_rval != OK)
 	rval = ERROR;
 
     }
 
   CHECK_PARAM(ti_general_ini, "SYNCEVENT_INTERVAL");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       ti_rval = tiSetSyncEventInterval(param_val);
       if(ti_rval != OK)
@@ -605,22 +601,60 @@ param2ti()
 
     }
 
+  // Trigger table from rules, in place of the user defined pattern words
+  std::string table_expr = ir->Get("general", "TRIGGER_TABLE_EXPR", "");
+
   CHECK_PARAM(ti_general_ini, "TRIGGER_TABLE");
-  if(param_val > 0)
+  if(table_expr != "")
     {
-      ti_rval = tiTriggerTablePredefinedConfig(param_val);
+      if((param_val >= 0) && (param_val != 4))
+	{
+	  std::cerr << __func__ << ": ERROR: TRIGGER_TABLE_EXPR requires TRIGGER_TABLE = 4"
+		    << " (found " << param_val << ")" << std::endl;
+	  rval = ERROR;
+	}
+      else if(tiTriggerTableConfigExpr(table_expr.c_str()) != OK)
+	{
+	  std::cerr << __func__ << ": ERROR: Invalid TRIGGER_TABLE_EXPR" << std::endl;
+	  rval = ERROR;
+	}
+      else
+	{
+	  ti_rval = tiLoadTriggerTable(4);
+	  if(ti_rval != OK)
+	    rval = ERROR;
+	}
+    }
+  else if(param_val >= 0)
+    {
+      if(param_val == 4)
+	{
+	  // User defined table, restore the pattern words
+	  uint32_t table[16];
+
+	  ti_rval = tiGetTriggerTable(table);
+	  for(int32_t iword = 0; iword < 16; iword++)
+	    {
+	      std::string key = "TABLE_WORD_" + std::to_string(iword);
+	      if(ir->Get("trigger_table", key, "") != "")
+		table[iword] = (uint32_t) ti_table_ini[key];
+	    }
+	  tiTriggerTableConfig(table);
+	}
+
+      ti_rval = tiLoadTriggerTable(param_val);
       if(ti_rval != OK)
 	rval = ERROR;
 
     }
 
   CHECK_PARAM(ti_general_ini, "FIXED_PULSER_EVENTTYPE");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       int32_t fixed = param_val, random = 0;
 
       CHECK_PARAM(ti_general_ini, "RANDOM_PULSER_EVENTTYPE");
-      random = param_val;
+      random = (param_val >= 0) ? param_val : 0;
 
       ti_rval = tiDefinePulserEventType(fixed, random);
       if(ti_rval != OK)
@@ -629,7 +663,7 @@ param2ti()
     }
 
   CHECK_PARAM(ti_general_ini, "FIBER_SYNC_DELAY");
-  if(param_val > 0)
+  if(param_val >= 0)
     {
       tiSetFiberSyncDelay(param_val);
     }
@@ -653,7 +687,7 @@ param2ti()
   // TS INPUTS
   /////////////////
 
-  uint32_t input_mask = 0;
+  uint32_t input_mask = 0, disable_mask = 0;
   for(int32_t inp = 1; inp <= 6; inp++)
     {
       CHECK_PARAM(ti_tsinputs_ini, "ENABLE_TS" + std::to_string(inp));
@@ -661,8 +695,16 @@ param2ti()
 	{
 	  if(param_val)
 	    input_mask |= (1 << (inp-1));
+	  else
+	    disable_mask |= (1 << (inp-1));
 	}
     }
+  if(disable_mask > 0)
+    {
+      ti_rval = tiDisableTSInput(disable_mask);
+      if(ti_rval != OK)
+	rval = ERROR;
+    }
   if(input_mask > 0)
     {
       ti_rval = tiEnableTSInput(input_mask);
@@ -673,7 +715,7 @@ param2ti()
   for(int32_t inp = 1; inp <= 6; inp++)
     {
       CHECK_PARAM(ti_tsinputs_ini, "PRESCALE_TS" + std::to_string(inp));
-      if(param_val > 0)
+      if(param_val >= 0)
 	{
 	  ti_rval = tiSetInputPrescale(inp, param_val);
 	  if(ti_rval != OK)
@@ -684,7 +726,7 @@ param2ti()
   for(int32_t inp = 1; inp <= 6; inp++)
     {
       CHECK_PARAM(ti_tsinputs_ini, "DELAY_TS" + std::to_string(inp));
-      if(param_val > 0)
+      if(param_val >= 0)
 	{
 	  ti_rval = tiSetTSInputDelay(inp, param_val);
 	  if(ti_rval != OK)
@@ -795,12 +837,12 @@ tiConfigEnablePulser()
   CHECK_PARAM(ti_pulser_ini, "RANDOM_PRESCALE");
   random_prescale = param_val;
 
-  if(fixed_enable)
+  if(fixed_enable > 0)
     {
-      tiSoftTrig(1, fixed_number, fixed_number, fixed_range);
+      tiSoftTrig(1, fixed_number, fixed_period, fixed_range);
     }
 
-  if(random_enable)
+  if(random_enable > 0)
     {
       tiSetRandomTrigger(1, random_prescale);
     }
@@ -822,12 +864,12 @@ tiConfigDisablePulser()
   CHECK_PARAM(ti_pulser_ini, "RANDOM_ENABLE");
   random_enable = param_val;
 
-  if(fixed_enable)
+  if(fixed_enable > 0)
     {
       tiSoftTrig(1, 0, 0, 0);
     }
 
-  if(random_enable)
+  if(random_enable > 0)
     {
       tiDisableRandomTrigger();
     }
@@ -835,6 +877,224 @@ tiConfigDisablePulser()
   return OK;
 }
 
+/////////////////
+// RELOAD
+/////////////////
+
+// Time to wait for a block boundary to apply a reload [ms]
+#define TI_CONFIG_RELOAD_TIMEOUT 2000
+
+// Keys that are safe to change while triggers are enabled.
+// All of [trigger_rules] and [pulser] are safe.
+static const std::set<std::string> ti_general_runsafe
+  {
+    "PRESCALE"
+  };
+static const std::set<std::string> ti_tsinputs_runsafe
+  {
+    "PRESCALE_TS1", "PRESCALE_TS2", "PRESCALE_TS3",
+    "PRESCALE_TS4", "PRESCALE_TS5", "PRESCALE_TS6"
+  };
+
+// Accepted changes, waiting for the block boundary
+static ti_param_map ti_general_reload, ti_tsinputs_reload, ti_rules_reload, ti_pulser_reload;
+static int32_t ti_reload_rval = OK;
+
+/**
+ * @brief Collect the keys that differ between the current and reloaded section
+ * @param runsafe Keys allowed to change.  NULL: all keys in the section
+ * @return Number of changed keys that were rejected
+ */
+static int32_t
+diffSection(const std::string &section, const ti_param_map &current,
+	    const ti_param_map &reloaded, const std::set<std::string> *runsafe,
+	    ti_param_map &changes)
+{
+  int32_t nrejected = 0;
+
+  changes.clear();
+
+  for(auto &param : reloaded)
+    {
+      ti_param_map::const_iterator pos = current.find(param.first);
+      if((pos != current.end()) && (pos->second == param.second))
+	continue;
+
+      if((runsafe == NULL) || runsafe->count(param.first))
+	{
+	  changes[param.first] = param.second;
+	}
+      else
+	{
+	  std::cerr << __func__ << ": WARN: [" << section << "] " << param.first
+		    << " cannot be changed during a run (ignored)" << std::endl;
+	  nrejected++;
+	}
+    }
+
+  return nrejected;
+}
+
+/**
+ * @brief Apply the accepted reload changes.  Executed between blocks.
+ */
+static void
+tiConfigApplyReload()
+{
+  int32_t rval = OK;
+
+  // Update the local maps, so they continue to describe the module
+  for(auto &param : ti_general_reload)
+    ti_general_ini[param.first] = param.second;
+  for(auto &param : ti_tsinputs_reload)
+    ti_tsinputs_ini[param.first] = param.second;
+  for(auto &param : ti_rules_reload)
+    ti_rules_ini[param.first] = param.second;
+  for(auto &param : ti_pulser_reload)
+    ti_pulser_ini[param.first] = param.second;
+
+  if(ti_general_reload.count("PRESCALE") && (ti_general_ini["PRESCALE"] >= 0))
+    {
+      if(tiSetPrescale(ti_general_ini["PRESCALE"]) != OK)
+	rval = ERROR;
+    }
+
+  for(int32_t inp = 1; inp <= 6; inp++)
+    {
+      std::string key = "PRESCALE_TS" + std::to_string(inp);
+      if(ti_tsinputs_reload.count(key) && (ti_tsinputs_ini[key] >= 0))
+	{
+	  if(tiSetInputPrescale(inp, ti_tsinputs_ini[key]) != OK)
+	    rval = ERROR;
+	}
+    }
+
+  for(int32_t rule = 1; rule <= 4; rule++)
+    {
+      std::string rule_key = "RULE_" + std::to_string(rule),
+	timestep_key = "RULE_TIMESTEP_" + std::to_string(rule),
+	min_key = "RULE_MIN_" + std::to_string(rule);
+
+      if((ti_rules_reload.count(rule_key) || ti_rules_reload.count(timestep_key)) &&
+	 (ti_rules_ini[rule_key] >= 0) && (ti_rules_ini[timestep_key] >= 0))
+	{
+	  if(tiSetTriggerHoldoff(rule, ti_rules_ini[rule_key], ti_rules_ini[timestep_key]) != OK)
+	    rval = ERROR;
+	}
+
+      if((rule > 1) && ti_rules_reload.count(min_key) && (ti_rules_ini[min_key] >= 0))
+	{
+	  if(tiSetTriggerHoldoffMin(rule, ti_rules_ini[min_key]) != OK)
+	    rval = ERROR;
+	}
+    }
+
+  // Pulser settings take effect now, only if the pulser is running.
+  // Otherwise, they're used at the next tiConfigEnablePulser
+  if(!ti_pulser_reload.empty())
+    {
+      int32_t nevents = 0, period = 0, range = 0, random_enable = 0, random_prescale = 0;
+
+      tiGetSoftTrig(1, &nevents, &period, &range);
+      tiGetRandomTrigger(1, &random_enable, &random_prescale);
+
+      int32_t ti_rval = OK;
+
+      if(nevents > 0)
+	{
+	  if(ti_pulser_ini["FIXED_ENABLE"] > 0)
+	    ti_rval = tiSoftTrig(1, ti_pulser_ini["FIXED_NUMBER"],
+				 ti_pulser_ini["FIXED_PERIOD"], ti_pulser_ini["FIXED_RANGE"]);
+	  else
+	    ti_rval = tiSoftTrig(1, 0, 0, 0);
+	  if(ti_rval != OK)
+	    rval = ERROR;
+	}
+
+      if(random_enable)
+	{
+	  if(ti_pulser_ini["RANDOM_ENABLE"] > 0)
+	    ti_rval = tiSetRandomTrigger(1, ti_pulser_ini["RANDOM_PRESCALE"]);
+	  else
+	    ti_rval = tiDisableRandomTrigger();
+	  if(ti_rval != OK)
+	    rval = ERROR;
+	}
+    }
+
+  ti_reload_rval = (rval == OK) ? OK : ERROR;
+}
+
+/**
+ * @brief Re-read the ini file and apply the settings that are safe to change
+ *        during a run (prescales, trigger rules, pulser), between blocks.
+ *        Changes to any other setting are rejected.
+ * @return Number of rejected changes (0: everything applied), ERROR if the file
+ *         could not be parsed or the changes could not be applied
+ */
+int32_t
+tiConfigReload(const char *filename)
+{
+  int32_t nrejected = 0;
+
+  if(ir == NULL)
+    {
+      std::cerr << __func__ << ": ERROR: tiConfig has not been called" << std::endl;
+      return ERROR;
+    }
+
+  INIReader reload_ir(filename);
+
+  if(reload_ir.ParseError() < 0)
+    {
+      std::cout << "Can't load: " << filename << std::endl;
+      return ERROR;
+    }
+
+  ti_param_map general = ti_general_def, slaves = ti_slaves_def,
+    tsinputs = ti_tsinputs_def, rules = ti_rules_def, pulser = ti_pulser_def,
+    table = ti_table_def;
+
+  parseSection(&reload_ir, "general", ti_general_def, general);
+  parseSection(&reload_ir, "slaves", ti_slaves_def, slaves);
+  parseSection(&reload_ir, "tsinputs", ti_tsinputs_def, tsinputs);
+  parseSection(&reload_ir, "trigger_rules", ti_rules_def, rules);
+  parseSection(&reload_ir, "pulser", ti_pulser_def, pulser);
+  parseSection(&reload_ir, "trigger_table", ti_table_def, table);
+
+  const std::set<std::string> none;
+  ti_param_map ignored;
+
+  nrejected += diffSection("general", ti_general_ini, general, &ti_general_runsafe, ti_general_reload);
+  nrejected += diffSection("slaves", ti_slaves_ini, slaves, &none, ignored);
+  nrejected += diffSection("trigger_table", ti_table_ini, table, &none, ignored);
+  nrejected += diffSection("tsinputs", ti_tsinputs_ini, tsinputs, &ti_tsinputs_runsafe, ti_tsinputs_reload);
+  nrejected += diffSection("trigger_rules", ti_rules_ini, rules, NULL, ti_rules_reload);
+  nrejected += diffSection("pulser", ti_pulser_ini, pulser, NULL, ti_pulser_reload);
+
+  // TRIGGER_TABLE_EXPR is not in the param maps.  Not run-safe, like [trigger_table]
+  if(reload_ir.Get("general", "TRIGGER_TABLE_EXPR", "") !=
+     ir->Get("general", "TRIGGER_TABLE_EXPR", ""))
+    {
+      std::cerr << __func__ << ": WARN: [general] TRIGGER_TABLE_EXPR"
+		<< " cannot be changed during a run (ignored)" << std::endl;
+      nrejected++;
+    }
+
+  if(ti_general_reload.empty() && ti_tsinputs_reload.empty() &&
+     ti_rules_reload.empty() && ti_pulser_reload.empty())
+    return nrejected;
+
+  ti_reload_rval = OK;
+  if(tiRunAtBlockBoundary(tiConfigApplyReload, 0, TI_CONFIG_RELOAD_TIMEOUT) != OK)
+    return ERROR;
+
+  if(ti_reload_rval != OK)
+    return ERROR;
+
+  return nrejected;
+}
+
 /**
  * @brief Read the module parameters input the maps
  * @return 0
@@ -845,6 +1105,13 @@ ti2param()
 {
   int32_t rval = OK, ti_rval = OK;
 
+  // Start from a clean snapshot
+  ti_general_readback = ti_general_def;
+  ti_slaves_readback = ti_slaves_def;
+  ti_tsinputs_readback = ti_tsinputs_def;
+  ti_rules_readback = ti_rules_def;
+  ti_table_readback = ti_table_def;
+
   /////////////////
   // GENERAL
   /////////////////
@@ -930,70 +1197,20 @@ ti2param()
     rval = ERROR;
   else
     {
-      if(ti_rval & TI_BUSY_SWA)
-	ti_general_readback["BUSY_SOURCE_SWA"] = 1;
-
-      if(ti_rval & TI_BUSY_SWB)
-	ti_general_readback["BUSY_SOURCE_SWB"] = 1;
-
-      if(ti_rval & TI_BUSY_FP_FTDC)
-	ti_general_readback["BUSY_SOURCE_FP_TDC"] = 1;
+      ti_general_readback["BUSY_SOURCE_SWA"] = (ti_rval & TI_BUSY_SWA) ? 1 : 0;
+      ti_general_readback["BUSY_SOURCE_SWB"] = (ti_rval & TI_BUSY_SWB) ? 1 : 0;
+      ti_general_readback["BUSY_SOURCE_P2"] = (ti_rval & TI_BUSY_P2) ? 1 : 0;
+      ti_general_readback["BUSY_SOURCE_FP_TDC"] = (ti_rval & TI_BUSY_FP_FTDC) ? 1 : 0;
+      ti_general_readback["BUSY_SOURCE_FP_ADC"] = (ti_rval & TI_BUSY_FP_FADC) ? 1 : 0;
+      ti_general_readback["BUSY_SOURCE_FP"] = (ti_rval & TI_BUSY_FP) ? 1 : 0;
+      ti_general_readback["BUSY_SOURCE_LOOPBACK"] = (ti_rval & TI_BUSY_LOOPBACK) ? 1 : 0;
 
-      if(ti_rval & TI_BUSY_FP_FADC)
-	ti_general_readback["BUSY_SOURCE_FP_ADC"] = 1;
-
-      if(ti_rval & TI_BUSY_FP)
-	ti_general_readback["BUSY_SOURCE_FP"] = 1;
-
-      if(ti_rval & TI_BUSY_LOOPBACK)
-	ti_general_readback["BUSY_SOURCE_LOOPBACK"] = 1;
-
-      if(ti_rval & TI_BUSY_HFBR1)
+      for(int32_t ibit = 0; ibit < 8; ibit++)
 	{
-	  slave_bits |= (1 << 0);
-	  ti_general_readback["BUSY_SOURCE_FIBER1"] = 1;
-	}
+	  int32_t fiber_busy = (ti_rval & (TI_BUSY_HFBR1 << ibit)) ? 1 : 0;
 
-      if(ti_rval & TI_BUSY_HFBR2)
-	{
-	  slave_bits |= (1 << 1);
-	  ti_general_readback["BUSY_SOURCE_FIBER2"] = 1;
-	}
-
-      if(ti_rval & TI_BUSY_HFBR3)
-	{
-	  slave_bits |= (1 << 2);
-	  ti_general_readback["BUSY_SOURCE_FIBER3"] = 1;
-	}
-
-      if(ti_rval & TI_BUSY_HFBR4)
-	{
-	  slave_bits |= (1 << 3);
-	  ti_general_readback["BUSY_SOURCE_FIBER4"] = 1;
-	}
-
-      if(ti_rval & TI_BUSY_HFBR5)
-	{
-	  slave_bits |= (1 << 4);
-	  ti_general_readback["BUSY_SOURCE_FIBER5"] = 1;
-	}
-
-      if(ti_rval & TI_BUSY_HFBR6)
-	{
-	  slave_bits |= (1 << 5);
-	  ti_general_readback["BUSY_SOURCE_FIBER6"] = 1;
-	}
-
-      if(ti_rval & TI_BUSY_HFBR7)
-	{
-	  slave_bits |= (1 << 6);
-	  ti_general_readback["BUSY_SOURCE_FIBER7"] = 1;
-	}
-
-      if(ti_rval & TI_BUSY_HFBR8)
-	{
-	  slave_bits |= (1 << 7);
-	  ti_general_readback["BUSY_SOURCE_FIBER8"] = 1;
+	  slave_bits |= (fiber_busy << ibit);
+	  ti_general_readback["BUSY_SOURCE_FIBER" + std::to_string(ibit + 1)] = fiber_busy;
 	}
     }
 
@@ -1098,11 +1315,20 @@ ti2param()
   else
     ti_general_readback["SYNCEVENT_INTERVAL"] = ti_rval;
 
+  // -1: no table loaded, the one held by the TI is kept
   ti_rval = tiGetTriggerTableMode();
-  if(ti_rval == ERROR)
-    rval = ERROR;
-  else
-    ti_general_readback["TRIGGER_TABLE"] = ti_rval;
+  if(ti_rval >= 0)
+    {
+      ti_general_readback["TRIGGER_TABLE"] = ti_rval;
+
+      if(ti_rval == 4)
+	{
+	  uint32_t table[16];
+	  tiGetTriggerTable(table);
+	  for(int32_t iword = 0; iword < 16; iword++)
+	    ti_table_readback["TABLE_WORD_" + std::to_string(iword)] = (int32_t) table[iword];
+	}
+    }
 
   int32_t fixed_type= 0, random_type = 0;
   ti_rval = tiGetPulserEventType(&fixed_type, &random_type);
@@ -1114,10 +1340,12 @@ ti2param()
       ti_general_readback["RANDOM_PULSER_EVENTTYPE"] = random_type;
     }
 
+  // Without a configured value, the library measures / defaults the
+  // fiber delay at init.  Keep it that way, instead of pinning the result.
   ti_rval = tiGetFiberDelay();
   if(ti_rval == ERROR)
     rval = ERROR;
-  else
+  else if(ti_general_ini["FIBER_SYNC_DELAY"] != -1)
     ti_general_readback["FIBER_SYNC_DELAY"] = ti_rval;
 
   /////////////////
@@ -1127,10 +1355,8 @@ ti2param()
   //  loop through the slave bits gathered from the BUSY source mask above
   for(int32_t ibit = 0; ibit < 8; ibit++)
     {
-      if(slave_bits & (1 << ibit))
-	{
-	  ti_slaves_readback["ENABLE_FIBER_" + std::to_string(ibit + 1)] = 1;
-	}
+      ti_slaves_readback["ENABLE_FIBER_" + std::to_string(ibit + 1)] =
+	(slave_bits & (1 << ibit)) ? 1 : 0;
     }
 
 
@@ -1144,10 +1370,8 @@ ti2param()
     {
       for(int32_t ibit = 0; ibit < 6; ibit++)
 	{
-	  if(ti_rval & (1 << ibit))
-	    {
-	      ti_tsinputs_readback["ENABLE_TS" + std::to_string(ibit + 1)] = 1;
-	    }
+	  ti_tsinputs_readback["ENABLE_TS" + std::to_string(ibit + 1)] =
+	    (ti_rval & (1 << ibit)) ? 1 : 0;
 	}
     }
 
@@ -1202,14 +1426,105 @@ ti2param()
 	rval = ERROR;
       else
 	{
-	  ti_rules_readback["RULE_MIN_" + std::to_string(irule)] = ti_rval;
+	  ti_rules_readback["RULE_MIN_" + std::to_string(irule)] =
+	    (ti_rval & (1 << 7)) ? (ti_rval & 0x7F) : 0;
 	}
 
     }
 
+  /////////////////
+  // PULSER
+  /////////////////
+  // The pulser is only started by tiConfigEnablePulser.  Keep the
+  // configured values, unless the pulser is currently running.
+  ti_pulser_readback = ti_pulser_ini;
+
+  int32_t nevents = 0, period = 0, range = 0;
+  ti_rval = tiGetSoftTrig(1, &nevents, &period, &range);
+  if(ti_rval == ERROR)
+    rval = ERROR;
+  else if(nevents > 0)
+    {
+      ti_pulser_readback["FIXED_ENABLE"] = 1;
+      ti_pulser_readback["FIXED_NUMBER"] = nevents;
+      ti_pulser_readback["FIXED_PERIOD"] = period;
+      ti_pulser_readback["FIXED_RANGE"] = range;
+    }
+
+  int32_t random_enable = 0, random_prescale = 0;
+  ti_rval = tiGetRandomTrigger(1, &random_enable, &random_prescale);
+  if(ti_rval == ERROR)
+    rval = ERROR;
+  else if(random_enable)
+    {
+      ti_pulser_readback["RANDOM_ENABLE"] = 1;
+      ti_pulser_readback["RANDOM_PRESCALE"] = random_prescale;
+    }
+
   return rval;
 }
 
+/**
+ * @brief Compare one section of the loaded ini parameters with the readback
+ * @return Number of defined parameters that differ
+ */
+static int32_t
+verifySection(const std::string &section, const ti_param_map &ini,
+	      ti_param_map &readback, const std::set<std::string> &skip)
+{
+  int32_t ndiff = 0;
+
+  for(auto &param : ini)
+    {
+      if((param.second == -1) || skip.count(param.first))
+	continue;
+
+      if(readback[param.first] != param.second)
+	{
+	  std::cerr << __func__ << ": [" << section << "] " << param.first
+		    << " = " << param.second << ", module has "
+		    << readback[param.first] << std::endl;
+	  ndiff++;
+	}
+    }
+
+  return ndiff;
+}
+
+/**
+ * @brief Verify that the module settings match the parameters loaded by tiConfig
+ * @return Number of settings that differ, ERROR if the module could not be read
+ */
+int32_t
+tiConfigVerify()
+{
+  int32_t ndiff = 0;
+  std::set<std::string> skip;
+
+  if(ti2param() == ERROR)
+    {
+      std::cerr << __func__ << ": ERROR: ti2param() returned ERROR" << std::endl;
+      return ERROR;
+    }
+
+  // No minimum for rule 1
+  skip.insert("RULE_MIN_1");
+
+  // Enabling a slave also enables its fiber busy
+  for(int32_t inp = 1; inp <= 8; inp++)
+    {
+      if(ti_slaves_ini["ENABLE_FIBER_" + std::to_string(inp)] > 0)
+	skip.insert("BUSY_SOURCE_FIBER" + std::to_string(inp));
+    }
+
+  ndiff += verifySection("general", ti_general_ini, ti_general_readback, skip);
+  ndiff += verifySection("slaves", ti_slaves_ini, ti_slaves_readback, skip);
+  ndiff += verifySection("tsinputs", ti_tsinputs_ini, ti_tsinputs_readback, skip);
+  ndiff += verifySection("trigger_rules", ti_rules_ini, ti_rules_readback, skip);
+
+  return ndiff;
+}
+
 /**
  * @brief Write the Ini values to an output file
  */
@@ -1282,8 +1597,45 @@ writeIni(const char* filename)
       ++pos;
     }
 
+  outFile << "[pulser]" << std::endl;
+
+  pos = ti_pulser_def.begin();
+  while(pos != ti_pulser_def.end())
+    {
+      if(ti_pulser_readback[pos->first] != -1)
+	{
+	  outFile << pos->first << "= " << ti_pulser_readback[pos->first] << std::endl;
+	}
+
+      ++pos;
+    }
+
+  if(ti_general_readback["TRIGGER_TABLE"] == 4)
+    {
+      outFile << "[trigger_table]" << std::endl;
+
+      // Written in hex, every word is significant
+      for(int32_t iword = 0; iword < 16; iword++)
+	{
+	  std::string key = "TABLE_WORD_" + std::to_string(iword);
+	  outFile << key << "= 0x" << std::hex << std::setw(8) << std::setfill('0')
+		  << (uint32_t) ti_table_readback[key] << std::dec << std::endl;
+	}
 
+      // The same table as rules, for reading
+      uint32_t table[16];
+      char expr[4096];
+      for(int32_t iword = 0; iword < 16; iword++)
+	table[iword] = (uint32_t) ti_table_readback["TABLE_WORD_" + std::to_string(iword)];
 
+      if(tiTriggerTableDecompile(table, expr, sizeof(expr)) != ERROR)
+	{
+	  std::istringstream rules(expr);
+	  std::string rule;
+	  while(std::getline(rules, rule))
+	    outFile << ";; " << rule << std::endl;
+	}
+    }
 
   outFile.close();
   return 0;
@@ -6,6 +6,8 @@ extern "C" {
   /* routine prototypes */
   int32_t tiConfigInitGlobals();
   int32_t tiConfig(const char *filename);
+  int32_t tiConfigReload(const char *filename);
+  int32_t tiConfigVerify();
   int32_t tiConfigFree();
   void    tiConfigPrintParameters();
 
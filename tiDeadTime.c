@@ -0,0 +1,217 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Dead time accounting for the TI.
+ *
+ *     Each update takes one latched snapshot of the live and busy timers
+ *     and of the BUSY counters of all sources (tiGetBusyScalers), and
+ *     returns the fraction of the interval since the caller's previous
+ *     update that each source held BUSY.  The BUSY counters count in
+ *     the units of the live and busy timers.
+ *
+ *     Unlike tiLive, the differential state belongs to the caller, so
+ *     several monitors can run at different intervals.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiDeadTime.h"
+
+/**
+ * @defgroup DeadTime Dead Time Accounting
+ *   Dead time broken down by busy source.
+ */
+
+#define TI_DEADTIME_TIMER_UNIT 7.68e-6   /* seconds per live/busy timer count */
+
+static const char *tiDeadTimeSourceNames[TI_DEADTIME_NSOURCES] =
+  {
+    "SWA",
+    "SWB",
+    "P2",
+    "FP-FTDC",
+    "FP-FADC",
+    "FP",
+    "Unused",
+    "Loopback",
+    "Fiber 1",
+    "Fiber 2",
+    "Fiber 3",
+    "Fiber 4",
+    "Fiber 5",
+    "Fiber 6",
+    "Fiber 7",
+    "Fiber 8"
+  };
+
+/**
+ * @ingroup DeadTime
+ * @brief Return the name of a busy source
+ *
+ * @param source  Source index (0-15), as the busysrc of tiGetBusyCounter
+ * @return Name of the source, or "Invalid"
+ */
+const char *
+tiDeadTimeSourceName(int source)
+{
+  if((source < 0) || (source >= TI_DEADTIME_NSOURCES))
+    return "Invalid";
+
+  return tiDeadTimeSourceNames[source];
+}
+
+/**
+ * @ingroup DeadTime
+ * @brief Take the starting snapshot of a caller's differential state
+ *
+ * @param state  Differential state owned by the caller
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiDeadTimeInit(tiDeadTimeState *state)
+{
+  if(state == NULL)
+    {
+      printf("%s: ERROR: Invalid state\n", __func__);
+      return ERROR;
+    }
+
+  memset((void *)state, 0, sizeof(tiDeadTimeState));
+  if(tiGetBusyScalers(&state->livetime, &state->busytime, state->counter) != OK)
+    return ERROR;
+  state->primed = 1;
+
+  return OK;
+}
+
+/**
+ * @ingroup DeadTime
+ * @brief Break down the dead time since the caller's previous update
+ *
+ *   If the state has not been primed, it is primed and an empty interval
+ *   is returned.
+ *
+ * @param state  Differential state owned by the caller
+ * @param dt     Where to store the dead time of the interval
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiDeadTimeUpdate(tiDeadTimeState *state, tiDeadTime *dt)
+{
+  uint32_t livetime = 0, busytime = 0, counter[TI_DEADTIME_NSOURCES];
+  unsigned int status[TI_DEADTIME_NPORTS];
+  uint32_t dlive = 0, dbusy = 0, total = 0;
+  int32_t enabled = 0;
+  int isrc, iport;
+
+  if((state == NULL) || (dt == NULL))
+    {
+      printf("%s: ERROR: Invalid state or destination\n", __func__);
+      return ERROR;
+    }
+
+  if(tiGetBusyScalers(&livetime, &busytime, counter) != OK)
+    return ERROR;
+
+  enabled = tiGetBusySource();
+  if(enabled == ERROR)
+    return ERROR;
+
+  if(tiBlockStatusAll(status) != OK)
+    return ERROR;
+
+  memset((void *)dt, 0, sizeof(tiDeadTime));
+  dt->dominant = -1;
+  dt->enabled = (uint32_t)enabled & TI_BUSY_SOURCEMASK;
+  for(iport = 0; iport < TI_DEADTIME_NPORTS; iport++)
+    dt->needAck[iport] = (status[iport] & TI_BLOCKSTATUS_NBLOCKS_NEEDACK0)>>8;
+
+  if(state->primed)
+    {
+      dlive = livetime - state->livetime;
+      dbusy = busytime - state->busytime;
+      total = dlive + dbusy;
+    }
+
+  if(total > 0)
+    {
+      dt->interval = total * TI_DEADTIME_TIMER_UNIT;
+      dt->live = (double)dlive / total;
+      dt->dead = (double)dbusy / total;
+
+      for(isrc = 0; isrc < TI_DEADTIME_NSOURCES; isrc++)
+	{
+	  dt->source[isrc] = (double)(counter[isrc] - state->counter[isrc]) / total;
+	  if(dt->source[isrc] > 1.0)
+	    dt->source[isrc] = 1.0;
+
+	  if((dt->enabled & (1 << isrc)) &&
+	     ((dt->dominant < 0) || (dt->source[isrc] > dt->source[dt->dominant])))
+	    dt->dominant = isrc;
+	}
+
+      if((dt->dominant >= 0) && (dt->source[dt->dominant] == 0))
+	dt->dominant = -1;
+
+      dt->unexplained = dt->dead;
+      if(dt->dominant >= 0)
+	dt->unexplained -= dt->source[dt->dominant];
+      if(dt->unexplained < 0)
+	dt->unexplained = 0;
+    }
+
+  state->livetime = livetime;
+  state->busytime = busytime;
+  memcpy((void *)state->counter, (void *)counter, sizeof(state->counter));
+  state->primed = 1;
+
+  return OK;
+}
+
+/**
+ * @ingroup DeadTime
+ * @brief Print the dead time of an interval to standard out
+ *
+ * @param dt  Dead time from tiDeadTimeUpdate
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiDeadTimePrint(const tiDeadTime *dt)
+{
+  int isrc;
+
+  if(dt == NULL)
+    {
+      printf("%s: ERROR: Invalid dead time\n", __func__);
+      return ERROR;
+    }
+
+  printf("\n");
+  printf(" Dead Time over %.3f s:  live %.2f%%  dead %.2f%%\n",
+	 dt->interval, 100. * dt->live, 100. * dt->dead);
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Source     Enabled    Busy%%   NeedAck\n");
+  printf("--------------------------------------------------------------------------------\n");
+  for(isrc = 0; isrc < TI_DEADTIME_NSOURCES; isrc++)
+    {
+      if(((dt->enabled & (1 << isrc)) == 0) && (dt->source[isrc] == 0))
+	continue;
+
+      printf("  %-8s   %7s  %7.2f   ",
+	     tiDeadTimeSourceNames[isrc],
+	     (dt->enabled & (1 << isrc)) ? "yes" : "no",
+	     100. * dt->source[isrc]);
+      if(isrc >= 7)
+	printf("%7d", dt->needAck[isrc - 7]);
+      printf("%s\n", (isrc == dt->dominant) ? "  ***" : "");
+    }
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Dominant: %s   Unexplained dead time: %.2f%%\n",
+	 (dt->dominant >= 0) ? tiDeadTimeSourceNames[dt->dominant] : "none",
+	 100. * dt->unexplained);
+  printf("\n");
+
+  return OK;
+}
@@ -0,0 +1,47 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Dead time accounting for the TI.  Breaks the dead time of an
+ *     interval down by busy source, using caller owned differential state.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Sources, indexed as the busysrc of tiGetBusyCounter:
+   0: SWA, 1: SWB, 2: P2, 3: FP-FTDC, 4: FP-FADC, 5: FP, 6: Unused,
+   7: Loopback, 8-15: Fiber 1-8 */
+#define TI_DEADTIME_NSOURCES 16
+#define TI_DEADTIME_NPORTS    9   /* Loopback, Fiber 1-8 */
+
+/* Differential state.  One per caller, zero it or call tiDeadTimeInit. */
+typedef struct tiDeadTimeState
+{
+  int      primed;
+  uint32_t livetime;
+  uint32_t busytime;
+  uint32_t counter[TI_DEADTIME_NSOURCES];
+} tiDeadTimeState;
+
+typedef struct tiDeadTime
+{
+  double   interval;     /* seconds, from the live and busy timers */
+  double   live;         /* live fraction of the interval */
+  double   dead;         /* dead fraction of the interval */
+  double   source[TI_DEADTIME_NSOURCES];  /* fraction each source was busy */
+  uint32_t enabled;      /* busy source mask at the end of the interval */
+  int      dominant;     /* enabled source with the largest fraction, -1 if none */
+  double   unexplained;  /* dead fraction not covered by the dominant source */
+  uint32_t needAck[TI_DEADTIME_NPORTS];  /* blocks needing acknowledge at the end */
+} tiDeadTime;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int         tiDeadTimeInit(tiDeadTimeState *state);
+  int         tiDeadTimeUpdate(tiDeadTimeState *state, tiDeadTime *dt);
+  const char *tiDeadTimeSourceName(int source);
+  int         tiDeadTimePrint(const tiDeadTime *dt);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,216 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Decoder for the trigger bank produced by tiReadTriggerBlock.
+ *
+ *     Trigger bank:
+ *       word 0:  bank length (words following)
+ *       word 1:  0xFF10 20 blocklevel (bits 16-19: error tag)
+ *     Each event:
+ *       header:  event type (bits 24-31), 0x01 (bits 16-23), length (bits 0-15)
+ *       word 1:  event number, lower 32 bits
+ *     then, depending on the event format (tiSetEventFormat):
+ *                timestamp, lower 32 bits                      (formats 1, 3)
+ *                timestamp bits 32-47 (bits 0-15),
+ *                event number bits 32-47 (bits 16-31)          (formats 2, 3)
+ *                latched TS inputs                      (tiSetFPInputReadout)
+ *
+ *     The words present cannot be told from the event length, so the
+ *     format is set with tiDecodeSetEventFormat (tiSetEventFormat sets it
+ *     for data read by this process).  Format 2 has no lower timestamp
+ *     word, so its events are decoded without a timestamp.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiDecode.h"
+
+/**
+ * @defgroup Decode Data Decoding
+ *   Offline decoding of TI readout data.
+ */
+
+static int decodeFormat = 3;   /* Event format, as set by tiInit */
+
+/**
+ * @ingroup Decode
+ * @brief Set the event format of the trigger banks to decode
+ *
+ * @param format Event format, as for tiSetEventFormat (0-3)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiDecodeSetEventFormat(int format)
+{
+  if((format < 0) || (format > 3))
+    {
+      printf("%s: ERROR: Invalid Event Format (%d)\n", __func__, format);
+      return ERROR;
+    }
+
+  decodeFormat = format;
+
+  return OK;
+}
+
+/**
+ * @ingroup Decode
+ * @brief Get the event format of the trigger banks to decode
+ *
+ * @return Event format (0-3)
+ */
+int
+tiDecodeGetEventFormat()
+{
+  return decodeFormat;
+}
+
+/**
+ * @ingroup Decode
+ * @brief Decode the events of one trigger bank
+ *
+ * @param data       Trigger bank, starting at the bank length word
+ * @param nwords     Number of words available in data
+ * @param event      Array to fill with the decoded events
+ * @param maxevents  Size of event
+ * @param nused      If not NULL, where to store the number of words of the bank
+ *
+ * @return Number of events decoded if successful, otherwise ERROR
+ */
+int
+tiDecodeTriggerBank(const uint32_t *data, int nwords,
+		    tiDecodedEvent *event, int maxevents, int *nused)
+{
+  uint32_t blen = 0, blevel = 0, evlen = 0, header = 0;
+  int iword = 0, iev = 0, nev = 0, iw = 0;
+  int format = decodeFormat;
+
+  if((data == NULL) || (event == NULL) || (nwords < 2))
+    {
+      printf("%s: ERROR: Invalid data\n", __func__);
+      return ERROR;
+    }
+
+  blen = data[0];
+  if((int)(blen + 1) > nwords)
+    {
+      printf("%s: ERROR: Bank length (%d) exceeds available data (%d)\n",
+	     __func__, blen, nwords);
+      return ERROR;
+    }
+
+  header = data[1];
+  if(((header & 0xFFF00000) != 0xFF100000) ||
+     (((header & 0x0000FF00) >> 8) != 0x20))
+    {
+      printf("%s: ERROR: Invalid trigger bank header (0x%08x)\n",
+	     __func__, header);
+      return ERROR;
+    }
+  blevel = header & 0xFF;
+
+  iword = 2;
+  for(iev = 0; iev < (int)blevel; iev++)
+    {
+      if(iword >= (int)(blen + 1))
+	break;
+
+      if(((data[iword] & 0x00FF0000) >> 16) != 0x01)
+	{
+	  printf("%s: ERROR: Invalid event header (0x%08x) at word %d\n",
+		 __func__, data[iword], iword);
+	  return ERROR;
+	}
+
+      evlen = data[iword] & 0x0000FFFF;
+      if((iword + (int)evlen) > (int)blen)
+	{
+	  printf("%s: ERROR: Event length (%d) exceeds bank at word %d\n",
+		 __func__, evlen, iword);
+	  return ERROR;
+	}
+
+      if(nev < maxevents)
+	{
+	  tiDecodedEvent *ev = &event[nev];
+
+	  memset((void *)ev, 0, sizeof(tiDecodedEvent));
+	  ev->evtype = (data[iword] & 0xFF000000) >> 24;
+	  ev->nwords = evlen;
+	  iw = 1;
+	  if(evlen >= (uint32_t)iw)
+	    ev->evnum = data[iword + iw++];
+	  if((format & 1) && (evlen >= (uint32_t)iw))
+	    {
+	      ev->timestamp = data[iword + iw++];
+	      ev->hasTimestamp = 1;
+	    }
+	  if((format & 2) && (evlen >= (uint32_t)iw))
+	    {
+	      /* Format 2: no lower word, the timestamp is left out */
+	      if(format & 1)
+		ev->timestamp |= ((uint64_t)(data[iword + iw] & 0xFFFF)) << 32;
+	      ev->evnum |= ((uint64_t)((data[iword + iw] & 0xFFFF0000) >> 16)) << 32;
+	      iw++;
+	    }
+	  if(evlen >= (uint32_t)iw)
+	    {
+	      ev->tsInputs = data[iword + iw];
+	      ev->hasTSInputs = 1;
+	    }
+	  nev++;
+	}
+
+      iword += evlen + 1;
+    }
+
+  if(nused)
+    *nused = blen + 1;
+
+  return nev;
+}
+
+/**
+ * @ingroup Decode
+ * @brief Extract the event timestamps from consecutive trigger banks
+ *
+ * @param data       Trigger banks, each starting at its bank length word
+ * @param nwords     Number of words in data
+ * @param timestamp  Array to fill with timestamps (4 ns ticks)
+ * @param maxts      Size of timestamp
+ *
+ * @return Number of timestamps extracted if successful, otherwise ERROR
+ */
+int
+tiDecodeTimestamps(const uint32_t *data, int nwords,
+		   uint64_t *timestamp, int maxts)
+{
+  tiDecodedEvent event[256];
+  int iword = 0, nused = 0, nev = 0, iev = 0, nts = 0;
+
+  if((data == NULL) || (timestamp == NULL))
+    {
+      printf("%s: ERROR: Invalid data or destination\n", __func__);
+      return ERROR;
+    }
+
+  while((iword < nwords) && (nts < maxts))
+    {
+      nev = tiDecodeTriggerBank(&data[iword], nwords - iword, event, 256, &nused);
+      if(nev == ERROR)
+	return (nts > 0) ? nts : ERROR;
+
+      for(iev = 0; (iev < nev) && (nts < maxts); iev++)
+	{
+	  if(event[iev].hasTimestamp)
+	    timestamp[nts++] = event[iev].timestamp;
+	}
+
+      iword += nused;
+    }
+
+  return nts;
+}
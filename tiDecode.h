@@ -0,0 +1,34 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Decoder for the trigger bank produced by tiReadTriggerBlock.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define TI_DECODE_TIMESTAMP_NS 4   /* ns per timestamp tick */
+
+typedef struct tiDecodedEvent
+{
+  uint32_t evtype;
+  uint32_t nwords;       /* event length, from the event header */
+  uint64_t evnum;
+  uint64_t timestamp;    /* 4 ns ticks */
+  int      hasTimestamp;
+  uint32_t tsInputs;     /* latched TS inputs */
+  int      hasTSInputs;
+} tiDecodedEvent;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int tiDecodeSetEventFormat(int format);
+  int tiDecodeGetEventFormat();
+  int tiDecodeTriggerBank(const uint32_t *data, int nwords,
+			  tiDecodedEvent *event, int maxevents, int *nused);
+  int tiDecodeTimestamps(const uint32_t *data, int nwords,
+			 uint64_t *timestamp, int maxts);
+#ifdef __cplusplus
+}
+#endif
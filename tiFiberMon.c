@@ -0,0 +1,402 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Fiber link health monitor for the TI Master.
+ *
+ *     Each call to tiFiberMonUpdate reads the connected, trigger source
+ *     enabled, trigger link error and fiber busy counter registers in one
+ *     batch (tiGetAllSlaveStatus), and stores one sample per fiber port in
+ *     a ring buffer.  Time is taken from the latched live and busy timers,
+ *     so the busy fraction and its trend are in the module's own time base.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiFiberMon.h"
+
+/**
+ * @defgroup FiberMon Fiber Link Monitor
+ *   Per fiber port history of link status and busy fraction.
+ */
+
+#define TI_FIBERMON_TIMER_UNIT 7.68e-6   /* seconds per live/busy timer count */
+
+static pthread_mutex_t fmMutex = PTHREAD_MUTEX_INITIALIZER;
+#define FMLOCK     if(pthread_mutex_lock(&fmMutex)<0) perror("pthread_mutex_lock");
+#define FMUNLOCK   if(pthread_mutex_unlock(&fmMutex)<0) perror("pthread_mutex_unlock");
+
+static tiFiberMonSample fmRing[TI_FIBERMON_DEPTH][TI_FIBERMON_NPORTS];
+static int      fmHead = 0, fmCount = 0;
+static uint32_t fmPortMask = 0;
+static int      fmPrimed = 0;
+static double   fmTime = 0;
+static uint32_t fmLastTimer = 0, fmLastBusy[TI_FIBERMON_NPORTS];
+
+static double   fmBusySlopeThreshold = 0.001;  /* busy fraction per second */
+static double   fmGTPSlopeThreshold  = 1.0;    /* buffer length per second */
+static double   fmErrorRateThreshold = 0.05;   /* fraction of samples */
+
+/**
+ * @ingroup FiberMon
+ * @brief Clear the sample history and select the fiber ports to watch
+ *
+ * @param portMask Mask of fiber ports (bit 0 = Fiber 1) to flag.
+ *                 If 0, the currently connected ports are used.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiFiberMonInit(uint32_t portMask)
+{
+  int connected = 0;
+
+  connected = tiGetConnectedFiberMask();
+  if(connected == ERROR)
+    return ERROR;
+
+  FMLOCK;
+  memset((void *)fmRing, 0, sizeof(fmRing));
+  memset((void *)fmLastBusy, 0, sizeof(fmLastBusy));
+  fmHead = 0; fmCount = 0;
+  fmPrimed = 0; fmTime = 0; fmLastTimer = 0;
+  fmPortMask = (portMask ? portMask : (uint32_t)connected) & 0xFF;
+  FMUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup FiberMon
+ * @brief Set the thresholds used to flag a degrading link
+ *
+ * @param busySlope  Busy fraction increase per second
+ * @param gtpSlope   GTP trigger buffer length increase per second
+ * @param errorRate  Fraction of samples with trigger link errors
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiFiberMonSetThresholds(double busySlope, double gtpSlope, double errorRate)
+{
+  if((busySlope <= 0) || (gtpSlope <= 0) || (errorRate <= 0))
+    {
+      printf("%s: ERROR: Invalid threshold (%g, %g, %g)\n",
+	     __func__, busySlope, gtpSlope, errorRate);
+      return ERROR;
+    }
+
+  FMLOCK;
+  fmBusySlopeThreshold = busySlope;
+  fmGTPSlopeThreshold  = gtpSlope;
+  fmErrorRateThreshold = errorRate;
+  FMUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup FiberMon
+ * @brief Sample the fiber port registers into the history.
+ *
+ *    The first call after tiFiberMonInit only records the counters, so that
+ *    each stored sample holds the busy fraction over the preceding interval.
+ *    Trigger link errors are cleared after they are recorded.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiFiberMonUpdate()
+{
+  tiPortStatus port[TI_PORT_NPORTS];
+  int iport = 0, errors = 0;
+  unsigned int gtp = 0, timer = 0, dtimer = 0, dbusy = 0;
+  unsigned int busy[TI_FIBERMON_NPORTS];
+  tiFiberMonSample *s;
+
+  /* Latch first, so the busy counters go with the timers */
+  tiLatchTimers();
+  if(tiGetAllSlaveStatus(port) == ERROR)
+    return ERROR;
+  timer = tiGetLiveTime() + tiGetBusyTime();
+  gtp = tiGetGTPBufferLength(0) & TI_GTPTRIGGERBUFFERLENGTH_GLOBAL_LENGTH_MASK;
+
+  for(iport = 0; iport < TI_FIBERMON_NPORTS; iport++)
+    {
+      busy[iport] = port[iport + 1].busyCounter;
+      errors |= port[iport + 1].linkErrors;
+    }
+
+  if(errors)
+    tiTriggerLinkErrorReset();
+
+  FMLOCK;
+  if(fmPrimed)
+    {
+      dtimer = timer - fmLastTimer;
+      fmTime += dtimer * TI_FIBERMON_TIMER_UNIT;
+
+      for(iport = 0; iport < TI_FIBERMON_NPORTS; iport++)
+	{
+	  s = &fmRing[fmHead][iport];
+
+	  s->time      = fmTime;
+	  s->connected = port[iport + 1].connected;
+	  s->trigsrc   = port[iport + 1].trigSrcEnabled;
+	  s->errors    = port[iport + 1].linkErrors;
+	  s->gtpLength = gtp;
+
+	  dbusy = busy[iport] - fmLastBusy[iport];
+	  s->busyFraction = (dtimer > 0) ? (double)dbusy / (double)dtimer : 0;
+	  if(s->busyFraction > 1.0)
+	    s->busyFraction = 1.0;
+	}
+
+      fmHead = (fmHead + 1) % TI_FIBERMON_DEPTH;
+      if(fmCount < TI_FIBERMON_DEPTH)
+	fmCount++;
+    }
+
+  memcpy((void *)fmLastBusy, (void *)busy, sizeof(fmLastBusy));
+  fmLastTimer = timer;
+  fmPrimed = 1;
+  FMUNLOCK;
+
+  return OK;
+}
+
+/* Copy the history of port (0-7), oldest first.  Call with FMLOCK held. */
+static int
+fmCopy(int iport, tiFiberMonSample *samples, int maxsamples)
+{
+  int isamp, n, first;
+
+  n = (fmCount < maxsamples) ? fmCount : maxsamples;
+  first = (fmHead - n + TI_FIBERMON_DEPTH) % TI_FIBERMON_DEPTH;
+
+  for(isamp = 0; isamp < n; isamp++)
+    samples[isamp] = fmRing[(first + isamp) % TI_FIBERMON_DEPTH][iport];
+
+  return n;
+}
+
+/* Least squares slope of y versus x */
+static double
+fmSlope(const double *x, const double *y, int n)
+{
+  double sx = 0, sy = 0, sxx = 0, sxy = 0, denom = 0;
+  int i;
+
+  for(i = 0; i < n; i++)
+    {
+      sx  += x[i];
+      sy  += y[i];
+      sxx += x[i] * x[i];
+      sxy += x[i] * y[i];
+    }
+
+  denom = n * sxx - sx * sx;
+  if((n < 2) || (denom <= 0))
+    return 0;
+
+  return (n * sxy - sx * sy) / denom;
+}
+
+/**
+ * @ingroup FiberMon
+ * @brief Copy the sample history of a fiber port
+ *
+ * @param port        Fiber port (1-8)
+ * @param samples     Destination array, filled oldest first
+ * @param maxsamples  Size of samples
+ *
+ * @return Number of samples copied if successful, otherwise ERROR
+ */
+int
+tiFiberMonGetSamples(int port, tiFiberMonSample *samples, int maxsamples)
+{
+  int rval = 0;
+
+  if((port < 1) || (port > TI_FIBERMON_NPORTS) || (samples == NULL) || (maxsamples < 0))
+    {
+      printf("%s: ERROR: Invalid port (%d) or destination\n",
+	     __func__, port);
+      return ERROR;
+    }
+
+  FMLOCK;
+  rval = fmCopy(port - 1, samples, maxsamples);
+  FMUNLOCK;
+
+  return rval;
+}
+
+/**
+ * @ingroup FiberMon
+ * @brief Compute the busy, error and link statistics of a fiber port over
+ *        the sample history, and flag it if it is degrading.
+ *
+ *   Flags are only set for ports selected in tiFiberMonInit.
+ *
+ * @param port   Fiber port (1-8)
+ * @param stats  Where to store the statistics
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiFiberMonGetStats(int port, tiFiberMonStats *stats)
+{
+  tiFiberMonSample samples[TI_FIBERMON_DEPTH];
+  double t[TI_FIBERMON_DEPTH], busy[TI_FIBERMON_DEPTH];
+  double busySlopeThreshold = 0, errorRateThreshold = 0;
+  int n = 0, isamp = 0, nerrors = 0, watched = 0;
+
+  if((port < 1) || (port > TI_FIBERMON_NPORTS) || (stats == NULL))
+    {
+      printf("%s: ERROR: Invalid port (%d) or destination\n",
+	     __func__, port);
+      return ERROR;
+    }
+
+  FMLOCK;
+  n = fmCopy(port - 1, samples, TI_FIBERMON_DEPTH);
+  watched = (fmPortMask >> (port - 1)) & 0x1;
+  busySlopeThreshold = fmBusySlopeThreshold;
+  errorRateThreshold = fmErrorRateThreshold;
+  FMUNLOCK;
+
+  memset((void *)stats, 0, sizeof(tiFiberMonStats));
+  stats->nsamples = n;
+  if(n == 0)
+    return OK;
+
+  for(isamp = 0; isamp < n; isamp++)
+    {
+      t[isamp] = samples[isamp].time;
+      busy[isamp] = samples[isamp].busyFraction;
+      stats->busyFraction += busy[isamp];
+      if(samples[isamp].errors)
+	nerrors++;
+      if((isamp > 0) && samples[isamp - 1].connected && !samples[isamp].connected)
+	stats->disconnects++;
+    }
+
+  stats->busyFraction /= n;
+  stats->busyLast = busy[n - 1];
+  stats->busySlope = fmSlope(t, busy, n);
+  stats->errorRate = (double)nerrors / n;
+
+  if(watched)
+    {
+      if((n >= TI_FIBERMON_MIN_TREND) && (stats->busySlope > busySlopeThreshold))
+	stats->degraded |= TI_FIBERMON_DEGRADED_BUSY;
+      if(stats->errorRate > errorRateThreshold)
+	stats->degraded |= TI_FIBERMON_DEGRADED_ERRORS;
+      if((stats->disconnects > 0) || !samples[n - 1].connected)
+	stats->degraded |= TI_FIBERMON_DEGRADED_LINK;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup FiberMon
+ * @brief Trend of the GTP global trigger buffer length, shared by all ports.
+ *
+ * @param slope  If not NULL, where to store the slope (length per second)
+ *
+ * @return 1 if the buffer length trends upward past the threshold, 0 if not,
+ *         ERROR on error
+ */
+int
+tiFiberMonGetGTPTrend(double *slope)
+{
+  tiFiberMonSample samples[TI_FIBERMON_DEPTH];
+  double t[TI_FIBERMON_DEPTH], length[TI_FIBERMON_DEPTH];
+  double threshold = 0, rslope = 0;
+  int n = 0, isamp = 0;
+
+  FMLOCK;
+  n = fmCopy(0, samples, TI_FIBERMON_DEPTH);
+  threshold = fmGTPSlopeThreshold;
+  FMUNLOCK;
+
+  for(isamp = 0; isamp < n; isamp++)
+    {
+      t[isamp] = samples[isamp].time;
+      length[isamp] = samples[isamp].gtpLength;
+    }
+  rslope = fmSlope(t, length, n);
+
+  if(slope)
+    *slope = rslope;
+
+  return ((n >= TI_FIBERMON_MIN_TREND) && (rslope > threshold)) ? 1 : 0;
+}
+
+/**
+ * @ingroup FiberMon
+ * @brief Return the mask of watched fiber ports that are flagged as degrading
+ *
+ * @return Mask of fiber ports (bit 0 = Fiber 1)
+ */
+uint32_t
+tiFiberMonDegradedMask()
+{
+  tiFiberMonStats stats;
+  uint32_t rval = 0;
+  int iport;
+
+  for(iport = 1; iport <= TI_FIBERMON_NPORTS; iport++)
+    {
+      if((tiFiberMonGetStats(iport, &stats) == OK) && stats.degraded)
+	rval |= (1 << (iport - 1));
+    }
+
+  return rval;
+}
+
+/**
+ * @ingroup FiberMon
+ * @brief Print the statistics of each fiber port to standard out
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiFiberMonPrintStatus()
+{
+  tiFiberMonStats stats;
+  double gtpSlope = 0;
+  int iport, gtpTrend = 0;
+
+  printf("\n");
+  printf(" Fiber Link Monitor\n");
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Port  Samples   Busy%%   Last%%   Slope(%%/s)   Errors%%  Drops  Flags\n");
+  printf("--------------------------------------------------------------------------------\n");
+
+  for(iport = 1; iport <= TI_FIBERMON_NPORTS; iport++)
+    {
+      if(tiFiberMonGetStats(iport, &stats) != OK)
+	return ERROR;
+
+      printf("  %4d  %7d  %6.2f  %6.2f  %11.4f  %8.2f  %5d  %s%s%s\n",
+	     iport, stats.nsamples,
+	     100. * stats.busyFraction, 100. * stats.busyLast,
+	     100. * stats.busySlope, 100. * stats.errorRate,
+	     stats.disconnects,
+	     (stats.degraded & TI_FIBERMON_DEGRADED_BUSY) ? "BUSY " : "",
+	     (stats.degraded & TI_FIBERMON_DEGRADED_ERRORS) ? "ERRORS " : "",
+	     (stats.degraded & TI_FIBERMON_DEGRADED_LINK) ? "LINK" : "");
+    }
+
+  gtpTrend = tiFiberMonGetGTPTrend(&gtpSlope);
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  GTP buffer length slope = %.3f /s %s\n",
+	 gtpSlope, (gtpTrend == 1) ? "(RISING)" : "");
+  printf("\n");
+
+  return OK;
+}
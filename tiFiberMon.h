@@ -0,0 +1,61 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Fiber link health monitor for the TI Master.  Samples the fiber
+ *     connection, trigger link error and busy counter registers of
+ *     each fiber port into a ring buffer, and flags links whose
+ *     busy fraction trends upward, report errors, or drop.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define TI_FIBERMON_NPORTS           8
+#define TI_FIBERMON_DEPTH           64   /* samples kept per port */
+#define TI_FIBERMON_MIN_TREND        8   /* samples needed before a trend is flagged */
+
+/* Sample errors bits (TI_PORT_LINK_* of tiGetAllSlaveStatus) */
+#define TI_FIBERMON_ERROR_DATA       (1<<0)
+#define TI_FIBERMON_ERROR_DISPARITY  (1<<1)
+#define TI_FIBERMON_ERROR_NOT_8B10B  (1<<2)
+
+/* Stats degraded bits */
+#define TI_FIBERMON_DEGRADED_BUSY    (1<<0)
+#define TI_FIBERMON_DEGRADED_ERRORS  (1<<1)
+#define TI_FIBERMON_DEGRADED_LINK    (1<<2)
+
+typedef struct tiFiberMonSample
+{
+  double   time;          /* seconds since the first sample, from the live/busy timers */
+  uint32_t connected;     /* 1 if the port reports connected */
+  uint32_t trigsrc;       /* 1 if the port has its trigger source enabled */
+  uint32_t errors;        /* TI_FIBERMON_ERROR_* seen since the previous sample */
+  uint32_t gtpLength;     /* GTP global trigger buffer length (shared by all ports) */
+  double   busyFraction;  /* port busy counter / elapsed time since the previous sample */
+} tiFiberMonSample;
+
+typedef struct tiFiberMonStats
+{
+  int      nsamples;
+  double   busyFraction;  /* mean over the window */
+  double   busyLast;      /* most recent sample */
+  double   busySlope;     /* least squares slope of busyFraction (1/s) */
+  double   errorRate;     /* fraction of samples with link errors */
+  int      disconnects;   /* connected -> disconnected transitions in the window */
+  uint32_t degraded;      /* TI_FIBERMON_DEGRADED_* */
+} tiFiberMonStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int      tiFiberMonInit(uint32_t portMask);
+  int      tiFiberMonSetThresholds(double busySlope, double gtpSlope, double errorRate);
+  int      tiFiberMonUpdate();
+  int      tiFiberMonGetSamples(int port, tiFiberMonSample *samples, int maxsamples);
+  int      tiFiberMonGetStats(int port, tiFiberMonStats *stats);
+  int      tiFiberMonGetGTPTrend(double *slope);
+  uint32_t tiFiberMonDegradedMask();
+  int      tiFiberMonPrintStatus();
+#ifdef __cplusplus
+}
+#endif
@@ -45,6 +45,31 @@
 #include <string.h>
 #include <pthread.h>
 #include "tiLib.h"
+#include "tiDecode.h"
+#ifdef TI_TRACE
+#include "tiTrace.h"
+#else
+#define TI_TRACE_POINT(_point, _arg)           do { } while(0)
+#define TI_TRACE_POINT_AT(_point, _tsc, _arg)  do { } while(0)
+#define TI_TRACE_CLOCK(_var)
+#endif
+#ifndef VXWORKS
+#include "tiLog.h"
+/* Messages from the readout path are queued, with their severity, for the
+   tiLog drain thread (after tiLogStart, otherwise they go to logMsg) */
+#define TILOGMSG(_level, _format, _a1, _a2, _a3, _a4, _a5, _a6)		\
+  tiLogMsgLevel(TI_LOG_##_level, _format, _a1, _a2, _a3, _a4, _a5, _a6)
+#include "tiCapture.h"
+/* Readout data stream capture, when tiCaptureStart was called */
+#define TICAPTURE(_call)  do { if(tiCaptureEnabled) _call; } while(0)
+static int tiCaptureCaller = TI_CAPTURE_READBLOCK;
+#define TICAPTURE_CALLER(_caller)  tiCaptureCaller = (_caller)
+#else
+#define TILOGMSG(_level, _format, _a1, _a2, _a3, _a4, _a5, _a6)	\
+  logMsg(_format, _a1, _a2, _a3, _a4, _a5, _a6)
+#define TICAPTURE(_call)  do { } while(0)
+#define TICAPTURE_CALLER(_caller)
+#endif
 
 /* Mutex to guard TI read/writes */
 pthread_mutex_t   tiMutex = PTHREAD_MUTEX_INITIALIZER;
@@ -63,6 +88,14 @@ void intUnlock(int key) {};
     intUnlock(tiLockKey);						\
   }
 
+/* Single cycle read of the data FIFO.  Through vmeRead32 for the
+   simulated backend, which serves the FIFO words */
+#ifdef TI_SIM
+#define TIFIFOREAD   vmeRead32(TIpd)
+#else
+#define TIFIFOREAD   (unsigned int) *TIpd
+#endif
+
 /* Global Variables */
 volatile struct TI_A24RegStruct  *TIp=NULL;    /* pointer to TI memory map */
 volatile        unsigned int     *TIpd=NULL;  /* pointer to TI data FIFO */
@@ -111,7 +144,10 @@ static int          tiSyncResetType=TI_SYNCCOMMAND_SYNCRESET_4US;  /* Set defaul
 static int          tiFakeTriggerBank=1;
 static int          tiUseGoOutput=1;
 static int          tiUseEvTypeScalers=0;
-static int32_t      tiTriggerTableMode=0;    /* Predefined: 0-3, User: 4 */
+static int32_t      tiTriggerTableMode=-1;   /* Predefined: 0-3, User: 4, -1: not loaded */
+static char         tiTopologyFile[256]="";  /* Topology cache, see tiSetTopologyCache_preInit */
+static tiTopology   tiTopo;                  /* Topology found by the last tiInit */
+static int          tiTopoState=-1;          /* -1: unknown, 0: cold start, 1: warm start */
 
 static unsigned int tiTrigPatternData[16]=   /* Default Trigger Table to be loaded */
   { /* TS#1,2,3,4,5,6 generates Trigger1 (physics trigger),
@@ -124,6 +160,35 @@ static unsigned int tiTrigPatternData[16]=   /* Default Trigger Table to be load
     0x73727170, 0x77767574, 0x7b7a7978, 0x7f7e7d7c,
   };
 
+/* Routine to be executed once, at the next block boundary */
+static volatile VOIDFUNCPTR tiBlockBoundaryRoutine = NULL;
+static unsigned int tiBlockBoundaryArg = 0;
+#ifndef VXWORKS
+static pthread_mutex_t tiBlockBoundaryMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  tiBlockBoundaryCond  = PTHREAD_COND_INITIALIZER;
+#endif
+static void tiBlockBoundaryService(void);
+
+/* Readout latency histograms (ns).  Log-linear bins: TI_LATENCY_SUB bins per
+   power of 2, so any value is within 1/TI_LATENCY_SUB of its bin.  Updated
+   by the readout without locks, read with tiGetLatencyStats */
+#define TI_LATENCY_SUB_BITS  5
+#define TI_LATENCY_SUB       (1<<TI_LATENCY_SUB_BITS)
+#define TI_LATENCY_MAX_BITS  36   /* ~69 s, larger values go in the last bin */
+#define TI_LATENCY_NBINS     ((TI_LATENCY_MAX_BITS - TI_LATENCY_SUB_BITS + 1) * TI_LATENCY_SUB)
+typedef struct
+{
+  uint64_t bin[TI_LATENCY_NBINS];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;   /* +1, 0 when empty */
+  uint64_t max;
+} tiLatencyHist;
+static tiLatencyHist tiLatency[TI_LATENCY_NSTAGES];
+static uint64_t      tiLatencyReady = 0;        /* blocks ready */
+static uint64_t      tiLatencyCallbackEnd = 0;  /* user routine returned, not yet acked */
+static void tiIntRoutineCall(void);
+
 /* Interrupt/Polling routine prototypes (static) */
 static void tiInt(void);
 #ifndef VXWORKS
@@ -144,6 +209,78 @@ IMPORT  STATUS sysVmeDmaSend(UINT32, UINT32, int, BOOL);
 #endif
 
 static int FiberMeas();
+static int tiFiberMeasRestore(int latency);
+
+static inline uint64_t
+tiLatencyNow(void)
+{
+#ifdef VXWORKS
+  return 0;
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline int
+tiLatencyBin(uint64_t ns)
+{
+  int exp;
+
+  if(ns < TI_LATENCY_SUB)
+    return (int)ns;
+
+  exp = 63 - __builtin_clzll(ns);
+  if(exp >= TI_LATENCY_MAX_BITS)
+    return TI_LATENCY_NBINS - 1;
+
+  return (exp - TI_LATENCY_SUB_BITS + 1) * TI_LATENCY_SUB +
+    (int)((ns >> (exp - TI_LATENCY_SUB_BITS)) & (TI_LATENCY_SUB - 1));
+}
+
+/* Middle of a histogram bin (ns) */
+static double
+tiLatencyBinValue(int ibin)
+{
+  int group = ibin / TI_LATENCY_SUB;
+  uint64_t low;
+
+  if(group == 0)
+    return (double)ibin;
+
+  low = (uint64_t)(TI_LATENCY_SUB + (ibin % TI_LATENCY_SUB)) << (group - 1);
+  return (double)low + 0.5 * (double)(1ULL << (group - 1));
+}
+
+static void
+tiLatencyRecord(int stage, uint64_t start, uint64_t end)
+{
+#ifndef VXWORKS
+  tiLatencyHist *h = &tiLatency[stage];
+  uint64_t ns, old;
+
+  if((start == 0) || (end < start))
+    return;
+  ns = end - start;
+
+  __atomic_fetch_add(&h->bin[tiLatencyBin(ns)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->sum, ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+
+  old = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+  while((ns > old) &&
+	!__atomic_compare_exchange_n(&h->max, &old, ns, 0,
+				     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+  old = __atomic_load_n(&h->min, __ATOMIC_RELAXED);
+  while(((old == 0) || (ns + 1 < old)) &&
+	!__atomic_compare_exchange_n(&h->min, &old, ns + 1, 0,
+				     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+#endif
+}
 
 /**
  * @defgroup PreInit Pre-Initialization
@@ -234,6 +371,153 @@ tiSetFiberIn_preInit(int port)
   return OK;
 }
 
+/**
+ * @ingroup PreInit
+ *
+ * @brief Set the file of the topology cache, for a warm start of tiInit
+ *
+ *  tiInit keeps what it found in the cache: VME A24 and A32 addresses, slot,
+ *  firmware version, serial number and, for a TI Slave, the fiber port,
+ *  measured fiber latency and connected fibers.  When the firmware version
+ *  and serial number read back match, tiInit skips the scan for the TI
+ *  (tAddr = 0).  If the connected fibers and a single latency measurement
+ *  also match, it skips the full fiber latency measurement.
+ *  TI_INIT_COLD_START ignores the cache.
+ *
+ * @param filename Cache file.  NULL or "" to disable the cache.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiSetTopologyCache_preInit(const char *filename)
+{
+  if((filename == NULL) || (filename[0] == '\0'))
+    {
+      tiTopologyFile[0] = '\0';
+      return OK;
+    }
+
+  if(strlen(filename) >= sizeof(tiTopologyFile))
+    {
+      printf("%s: ERROR: Topology cache filename too long (%d characters)\n",
+	     __func__, (int)strlen(filename));
+      return ERROR;
+    }
+
+  strcpy(tiTopologyFile, filename);
+
+  return OK;
+}
+
+/* Topology cache record */
+#define TI_TOPOLOGY_MAGIC "TITOPO01"
+typedef struct
+{
+  char         magic[8];
+  unsigned int size;      /* sizeof(tiTopology) */
+  tiTopology   topo;
+} tiTopologyRecord;
+
+/* Read the topology cache.  Returns OK if it holds a valid record */
+static int
+tiTopologyLoad(tiTopology *topo)
+{
+  tiTopologyRecord rec;
+  FILE *f;
+  int n;
+
+  if(tiTopologyFile[0] == '\0')
+    return ERROR;
+
+  f = fopen(tiTopologyFile, "r");
+  if(f == NULL)
+    return ERROR;
+  n = fread(&rec, sizeof(rec), 1, f);
+  fclose(f);
+
+  if((n != 1) || (memcmp(rec.magic, TI_TOPOLOGY_MAGIC, sizeof(rec.magic)) != 0) ||
+     (rec.size != sizeof(tiTopology)))
+    {
+      printf("%s: WARN: Ignoring invalid topology cache %s\n",
+	     __func__, tiTopologyFile);
+      return ERROR;
+    }
+
+  *topo = rec.topo;
+
+  return OK;
+}
+
+/* Write the topology to the cache, unless it holds the same (cached != NULL).
+   Written to a temporary file then renamed, to never leave a partial record. */
+static int
+tiTopologySave(const tiTopology *topo, const tiTopology *cached)
+{
+  tiTopologyRecord rec;
+  char tmp[sizeof(tiTopologyFile) + 8];
+  FILE *f;
+  int n;
+
+  if(tiTopologyFile[0] == '\0')
+    return OK;
+
+  if((cached != NULL) && (memcmp(cached, topo, sizeof(tiTopology)) == 0))
+    return OK;
+
+  memset(&rec, 0, sizeof(rec));
+  memcpy(rec.magic, TI_TOPOLOGY_MAGIC, sizeof(rec.magic));
+  rec.size = sizeof(tiTopology);
+  rec.topo = *topo;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", tiTopologyFile);
+  f = fopen(tmp, "w");
+  if(f == NULL)
+    {
+      printf("%s: ERROR: Unable to write topology cache %s\n",
+	     __func__, tmp);
+      return ERROR;
+    }
+  n = fwrite(&rec, sizeof(rec), 1, f);
+  if((fclose(f) != 0) || (n != 1) || (rename(tmp, tiTopologyFile) != 0))
+    {
+      printf("%s: ERROR: Unable to write topology cache %s\n",
+	     __func__, tiTopologyFile);
+      remove(tmp);
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/* Check that the TI of the topology cache is still at its A24 address.
+   Returns 1 if so, otherwise 0 */
+static int
+tiTopologyProbe(const tiTopology *topo)
+{
+  unsigned int rval=0;
+  unsigned long laddr;
+  int stat;
+
+#ifdef VXWORKS
+  stat = sysBusToLocalAdrs(0x39,(char *)topo->a24,(char **)&laddr);
+#else
+  stat = vmeBusToLocalAdrs(0x39,(char *)(unsigned long)topo->a24,(char **)&laddr);
+#endif
+  if(stat != 0)
+    return 0;
+
+#ifdef VXWORKS
+  stat = vxMemProbe((char *)(laddr),0,4,(char *)&rval);
+#else
+  stat = vmeMemProbe((char *)(laddr),4,(char *)&rval);
+#endif
+  if(stat != 0)
+    return 0;
+
+  return ((((rval&TI_BOARDID_TYPE_MASK)>>16) == TI_BOARDID_TYPE_TI) &&
+	  (((rval&TI_BOARDID_GEOADR_MASK)>>8) == topo->slot));
+}
+
 
 /**
  *  @ingroup Config
@@ -257,6 +541,7 @@ tiSetFiberIn_preInit(int port)
  *     - 0   Do not initialize the board, just setup the pointers to the registers
  *     - 1   Use Slave Fiber 5, instead of 1
  *     - 2   Ignore firmware check
+ *     - 3   Cold start: ignore the topology cache (tiSetTopologyCache_preInit)
  *
  *  @return OK if successful, otherwise ERROR.
  *
@@ -273,7 +558,19 @@ tiInit(unsigned int tAddr, unsigned int mode, int iFlag)
   int supportedVersion = TI_SUPPORTED_FIRMWARE;
   int supportedType    = TI_SUPPORTED_TYPE;
   int tiFirmwareType;
+  tiTopology topo, cached;
+  int cacheValid=0, warm=0;
+
+#ifndef VXWORKS
+  tiResetLatencyStats();
+#endif
+  /* Including a block held by the readout recovery, read before this init */
+  tiResetReadoutRecovery();
 
+  tiTopoState = -1;
+  memset(&topo, 0, sizeof(topo));
+  if(!(iFlag&TI_INIT_COLD_START) && (tiTopologyLoad(&cached) == OK))
+    cacheValid = 1;
 
   /* Check VME address */
   if(tAddr<0 || tAddr>0xffffff)
@@ -283,8 +580,16 @@ tiInit(unsigned int tAddr, unsigned int mode, int iFlag)
     }
   if(tAddr==0)
     {
-      printf("%s: Scanning for TI...\n",__FUNCTION__);
-      tAddr=tiFind();
+      if(cacheValid && tiTopologyProbe(&cached))
+	{
+	  tAddr = cached.a24;
+	  printf("%s: TI at 0x%08x (topology cache)\n",__FUNCTION__,tAddr);
+	}
+      else
+	{
+	  printf("%s: Scanning for TI...\n",__FUNCTION__);
+	  tAddr=tiFind();
+	}
 
       if(tAddr==0)
 	{
@@ -486,6 +791,16 @@ tiInit(unsigned int tAddr, unsigned int mode, int iFlag)
       return OK;
     }
 
+  /* Warm start if the topology cache is of this board */
+  topo.a24          = tAddr;
+  topo.slot         = tiSlotNumber;
+  topo.a32          = tiA32Base;
+  topo.firmware     = firmwareInfo;
+  topo.serialNumber = tiGetSerialNumber(NULL);
+  warm = cacheValid &&
+    (cached.a24 == topo.a24) && (cached.slot == topo.slot) &&
+    (cached.firmware == topo.firmware) && (cached.serialNumber == topo.serialNumber);
+
   /* Reset global library variables */
   tiBlockLevel=1;
   tiNextBlockLevel=1;
@@ -691,14 +1006,28 @@ tiInit(unsigned int tAddr, unsigned int mode, int iFlag)
   /* Disable all TS Inputs */
   tiDisableTSInput(TI_TSINPUT_ALL);
 
+  TILOCK;
+  topo.connectedFibers = (vmeRead32(&TIp->fiber) & TI_FIBER_CONNECTED_MASK)>>16;
+  TIUNLOCK;
+
   if(tiMaster != 1)
     {
-      if(FiberMeas() == ERROR)
+      topo.slaveFiberIn = tiSlaveFiberIn;
+
+      /* Same fibers to the same board: check and keep the measured latency */
+      if(!(warm && (cached.slaveFiberIn == topo.slaveFiberIn) &&
+	   (cached.connectedFibers == topo.connectedFibers) &&
+	   (tiFiberMeasRestore(cached.fiberLatency) == OK)))
 	{
-	  printf("%s: Fiber Measurement failure.  Check fiber and/or fiber port,\n",
-		 __FUNCTION__);
-	  return -2;
+	  warm = 0;
+	  if(FiberMeas() == ERROR)
+	    {
+	      printf("%s: Fiber Measurement failure.  Check fiber and/or fiber port,\n",
+		     __FUNCTION__);
+	      return -2;
+	    }
 	}
+      topo.fiberLatency = tiFiberLatencyMeasurement;
     }
   else
     {
@@ -715,6 +1044,10 @@ tiInit(unsigned int tAddr, unsigned int mode, int iFlag)
       taskDelay(1);
     }
 
+  tiTopo = topo;
+  tiTopoState = warm;
+  tiTopologySave(&topo, cacheValid ? &cached : NULL);
+
   return OK;
 }
 
@@ -1748,6 +2081,31 @@ tiGetSerialNumber(char **rSN)
 
 }
 
+/**
+ * @ingroup Status
+ * @brief Get the topology found by the last tiInit
+ *
+ * @param topo Where to return the topology (may be NULL)
+ *
+ * @return 1 if tiInit made a warm start from the topology cache (same
+ *         board and fibers, nothing measured), 0 if not, otherwise ERROR
+ *
+ */
+int
+tiGetTopology(tiTopology *topo)
+{
+  if(tiTopoState < 0)
+    {
+      printf("%s: ERROR: TI not initialized\n",__func__);
+      return ERROR;
+    }
+
+  if(topo != NULL)
+    *topo = tiTopo;
+
+  return tiTopoState;
+}
+
 /**
  * @ingroup MasterConfig
  * @brief Resync the 250 MHz Clock
@@ -1965,6 +2323,113 @@ tiGetSlaveBlocklevel(int port)
   return rval;
 }
 
+/**
+ * @ingroup Status
+ * @brief Read the status of the loopback and all fiber ports in a single
+ *        locked batch: what tiSlaveStatus prints, with tiGetCrateID,
+ *        tiGetPortTrigSrcEnabled, tiGetSlaveBlocklevel, tiBlockStatus and
+ *        tiGetBusyCounter for every port.
+ *
+ * @param status  Array of TI_PORT_NPORTS elements to fill.
+ *                0: Loopback, 1-8: Fiber 1-8
+ *
+ * @return Number of slaves in the slave mask if successful, otherwise ERROR
+ */
+int
+tiGetAllSlaveStatus(tiPortStatus *status)
+{
+  unsigned int hfbr_tiID[8], blockStatus[4], busyCounter[TI_PORT_NPORTS];
+  unsigned int master_tiID = 0, fiber = 0, busy = 0, trigsrc = 0, adr24 = 0;
+  unsigned int blocklevel = 0, gtp = 0, bs = 0;
+  int iport = 0, ireg = 0, nslaves = 0;
+  tiPortStatus *p;
+
+  if(TIp == NULL)
+    {
+      printf("%s: ERROR: TI not initialized\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if(tiUseTsRev2)
+    {
+      printf("%s: ERROR: Invalid usage with TS rev 2.\n",
+	     __func__);
+      return ERROR;
+    }
+
+  if(status == NULL)
+    {
+      printf("%s: ERROR: Invalid destination\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  TILOCK;
+  for(iport = 0; iport < 8; iport++)
+    hfbr_tiID[iport] = vmeRead32(&TIp->hfbr_tiID[iport]);
+  master_tiID = vmeRead32(&TIp->master_tiID);
+  fiber       = vmeRead32(&TIp->fiber);
+  busy        = vmeRead32(&TIp->busy);
+  trigsrc     = vmeRead32(&TIp->trigsrc);
+  for(ireg = 0; ireg < 4; ireg++)
+    blockStatus[ireg] = vmeRead32(&TIp->blockStatus[ireg]);
+  adr24       = vmeRead32(&TIp->adr24);
+  blocklevel  = vmeRead32(&TIp->blocklevel);
+  gtp         = vmeRead32(&TIp->GTPStatusB);
+  for(iport = 0; iport < TI_PORT_NPORTS; iport++)
+    busyCounter[iport] = vmeRead32(&TIp->busy_scaler2[iport]);
+  TIUNLOCK;
+
+  memset(status, 0, TI_PORT_NPORTS * sizeof(tiPortStatus));
+
+  /* Loopback */
+  p = &status[0];
+  p->port           = 0;
+  p->slave          = 0;
+  p->connected      = 1;
+  p->trigSrcEnabled = (trigsrc & TI_TRIGSRC_LOOPBACK) ? 1 : 0;
+  p->busy           = (busy & TI_BUSY_MONITOR_LOOPBACK) ? 1 : 0;
+  p->crateID        = (master_tiID & TI_ID_CRATEID_MASK)>>8;
+  p->portTrigSrc    = master_tiID & TI_ID_TRIGSRC_ENABLE_MASK;
+  p->blocklevel     = (blocklevel & TI_BLOCKLEVEL_CURRENT_MASK)>>16;
+  p->blocksReady    = (adr24 & TI_BLOCKSTATUS_NBLOCKS_READY1)>>16;
+  p->blocksNeedAck  = (adr24 & TI_BLOCKSTATUS_NBLOCKS_NEEDACK1)>>24;
+  p->linkUp         = 1;
+  p->busyCounter    = busyCounter[0];
+
+  /* Fiber ports */
+  for(iport = 1; iport < TI_PORT_NPORTS; iport++)
+    {
+      p = &status[iport];
+      p->port           = iport;
+      p->slave          = (tiSlaveMask & (1<<(iport-1))) ? 1 : 0;
+      p->connected      = (fiber & TI_FIBER_CONNECTED_TI(iport)) ? 1 : 0;
+      p->trigSrcEnabled = (fiber & TI_FIBER_TRIGSRC_ENABLED_TI(iport)) ? 1 : 0;
+      p->busy           = (busy & TI_BUSY_MONITOR_FIBER_BUSY(iport)) ? 1 : 0;
+      p->crateID        = (hfbr_tiID[iport-1] & TI_ID_CRATEID_MASK)>>8;
+      p->portTrigSrc    = hfbr_tiID[iport-1] & TI_ID_TRIGSRC_ENABLE_MASK;
+      p->blocklevel     = (hfbr_tiID[iport-1] & TI_ID_BLOCKLEVEL_MASK)>>16;
+
+      if(iport & 1)
+	bs = blockStatus[(iport-1)/2] & 0xFFFF;
+      else
+	bs = (blockStatus[(iport/2)-1] & 0xFFFF0000)>>16;
+      p->blocksReady    = bs & TI_BLOCKSTATUS_NBLOCKS_READY0;
+      p->blocksNeedAck  = (bs & TI_BLOCKSTATUS_NBLOCKS_NEEDACK0)>>8;
+
+      p->linkUp         = (gtp & TI_GTPSTATUSB_CHANNEL_BONDING_MASK & (1<<(iport-1))) ? 1 : 0;
+      p->linkErrors     =
+	(((gtp & TI_GTPSTATUSB_DATA_ERROR_MASK) >> (8 + iport - 1)) & 0x1) * TI_PORT_LINK_DATA_ERROR |
+	(((gtp & TI_GTPSTATUSB_DISPARITY_ERROR_MASK) >> (16 + iport - 1)) & 0x1) * TI_PORT_LINK_DISPARITY |
+	(((gtp & TI_GTPSTATUSB_DATA_NOT_IN_TABLE_ERROR_MASK) >> (24 + iport - 1)) & 0x1) * TI_PORT_LINK_NOT_IN_TABLE;
+      p->busyCounter    = busyCounter[iport];
+
+      if(p->slave)
+	nslaves++;
+    }
+
+  return nslaves;
+}
+
 /**
  * @ingroup MasterConfig
  * @brief Set the number of events per block
@@ -2038,6 +2503,79 @@ tiBroadcastNextBlockLevel(int blockLevel)
 
 }
 
+/**
+ * @ingroup MasterConfig
+ * @brief Broadcast the next block level and the block buffer level
+ *   together, with one lock and no delays.  Same effect as
+ *   tiBroadcastNextBlockLevel followed by tiSetBlockBufferLevel.
+ *
+ * @param blockLevel   block level to broadcast, 0 to leave it unchanged
+ * @param bufferLevel  block buffer level to set and broadcast, -1 to leave it unchanged
+ *
+ * @return OK if successful, ERROR otherwise
+ */
+int
+tiBroadcastBlockBufferLevel(int blockLevel, int bufferLevel)
+{
+  unsigned int trigger=0, reg_bl=0;
+  if(TIp==NULL)
+    {
+      printf("%s: ERROR: TI not initialized\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if( (blockLevel>TI_BLOCKLEVEL_MASK) || (blockLevel<0) )
+    {
+      printf("%s: ERROR: Invalid Block Level (%d)\n",__FUNCTION__,blockLevel);
+      return ERROR;
+    }
+
+  if(bufferLevel>TI_BLOCKBUFFER_BUFFERLEVEL_MASK)
+    {
+      printf("%s: ERROR: Invalid Buffer Level (%d)\n",__FUNCTION__,bufferLevel);
+      return ERROR;
+    }
+
+  if(!tiMaster)
+    {
+      printf("%s: ERROR: TI is not the TI Master.\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if((tiUseTsRev2 == 1) && (blockLevel > 1))
+    {
+      printf("%s: WARN: Invalid blockLevel (%d) for use with TS rev2 branch.  Using 1.",
+	     __func__, blockLevel);
+      blockLevel = 1;
+    }
+
+  TILOCK;
+  trigger = vmeRead32(&TIp->trigsrc);
+
+  if(!(trigger & TI_TRIGSRC_VME)) /* Turn on the VME trigger, if not enabled */
+    vmeWrite32(&TIp->trigsrc, TI_TRIGSRC_VME | trigger);
+
+  if(bufferLevel >= 0)
+    {
+      vmeWrite32(&TIp->blockBuffer, bufferLevel);
+      vmeWrite32(&TIp->triggerCommand, TI_TRIGGERCOMMAND_SET_BUFFERLEVEL | bufferLevel);
+      tiBlockBufferLevel = bufferLevel;
+    }
+
+  if(blockLevel > 0)
+    vmeWrite32(&TIp->triggerCommand, TI_TRIGGERCOMMAND_SET_BLOCKLEVEL | blockLevel);
+
+  if(!(trigger & TI_TRIGSRC_VME)) /* Turn off the VME trigger, if it was initially disabled */
+    vmeWrite32(&TIp->trigsrc, trigger);
+
+  reg_bl = vmeRead32(&TIp->blocklevel);
+  tiNextBlockLevel = (reg_bl & TI_BLOCKLEVEL_RECEIVED_MASK)>>24;
+  tiBlockLevel = (reg_bl & TI_BLOCKLEVEL_CURRENT_MASK)>>16;
+  TIUNLOCK;
+
+  return OK;
+}
+
 /**
  * @ingroup Status
  * @brief Get the block level that will be updated on the end of the block readout.
@@ -2364,11 +2902,12 @@ tiGetTriggerSource()
       else if(tiTriggerSource & TI_TRIGSRC_TSREV2)
 	rval = TI_TRIGGER_TSREV2;
 
-      else if(tiTriggerSource & TI_TRIGSRC_PULSER)
-	rval = TI_TRIGGER_PULSER;
-
+      /* TRIG21 also enables the pulser source, check it first */
       else if(tiTriggerSource & TI_TRIGSRC_TRIG21)
 	rval = TI_TRIGGER_TRIG21;
+
+      else if(tiTriggerSource & TI_TRIGSRC_PULSER)
+	rval = TI_TRIGGER_PULSER;
     }
   else
     {
@@ -2728,6 +3267,9 @@ tiSetEventFormat(int format)
 
   TIUNLOCK;
 
+  /* Decode the trigger banks read from now on with this format */
+  tiDecodeSetEventFormat(format);
+
   return OK;
 }
 
@@ -2846,8 +3388,8 @@ tiGetFPInputReadout()
  *  @param nevents  integer number of events to trigger
  *  @param period_inc  period multiplier, depends on range (0-0x7FFF)
  *  @param range
- *     - 0: small period range (min: 120ns, increments of 120ns)
- *     - 1: large period range (min: 120ns, increments of 245.7us)
+ *     - 0: small period range (min: 120ns, increments of 30ns)
+ *     - 1: large period range (min: 120ns, increments of 30ns x 2048 = 61.44us)
  *
  * @return OK if successful, ERROR otherwise
  *
@@ -2861,42 +3403,50 @@ tiSoftTrig(int trigger, unsigned int nevents, unsigned int period_inc, int range
 
   if(TIp==NULL)
     {
-      logMsg("\ntiSoftTrig: ERROR: TI not initialized\n",1,2,3,4,5,6);
+      TILOGMSG(ERROR, "\ntiSoftTrig: ERROR: TI not initialized\n",1,2,3,4,5,6);
       return ERROR;
     }
 
   if(trigger!=1 && trigger!=2)
     {
-      logMsg("\ntiSoftTrig: ERROR: Invalid trigger type %d\n",trigger,2,3,4,5,6);
+      TILOGMSG(ERROR, "\ntiSoftTrig: ERROR: Invalid trigger type %d\n",trigger,2,3,4,5,6);
       return ERROR;
     }
 
   if(nevents>TI_FIXEDPULSER1_NTRIGGERS_MASK)
     {
-      logMsg("\ntiSoftTrig: ERROR: nevents (%d) must be less than %d\n",nevents,
+      TILOGMSG(ERROR, "\ntiSoftTrig: ERROR: nevents (%d) must be less than %d\n",nevents,
 	     TI_FIXEDPULSER1_NTRIGGERS_MASK,3,4,5,6);
       return ERROR;
     }
   if(period_inc>periodMax)
     {
-      logMsg("\ntiSoftTrig: ERROR: period_inc (%d) must be less than %d ns\n",
+      TILOGMSG(ERROR, "\ntiSoftTrig: ERROR: period_inc (%d) must be less than %d ns\n",
 	     period_inc,periodMax,3,4,5,6);
       return ERROR;
     }
   if( (range!=0) && (range!=1) )
     {
-      logMsg("\ntiSoftTrig: ERROR: range must be 0 or 1\n",
+      TILOGMSG(ERROR, "\ntiSoftTrig: ERROR: range must be 0 or 1\n",
 	     periodMax,2,3,4,5,6);
       return ERROR;
     }
 
   if(range==0)
-    time = 120 + (30 * period_inc);
+    {
+      time = TI_FIXEDPULSER_PERIOD_MIN_NS + (TI_FIXEDPULSER_STEP_NS * period_inc);
+      TILOGMSG(INFO, "\ntiSoftTrig: INFO: Setting software trigger for %d nevents with period of %d ns\n",
+	     nevents,time,3,4,5,6);
+    }
   if(range==1)
-    time = 120 + (30 * period_inc * 2048);
-
-  logMsg("\ntiSoftTrig: INFO: Setting software trigger for %d nevents with period of %d\n",
-	 nevents,time,3,4,5,6);
+    {
+      /* 30ns x 2048 = 61.44us increments */
+      time = (TI_FIXEDPULSER_PERIOD_MIN_NS +
+	      (TI_FIXEDPULSER_STEP_NS * TI_FIXEDPULSER_RANGE1_FACTOR *
+	       (unsigned long long)period_inc)) / 1000;
+      TILOGMSG(INFO, "\ntiSoftTrig: INFO: Setting software trigger for %d nevents with period of %d us\n",
+	     nevents,time,3,4,5,6);
+    }
 
   reg = (range<<31)| (period_inc<<16) | (nevents);
   TILOCK;
@@ -2917,15 +3467,105 @@ tiSoftTrig(int trigger, unsigned int nevents, unsigned int period_inc, int range
 
 /**
  * @ingroup MasterConfig
- * @brief Set the parameters of the random internal trigger
+ * @brief Restart the "software" trigger with its current settings, without
+ *        printing.  The number of events starts over.
  *
- * @param trigger  - Trigger Selection
- *       -              1: trig1
- *       -              2: trig2
- * @param setting  - frequency prescale from 500MHz
+ *  @param trigger  trigger type 1 or 2 (playback trigger)
  *
- * @sa tiDisableRandomTrigger
- * @return OK if successful, ERROR otherwise.
+ * @sa tiSoftTrig
+ * @return OK if successful, ERROR otherwise
+ *
+ */
+int
+tiSoftTrigRestart(int trigger)
+{
+  volatile unsigned int *preg = NULL;
+  unsigned int reg = 0;
+
+  if(TIp==NULL)
+    {
+      printf("%s: ERROR: TI not initialized\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if(trigger!=1 && trigger!=2)
+    {
+      printf("%s: ERROR: Invalid trigger type %d\n",__FUNCTION__,trigger);
+      return ERROR;
+    }
+
+  preg = (trigger==1) ? &TIp->fixedPulser1 : &TIp->fixedPulser2;
+
+  TILOCK;
+  reg = vmeRead32(preg);
+  if((reg & TI_FIXEDPULSER1_NTRIGGERS_MASK) != 0)
+    vmeWrite32(preg, reg);
+  TIUNLOCK;
+
+  if((reg & TI_FIXEDPULSER1_NTRIGGERS_MASK) == 0)
+    {
+      printf("%s: ERROR: trig%d software trigger is not enabled\n",__FUNCTION__,trigger);
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup MasterStatus
+ * @brief Get the current settings of the "software" trigger
+ *
+ *  @param trigger  trigger type 1 or 2 (playback trigger)
+ *  @param nevents  number of events programmed (0: disabled)
+ *  @param period_inc  period multiplier, depends on range
+ *  @param range  period range (0: 30ns, 1: 30ns x 2048 = 61.44us increments)
+ *
+ * @sa tiSoftTrig
+ * @return OK if successful, ERROR otherwise
+ *
+ */
+int32_t
+tiGetSoftTrig(int32_t trigger, int32_t *nevents, int32_t *period_inc, int32_t *range)
+{
+  uint32_t reg = 0;
+
+  if(TIp==NULL)
+    {
+      printf("%s: ERROR: TI not initialized\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if(trigger!=1 && trigger!=2)
+    {
+      printf("%s: ERROR: Invalid trigger type %d\n",__FUNCTION__,trigger);
+      return ERROR;
+    }
+
+  TILOCK;
+  if(trigger==1)
+    reg = vmeRead32(&TIp->fixedPulser1);
+  else
+    reg = vmeRead32(&TIp->fixedPulser2);
+  TIUNLOCK;
+
+  *nevents    = reg & TI_FIXEDPULSER1_NTRIGGERS_MASK;
+  *period_inc = (reg & TI_FIXEDPULSER1_PERIOD_MASK) >> 16;
+  *range      = (reg & TI_FIXEDPULSER1_PERIOD_RANGE) ? 1 : 0;
+
+  return OK;
+}
+
+/**
+ * @ingroup MasterConfig
+ * @brief Set the parameters of the random internal trigger
+ *
+ * @param trigger  - Trigger Selection
+ *       -              1: trig1
+ *       -              2: trig2
+ * @param setting  - frequency prescale from 500MHz
+ *
+ * @sa tiDisableRandomTrigger
+ * @return OK if successful, ERROR otherwise.
  *
  */
 int
@@ -2941,7 +3581,7 @@ tiSetRandomTrigger(int trigger, int setting)
 
   if(trigger!=1 && trigger!=2)
     {
-      logMsg("\ntiSetRandomTrigger: ERROR: Invalid trigger type %d\n",trigger,2,3,4,5,6);
+      TILOGMSG(ERROR, "\ntiSetRandomTrigger: ERROR: Invalid trigger type %d\n",trigger,2,3,4,5,6);
       return ERROR;
     }
 
@@ -2995,6 +3635,55 @@ tiDisableRandomTrigger()
   return OK;
 }
 
+/**
+ * @ingroup MasterStatus
+ * @brief Get the current settings of the random internal trigger
+ *
+ * @param trigger  - Trigger Selection
+ *       -              1: trig1
+ *       -              2: trig2
+ * @param enable   - 1 if enabled, 0 if disabled
+ * @param setting  - frequency prescale from 500MHz
+ *
+ * @sa tiSetRandomTrigger
+ * @return OK if successful, ERROR otherwise.
+ *
+ */
+int32_t
+tiGetRandomTrigger(int32_t trigger, int32_t *enable, int32_t *setting)
+{
+  uint32_t reg = 0;
+
+  if(TIp==NULL)
+    {
+      printf("%s: ERROR: TI not initialized\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if(trigger!=1 && trigger!=2)
+    {
+      printf("%s: ERROR: Invalid trigger type %d\n",__FUNCTION__,trigger);
+      return ERROR;
+    }
+
+  TILOCK;
+  reg = vmeRead32(&TIp->randomPulser);
+  TIUNLOCK;
+
+  if(trigger==1)
+    {
+      *enable  = (reg & TI_RANDOMPULSER_TRIG1_ENABLE) ? 1 : 0;
+      *setting = reg & TI_RANDOMPULSER_TRIG1_RATE_MASK;
+    }
+  else
+    {
+      *enable  = (reg & TI_RANDOMPULSER_TRIG2_ENABLE) ? 1 : 0;
+      *setting = (reg & TI_RANDOMPULSER_TRIG2_RATE_MASK) >> 8;
+    }
+
+  return OK;
+}
+
 /**
  * @ingroup Readout
  * @brief Read a block of events from the TI
@@ -3015,33 +3704,35 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
   int ii, dummy=0, iword = 0;
   int dCnt, retVal, xferCount;
   volatile unsigned int *laddr;
-  unsigned int vmeAdr, val;
-  int ntrig=0, itrig = 0, trigwords = 0;
+  unsigned int vmeAdr, val, filler = 0;
+  int ntrig=0, itrig = 0, trigwords = 0, nfiller = 0;
+  uint64_t dmaStart = 0;
 
   if(TIp==NULL)
     {
-      logMsg("\ntiReadBlock: ERROR: TI not initialized\n",1,2,3,4,5,6);
+      TILOGMSG(ERROR, "\ntiReadBlock: ERROR: TI not initialized\n",1,2,3,4,5,6);
       return ERROR;
     }
 
   if(TIpd==NULL)
     {
-      logMsg("\ntiReadBlock: ERROR: TI A32 not initialized\n",1,2,3,4,5,6);
+      TILOGMSG(ERROR, "\ntiReadBlock: ERROR: TI A32 not initialized\n",1,2,3,4,5,6);
       return ERROR;
     }
 
   if(data==NULL)
     {
-      logMsg("\ntiReadBlock: ERROR: Invalid Destination address\n",0,0,0,0,0,0);
+      TILOGMSG(ERROR, "\ntiReadBlock: ERROR: Invalid Destination address\n",0,0,0,0,0,0);
       return(ERROR);
     }
 
+  TI_TRACE_POINT(TI_TRACE_READBLOCK_BEGIN, nwrds);
   TILOCK;
   if(rflag >= 1)
     { /* Block transfer */
       if(tiBusError==0)
 	{
-	  logMsg("tiReadBlock: WARN: Bus Error Block Termination was disabled.  Re-enabling\n",
+	  TILOGMSG(WARN, "tiReadBlock: WARN: Bus Error Block Termination was disabled.  Re-enabling\n",
 		 1,2,3,4,5,6);
 	  TIUNLOCK;
 	  tiEnableBusError();
@@ -3073,12 +3764,18 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 #ifdef VXWORKS
       retVal = sysVmeDmaSend((UINT32)laddr, vmeAdr, (nwrds<<2), 0);
 #else
+      dmaStart = tiLatencyNow();
+      TI_TRACE_POINT(TI_TRACE_DMASEND_BEGIN, nwrds<<2);
       retVal = vmeDmaSend((unsigned long)laddr, vmeAdr, (nwrds<<2));
+      TI_TRACE_POINT(TI_TRACE_DMASEND_END, retVal);
 #endif
       if(retVal != 0)
 	{
-	  logMsg("\ntiReadBlock: ERROR in DMA transfer Initialization 0x%x\n",retVal,0,0,0,0,0);
+	  TILOGMSG(ERROR, "\ntiReadBlock: ERROR in DMA transfer Initialization 0x%x\n",retVal,0,0,0,0,0);
 	  TIUNLOCK;
+	  TICAPTURE(tiCaptureBlock(tiCaptureCaller | (rflag << TI_CAPTURE_RFLAG_SHIFT),
+				   nwrds, data, retVal, NULL, 0));
+	  TI_TRACE_POINT(TI_TRACE_READBLOCK_END, 0);
 	  return(retVal);
 	}
 
@@ -3086,7 +3783,10 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 #ifdef VXWORKS
       retVal = sysVmeDmaDone(10000,1);
 #else
+      TI_TRACE_POINT(TI_TRACE_DMADONE_BEGIN, 0);
       retVal = vmeDmaDone();
+      TI_TRACE_POINT(TI_TRACE_DMADONE_END, retVal);
+      tiLatencyRecord(TI_LATENCY_DMA, dmaStart, tiLatencyNow());
 #endif
 
       if(retVal > 0)
@@ -3100,30 +3800,39 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 	    tiScanAndFillEvTypeScalers(data, xferCount);
 
 	  TIUNLOCK;
+	  TICAPTURE(tiCaptureBlock(tiCaptureCaller | (rflag << TI_CAPTURE_RFLAG_SHIFT),
+				   nwrds, data, xferCount, NULL, 0));
+	  TI_TRACE_POINT(TI_TRACE_READBLOCK_END, xferCount);
 	  return(xferCount);
 	}
       else if (retVal == 0)
 	{
 #ifdef VXWORKS
-	  logMsg("\ntiReadBlock: WARN: DMA transfer terminated by word count 0x%x\n",
+	  TILOGMSG(WARN, "\ntiReadBlock: WARN: DMA transfer terminated by word count 0x%x\n",
 		 nwrds,0,0,0,0,0);
 #else
-	  logMsg("\ntiReadBlock: WARN: DMA transfer returned zero word count 0x%x\n",
-		 nwrds,0,0,0,0,0,0);
+	  TILOGMSG(WARN, "\ntiReadBlock: WARN: DMA transfer returned zero word count 0x%x\n",
+		 nwrds,0,0,0,0,0);
 #endif
 	  TIUNLOCK;
+	  TICAPTURE(tiCaptureBlock(tiCaptureCaller | (rflag << TI_CAPTURE_RFLAG_SHIFT),
+				   nwrds, data, nwrds, NULL, 0));
+	  TI_TRACE_POINT(TI_TRACE_READBLOCK_END, nwrds);
 	  return(nwrds);
 	}
       else
 	{  /* Error in DMA */
 #ifdef VXWORKS
-	  logMsg("\ntiReadBlock: ERROR: sysVmeDmaDone returned an Error\n",
+	  TILOGMSG(ERROR, "\ntiReadBlock: ERROR: sysVmeDmaDone returned an Error\n",
 		 0,0,0,0,0,0);
 #else
-	  logMsg("\ntiReadBlock: ERROR: vmeDmaDone returned an Error\n",
+	  TILOGMSG(ERROR, "\ntiReadBlock: ERROR: vmeDmaDone returned an Error\n",
 		 0,0,0,0,0,0);
 #endif
 	  TIUNLOCK;
+	  TICAPTURE(tiCaptureBlock(tiCaptureCaller | (rflag << TI_CAPTURE_RFLAG_SHIFT),
+				   nwrds, data, retVal>>2, NULL, 0));
+	  TI_TRACE_POINT(TI_TRACE_READBLOCK_END, 0);
 	  return(retVal>>2);
 
 	}
@@ -3132,7 +3841,7 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
     { /* Programmed IO */
       if(tiBusError==1)
 	{
-	  logMsg("tiReadBlock: WARN: Bus Error Block Termination was enabled.  Disabling\n",
+	  TILOGMSG(WARN, "tiReadBlock: WARN: Bus Error Block Termination was enabled.  Disabling\n",
 		 1,2,3,4,5,6);
 	  TIUNLOCK;
 	  tiDisableBusError();
@@ -3143,7 +3852,7 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
       ii=0;
 
       /* First word should be the block header */
-      val = (unsigned int) *TIpd;
+      val = TIFIFOREAD;
       data[ii++] = val;
 #ifndef VXWORKS
       val = LSWAP(val);
@@ -3154,7 +3863,7 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 	  ntrig = val & TI_DATA_BLKLEVEL_MASK;
 
 	  /* Next word is the CODA 3.0 header */
-	  val = (unsigned int) *TIpd;
+	  val = TIFIFOREAD;
 	  data[ii++] = val;
 #ifndef VXWORKS
 	  val = LSWAP(val);
@@ -3163,7 +3872,7 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 	    {
 	      if((val & 0xff) != ntrig)
 		{
-		  logMsg("\ntiReadBlock: ERROR: TI Blocklevel %d inconsistent with TI Trigger Bank Header (0x%08x)",ntrig, val, 3, 4, 5, 6);
+		  TILOGMSG(ERROR, "\ntiReadBlock: ERROR: TI Blocklevel %d inconsistent with TI Trigger Bank Header (0x%08x)",ntrig, val, 3, 4, 5, 6);
 		  // return?
 
 		}
@@ -3172,22 +3881,29 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 	      for(itrig = 0; itrig < ntrig; itrig++)
 		{
 		  /* Trigger type word contains number of words to follow */
-		  val = (unsigned int) *TIpd;
+		  val = TIFIFOREAD;
 		  data[ii++] = val;
 
 #ifndef VXWORKS
 		  val = LSWAP(val);
 #endif
 		  trigwords = val & 0xFFFF;
+		  /* Keep room for the block trailer */
+		  if((ii + trigwords) > (nwrds - 1))
+		    {
+		      TILOGMSG(ERROR, "\ntiReadBlock: ERROR: Trigger words (%d) exceed the maximum words (%d)\n",
+			     trigwords, nwrds, 3, 4, 5, 6);
+		      break;
+		    }
 		  for(iword = 0; iword < trigwords; iword++)
 		    {
-		      val = (unsigned int) *TIpd;
+		      val = TIFIFOREAD;
 		      data[ii++] = val;
 		    }
 		}
 
 	      /* Next word should be block trailer */
-	      val = (unsigned int) *TIpd;
+	      val = TIFIFOREAD;
 	      data[ii++] = val;
 #ifndef VXWORKS
 	      val = LSWAP(val);
@@ -3199,14 +3915,16 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 		  if((ii%2)!=0)
 		    {
 		      /* Read out an extra word (filler) in the fifo */
-		      val = (unsigned int) *TIpd;
+		      filler = TIFIFOREAD;
+		      nfiller = 1;
+		      val = filler;
 #ifndef VXWORKS
 		      val = LSWAP(val);
 #endif
 		      if(((val & TI_DATA_TYPE_DEFINE_MASK) != TI_DATA_TYPE_DEFINE_MASK) ||
 			 ((val & TI_WORD_TYPE_MASK) != TI_FILLER_WORD_TYPE))
 			{
-			  logMsg("\ntiReadBlock: ERROR: Unexpected word after block trailer (0x%08x)\n",
+			  TILOGMSG(ERROR, "\ntiReadBlock: ERROR: Unexpected word after block trailer (0x%08x)\n",
 				 val,2,3,4,5,6);
 			}
 		    }
@@ -3215,21 +3933,21 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 		}
 	      else
 		{
-		  logMsg("\ntiReadBlock: ERROR: Invalid TI block trailer 0x%08x\n",
+		  TILOGMSG(ERROR, "\ntiReadBlock: ERROR: Invalid TI block trailer 0x%08x\n",
 			 val, 2, 3, 4, 5, 6);
 		  dCnt = ii;
 		}
 	    }
 	  else
 	    {
-	      logMsg("\ntiReadBlock: ERROR: Invalid Trigger bank header from TI 0x%08x\n",val, 2, 3, 4, 5, 6);
+	      TILOGMSG(ERROR, "\ntiReadBlock: ERROR: Invalid Trigger bank header from TI 0x%08x\n",val, 2, 3, 4, 5, 6);
 	      dCnt = ii;
 	    }
 
 	}
       else
 	{
-	  logMsg("\ntiReadBlock: ERROR: Invalid block header from TI 0x%08x\n",
+	  TILOGMSG(ERROR, "\ntiReadBlock: ERROR: Invalid block header from TI 0x%08x\n",
 		 val, 2, 3, 4, 5, 6);
 	  dCnt = ii;
 	}
@@ -3237,6 +3955,8 @@ tiReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 	tiScanAndFillEvTypeScalers(data, dCnt);
 
       TIUNLOCK;
+      TICAPTURE(tiCaptureBlock(tiCaptureCaller, nwrds, data, dCnt, &filler, nfiller));
+      TI_TRACE_POINT(TI_TRACE_READBLOCK_END, dCnt);
       return dCnt;
     }
 
@@ -3303,69 +4023,20 @@ tiGenerateTriggerBank(volatile unsigned int *data)
   return nwords;
 }
 
-/**
- * @ingroup Readout
- * @brief Read a block from the TI and form it into a CODA Trigger Bank
- *
- * @param   data  - local memory address to place data
- *
- * @return Number of words transferred to data if successful, ERROR otherwise
- *
- */
-int
-tiReadTriggerBlock(volatile unsigned int *data)
+/* Find the block header and trailer of a block read with tiReadBlock.
+   Returns -1 if the block is complete, otherwise the TI_RECOVERY_* failure */
+static int
+tiFindTriggerBlock(volatile unsigned int *data, int nwords, int *iblkhead, int *iblktrl,
+		   unsigned int *trailer)
 {
-  int rval=0, nwrds=0, rflag=0;
-  int iword=0;
-  unsigned int word=0;
-  int iblkhead=-1, iblktrl=-1;
-
-  if(data==NULL)
-    {
-      logMsg("\ntiReadTriggerBlock: ERROR: Invalid Destination address\n",0,0,0,0,0,0);
-      return(ERROR);
-    }
-
-  /* Determine the maximum number of words to expect, from the block level */
-  nwrds = (8*tiBlockLevel) + 8;
-
-  /* Optimize the transfer type based on the blocklevel */
-  if(tiBlockLevel>2)
-    { /* Use DMA */
-      rflag = 1;
-    }
-  else
-    { /* Use programmed I/O (Single cycle reads) */
-      rflag = 0;
-    }
-
-  /* Obtain the trigger bank by just making a call the tiReadBlock */
-  rval = tiReadBlock(data, nwrds, rflag);
-  if(rval < 0)
-    {
-      /* Error occurred */
-      logMsg("tiReadTriggerBlock: ERROR: tiReadBlock returned ERROR\n",
-	     1,2,3,4,5,6);
-
-      if(tiFakeTriggerBank)
-	return tiGenerateTriggerBank(data);
-      else
-	return ERROR;
-    }
-  else if (rval == 0)
-    {
-      /* No data returned */
-      logMsg("tiReadTriggerBlock: WARN: No data available\n",
-	     1,2,3,4,5,6);
+  unsigned int word = 0;
+  int iword = 0;
 
-      if(tiFakeTriggerBank)
-	return tiGenerateTriggerBank(data);
-      else
-	return 0;
-    }
+  *iblkhead = -1;
+  *iblktrl = -1;
 
   /* Work down to find index of block header */
-  while(iword<rval)
+  while(iword<nwords)
     {
 
       word = data[iword];
@@ -3377,45 +4048,15 @@ tiReadTriggerBlock(volatile unsigned int *data)
 	{
 	  if(((word & TI_WORD_TYPE_MASK)) == TI_BLOCK_HEADER_WORD_TYPE)
 	    {
-	      iblkhead = iword;
+	      *iblkhead = iword;
 	      break;
 	    }
 	}
       iword++;
     }
 
-  /* Check if the index is valid */
-  if(iblkhead == -1)
-    {
-      logMsg("tiReadTriggerBlock: ERROR: Failed to find TI Block Header\n",
-	     1,2,3,4,5,6);
-
-/* #define DEBUGDATA */
-#ifdef DEBUGDATA
-      int idbg;
-      static int out = 0;
-      if(out == 0)
-	{
-	  for(idbg = 0; idbg < rval; idbg++)
-	    printf("%3d: 0x%08x\n",
-		   idbg, LSWAP(data[iword]));
-	}
-      out = 1;
-#endif
-
-      if(tiFakeTriggerBank)
-	return tiGenerateTriggerBank(data);
-      else
-	return ERROR;
-    }
-  if(iblkhead != 0)
-    {
-      logMsg("tiReadTriggerBlock: WARN: Invalid index (%d) for the TI Block header.\n",
-	     iblkhead,2,3,4,5,6);
-    }
-
   /* Work up to find index of block trailer */
-  iword=rval-1;
+  iword=nwords-1;
   while(iword>=0)
     {
 
@@ -3431,42 +4072,35 @@ tiReadTriggerBlock(volatile unsigned int *data)
 	      printf("%s: block trailer? 0x%08x\n",
 		     __FUNCTION__,word);
 #endif
-	      iblktrl = iword;
+	      *iblktrl = iword;
 	      break;
 	    }
 	}
       iword--;
     }
 
-  /* Check if the index is valid */
-  if(iblktrl == -1)
-    {
-      logMsg("tiReadTriggerBlock: ERROR: Failed to find TI Block Trailer\n",
-	     1,2,3,4,5,6);
+  if(*iblkhead == -1)
+    return TI_RECOVERY_NO_HEADER;
 
-      if(tiFakeTriggerBank)
-	return tiGenerateTriggerBank(data);
-      else
-	return ERROR;
-    }
+  if(*iblktrl == -1)
+    return TI_RECOVERY_NO_TRAILER;
 
-  /* Get the block trailer, and check the number of words contained in it */
-  word = data[iblktrl];
-#ifndef VXWORKS
-  word = LSWAP(word);
-#endif
-  tiBlockSyncFlag = (word & TI_BLOCK_TRAILER_SYNCEVENT_FLAG) ? 1 : 0;
+  /* Check the number of words contained in the block trailer */
+  *trailer = word;
+  if((*iblktrl - *iblkhead + 1) != (word & TI_BLOCK_TRAILER_WORD_COUNT_MASK))
+    return TI_RECOVERY_COUNT_MISMATCH;
 
-  if((iblktrl - iblkhead + 1) != (word & TI_BLOCK_TRAILER_WORD_COUNT_MASK))
-    {
-      logMsg("tiReadTriggerBlock: Number of words inconsistent (index count = %d, block trailer count = %d\n",
-	     (iblktrl - iblkhead + 1), word & TI_BLOCK_TRAILER_WORD_COUNT_MASK,3,4,5,6);
+  return -1;
+}
 
-      if(tiFakeTriggerBank)
-	return tiGenerateTriggerBank(data);
-      else
-	return ERROR;
-    }
+/* Form a complete block into a CODA Trigger Bank.  Returns the number of words */
+static int
+tiFormTriggerBank(volatile unsigned int *data, int iblkhead, int iblktrl, unsigned int trailer)
+{
+  unsigned int word = 0;
+  int iword, rval;
+
+  tiBlockSyncFlag = (trailer & TI_BLOCK_TRAILER_SYNCEVENT_FLAG) ? 1 : 0;
 
   /* Modify the total words returned */
   rval = iblktrl - iblkhead;
@@ -3488,54 +4122,448 @@ tiReadTriggerBlock(volatile unsigned int *data)
     }
 
   return rval;
-
 }
 
-/**
- * @ingroup Readout
- * @brief Return the value of the sync event flag from the previous call to
- *        tiReadTriggerBlock
- *
- * @return tiBlockSyncFlag if successful, ERROR otherwise
- *
- */
-int
-tiGetBlockSyncFlag()
-{
-  return tiBlockSyncFlag;
-}
+/* Words of a block from the block level, as read by tiReadTriggerBlock */
+#define TI_RECOVERY_BLOCK_WORDS(_bl)  ((8*(_bl)) + 8)
+#define TI_RECOVERY_MAXWORDS          TI_RECOVERY_BLOCK_WORDS(255)
 
-/**
- * @ingroup Readout
- * @brief Check the provided array for valid trigger block format
- *
- * @param   data  - local memory address to find trigger block
- *
- * @return OK if successful, ERROR otherwise
- *
- */
-int
-tiCheckTriggerBlock(volatile unsigned int *data)
+/* Readout recovery, see tiSetReadoutRecovery */
+static int          tiRecoveryEnabled = 1;
+static int          tiRecoveryMaxDrains = 4;
+static tiRecoveryStats tiRecovery;
+static int          tiRecoveryHead = 0;    /* next record */
+static unsigned int tiRecoveryBuffer[TI_RECOVERY_MAXWORDS] __attribute__((aligned(8)));
+static unsigned int tiRecoveryHeld[TI_RECOVERY_MAXWORDS];
+static int          tiRecoveryHeldWords = 0;
+
+/* Handle a block tiReadTriggerBlock could not form.  Drains the rest of the
+   bad block from the FIFO, up to the next valid block: returned now if the
+   bad data had no block header (it belonged to an earlier block), held for
+   the next readout otherwise.  Returns what tiReadTriggerBlock returns. */
+static int
+tiRecoverTriggerBlock(volatile unsigned int *data, int failure, int nread)
 {
-  unsigned int blen=0, blevel=0, evlen=0;
-  int iword=0, iev=0, ievword=0;
-  int rval=OK;
+  tiRecoveryRecord *rec;
+  unsigned int trailer = 0, firstWord = 0, dropped = 0;
+  int outcome = TI_RECOVERY_DROPPED, drain = 0, ndrains = 0, nwords, iword, check;
+  int iblkhead, iblktrl, maxwords, rval = 0;
+#ifndef VXWORKS
+  struct timespec start, end;
 
-  printf("--------------------------------------------------------------------------------\n");
-  /* First word should be the trigger bank length */
-  blen = data[iword];
-  printf("%4d: %08X - TRIGGER BANK LENGTH - len = %d\n",iword, data[iword], blen);
-  iword++;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
 
-  /* Trigger Bank Header */
-  if( ((data[iword] & 0xFF100000)>>16 != 0xFF10) ||
-      ((data[iword] & 0x0000FF00)>>8 != 0x20) )
+  if(nread > 0)
     {
-      rval = ERROR;
-      printf("%4d: %08X - **** INVALID TRIGGER BANK HEADER ****\n",
-	     iword,
-	     data[iword]);
-      iword++;
+      firstWord = data[0];
+#ifndef VXWORKS
+      firstWord = LSWAP(firstWord);
+#endif
+      dropped = nread;
+    }
+
+  /* The trailer was read with the rest of the block: nothing to drain */
+  drain = tiRecoveryEnabled && (failure != TI_RECOVERY_COUNT_MISMATCH);
+  maxwords = TI_RECOVERY_BLOCK_WORDS(tiBlockLevel);
+  if(maxwords > TI_RECOVERY_MAXWORDS)
+    maxwords = TI_RECOVERY_MAXWORDS;
+
+  for(ndrains = 0; drain && (ndrains < tiRecoveryMaxDrains); ndrains++)
+    {
+      memset(tiRecoveryBuffer, 0, maxwords * sizeof(unsigned int));
+      TICAPTURE_CALLER(TI_CAPTURE_RECOVERY);
+      nwords = tiReadBlock(tiRecoveryBuffer, maxwords, 1);
+      TICAPTURE_CALLER(TI_CAPTURE_READBLOCK);
+      if(nwords <= 0)
+	break;
+
+      /* Nothing transferred, the FIFO is empty */
+      for(iword = 0; iword < nwords; iword++)
+	if(tiRecoveryBuffer[iword] != 0)
+	  break;
+      if(iword == nwords)
+	break;
+
+      check = tiFindTriggerBlock(tiRecoveryBuffer, nwords, &iblkhead, &iblktrl, &trailer);
+      if((check == -1) && (iblkhead == 0))
+	{
+	  if(failure == TI_RECOVERY_NO_TRAILER)
+	    {
+	      /* The bad block header was read, this is the next block */
+	      memcpy(tiRecoveryHeld, tiRecoveryBuffer, nwords * sizeof(unsigned int));
+	      tiRecoveryHeldWords = nwords;
+	      outcome = TI_RECOVERY_HELD;
+	    }
+	  else
+	    {
+	      memcpy((void *)data, tiRecoveryBuffer, nwords * sizeof(unsigned int));
+	      rval = tiFormTriggerBank(data, iblkhead, iblktrl, trailer);
+	      outcome = TI_RECOVERY_RESYNCED;
+	    }
+	  ndrains++;
+	  break;
+	}
+
+      dropped += nwords;
+      /* Reached the end of the bad block */
+      if(iblktrl != -1)
+	{
+	  ndrains++;
+	  break;
+	}
+    }
+
+  TILOCK;
+  tiRecovery.failures[failure]++;
+  if(outcome == TI_RECOVERY_DROPPED)
+    tiRecovery.dropped++;
+  else if(outcome == TI_RECOVERY_RESYNCED)
+    tiRecovery.resynced++;
+  else
+    tiRecovery.held++;
+  tiRecovery.wordsDropped += dropped;
+
+  rec = &tiRecovery.record[tiRecoveryHead];
+  rec->readout      = tiIntCount;
+  rec->failure      = failure;
+  rec->outcome      = outcome;
+  rec->firstWord    = firstWord;
+  rec->wordsDropped = dropped;
+  rec->drains       = ndrains;
+#ifndef VXWORKS
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  rec->elapsed_us   = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) * 1e-3;
+#else
+  rec->elapsed_us   = 0;
+#endif
+  if(rec->elapsed_us > tiRecovery.maxElapsed_us)
+    tiRecovery.maxElapsed_us = rec->elapsed_us;
+  tiRecoveryHead = (tiRecoveryHead + 1) % TI_RECOVERY_NRECORDS;
+  if(tiRecovery.nrecords < TI_RECOVERY_NRECORDS)
+    tiRecovery.nrecords++;
+  TIUNLOCK;
+
+  if(outcome == TI_RECOVERY_RESYNCED)
+    return rval;
+
+  if(tiFakeTriggerBank)
+    return tiGenerateTriggerBank(data);
+  else
+    return ERROR;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Read a block from the TI and form it into a CODA Trigger Bank
+ *
+ *  If the block cannot be formed, the readout recovery (see
+ *  @tiSetReadoutRecovery) drains what is left of it from the FIFO.
+ *
+ * @param   data  - local memory address to place data
+ *
+ * @return Number of words transferred to data if successful, ERROR otherwise
+ *
+ */
+int
+tiReadTriggerBlock(volatile unsigned int *data)
+{
+  int rval=0, nwrds=0, rflag=0;
+  unsigned int word=0;
+  int iblkhead=-1, iblktrl=-1, check;
+
+  if(data==NULL)
+    {
+      TILOGMSG(ERROR, "\ntiReadTriggerBlock: ERROR: Invalid Destination address\n",0,0,0,0,0,0);
+      return(ERROR);
+    }
+
+  /* Determine the maximum number of words to expect, from the block level */
+  nwrds = (8*tiBlockLevel) + 8;
+
+  /* Optimize the transfer type based on the blocklevel */
+  if(tiBlockLevel>2)
+    { /* Use DMA */
+      rflag = 1;
+    }
+  else
+    { /* Use programmed I/O (Single cycle reads) */
+      rflag = 0;
+    }
+
+  if(tiRecoveryHeldWords > 0)
+    {
+      /* Already read from the FIFO by the readout recovery */
+      memcpy((void *)data, tiRecoveryHeld, tiRecoveryHeldWords * sizeof(unsigned int));
+      rval = tiRecoveryHeldWords;
+      tiRecoveryHeldWords = 0;
+    }
+  else
+    {
+      /* Obtain the trigger bank by just making a call the tiReadBlock */
+      TICAPTURE_CALLER(TI_CAPTURE_TRIGGERBLOCK);
+      rval = tiReadBlock(data, nwrds, rflag);
+      TICAPTURE_CALLER(TI_CAPTURE_READBLOCK);
+    }
+  if(rval < 0)
+    {
+      /* Error occurred */
+      TILOGMSG(ERROR, "tiReadTriggerBlock: ERROR: tiReadBlock returned ERROR\n",
+	     1,2,3,4,5,6);
+
+      return tiRecoverTriggerBlock(data, TI_RECOVERY_DMA, 0);
+    }
+  else if (rval == 0)
+    {
+      /* No data returned */
+      TILOGMSG(WARN, "tiReadTriggerBlock: WARN: No data available\n",
+	     1,2,3,4,5,6);
+
+      if(tiFakeTriggerBank)
+	return tiGenerateTriggerBank(data);
+      else
+	return 0;
+    }
+
+  check = tiFindTriggerBlock(data, rval, &iblkhead, &iblktrl, &word);
+
+  /* Check if the index is valid */
+  if(check == TI_RECOVERY_NO_HEADER)
+    {
+      TILOGMSG(ERROR, "tiReadTriggerBlock: ERROR: Failed to find TI Block Header\n",
+	     1,2,3,4,5,6);
+
+/* #define DEBUGDATA */
+#ifdef DEBUGDATA
+      int idbg;
+      static int out = 0;
+      if(out == 0)
+	{
+	  for(idbg = 0; idbg < rval; idbg++)
+	    printf("%3d: 0x%08x\n",
+		   idbg, LSWAP(data[idbg]));
+	}
+      out = 1;
+#endif
+
+      return tiRecoverTriggerBlock(data, check, rval);
+    }
+  if(iblkhead != 0)
+    {
+      TILOGMSG(WARN, "tiReadTriggerBlock: WARN: Invalid index (%d) for the TI Block header.\n",
+	     iblkhead,2,3,4,5,6);
+    }
+
+  /* Check if the index is valid */
+  if(check == TI_RECOVERY_NO_TRAILER)
+    {
+      TILOGMSG(ERROR, "tiReadTriggerBlock: ERROR: Failed to find TI Block Trailer\n",
+	     1,2,3,4,5,6);
+
+      return tiRecoverTriggerBlock(data, check, rval);
+    }
+
+  if(check == TI_RECOVERY_COUNT_MISMATCH)
+    {
+      tiBlockSyncFlag = (word & TI_BLOCK_TRAILER_SYNCEVENT_FLAG) ? 1 : 0;
+      TILOGMSG(ERROR, "tiReadTriggerBlock: Number of words inconsistent (index count = %d, block trailer count = %d\n",
+	     (iblktrl - iblkhead + 1), word & TI_BLOCK_TRAILER_WORD_COUNT_MASK,3,4,5,6);
+
+      return tiRecoverTriggerBlock(data, check, rval);
+    }
+
+  return tiFormTriggerBank(data, iblkhead, iblktrl, word);
+
+}
+
+/**
+ * @ingroup Readout
+ * @brief Return the value of the sync event flag from the previous call to
+ *        tiReadTriggerBlock
+ *
+ * @return tiBlockSyncFlag if successful, ERROR otherwise
+ *
+ */
+int
+tiGetBlockSyncFlag()
+{
+  return tiBlockSyncFlag;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Configure the readout recovery of @tiReadTriggerBlock.
+ *        Enabled by library default.
+ *
+ *  When a block cannot be formed (tiReadBlock error, no block header,
+ *  no block trailer), what is left of it is drained from the FIFO with
+ *  up to maxDrains block reads, up to its block trailer or the next
+ *  valid block.  A valid block found this way is returned instead (if
+ *  the bad data had no block header), or held and returned by the next
+ *  call.  Otherwise the fake trigger bank (@tiFakeTriggerBankOnError) or
+ *  ERROR is returned, as without recovery.  Every failure is counted and
+ *  recorded, see @tiGetReadoutRecovery.
+ *
+ * @param enable     Drain the FIFO if enable != 0, otherwise only record
+ * @param maxDrains  Block reads for each failure, bounds the extra latency
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiSetReadoutRecovery(int enable, int maxDrains)
+{
+  if((maxDrains < 1) || (maxDrains > 64))
+    {
+      printf("%s: ERROR: Invalid maxDrains (%d)\n", __func__, maxDrains);
+      return ERROR;
+    }
+
+  TILOCK;
+  tiRecoveryEnabled = enable ? 1 : 0;
+  tiRecoveryMaxDrains = maxDrains;
+  if(!tiRecoveryEnabled)
+    tiRecoveryHeldWords = 0;
+  TIUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Return the counters and the most recent records of the readout
+ *        recovery
+ *
+ * @param stats  Where to store them.  Records are ordered oldest first.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiGetReadoutRecovery(tiRecoveryStats *stats)
+{
+  int irec, first;
+
+  if(stats == NULL)
+    {
+      printf("%s: ERROR: Invalid destination\n", __func__);
+      return ERROR;
+    }
+
+  TILOCK;
+  *stats = tiRecovery;
+  first = (tiRecoveryHead - tiRecovery.nrecords + TI_RECOVERY_NRECORDS) % TI_RECOVERY_NRECORDS;
+  for(irec = 0; irec < tiRecovery.nrecords; irec++)
+    stats->record[irec] = tiRecovery.record[(first + irec) % TI_RECOVERY_NRECORDS];
+  TIUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Clear the counters and records of the readout recovery, and drop
+ *        the block it holds for the next readout.  Called by tiInit.
+ *
+ * @return OK
+ */
+int
+tiResetReadoutRecovery()
+{
+  TILOCK;
+  memset(&tiRecovery, 0, sizeof(tiRecovery));
+  tiRecoveryHead = 0;
+  tiRecoveryHeldWords = 0;
+  TIUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Print the counters and the most recent records of the readout
+ *        recovery to standard out
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiPrintReadoutRecovery()
+{
+  const char *sfailure[TI_RECOVERY_NFAILURES] =
+    {
+      "DMA error",
+      "No header",
+      "No trailer",
+      "Count mismatch"
+    };
+  const char *soutcome[3] = { "Dropped", "Resynced", "Held" };
+  tiRecoveryStats stats;
+  int ifail, irec;
+
+  if(tiGetReadoutRecovery(&stats) != OK)
+    return ERROR;
+
+  printf("\n");
+  printf("TI Readout Recovery (%s, %d drains)\n",
+	 tiRecoveryEnabled ? "enabled" : "disabled", tiRecoveryMaxDrains);
+  printf("--------------------------------------------------------------------------------\n");
+  for(ifail = 0; ifail < TI_RECOVERY_NFAILURES; ifail++)
+    printf("  %-15s %10u\n", sfailure[ifail], stats.failures[ifail]);
+  printf("\n");
+  printf("  Dropped         %10u\n", stats.dropped);
+  printf("  Resynced        %10u\n", stats.resynced);
+  printf("  Held            %10u\n", stats.held);
+  printf("  Words dropped   %10llu\n", stats.wordsDropped);
+  printf("  Max time        %10.1f us\n", stats.maxElapsed_us);
+
+  if(stats.nrecords > 0)
+    {
+      printf("\n");
+      printf("     Readout  Failure         Outcome   First word  Dropped  Drains   Time (us)\n");
+      for(irec = 0; irec < stats.nrecords; irec++)
+	{
+	  tiRecoveryRecord *r = &stats.record[irec];
+
+	  printf("  %10u  %-15s %-8s  0x%08x  %7u  %6u  %10.1f\n",
+		 r->readout, sfailure[r->failure], soutcome[r->outcome],
+		 r->firstWord, r->wordsDropped, r->drains, r->elapsed_us);
+	}
+    }
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n");
+
+  return OK;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Check the provided array for valid trigger block format
+ *
+ * @param   data  - local memory address to find trigger block
+ *
+ * @return OK if successful, ERROR otherwise
+ *
+ */
+int
+tiCheckTriggerBlock(volatile unsigned int *data)
+{
+  unsigned int blen=0, blevel=0, evlen=0;
+  int iword=0, iev=0, ievword=0;
+  int rval=OK;
+
+  printf("--------------------------------------------------------------------------------\n");
+  /* First word should be the trigger bank length */
+  blen = data[iword];
+  printf("%4d: %08X - TRIGGER BANK LENGTH - len = %d\n",iword, data[iword], blen);
+  iword++;
+
+  /* Trigger Bank Header */
+  if( ((data[iword] & 0xFF100000)>>16 != 0xFF10) ||
+      ((data[iword] & 0x0000FF00)>>8 != 0x20) )
+    {
+      rval = ERROR;
+      printf("%4d: %08X - **** INVALID TRIGGER BANK HEADER ****\n",
+	     iword,
+	     data[iword]);
+      iword++;
       while(iword<blen+1)
 	{
 	  if(iword>blen)
@@ -3685,7 +4713,7 @@ tiDecodeTriggerTypes(volatile unsigned int *data, int data_len,
 
   if(blocklevel == -1)
     {
-      logMsg("tiDecodeTriggerTypes: ERROR: Failed to find Trigger Bank header\n",
+      TILOGMSG(ERROR, "tiDecodeTriggerTypes: ERROR: Failed to find Trigger Bank header\n",
 	     0,1,2,3,4,5);
       return ERROR;
     }
@@ -3753,7 +4781,7 @@ tiDecodeTriggerType(volatile unsigned int *data, int data_len, int event)
 
   if((event < 0) || (event > 255))
     {
-      logMsg("tiDecodeTriggerType: ERROR: Invalid event number (%d)\n",
+      TILOGMSG(ERROR, "tiDecodeTriggerType: ERROR: Invalid event number (%d)\n",
 	     event, 1, 2, 3, 4, 5);
       return ERROR;
     }
@@ -3762,13 +4790,13 @@ tiDecodeTriggerType(volatile unsigned int *data, int data_len, int event)
 
   if(nevtypes == ERROR)
     {
-      logMsg("tiDecodeTriggerType: ERROR: Failed to find trigger type for event %d\n",
+      TILOGMSG(ERROR, "tiDecodeTriggerType: ERROR: Failed to find trigger type for event %d\n",
 	     event, 1, 2, 3, 4, 5);
       rval = ERROR;
     }
   if(nevtypes < event)
     {
-      logMsg("tiDecodeTriggerType: ERROR: # EvTypes (%d) < Requested Event (%d)\n",
+      TILOGMSG(ERROR, "tiDecodeTriggerType: ERROR: # EvTypes (%d) < Requested Event (%d)\n",
 	     nevtypes, event, 3, 4, 5, 6);
       rval = ERROR;
     }
@@ -3805,7 +4833,7 @@ tiDecodeTSrev2Data(volatile unsigned int *data, int data_len,
 
   if(!tiUseTsRev2)
     {
-      logMsg("tiDecodeTsRev2Data: ERROR: TI not initialized for TSrev2 feature.\n",
+      TILOGMSG(ERROR, "tiDecodeTsRev2Data: ERROR: TI not initialized for TSrev2 feature.\n",
 	     0,1,2,3,4,5);
       return ERROR;
     }
@@ -3816,7 +4844,7 @@ tiDecodeTSrev2Data(volatile unsigned int *data, int data_len,
 
   if(data_len > 0xFFF)
     {
-      logMsg("tiDecodeTsRev2Data: ERROR: Invalid data length (%d).\n",
+      TILOGMSG(ERROR, "tiDecodeTsRev2Data: ERROR: Invalid data length (%d).\n",
 	     0,1,2,3,4,5);
       return ERROR;
     }
@@ -3840,14 +4868,14 @@ tiDecodeTSrev2Data(volatile unsigned int *data, int data_len,
 
   if(blocklevel == -1)
     {
-      logMsg("tiDecodeTSrev2Data: ERROR: Failed to find Trigger Bank header\n",
+      TILOGMSG(ERROR, "tiDecodeTSrev2Data: ERROR: Failed to find Trigger Bank header\n",
 	     0,1,2,3,4,5);
       return ERROR;
     }
 
   if(blocklevel != 1)
     {
-      logMsg("tiDecodeTSrev2Data: ERROR: Invalid Blocklevel (%d).  Must be 1.\n",
+      TILOGMSG(ERROR, "tiDecodeTSrev2Data: ERROR: Invalid Blocklevel (%d).  Must be 1.\n",
 	     blocklevel,1,2,3,4,5);
       return ERROR;
     }
@@ -3874,7 +4902,7 @@ tiDecodeTSrev2Data(volatile unsigned int *data, int data_len,
 
   if(!found)
     {
-      logMsg("tiDecodeTSrev2Data: ERROR: Trigger data not found\n",
+      TILOGMSG(ERROR, "tiDecodeTSrev2Data: ERROR: Trigger data not found\n",
 	     0, 1, 2, 3, 4, 5);
       return ERROR;
     }
@@ -4410,13 +5438,13 @@ tiGetTriggerPulse(int32_t trigger, int32_t *delay, int32_t *width, int32_t *dela
   reg_val = vmeRead32(&TIp->trigDelay);
   if(trigger==1)
     {
-      *delay = (reg_val & TI_TRIGDELAY_TRIG1_DELAY_MASK);
+      *delay = (reg_val & TI_TRIGDELAY_TRIG1_DELAY_MASK) & ~TI_TRIGDELAY_TRIG1_64NS_STEP;
       *width = (reg_val & TI_TRIGDELAY_TRIG1_WIDTH_MASK) >> 8;
       *delay_step = (reg_val & TI_TRIGDELAY_TRIG1_64NS_STEP) ? 1 : 0;
     }
   if(trigger==2)
     {
-      *delay = (reg_val & TI_TRIGDELAY_TRIG2_DELAY_MASK) >> 16;
+      *delay = ((reg_val & TI_TRIGDELAY_TRIG2_DELAY_MASK) & ~TI_TRIGDELAY_TRIG2_64NS_STEP) >> 16;
       *width = (reg_val & TI_TRIGDELAY_TRIG2_WIDTH_MASK) >> 24;
       *delay_step = (reg_val & TI_TRIGDELAY_TRIG2_64NS_STEP) ? 1 : 0;
     }
@@ -4633,9 +5661,9 @@ tiGetSyncResetType()
   if(tiSyncResetType == TI_SYNCCOMMAND_SYNCRESET_4US)
     rval = 1;
   else
-    rval = TI_SYNCCOMMAND_SYNCRESET;
+    rval = 0;
 
-  return OK;
+  return rval;
 }
 
 
@@ -5022,7 +6050,7 @@ tiBReady()
 
   if(TIp == NULL)
     {
-      logMsg("tiBReady: ERROR: TI not initialized\n",1,2,3,4,5,6);
+      TILOGMSG(ERROR, "tiBReady: ERROR: TI not initialized\n",1,2,3,4,5,6);
       return 0;
     }
 
@@ -5040,6 +6068,7 @@ tiBReady()
     tiSyncEventFlag = 0;
 
   TIUNLOCK;
+  TICAPTURE(tiCaptureBReady(blockBuffer));
 
   return rval;
 }
@@ -6044,6 +7073,25 @@ tiAddSlaveMask(unsigned int fibermask)
 
 }
 
+/**
+ * @ingroup MasterStatus
+ * @brief Return the mask of fiber ports that have been added as TI Slaves
+ *
+ * @return Slave mask (bit 0 = Fiber 1) if successful, otherwise ERROR
+ * @sa tiAddSlave
+ */
+int
+tiGetSlaveMask()
+{
+  if(TIp == NULL)
+    {
+      printf("%s: ERROR: TI not initialized\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  return tiSlaveMask;
+}
+
 static int tiTriggerRuleClockPrescale[3][4] =
   {
     {4, 4, 8, 16}, // 250 MHz ref
@@ -6343,7 +7391,8 @@ tiPrintTriggerHoldoff(int dflag)
  *            e.g. rule=1: No more than ONE trigger within the
  *                         specified time period
  *
- * @param   value  the specified time period (in steps of timestep)
+ * @param   value  the specified time period (in steps of timestep),
+ *                 0 to disable the minimum
  *<pre>
  *       	 	      rule
  *    		         2      3      4
@@ -6397,6 +7446,9 @@ tiSetTriggerHoldoffMin(int rule, unsigned int value)
       break;
     }
 
+  if(value == 0)
+    enable = 0;
+
   TILOCK;
   vmeWrite32(&TIp->triggerRuleMin,
 	     (vmeRead32(&TIp->triggerRuleMin) & mask) |
@@ -6440,18 +7492,19 @@ tiGetTriggerHoldoffMin(int rule, int pflag)
       return ERROR;
     }
 
+  /* Value in bits 0-6, enable in bit 7 */
   switch(rule)
     {
     case 2:
-      mask = TI_TRIGGERRULEMIN_MIN2_MASK;
+      mask = TI_TRIGGERRULEMIN_MIN2_MASK | TI_TRIGGERRULEMIN_MIN2_EN;
       shift = 8;
       break;
     case 3:
-      mask = TI_TRIGGERRULEMIN_MIN3_MASK;
+      mask = TI_TRIGGERRULEMIN_MIN3_MASK | TI_TRIGGERRULEMIN_MIN3_EN;
       shift = 16;
       break;
     case 4:
-      mask = TI_TRIGGERRULEMIN_MIN4_MASK;
+      mask = TI_TRIGGERRULEMIN_MIN4_MASK | TI_TRIGGERRULEMIN_MIN4_EN;
       shift = 24;
       break;
     }
@@ -6542,7 +7595,7 @@ tiResetBlockReadout()
 
   if(TIp == NULL)
     {
-      logMsg("tiResetBlockReadout: ERROR: TI not initialized\n",1,2,3,4,5,6);
+      TILOGMSG(ERROR, "tiResetBlockReadout: ERROR: TI not initialized\n",1,2,3,4,5,6);
       return;
     }
 
@@ -6884,7 +7937,8 @@ tiLoadTriggerTable(int mode)
  * @ingroup Status
  * @brief Return trigger table mode
  *
- * @return 0-3: Predefined modes, 4: User
+ * @return 0-3: Predefined modes, 4: User, -1: none loaded by the library
+ *   (the table held by the TI is kept)
  *
  */
 int32_t
@@ -7326,20 +8380,20 @@ tiGetTSscaler(int input, int latch)
   unsigned int rval=0;
   if(TIp == NULL)
     {
-      logMsg("tiGetTSscaler: ERROR: TI not initialized\n",1,2,3,4,5,6);
+      TILOGMSG(ERROR, "tiGetTSscaler: ERROR: TI not initialized\n",1,2,3,4,5,6);
       return ERROR;
     }
 
   if((input<1)||(input>6))
     {
-      logMsg("tiGetTSscaler: ERROR: Invalid input (%d).\n",
+      TILOGMSG(ERROR, "tiGetTSscaler: ERROR: Invalid input (%d).\n",
 	     input,2,3,4,5,6);
       return ERROR;
     }
 
   if((latch<0) || (latch>2))
     {
-      logMsg("tiGetTSscaler: ERROR: Invalid latch (%d).\n",
+      TILOGMSG(ERROR, "tiGetTSscaler: ERROR: Invalid latch (%d).\n",
 	     latch,2,3,4,5,6);
       return ERROR;
     }
@@ -7382,13 +8436,14 @@ tiBlockStatus(int fiber, int pflag)
       return ERROR;
     }
 
-  if(fiber>8)
+  if((fiber<0) || (fiber>8))
     {
       printf("%s: ERROR: Invalid value (%d) for fiber\n",__FUNCTION__,fiber);
       return ERROR;
 
     }
 
+  TILOCK;
   switch(fiber)
     {
     case 0:
@@ -7409,6 +8464,7 @@ tiBlockStatus(int fiber, int pflag)
       rval = ( vmeRead32(&TIp->blockStatus[(fiber/2)-1]) & 0xFFFF0000 )>>16;
       break;
     }
+  TIUNLOCK;
 
   if(pflag)
     {
@@ -7429,150 +8485,323 @@ tiBlockStatus(int fiber, int pflag)
   return rval;
 }
 
-unsigned char *measurement;
-int maxCount = 0, maxIndex = 0;
+/**
+ * @ingroup Status
+ * @brief Read the block status of the loopback and all fiber ports in a
+ *        single locked batch.
+ *
+ *   Each element has the format of the return value of tiBlockStatus:
+ *     bits 0-7: Blocks ready, bits 8-15: Blocks needing acknowledge
+ *
+ * @param status  Array of 9 elements to fill.  0: Loopback, 1-8: Fiber 1-8
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiBlockStatusAll(unsigned int *status)
+{
+  unsigned int blockStatus[4], adr24 = 0;
+  int ireg = 0;
+
+  if(TIp == NULL)
+    {
+      printf("%s: ERROR: TI not initialized\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if(status == NULL)
+    {
+      printf("%s: ERROR: Invalid destination\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  TILOCK;
+  for(ireg = 0; ireg < 4; ireg++)
+    blockStatus[ireg] = vmeRead32(&TIp->blockStatus[ireg]);
+  adr24 = vmeRead32(&TIp->adr24);
+  TIUNLOCK;
+
+  status[0] = (adr24 & 0xFFFF0000)>>16;
+  for(ireg = 0; ireg < 4; ireg++)
+    {
+      status[2*ireg + 1] = blockStatus[ireg] & 0xFFFF;
+      status[2*ireg + 2] = (blockStatus[ireg] & 0xFFFF0000)>>16;
+    }
+
+  return OK;
+}
+
+/* Fiber latency measurement state machine.  Each try strobes three
+   hardware steps (fiber auto-align, latency measurement, sync auto-align)
+   and polls the associated register until two consecutive reads agree,
+   no sooner than the fixed wait the step used to have (there is no done
+   bit to poll).  TILOCK is only held around the register access of a
+   single step.
+
+   With one call per tick, a try takes at least 26 ticks: the strobe and
+   20 polls to align, 3 calls to measure, 2 to sync align.  The
+   measurement stops once the remaining tries cannot change the mode, so
+   a steady link is decided after 3 of the 5 tries, in about 80 ticks
+   (about 120 for the 5 fixed tries of the original loop). */
+#define TI_FIBERMEAS_MAX_TRIES 5
+#define TI_FIBERMEAS_NBINS   256
+
+enum tiFiberMeasState
+  {
+    TI_FIBERMEAS_IDLE = 0,
+    TI_FIBERMEAS_ALIGN,
+    TI_FIBERMEAS_MEASURE,
+    TI_FIBERMEAS_SYNC_ALIGN,
+    TI_FIBERMEAS_DONE
+  };
+
+/* Minimum and maximum number of polls (one per tick) for each step.
+   The minimum is the fixed wait of the original measurement loop. */
+static const int tiFiberMeasMinPolls[TI_FIBERMEAS_DONE] = {0, 20, 2, 1};
+static const int tiFiberMeasMaxPolls[TI_FIBERMEAS_DONE] = {0, 40, 4, 4};
+
+static struct
+{
+  int           state;
+  int           polls;
+  unsigned int  prev;
+  int           ntries;
+  int           maxCount;
+  int           maxIndex;
+  unsigned char histo[TI_FIBERMEAS_NBINS];
+} tiFiberMeasData;
+
 int FiberMeasMaxCount()
 {
-  return maxCount;
+  return tiFiberMeasData.maxCount;
 }
 
 int FiberMeasMaxIndex()
 {
-  return maxIndex;
+  return tiFiberMeasData.maxIndex;
 }
 
 void FiberMeasHisto()
 {
   int imeas;
-  for(imeas = 0; imeas < 256; imeas++)
+  for(imeas = 0; imeas < TI_FIBERMEAS_NBINS; imeas++)
     {
       printf("%s: %2d: measurement = %d  %s\n",
-	     __func__, imeas, measurement[imeas],
-	     (imeas==maxIndex)?"***":"");
+	     __func__, imeas, tiFiberMeasData.histo[imeas],
+	     (imeas==tiFiberMeasData.maxIndex)?"***":"");
+    }
+}
+
+/* Register strobed and polled by each step of the measurement */
+static void
+tiFiberMeasTarget(int state, unsigned int *strobe,
+		  volatile unsigned int **reg, unsigned int *mask)
+{
+  volatile unsigned int *latencyReg =
+    (tiSlaveFiberIn==1) ? &TIp->fiberLatencyMeasurement : &TIp->fiberAlignment;
+
+  switch(state)
+    {
+    case TI_FIBERMEAS_ALIGN:
+      *strobe = TI_RESET_FIBER_AUTO_ALIGN;
+      *reg    = &TIp->fiberAlignment;
+      *mask   = (tiSlaveFiberIn==1) ?
+	TI_FIBERALIGNMENT_HFBR1_IODELAY_MASK : TI_FIBERALIGNMENT_HFBR5_IODELAY_MASK;
+      break;
+
+    case TI_FIBERMEAS_MEASURE:
+      *strobe = TI_RESET_MEASURE_LATENCY;
+      *reg    = latencyReg;
+      *mask   = TI_FIBERLATENCYMEASUREMENT_DATA_MASK;
+      break;
+
+    case TI_FIBERMEAS_SYNC_ALIGN:
+    default:
+      *strobe = (tiSlaveFiberIn==1) ?
+	TI_RESET_AUTOALIGN_HFBR1_SYNC : TI_RESET_AUTOALIGN_HFBR5_SYNC;
+      *reg    = latencyReg;
+      *mask   = TI_FIBERLATENCYMEASUREMENT_DATA_MASK;
+      break;
     }
 }
 
+/* Return 1 when the remaining tries can no longer change the histogram mode */
 static int
-FiberMeas()
+tiFiberMeasSettled()
 {
-  int clksrc=0, imeas = 0, ntries = 5;
-  unsigned int defaultDelay=0x1f1f1f00, fiberLatency=0, syncDelay=0, syncDelay_write=0;
-  int index = 0;
-  int failed = 0;
-  int rval = OK;
+  int ibin, first = 0, second = 0;
+  int remaining = TI_FIBERMEAS_MAX_TRIES - tiFiberMeasData.ntries;
 
-  measurement = (unsigned char *)malloc(256*sizeof(unsigned char));
-  memset((void *)measurement, 0, 256*sizeof(unsigned char));
+  if(remaining <= 0)
+    return 1;
 
-  clksrc = tiGetClockSource();
-  /* Check to be sure the TI has external HFBR1/5 clock enabled */
-  if((clksrc != TI_CLOCK_HFBR1) && (clksrc != TI_CLOCK_HFBR5))
+  for(ibin = 0; ibin < TI_FIBERMEAS_NBINS; ibin++)
     {
-      printf("%s: ERROR: Unable to measure fiber latency without HFBR1/5 as Clock Source\n",
-	     __FUNCTION__);
-      printf("\t Using default Fiber Sync Delay = %d (0x%x)",
-	     defaultDelay, defaultDelay);
+      if(tiFiberMeasData.histo[ibin] > first)
+	{
+	  second = first;
+	  first = tiFiberMeasData.histo[ibin];
+	}
+      else if(tiFiberMeasData.histo[ibin] > second)
+	second = tiFiberMeasData.histo[ibin];
+    }
 
-      TILOCK;
-      vmeWrite32(&TIp->fiberSyncDelay,defaultDelay);
-      TIUNLOCK;
+  return (first > (second + remaining));
+}
 
-      free(measurement);
-      return ERROR;
+/* Advance the measurement by one non-blocking step.  Returns the new state. */
+static int
+tiFiberMeasStep()
+{
+  unsigned int strobe = 0, mask = 0, value = 0;
+  volatile unsigned int *reg = NULL;
+  int state = tiFiberMeasData.state, settled = 0;
+
+  if(state == TI_FIBERMEAS_DONE)
+    return state;
+
+  if(state == TI_FIBERMEAS_IDLE)
+    {
+      memset((void *)&tiFiberMeasData, 0, sizeof(tiFiberMeasData));
+      tiFiberMeasData.state = TI_FIBERMEAS_ALIGN;
+      return tiFiberMeasData.state;
     }
 
-  TILOCK;
-  for(imeas = 0; imeas < ntries; imeas++)
+  tiFiberMeasTarget(state, &strobe, &reg, &mask);
+
+  if(tiFiberMeasData.polls == 0)
     {
 #ifdef SKIPIODELAY
-      /* Reset the IODELAY */
-      vmeWrite32(&TIp->reset,TI_RESET_IODELAY);
-      tiWaitForIODelayReset(10);
+      if(state == TI_FIBERMEAS_ALIGN)
+	{
+	  /* Reset the IODELAY */
+	  TILOCK;
+	  vmeWrite32(&TIp->reset,TI_RESET_IODELAY);
+	  TIUNLOCK;
+	  tiWaitForIODelayReset(10);
+	}
 #endif
-      /* Auto adjust the return signal phase */
-      vmeWrite32(&TIp->reset,TI_RESET_FIBER_AUTO_ALIGN);
-      taskDelay(20);
+      TILOCK;
+      vmeWrite32(&TIp->reset, strobe);
+      TIUNLOCK;
+      tiFiberMeasData.polls = 1;
+      return state;
+    }
 
-      /* Measure the fiber latency */
-      vmeWrite32(&TIp->reset,TI_RESET_MEASURE_LATENCY);
-      taskDelay(2);
+  TILOCK;
+  value = vmeRead32(reg) & mask;
+  TIUNLOCK;
 
-      /* Get the fiber latency measurement result */
-      if(tiSlaveFiberIn==1)
-	fiberLatency = vmeRead32(&TIp->fiberLatencyMeasurement);
-      else
-	fiberLatency = vmeRead32(&TIp->fiberAlignment);
+  settled = (tiFiberMeasData.polls >= tiFiberMeasMinPolls[state]) &&
+    (value == tiFiberMeasData.prev);
+  tiFiberMeasData.prev = value;
+
+  if(!settled && (tiFiberMeasData.polls++ < tiFiberMeasMaxPolls[state]))
+    return state;
 
 #ifdef DEBUGFIBERMEAS
-      printf("Software offset = 0x%08x (%d)\n",
-	     tiFiberLatencyOffset, tiFiberLatencyOffset);
-      printf("Fiber Latency is 0x%08x\n",
-	     fiberLatency);
-      printf("  Latency data = 0x%08x (%d ns)\n",
-	     (fiberLatency>>23), (fiberLatency>>23) * 4);
+  printf("%s: step %d %s after %d polls: 0x%08x\n",
+	 __func__, state, settled ? "settled" : "timed out",
+	 tiFiberMeasData.polls, value);
 #endif /* DEBUGFIBERMEAS */
 
-      /* Auto adjust the sync phase */
-      if(tiSlaveFiberIn==1)
-	vmeWrite32(&TIp->reset,TI_RESET_AUTOALIGN_HFBR1_SYNC);
-      else
-	vmeWrite32(&TIp->reset,TI_RESET_AUTOALIGN_HFBR5_SYNC);
+  tiFiberMeasData.polls = 0;
+  switch(state)
+    {
+    case TI_FIBERMEAS_ALIGN:
+      tiFiberMeasData.state = TI_FIBERMEAS_MEASURE;
+      break;
 
-      taskDelay(1);
+    case TI_FIBERMEAS_MEASURE:
+      tiFiberMeasData.state = TI_FIBERMEAS_SYNC_ALIGN;
+      break;
 
-      /* Get the fiber latency measurement result */
-      if(tiSlaveFiberIn==1)
-	fiberLatency = vmeRead32(&TIp->fiberLatencyMeasurement);
-      else
-	fiberLatency = vmeRead32(&TIp->fiberAlignment);
+    case TI_FIBERMEAS_SYNC_ALIGN:
+      /* Divide by two to get the one way trip.  Unsettled reads are not counted. */
+      if(settled)
+	tiFiberMeasData.histo[(value>>23)>>1]++;
+      tiFiberMeasData.ntries++;
 
-      /* Divide by two to get the one way trip */
-      index = ((fiberLatency& TI_FIBERLATENCYMEASUREMENT_DATA_MASK)>>23)>>1;
-      measurement[index]++;
+      tiFiberMeasData.state =
+	tiFiberMeasSettled() ? TI_FIBERMEAS_DONE : TI_FIBERMEAS_ALIGN;
+      break;
+    }
 
-      taskDelay(1);
+  return tiFiberMeasData.state;
+}
 
+static int
+FiberMeas()
+{
+  int clksrc=0, imeas = 0;
+  unsigned int defaultDelay=0x1f1f1f00, syncDelay=0, syncDelay_write=0;
+  int failed = 0;
+  int rval = OK;
+
+  clksrc = tiGetClockSource();
+  /* Check to be sure the TI has external HFBR1/5 clock enabled */
+  if((clksrc != TI_CLKSRC_HFBR1) && (clksrc != TI_CLKSRC_HFBR5))
+    {
+      printf("%s: ERROR: Unable to measure fiber latency without HFBR1/5 as Clock Source\n",
+	     __FUNCTION__);
+      printf("\t Using default Fiber Sync Delay = %d (0x%x)",
+	     defaultDelay, defaultDelay);
+
+      TILOCK;
+      vmeWrite32(&TIp->fiberSyncDelay,defaultDelay);
+      TIUNLOCK;
+
+      return ERROR;
     }
 
+  tiFiberMeasData.state = TI_FIBERMEAS_IDLE;
+  while(tiFiberMeasStep() != TI_FIBERMEAS_DONE)
+    taskDelay(1);
+
   /* Loop through measurements to find the most common */
-  for(imeas = 0; imeas < 256; imeas++)
+  for(imeas = 0; imeas < TI_FIBERMEAS_NBINS; imeas++)
     {
-      if(measurement[imeas] >= maxCount)
+      if(tiFiberMeasData.histo[imeas] >= tiFiberMeasData.maxCount)
 	{
-	  maxCount = measurement[imeas];
-	  maxIndex = imeas;
+	  tiFiberMeasData.maxCount = tiFiberMeasData.histo[imeas];
+	  tiFiberMeasData.maxIndex = imeas;
 	}
 /* #define DEBUGMEAS */
 #ifdef DEBUGMEAS
       printf("%s: %2d: measurement = %d  %s\n",
-	     __func__, imeas, measurement[imeas],
-	     (imeas==maxIndex)?"***":"");
+	     __func__, imeas, tiFiberMeasData.histo[imeas],
+	     (imeas==tiFiberMeasData.maxIndex)?"***":"");
 #endif
     }
-  tiFiberLatencyMeasurement = maxIndex;
+
+  if(tiFiberMeasData.maxCount == 0)
+    failed = 1;
+
+  tiFiberLatencyMeasurement = tiFiberMeasData.maxIndex;
 
   syncDelay = (tiFiberLatencyOffset - tiFiberLatencyMeasurement);
 
   syncDelay_write = (syncDelay & 0xFF) << 8 |
     (syncDelay & 0xFF) << 16 | (syncDelay & 0xFF) << 24;
 
-  vmeWrite32(&TIp->fiberSyncDelay,syncDelay_write);
-  taskDelay(1);
-  syncDelay = vmeRead32(&TIp->fiberSyncDelay);
-  TIUNLOCK;
+  if(failed == 0)
+    {
+      TILOCK;
+      vmeWrite32(&TIp->fiberSyncDelay,syncDelay_write);
+      syncDelay = vmeRead32(&TIp->fiberSyncDelay);
+      TIUNLOCK;
+    }
 
 #ifdef DEBUGFIBERMEAS
-  printf (" \n The fiber latency of 0xA0 is: 0x%08x, ", fiberLatency);
   printf (" The sync latency of 0x50 is: 0x%08x\n",syncDelay);
 #endif /* DEBUGFIBERMEAS */
 
   if(failed == 1)
     {
       printf("\n");
-      /* printf("%s: ERROR: TI Fiber Measurement failed!" */
-      /* 	     "\n\tFirst Measurement != Second Measurement (%d != %d)\n\n", */
-      /* 	     __FUNCTION__, */
-      /* 	     firstMeas, tiFiberLatencyMeasurement); */
+      printf("%s: ERROR: TI Fiber Measurement failed!"
+	     "\n\tLatency did not settle in %d tries\n\n",
+	     __FUNCTION__,
+	     tiFiberMeasData.ntries);
       tiFiberLatencyMeasurement = 0;
       rval = ERROR;
     }
@@ -7589,16 +8818,80 @@ FiberMeas()
   else
     {
       printf("%s: TI Fiber Measurement success!"
-	     "  tiFiberLatencyMeasurement = 0x%x (%d)\n",
+	     "  tiFiberLatencyMeasurement = 0x%x (%d) in %d tries\n",
 	     __FUNCTION__,
-	     tiFiberLatencyMeasurement, tiFiberLatencyMeasurement);
+	     tiFiberLatencyMeasurement, tiFiberLatencyMeasurement,
+	     tiFiberMeasData.ntries);
       rval = OK;
     }
 
-  free(measurement);
   return rval;
 }
 
+/* Apply a fiber latency measured by an earlier FiberMeas: align the
+   fiber, check the latency with a single measurement, and align the sync,
+   instead of taking the histogram of several tries.  Returns ERROR if the
+   measurement differs (e.g. a fiber of another length), for FiberMeas. */
+static int
+tiFiberMeasRestore(int latency)
+{
+  int clksrc, measured;
+  unsigned int strobe=0, mask=0, value=0;
+  volatile unsigned int *reg=NULL;
+  unsigned int syncDelay=0, syncDelay_write=0;
+
+  clksrc = tiGetClockSource();
+  if(((clksrc != TI_CLKSRC_HFBR1) && (clksrc != TI_CLKSRC_HFBR5)) ||
+     !((latency > 0) && (latency <= 0xFF)))
+    return ERROR;
+
+  tiFiberMeasTarget(TI_FIBERMEAS_ALIGN, &strobe, &reg, &mask);
+  TILOCK;
+  vmeWrite32(&TIp->reset, strobe);
+  TIUNLOCK;
+  taskDelay(tiFiberMeasMinPolls[TI_FIBERMEAS_ALIGN]);
+
+  tiFiberMeasTarget(TI_FIBERMEAS_MEASURE, &strobe, &reg, &mask);
+  TILOCK;
+  vmeWrite32(&TIp->reset, strobe);
+  TIUNLOCK;
+  taskDelay(tiFiberMeasMinPolls[TI_FIBERMEAS_MEASURE]);
+  TILOCK;
+  value = vmeRead32(reg) & mask;
+  TIUNLOCK;
+
+  /* Divide by two to get the one way trip */
+  measured = (value>>23)>>1;
+  if(measured != latency)
+    {
+      printf("%s: WARN: Fiber latency 0x%x differs from the topology cache (0x%x)\n",
+	     __func__, measured, latency);
+      return ERROR;
+    }
+
+  tiFiberMeasTarget(TI_FIBERMEAS_SYNC_ALIGN, &strobe, &reg, &mask);
+  TILOCK;
+  vmeWrite32(&TIp->reset, strobe);
+  TIUNLOCK;
+  taskDelay(tiFiberMeasMinPolls[TI_FIBERMEAS_SYNC_ALIGN]);
+
+  tiFiberLatencyMeasurement = latency;
+
+  syncDelay = (tiFiberLatencyOffset - tiFiberLatencyMeasurement);
+
+  syncDelay_write = (syncDelay & 0xFF) << 8 |
+    (syncDelay & 0xFF) << 16 | (syncDelay & 0xFF) << 24;
+
+  TILOCK;
+  vmeWrite32(&TIp->fiberSyncDelay,syncDelay_write);
+  TIUNLOCK;
+
+  printf("%s: tiFiberLatencyMeasurement = 0x%x (%d) from the topology cache\n",
+	 __func__, tiFiberLatencyMeasurement, tiFiberLatencyMeasurement);
+
+  return OK;
+}
+
 /**
  * @ingroup Status
  * @brief Return measured fiber length
@@ -7682,7 +8975,7 @@ tiGetLastSyncCodes(int pflag)
  *   - >0: Print to standard out
  *
  * @return
- *   - 0: Empty
+ *   - 0: Empty or less than half full
  *   - 1: Half Full
  *   - 2: Full
  */
@@ -7701,23 +8994,23 @@ tiGetSyncHistoryBufferStatus(int pflag)
     & (TI_SYNC_HISTORY_FIFO_MASK);
   TIUNLOCK;
 
-  switch(hist_status)
+  /* No flag set: not empty, less than half full */
+  if(hist_status & TI_SYNC_HISTORY_FIFO_FULL)
     {
-    case TI_SYNC_HISTORY_FIFO_EMPTY:
-      rval=0;
-      if(pflag) printf("%s: Sync history buffer EMPTY\n",__FUNCTION__);
-      break;
-
-    case TI_SYNC_HISTORY_FIFO_HALF_FULL:
-      rval=1;
-      if(pflag) printf("%s: Sync history buffer HALF FULL\n",__FUNCTION__);
-      break;
-
-    case TI_SYNC_HISTORY_FIFO_FULL:
-    default:
       rval=2;
       if(pflag) printf("%s: Sync history buffer FULL\n",__FUNCTION__);
-      break;
+    }
+  else if(hist_status & TI_SYNC_HISTORY_FIFO_HALF_FULL)
+    {
+      rval=1;
+      if(pflag) printf("%s: Sync history buffer HALF FULL\n",__FUNCTION__);
+    }
+  else
+    {
+      rval=0;
+      if(pflag)
+	printf("%s: Sync history buffer %s\n",__FUNCTION__,
+	       (hist_status & TI_SYNC_HISTORY_FIFO_EMPTY) ? "EMPTY" : "LESS THAN HALF FULL");
     }
 
   return rval;
@@ -7737,58 +9030,150 @@ tiResetSyncHistory()
       return;
     }
 
-  TILOCK;
-  vmeWrite32(&TIp->reset, TI_RESET_SYNC_HISTORY);
-  TIUNLOCK;
+  TILOCK;
+  vmeWrite32(&TIp->reset, TI_RESET_SYNC_HISTORY);
+  TIUNLOCK;
+
+}
+
+/**
+ * @ingroup Config
+ * @brief Control level of the SyncReset signal
+ * @sa tiSetUserSyncResetReceive
+ * @param enable
+ *   - >0: High
+ *   -  0: Low
+ * @param blflag Option to change block level, after SyncReset Low (enable = 0)
+ *       -   0: Do not change block level
+ *       -  >0: Broadcast block level to all connected slaves (including self)
+ *            BlockLevel broadcasted will be set to library value
+ *            (Set with tiSetBlockLevel)
+ */
+void
+tiUserSyncReset(int enable, int blflag)
+{
+  if(TIp == NULL)
+    {
+      printf("%s: ERROR: TI not initialized\n",__FUNCTION__);
+      return;
+    }
+
+  TILOCK;
+  if(enable)
+    vmeWrite32(&TIp->syncCommand,TI_SYNCCOMMAND_SYNCRESET_HIGH);
+  else
+    vmeWrite32(&TIp->syncCommand,TI_SYNCCOMMAND_SYNCRESET_LOW);
+
+  taskDelay(2);
+  TIUNLOCK;
+
+  printf("%s: User Sync Reset ",__FUNCTION__);
+  if(enable)
+    printf("HIGH\n");
+  else
+    printf("LOW\n");
+
+  if((blflag > 0) && (enable == 0)) /* Set the block level from "Next" to Current */
+    {
+      printf("%s: INFO: Broadcasting Block Level %d, Buffer Level %d\n",
+	     __FUNCTION__,
+	     tiNextBlockLevel, tiBlockBufferLevel);
+      tiBroadcastNextBlockLevel(tiNextBlockLevel);
+      tiSetBlockBufferLevel(tiBlockBufferLevel);
+    }
+
+}
+
+/**
+ * @ingroup Status
+ * @brief Decode a word of the Sync Command history buffer, for the
+ *        sync source of this TI (loopback for the master, otherwise the
+ *        slave fiber port).
+ *
+ * @param word       Word read from the history buffer
+ * @param code       Where to store the sync code (4 bits)
+ * @param valid      Where to store the code valid flag
+ * @param overflow   Where to store the timestamp overflow flag
+ * @param timestamp  Where to store the 16 bit timestamp
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiDecodeSyncHistory(unsigned int word, int *code, int *valid, int *overflow, int *timestamp)
+{
+  if((code == NULL) || (valid == NULL) || (overflow == NULL) || (timestamp == NULL))
+    {
+      printf("%s: ERROR: Invalid destination\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if(tiMaster)
+    {
+      *code  = (word & TI_SYNCHISTORY_LOOPBACK_CODE_MASK)>>10;
+      *valid = (word & TI_SYNCHISTORY_LOOPBACK_CODE_VALID)>>14;
+    }
+  else if(tiSlaveFiberIn == 1)
+    {
+      *code  = word & TI_SYNCHISTORY_HFBR1_CODE_MASK;
+      *valid = (word & TI_SYNCHISTORY_HFBR1_CODE_VALID)>>4;
+    }
+  else if(tiSlaveFiberIn == 5)
+    {
+      *code  = (word & TI_SYNCHISTORY_HFBR5_CODE_MASK) >> 5;
+      *valid = (word & TI_SYNCHISTORY_HFBR5_CODE_VALID)>>9;
+    }
+  else
+    {
+      printf("%s: Invalid slave fiber port %d\n",
+	     __func__, tiSlaveFiberIn);
+      return ERROR;
+    }
+
+  *overflow  = (word & TI_SYNCHISTORY_TIMESTAMP_OVERFLOW)>>15;
+  *timestamp = (word & TI_SYNCHISTORY_TIMESTAMP_MASK)>>16;
 
+  return OK;
 }
 
 /**
- * @ingroup Config
- * @brief Control level of the SyncReset signal
- * @sa tiSetUserSyncResetReceive
- * @param enable
- *   - >0: High
- *   -  0: Low
- * @param blflag Option to change block level, after SyncReset Low (enable = 0)
- *       -   0: Do not change block level
- *       -  >0: Broadcast block level to all connected slaves (including self)
- *            BlockLevel broadcasted will be set to library value
- *            (Set with tiSetBlockLevel)
+ * @ingroup Status
+ * @brief Read the Sync Command history buffer until it is empty, or
+ *        maxwords have been read.  Reads are removed from the buffer.
+ *
+ * @param data      Where to store the words read
+ * @param maxwords  Maximum number of words to read
+ *
+ * @return Number of words read if successful, otherwise ERROR
  */
-void
-tiUserSyncReset(int enable, int blflag)
+int
+tiReadSyncHistory(unsigned int *data, int maxwords)
 {
+  unsigned int word=0;
+  int nwords=0;
+
   if(TIp == NULL)
     {
       printf("%s: ERROR: TI not initialized\n",__FUNCTION__);
-      return;
+      return ERROR;
     }
 
-  TILOCK;
-  if(enable)
-    vmeWrite32(&TIp->syncCommand,TI_SYNCCOMMAND_SYNCRESET_HIGH);
-  else
-    vmeWrite32(&TIp->syncCommand,TI_SYNCCOMMAND_SYNCRESET_LOW);
-
-  taskDelay(2);
-  TIUNLOCK;
-
-  printf("%s: User Sync Reset ",__FUNCTION__);
-  if(enable)
-    printf("HIGH\n");
-  else
-    printf("LOW\n");
+  if((data == NULL) || (maxwords < 0))
+    {
+      printf("%s: ERROR: Invalid destination\n",__FUNCTION__);
+      return ERROR;
+    }
 
-  if((blflag > 0) && (enable == 0)) /* Set the block level from "Next" to Current */
+  TILOCK;
+  while(nwords < maxwords)
     {
-      printf("%s: INFO: Broadcasting Block Level %d, Buffer Level %d\n",
-	     __FUNCTION__,
-	     tiNextBlockLevel, tiBlockBufferLevel);
-      tiBroadcastNextBlockLevel(tiNextBlockLevel);
-      tiSetBlockBufferLevel(tiBlockBufferLevel);
+      word = vmeRead32(&TIp->syncHistory);
+      if(word == 0)
+	break;
+      data[nwords++] = word;
     }
+  TIUNLOCK;
 
+  return nwords;
 }
 
 /**
@@ -7810,40 +9195,11 @@ tiPrintSyncHistory()
 
   while(code!=0)
     {
-      TILOCK;
-      syncHistory = vmeRead32(&TIp->syncHistory);
-      TIUNLOCK;
-
-      if(syncHistory == 0)
+      if(tiReadSyncHistory(&syncHistory, 1) != 1)
 	break;
 
-      if(tiMaster)
-	{
-	  code  = (syncHistory & TI_SYNCHISTORY_LOOPBACK_CODE_MASK)>>10;
-	  valid = (syncHistory & TI_SYNCHISTORY_LOOPBACK_CODE_VALID)>>14;
-	}
-      else
-	{
-	  if(tiSlaveFiberIn == 1)
-	    {
-	      code  = syncHistory & TI_SYNCHISTORY_HFBR1_CODE_MASK;
-	      valid = (syncHistory & TI_SYNCHISTORY_HFBR1_CODE_VALID)>>4;
-	    }
-	  else if(tiSlaveFiberIn == 5)
-	    {
-	      code  = (syncHistory & TI_SYNCHISTORY_HFBR5_CODE_MASK) >> 5;
-	      valid = (syncHistory & TI_SYNCHISTORY_HFBR5_CODE_VALID)>>9;
-	    }
-	  else
-	    {
-	      printf("%s: Invalid slave fiber port %d\n",
-		     __func__, tiSlaveFiberIn);
-	      return;
-	    }
-	}
-
-      overflow  = (syncHistory & TI_SYNCHISTORY_TIMESTAMP_OVERFLOW)>>15;
-      timestamp = (syncHistory & TI_SYNCHISTORY_TIMESTAMP_MASK)>>16;
+      if(tiDecodeSyncHistory(syncHistory, &code, &valid, &overflow, &timestamp) != OK)
+	return;
 
 /*       if(valid) */
 	{
@@ -8735,12 +10091,14 @@ tiGetGeoAddress()
 static void
 tiInt(void)
 {
+  tiLatencyReady = tiLatencyNow();
   tiIntCount++;
+  TI_TRACE_POINT(TI_TRACE_INT, tiIntCount);
 
   INTLOCK;
 
   if (tiIntRoutine != NULL)	/* call user routine */
-    (*tiIntRoutine) (tiIntArg);
+    tiIntRoutineCall();
 
   /* Acknowledge trigger */
   if(tiDoAck==1)
@@ -8751,6 +10109,33 @@ tiInt(void)
 
 }
 
+/*******************************************************************************
+ *
+ *  tiIntRoutineCall
+ *  - Call the user routine connected with tiIntConnect, from tiInt or
+ *    tiPoll.  Records the time from blocks ready to the call, and the
+ *    time in the routine.
+ *
+ */
+static void
+tiIntRoutineCall(void)
+{
+  uint64_t start, end;
+
+  start = tiLatencyNow();
+  tiLatencyRecord(TI_LATENCY_READY_TO_CALLBACK, tiLatencyReady, start);
+  tiLatencyReady = 0;
+  tiLatencyCallbackEnd = 0;
+
+  TI_TRACE_POINT(TI_TRACE_ROUTINE_BEGIN, tiIntCount);
+  (*tiIntRoutine) (tiIntArg);
+  TI_TRACE_POINT(TI_TRACE_ROUTINE_END, tiIntCount);
+
+  end = tiLatencyNow();
+  tiLatencyRecord(TI_LATENCY_CALLBACK, start, end);
+  tiLatencyCallbackEnd = end;
+}
+
 /*******************************************************************************
  *
  *  tiPoll
@@ -8828,7 +10213,17 @@ tiPoll(void)
 
       tidata = 0;
 
-      tidata = tiBReady();
+      {
+	/* Only polls that find blocks are traced */
+	TI_TRACE_CLOCK(tsc);
+	tidata = tiBReady();
+	if(tidata && (tidata != ERROR))
+	  {
+	    tiLatencyReady = tiLatencyNow();
+	    TI_TRACE_POINT_AT(TI_TRACE_BREADY_BEGIN, tsc, 0);
+	    TI_TRACE_POINT(TI_TRACE_BREADY_END, tidata);
+	  }
+      }
       if(tidata == ERROR)
 	{
 	  printf("%s: ERROR: tiIntPoll returned ERROR.\n",__FUNCTION__);
@@ -8840,9 +10235,10 @@ tiPoll(void)
 	  INTLOCK;
 	  tiDaqCount = tidata;
 	  tiIntCount++;
+	  TI_TRACE_POINT(TI_TRACE_POLL_READY, tidata);
 
 	  if (tiIntRoutine != NULL)	/* call user routine */
-	    (*tiIntRoutine) (tiIntArg);
+	    tiIntRoutineCall();
 
 	  /* Write to TI to Acknowledge Interrupt */
 	  if(tiDoAck==1)
@@ -9009,7 +10405,7 @@ tiIntDisconnect()
 
   if(tiIntRunning)
     {
-      logMsg("tiIntDisconnect: ERROR: TI is Enabled - Call tiIntDisable() first\n",
+      TILOGMSG(ERROR, "tiIntDisconnect: ERROR: TI is Enabled - Call tiIntDisable() first\n",
 	     1,2,3,4,5,6);
       return ERROR;
     }
@@ -9106,10 +10502,11 @@ tiIntAck()
 {
   int resetbits=0;
   if(TIp == NULL) {
-    logMsg("tiIntAck: ERROR: TI not initialized\n",0,0,0,0,0,0);
+    TILOGMSG(ERROR, "tiIntAck: ERROR: TI not initialized\n",0,0,0,0,0,0);
     return;
   }
 
+  TI_TRACE_POINT(TI_TRACE_INTACK_BEGIN, tiAckCount);
   if (tiAckRoutine != NULL)
     {
       /* Execute user defined Acknowlege, if it was defined */
@@ -9141,7 +10538,135 @@ tiIntAck()
       tiNReadoutEvents = 0;
       TIUNLOCK;
     }
+  TI_TRACE_POINT(TI_TRACE_INTACK_END, tiAckCount);
+
+  if(tiLatencyCallbackEnd != 0)
+    {
+      tiLatencyRecord(TI_LATENCY_CALLBACK_TO_ACK, tiLatencyCallbackEnd,
+		      tiLatencyNow());
+      tiLatencyCallbackEnd = 0;
+    }
+
+  /* Block is done, run anything that was waiting for the boundary */
+  if(tiBlockBoundaryRoutine != NULL)
+    tiBlockBoundaryService();
+
+}
+
+/*******************************************************************************
+ *
+ *  tiBlockBoundaryService
+ *  - Execute the routine scheduled with tiRunAtBlockBoundary, and wake
+ *    up the caller.
+ *
+ */
+static void
+tiBlockBoundaryService(void)
+{
+#ifndef VXWORKS
+  /* Caller is timing out and handling it, if this is busy */
+  if(pthread_mutex_trylock(&tiBlockBoundaryMutex) != 0)
+    return;
+
+  if(tiBlockBoundaryRoutine != NULL)
+    {
+      (*tiBlockBoundaryRoutine) (tiBlockBoundaryArg);
+      tiBlockBoundaryRoutine = NULL;
+      tiBlockBoundaryArg = 0;
+      pthread_cond_broadcast(&tiBlockBoundaryCond);
+    }
+  pthread_mutex_unlock(&tiBlockBoundaryMutex);
+#endif
+}
+
+/**
+ * @ingroup IntPoll
+ * @brief Execute a routine between blocks.
+ *
+ *    If triggers are enabled, the routine is executed by the readout
+ *    (polling thread or interrupt handler) right after the next block is
+ *    acknowledged.  The call blocks until the routine has been executed.
+ *    If no block is acknowledged within timeout, the routine is executed
+ *    here, provided there's no block waiting for an acknowledge.
+ *
+ *    If triggers are not enabled (or for VxWorks), the routine is executed
+ *    immediately.
+ *
+ * @param routine Routine to execute
+ * @param arg argument to pass to routine
+ * @param timeout Time (milliseconds) to wait for a block boundary
+ *
+ * @return OK if the routine was executed, otherwise ERROR
+ */
+int
+tiRunAtBlockBoundary(VOIDFUNCPTR routine, unsigned int arg, int timeout)
+{
+#ifndef VXWORKS
+  struct timespec abstime;
+  int rval = OK, status = 0;
+#endif
+
+  if(routine == NULL)
+    {
+      printf("%s: ERROR: routine undefined.\n",__FUNCTION__);
+      return ERROR;
+    }
+
+#ifdef VXWORKS
+  (*routine) (arg);
+  return OK;
+#else
+  if(!tiIntRunning)
+    {
+      (*routine) (arg);
+      return OK;
+    }
 
+  pthread_mutex_lock(&tiBlockBoundaryMutex);
+  if(tiBlockBoundaryRoutine != NULL)
+    {
+      pthread_mutex_unlock(&tiBlockBoundaryMutex);
+      printf("%s: ERROR: Another routine is already waiting for a block boundary\n",
+	     __FUNCTION__);
+      return ERROR;
+    }
+
+  tiBlockBoundaryArg = arg;
+  tiBlockBoundaryRoutine = routine;
+
+  clock_gettime(CLOCK_REALTIME, &abstime);
+  abstime.tv_sec  += timeout / 1000;
+  abstime.tv_nsec += (timeout % 1000) * 1000000;
+  if(abstime.tv_nsec >= 1000000000)
+    {
+      abstime.tv_sec++;
+      abstime.tv_nsec -= 1000000000;
+    }
+
+  while((tiBlockBoundaryRoutine != NULL) && (status == 0))
+    status = pthread_cond_timedwait(&tiBlockBoundaryCond, &tiBlockBoundaryMutex, &abstime);
+
+  if(tiBlockBoundaryRoutine != NULL)
+    {
+      /* No block boundary seen.  Run it here, if the readout is idle */
+      tiBlockBoundaryRoutine = NULL;
+      tiBlockBoundaryArg = 0;
+
+      INTLOCK;
+      if(tiNeedAck == 0)
+	(*routine) (arg);
+      else
+	{
+	  printf("%s: ERROR: Timeout waiting for a block boundary\n",
+		 __FUNCTION__);
+	  rval = ERROR;
+	}
+      INTUNLOCK;
+    }
+  pthread_mutex_unlock(&tiBlockBoundaryMutex);
+
+  return rval;
+#endif
 }
 
 /**
@@ -9288,6 +10813,166 @@ tiGetAckCount()
   return(rval);
 }
 
+/**
+ * @ingroup Status
+ * @brief Return the readout latency distributions, since tiInit or
+ *   tiResetLatencyStats.
+ *
+ *  Latencies of each readout are recorded in histograms with ~3% wide
+ *  bins, so the percentiles are within a few percent of the true values.
+ *
+ * @param stats Array of TI_LATENCY_NSTAGES, indexed by the TI_LATENCY_* stage.
+ *   All times in ns.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiGetLatencyStats(tiLatencyStats *stats)
+{
+#ifdef VXWORKS
+  printf("%s: ERROR: Not supported in vxWorks\n", __func__);
+  return ERROR;
+#else
+  static const double quantile[4] = { 0.5, 0.9, 0.99, 0.999 };
+  double *pvalue[4];
+  uint64_t bin[TI_LATENCY_NBINS], count, sum, min, target, cumulative;
+  int istage, ibin, iq;
+
+  if(stats == NULL)
+    {
+      printf("%s: ERROR: Invalid stats pointer\n", __func__);
+      return ERROR;
+    }
+
+  for(istage = 0; istage < TI_LATENCY_NSTAGES; istage++)
+    {
+      tiLatencyStats *st = &stats[istage];
+      tiLatencyHist *h = &tiLatency[istage];
+
+      memset(st, 0, sizeof(tiLatencyStats));
+
+      /* Count from the copied bins, so the percentiles are consistent */
+      count = 0;
+      for(ibin = 0; ibin < TI_LATENCY_NBINS; ibin++)
+	{
+	  bin[ibin] = __atomic_load_n(&h->bin[ibin], __ATOMIC_RELAXED);
+	  count += bin[ibin];
+	}
+      if(count == 0)
+	continue;
+
+      sum = __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+      st->count = count;
+      st->mean  = (double)sum / (double)count;
+      min = __atomic_load_n(&h->min, __ATOMIC_RELAXED);
+      st->min   = (min != 0) ? (double)(min - 1) : 0.;
+      st->max   = (double)__atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+      pvalue[0] = &st->p50;
+      pvalue[1] = &st->p90;
+      pvalue[2] = &st->p99;
+      pvalue[3] = &st->p999;
+
+      cumulative = 0;
+      iq = 0;
+      for(ibin = 0; (ibin < TI_LATENCY_NBINS) && (iq < 4); ibin++)
+	{
+	  cumulative += bin[ibin];
+	  while((iq < 4) && (bin[ibin] != 0))
+	    {
+	      target = (uint64_t)(quantile[iq] * (double)count + 0.999999);
+	      if(target < 1)
+		target = 1;
+	      if(cumulative < target)
+		break;
+
+	      *pvalue[iq] = tiLatencyBinValue(ibin);
+	      /* Bin middle may be outside of what was measured */
+	      if(*pvalue[iq] < st->min)
+		*pvalue[iq] = st->min;
+	      if(*pvalue[iq] > st->max)
+		*pvalue[iq] = st->max;
+	      iq++;
+	    }
+	}
+    }
+
+  return OK;
+#endif
+}
+
+/**
+ * @ingroup Status
+ * @brief Clear the readout latency distributions
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiResetLatencyStats()
+{
+#ifdef VXWORKS
+  printf("%s: ERROR: Not supported in vxWorks\n", __func__);
+  return ERROR;
+#else
+  int istage, ibin;
+
+  for(istage = 0; istage < TI_LATENCY_NSTAGES; istage++)
+    {
+      tiLatencyHist *h = &tiLatency[istage];
+
+      __atomic_store_n(&h->count, 0, __ATOMIC_RELAXED);
+      for(ibin = 0; ibin < TI_LATENCY_NBINS; ibin++)
+	__atomic_store_n(&h->bin[ibin], 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&h->sum, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&h->min, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&h->max, 0, __ATOMIC_RELAXED);
+    }
+
+  return OK;
+#endif
+}
+
+/**
+ * @ingroup Status
+ * @brief Print the readout latency distributions to standard out
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiPrintLatencyStats()
+{
+  static const char *stageName[TI_LATENCY_NSTAGES] =
+    {
+      "Ready to routine",
+      "Routine",
+      "DMA",
+      "Routine to ack"
+    };
+  tiLatencyStats stats[TI_LATENCY_NSTAGES];
+  int istage;
+
+  if(tiGetLatencyStats(stats) != OK)
+    return ERROR;
+
+  printf("\n");
+  printf("TI Readout Latency (us)\n");
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Stage                Count      Mean       p50       p90       p99     p99.9       Max\n");
+  for(istage = 0; istage < TI_LATENCY_NSTAGES; istage++)
+    {
+      tiLatencyStats *st = &stats[istage];
+
+      printf("  %-16s %9llu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+	     stageName[istage], st->count,
+	     st->mean * 1e-3, st->p50 * 1e-3, st->p90 * 1e-3,
+	     st->p99 * 1e-3, st->p999 * 1e-3, st->max * 1e-3);
+    }
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n");
+
+  return OK;
+}
+
 
 
 /**
@@ -9364,6 +11049,50 @@ tiGetBusyCounter(int busysrc)
   return rval;
 }
 
+/**
+ * @ingroup Status
+ * @brief Latch and read the live and busy timers and the BUSY counters of
+ *        all busy sources in a single locked batch.
+ *
+ * @param livetime  Where to store the live timer (7.68 us units)
+ * @param busytime  Where to store the busy timer (7.68 us units)
+ * @param counter   Array of 16 elements for the BUSY counters, indexed
+ *                  as the busysrc of tiGetBusyCounter
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiGetBusyScalers(unsigned int *livetime, unsigned int *busytime, unsigned int *counter)
+{
+  int icnt=0;
+
+  if(TIp == NULL)
+    {
+      printf("%s: ERROR: TI not initialized\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if((livetime == NULL) || (busytime == NULL) || (counter == NULL))
+    {
+      printf("%s: ERROR: Invalid destination\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  TILOCK;
+  vmeWrite32(&TIp->reset, TI_RESET_SCALERS_LATCH);
+  *livetime = vmeRead32(&TIp->livetime);
+  *busytime = vmeRead32(&TIp->busytime);
+  for(icnt=0; icnt<16; icnt++)
+    {
+      if(icnt<7)
+	counter[icnt] = vmeRead32(&TIp->busy_scaler1[icnt]);
+      else
+	counter[icnt] = vmeRead32(&TIp->busy_scaler2[icnt-7]);
+    }
+  TIUNLOCK;
+
+  return OK;
+}
+
 /**
  * @ingroup Status
  * @brief Print the BUSY counters for all busy sources
@@ -9718,7 +11447,7 @@ tiReadScalers(volatile unsigned int *data, int latch)
 
   if(TIp == NULL)
     {
-      logMsg("tiReadScalers: ERROR: TI not initialized\n",
+      TILOGMSG(ERROR, "tiReadScalers: ERROR: TI not initialized\n",
 	     1, 2, 3, 4, 5, 6);
       return ERROR;
     }
@@ -9730,7 +11459,7 @@ tiReadScalers(volatile unsigned int *data, int latch)
 
   if((latch<0) || (latch>2))
     {
-      logMsg("tiReadScalers: ERROR: Invalid latch (%d).\n",
+      TILOGMSG(ERROR, "tiReadScalers: ERROR: Invalid latch (%d).\n",
 	     latch,2,3,4,5,6);
       return ERROR;
     }
@@ -10003,7 +11732,7 @@ tiScanAndFillEvTypeScalers(volatile unsigned int *data, int nwords)
 
   if(nevtypes == ERROR)
     {
-      logMsg("tiScanAndFillEvTypeScalers: ERROR: Failed to fill event type scalers\n",
+      TILOGMSG(ERROR, "tiScanAndFillEvTypeScalers: ERROR: Failed to fill event type scalers\n",
 	     0, 1, 2, 3, 4, 5);
       rval = ERROR;
     }
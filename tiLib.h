@@ -444,6 +444,11 @@ struct TI_A24RegStruct
 #define TI_FIXEDPULSER1_NTRIGGERS_MASK 0x0000FFFF
 #define TI_FIXEDPULSER1_PERIOD_MASK    0x7FFF0000
 #define TI_FIXEDPULSER1_PERIOD_RANGE   (1<<31)
+/* Fixed pulser period: MIN + period_inc x STEP (range 0), or
+   MIN + period_inc x STEP x RANGE1 (range 1), in ns */
+#define TI_FIXEDPULSER_PERIOD_MIN_NS   120
+#define TI_FIXEDPULSER_STEP_NS         30
+#define TI_FIXEDPULSER_RANGE1_FACTOR   2048
 
 /* 0x90 fixedPulser2 bits and masks */
 #define TI_FIXEDPULSER2_NTRIGGERS_MASK 0x0000FFFF
@@ -639,11 +644,109 @@ struct TI_A24RegStruct
 #define TI_INIT_NO_INIT                 (1<<0)
 #define TI_INIT_SLAVE_FIBER_5           (1<<1)
 #define TI_INIT_SKIP_FIRMWARE_CHECK     (1<<2)
+#define TI_INIT_COLD_START              (1<<3)
+
+/* Board and fiber topology kept by the cache of tiSetTopologyCache_preInit */
+typedef struct tiTopology
+{
+  unsigned int a24;              /* VME A24 address */
+  unsigned int slot;
+  unsigned int a32;              /* A32 data buffer base */
+  unsigned int firmware;         /* tiGetFirmwareVersion */
+  unsigned int serialNumber;     /* tiGetSerialNumber */
+  unsigned int slaveFiberIn;     /* 1 or 5, 0 for a TI Master */
+  int          fiberLatency;     /* tiGetFiberLatencyMeasurement */
+  unsigned int connectedFibers;  /* fiber connected bits (1-8) */
+} tiTopology;
+
+/* Readout latency stages, from tiGetLatencyStats */
+#define TI_LATENCY_READY_TO_CALLBACK  0  /* blocks ready (tiBReady, interrupt) to user routine */
+#define TI_LATENCY_CALLBACK           1  /* user routine */
+#define TI_LATENCY_DMA                2  /* DMA in tiReadBlock */
+#define TI_LATENCY_CALLBACK_TO_ACK    3  /* user routine return to tiIntAck write */
+#define TI_LATENCY_NSTAGES            4
+
+/* Latency of one stage (ns) */
+typedef struct tiLatencyStats
+{
+  unsigned long long count;
+  double mean;
+  double min;
+  double max;
+  double p50;
+  double p90;
+  double p99;
+  double p999;
+} tiLatencyStats;
+
+/* tiReadTriggerBlock failures, from tiGetReadoutRecovery */
+#define TI_RECOVERY_DMA             0  /* tiReadBlock returned ERROR */
+#define TI_RECOVERY_NO_HEADER       1  /* no block header */
+#define TI_RECOVERY_NO_TRAILER      2  /* no block trailer */
+#define TI_RECOVERY_COUNT_MISMATCH  3  /* block trailer word count differs */
+#define TI_RECOVERY_NFAILURES       4
+
+/* What the readout recovery did with the block */
+#define TI_RECOVERY_DROPPED         0  /* drained, fake trigger bank (or ERROR) returned */
+#define TI_RECOVERY_RESYNCED        1  /* next valid block in the FIFO returned instead */
+#define TI_RECOVERY_HELD            2  /* next valid block held for the next readout */
+
+#define TI_RECOVERY_NRECORDS        16
+
+typedef struct tiRecoveryRecord
+{
+  unsigned int readout;       /* tiGetIntCount */
+  int          failure;       /* TI_RECOVERY_DMA .. TI_RECOVERY_COUNT_MISMATCH */
+  int          outcome;       /* TI_RECOVERY_DROPPED, _RESYNCED or _HELD */
+  unsigned int firstWord;     /* first word of the bad block */
+  unsigned int wordsDropped;
+  unsigned int drains;        /* block reads to recover */
+  double       elapsed_us;
+} tiRecoveryRecord;
+
+typedef struct tiRecoveryStats
+{
+  unsigned int       failures[TI_RECOVERY_NFAILURES];
+  unsigned int       dropped;
+  unsigned int       resynced;
+  unsigned int       held;
+  unsigned long long wordsDropped;
+  double             maxElapsed_us;
+  int                nrecords;
+  tiRecoveryRecord   record[TI_RECOVERY_NRECORDS];
+} tiRecoveryStats;
+
+/* Port status, from tiGetAllSlaveStatus.  Port 0 is the loopback (this TI),
+   1-8 the fiber ports */
+#define TI_PORT_NPORTS              9
+
+/* tiPortStatus linkErrors bits (GTPStatusB) */
+#define TI_PORT_LINK_DATA_ERROR     (1<<0)
+#define TI_PORT_LINK_DISPARITY      (1<<1)
+#define TI_PORT_LINK_NOT_IN_TABLE   (1<<2)
+
+typedef struct tiPortStatus
+{
+  int          port;
+  int          slave;          /* in the slave mask (tiAddSlave) */
+  int          connected;
+  int          trigSrcEnabled;
+  int          busy;
+  int          crateID;
+  int          portTrigSrc;    /* trigger sources enabled, as tiGetPortTrigSrcEnabled */
+  int          blocklevel;
+  int          blocksReady;
+  int          blocksNeedAck;
+  int          linkUp;         /* trigger link channel bonded (fiber ports) */
+  int          linkErrors;     /* TI_PORT_LINK_* */
+  unsigned int busyCounter;    /* as tiGetBusyCounter, Loopback and Fiber 1-8 */
+} tiPortStatus;
 
 /* Some pre-initialization routine prototypes */
 int  tiSetFiberLatencyOffset_preInit(int flo);
 int  tiSetCrateID_preInit(int cid);
 int  tiSetFiberIn_preInit(int port);
+int  tiSetTopologyCache_preInit(const char *filename);
 
 /* Function prototypes */
 int  tiInit(unsigned int tAddr, unsigned int mode, int force);
@@ -656,14 +759,17 @@ void tiSlaveStatus(int pflag);
 int  tiGetFirmwareVersion();
 int  tiReload();
 unsigned int tiGetSerialNumber(char **rSN);
+int  tiGetTopology(tiTopology *topo);
 int  tiClockResync();
 int  tiReset();
 int  tiSetCrateID(unsigned int crateID);
 int  tiGetCrateID(int port);
 int  tiGetPortTrigSrcEnabled(int port);
 int  tiGetSlaveBlocklevel(int port);
+int  tiGetAllSlaveStatus(tiPortStatus *status);
 int  tiSetBlockLevel(int blockLevel);
 int  tiBroadcastNextBlockLevel(int blockLevel);
+int  tiBroadcastBlockBufferLevel(int blockLevel, int bufferLevel);
 int32_t tiGetUseBroadcastBufferLevel();
 int  tiGetNextBlockLevel();
 int  tiGetCurrentBlockLevel();
@@ -684,13 +790,20 @@ int32_t tiGetEventFormat();
 int  tiSetFPInputReadout(int enable);
 int32_t tiGetFPInputReadout();
 int  tiSoftTrig(int trigger, unsigned int nevents, unsigned int period_inc, int range);
+int  tiSoftTrigRestart(int trigger);
 int  tiSetRandomTrigger(int trigger, int setting);
 int  tiDisableRandomTrigger();
+int32_t tiGetSoftTrig(int32_t trigger, int32_t *nevents, int32_t *period_inc, int32_t *range);
+int32_t tiGetRandomTrigger(int32_t trigger, int32_t *enable, int32_t *setting);
 int  tiReadBlock(volatile unsigned int *data, int nwrds, int rflag);
 int  tiFakeTriggerBankOnError(int enable);
 int  tiGenerateTriggerBank(volatile unsigned int *data);
 int  tiReadTriggerBlock(volatile unsigned int *data);
 int  tiGetBlockSyncFlag();
+int  tiSetReadoutRecovery(int enable, int maxDrains);
+int  tiGetReadoutRecovery(tiRecoveryStats *stats);
+int  tiResetReadoutRecovery();
+int  tiPrintReadoutRecovery();
 int  tiCheckTriggerBlock(volatile unsigned int *data);
 int  tiDecodeTriggerTypes(volatile unsigned int *data, int data_len,
 			  int nevents, unsigned int *evtypes);
@@ -754,6 +867,7 @@ int  tiResetSlaveConfig();
 int  tiAddSlave(unsigned int fiber);
 int  tiRemoveSlave(unsigned int fiber);
 int  tiAddSlaveMask(unsigned int fibermask);
+int  tiGetSlaveMask();
 int  tiSetTriggerHoldoff(int rule, unsigned int value, int timestep);
 int  tiGetTriggerHoldoff(int rule);
 int  tiGetTriggerHoldoffClock();
@@ -788,6 +902,7 @@ unsigned int tiGetBusyTime();
 int  tiLive(int sflag);
 unsigned int tiGetTSscaler(int input, int latch);
 unsigned int tiBlockStatus(int fiber, int pflag);
+int  tiBlockStatusAll(unsigned int *status);
 
 int  tiGetFiberLatencyMeasurement();
 int  tiSetUserSyncResetReceive(int enable);
@@ -795,6 +910,8 @@ int  tiGetLastSyncCodes(int pflag);
 int  tiGetSyncHistoryBufferStatus(int pflag);
 void tiResetSyncHistory();
 void tiUserSyncReset(int enable, int pflag);
+int  tiDecodeSyncHistory(unsigned int word, int *code, int *valid, int *overflow, int *timestamp);
+int  tiReadSyncHistory(unsigned int *data, int maxwords);
 void tiPrintSyncHistory();
 int  tiSetSyncEventInterval(int blk_interval);
 int  tiGetSyncEventInterval();
@@ -830,13 +947,19 @@ int  tiIntConnect(unsigned int vector, VOIDFUNCPTR routine, unsigned int arg);
 int  tiIntDisconnect();
 int  tiAckConnect(VOIDFUNCPTR routine, unsigned int arg);
 void tiIntAck();
+int  tiRunAtBlockBoundary(VOIDFUNCPTR routine, unsigned int arg, int timeout);
 int  tiIntEnable(int iflag);
 void tiIntDisable();
 unsigned int  tiGetIntCount();
 unsigned int  tiGetAckCount();
+int  tiGetLatencyStats(tiLatencyStats *stats);
+int  tiResetLatencyStats();
+int  tiPrintLatencyStats();
 
 int  tiGetSWBBusy(int pflag);
 unsigned int tiGetBusyCounter(int busysrc);
+int  tiGetBusyScalers(unsigned int *livetime, unsigned int *busytime,
+		      unsigned int *counter);
 int  tiPrintBusyCounters();
 
 int  tiReadFiberFifo(int fiber, volatile unsigned int *data, int maxwords);
@@ -855,6 +978,7 @@ int  tiSetScalerMode(int mode, int control);
 int32_t tiGetScalerMode(int32_t *mode, int32_t *control);
 int  tiSetEvTypeScalers(int enable);
 int32_t tiGetEvTypeScalersFlag();
+int  tiGetEvTypeScalers(unsigned int *data, int maxwords);
 void tiClearEvTypeScalers();
 int  tiScanAndFillEvTypeScalers(volatile unsigned int *data, int nwords);
 void tiPrintEvTypeScalers();
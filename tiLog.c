@@ -0,0 +1,597 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Non-blocking logging for the readout path (Linux).
+ *
+ *     tiLogMsgLevel never formats or writes: it looks up the message ID of
+ *     the format (open addressing on the format pointer, inserted
+ *     lock-free), applies the level and the per ID rate limit, and puts
+ *     the format, level and arguments in a bounded lock-free queue.  The
+ *     drain thread formats and passes them to the sink (stdout by
+ *     default), and once a second reports the messages suppressed or
+ *     dropped for each ID.
+ *
+ *     With the queue empty, the drain thread waits on an eventfd until the
+ *     next report.  The first message queued while it waits writes the
+ *     eventfd; the others see it already woken and only queue.
+ *
+ *     The drain thread is started by tiLogStart, not by tiInit.  Until
+ *     then, and after tiLogStop, messages go to logMsg when logged.
+ *
+ *     As with vxWorks logMsg, the format must stay valid until printed
+ *     (a string literal), and the arguments are ints.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include "jvme.h"
+#include "tiLog.h"
+
+/**
+ * @defgroup Log Readout Logging
+ *   Queued, rate limited messages from the readout path.
+ */
+
+typedef struct
+{
+  uint64_t    seq;
+  const char *format;
+  int         id;
+  int         level;
+  int         arg[6];
+  double      time;
+} tiLogEntry;
+
+typedef struct
+{
+  const char *format;
+  int         level;        /* of the last message */
+  uint64_t    count;
+  uint64_t    printed;
+  uint64_t    suppressed;
+  uint64_t    dropped;
+  uint64_t    reported;     /* suppressed + dropped, at the last report */
+  int64_t     window;       /* second of the rate limit window */
+  uint32_t    inWindow;
+} tiLogId;
+
+static tiLogEntry lgQueue[TI_LOG_QUEUE];
+static uint64_t   lgEnqueue = 0, lgDequeue = 0;
+static tiLogId    lgId[TI_LOG_NIDS];
+
+static volatile int lgRunning = 0;
+static volatile int lgLevel = TI_LOG_DEBUG;
+static volatile int lgRateLimit = 100;       /* messages per second per ID */
+static TILOGSINK    lgSink = NULL;
+
+static pthread_t    lgThread;
+static volatile int lgThreadStop = 0;
+static int          lgWaiting = 0;      /* drain thread waits on lgEventFd */
+static int          lgEventFd = -1;
+static int          lgAtExit = 0;
+
+static const char *lgLevelName[4] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+static void
+tiLogWake()
+{
+  uint64_t one = 1;
+
+  if(write(lgEventFd, &one, sizeof(one)) < 0)
+    return;
+}
+
+static int
+tiLogFindId(const char *format)
+{
+  uint32_t hash = (uint32_t)(((uintptr_t)format >> 2) * 2654435761u);
+  const char *expected;
+  int iid, idx;
+
+  for(iid = 0; iid < TI_LOG_NIDS; iid++)
+    {
+      idx = (hash + iid) & (TI_LOG_NIDS - 1);
+      expected = __atomic_load_n(&lgId[idx].format, __ATOMIC_ACQUIRE);
+      if(expected == format)
+	return idx;
+      if(expected != NULL)
+	continue;
+
+      if(__atomic_compare_exchange_n(&lgId[idx].format, &expected, format, 0,
+				     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ||
+	 (expected == format))
+	return idx;
+    }
+
+  return -1;
+}
+
+/**
+ * @ingroup Log
+ * @brief Log a message with its severity.  Does not block.
+ *
+ * @param level   TI_LOG_DEBUG, TI_LOG_INFO, TI_LOG_WARN or TI_LOG_ERROR
+ * @param format  printf format, must stay valid until printed
+ * @param arg1..arg6  int arguments of the format
+ *
+ * @return OK if queued, suppressed or printed, ERROR if the queue was full
+ */
+int
+tiLogMsgLevel(int level, const char *format, int arg1, int arg2, int arg3,
+	      int arg4, int arg5, int arg6)
+{
+  struct timespec now;
+  tiLogId *m = NULL;
+  tiLogEntry *e;
+  uint64_t pos, seq;
+  int64_t diff, window;
+  int id;
+
+  if(format == NULL)
+    return ERROR;
+
+  if(!lgRunning)
+    {
+      logMsg(format, arg1, arg2, arg3, arg4, arg5, arg6);
+      return OK;
+    }
+
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  id = tiLogFindId(format);
+  if(id >= 0)
+    {
+      m = &lgId[id];
+      __atomic_fetch_add(&m->count, 1, __ATOMIC_RELAXED);
+
+      __atomic_store_n(&m->level, level, __ATOMIC_RELAXED);
+
+      if(level < lgLevel)
+	{
+	  __atomic_fetch_add(&m->suppressed, 1, __ATOMIC_RELAXED);
+	  return OK;
+	}
+
+      window = __atomic_load_n(&m->window, __ATOMIC_RELAXED);
+      if((window != now.tv_sec) &&
+	 __atomic_compare_exchange_n(&m->window, &window, (int64_t)now.tv_sec, 0,
+				     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	__atomic_store_n(&m->inWindow, 0, __ATOMIC_RELAXED);
+
+      if(__atomic_fetch_add(&m->inWindow, 1, __ATOMIC_RELAXED) >= (uint32_t)lgRateLimit)
+	{
+	  __atomic_fetch_add(&m->suppressed, 1, __ATOMIC_RELAXED);
+	  return OK;
+	}
+    }
+
+  /* Claim a slot */
+  pos = __atomic_load_n(&lgEnqueue, __ATOMIC_RELAXED);
+  for(;;)
+    {
+      e = &lgQueue[pos & (TI_LOG_QUEUE - 1)];
+      seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+      diff = (int64_t)seq - (int64_t)pos;
+      if(diff == 0)
+	{
+	  if(__atomic_compare_exchange_n(&lgEnqueue, &pos, pos + 1, 1,
+					 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	    break;
+	}
+      else if(diff < 0)
+	{
+	  if(m)
+	    __atomic_fetch_add(&m->dropped, 1, __ATOMIC_RELAXED);
+	  return ERROR;
+	}
+      else
+	pos = __atomic_load_n(&lgEnqueue, __ATOMIC_RELAXED);
+    }
+
+  e->format = format;
+  e->id     = id;
+  e->level  = level;
+  e->arg[0] = arg1;
+  e->arg[1] = arg2;
+  e->arg[2] = arg3;
+  e->arg[3] = arg4;
+  e->arg[4] = arg5;
+  e->arg[5] = arg6;
+  e->time   = now.tv_sec + 1e-9 * now.tv_nsec;
+  __atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+
+  /* Wake the drain thread, if it waits (see tiLogWait) */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&lgWaiting, __ATOMIC_RELAXED) &&
+     __atomic_exchange_n(&lgWaiting, 0, __ATOMIC_RELAXED))
+    tiLogWake();
+
+  return OK;
+}
+
+/**
+ * @ingroup Log
+ * @brief Log a message, with the vxWorks logMsg arguments, as TI_LOG_INFO.
+ *   Does not block.
+ *
+ * @param format  printf format, must stay valid until printed
+ * @param arg1..arg6  int arguments of the format
+ *
+ * @return OK if queued, suppressed or printed, ERROR if the queue was full
+ */
+int
+tiLogMsg(const char *format, int arg1, int arg2, int arg3,
+	 int arg4, int arg5, int arg6)
+{
+  return tiLogMsgLevel(TI_LOG_INFO, format, arg1, arg2, arg3, arg4, arg5, arg6);
+}
+
+static void
+tiLogOutput(int level, int id, double time, const char *msg)
+{
+  if(lgSink)
+    (*lgSink) (level, id, time, msg);
+  else
+    fputs(msg, stdout);
+}
+
+/* Print the queued messages.  Returns the number printed */
+static int
+tiLogDrain()
+{
+  char msg[TI_LOG_MSGLEN];
+  tiLogEntry *e;
+  uint64_t pos;
+  int n = 0;
+
+  for(;;)
+    {
+      pos = lgDequeue;
+      e = &lgQueue[pos & (TI_LOG_QUEUE - 1)];
+      if(__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != pos + 1)
+	break;
+
+      snprintf(msg, sizeof(msg), e->format, e->arg[0], e->arg[1], e->arg[2],
+	       e->arg[3], e->arg[4], e->arg[5]);
+
+      if(e->id >= 0)
+	__atomic_fetch_add(&lgId[e->id].printed, 1, __ATOMIC_RELAXED);
+      tiLogOutput(e->level, e->id, e->time, msg);
+
+      __atomic_store_n(&e->seq, pos + TI_LOG_QUEUE, __ATOMIC_RELEASE);
+      __atomic_store_n(&lgDequeue, pos + 1, __ATOMIC_RELEASE);
+      n++;
+    }
+
+  if(n && (lgSink == NULL))
+    fflush(stdout);
+
+  return n;
+}
+
+/* Wait for a message to be queued, or the timeout.  lgWaiting is set
+   before checking the queue, and a message is published before
+   checking lgWaiting: one of the two sides sees the other. */
+static void
+tiLogWait(int timeout_ms)
+{
+  struct pollfd pfd;
+  uint64_t count;
+
+  __atomic_store_n(&lgWaiting, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  if((__atomic_load_n(&lgQueue[lgDequeue & (TI_LOG_QUEUE - 1)].seq,
+		      __ATOMIC_ACQUIRE) != lgDequeue + 1) && !lgThreadStop)
+    {
+      pfd.fd = lgEventFd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      poll(&pfd, 1, timeout_ms);
+    }
+
+  __atomic_store_n(&lgWaiting, 0, __ATOMIC_RELAXED);
+  if(read(lgEventFd, &count, sizeof(count)) < 0)
+    return;
+}
+
+/* Report the messages of each ID suppressed or dropped since the last report */
+static void
+tiLogReport()
+{
+  char msg[TI_LOG_MSGLEN], first[64];
+  struct timespec now;
+  uint64_t suppressed, dropped, lost;
+  int iid, ichar;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  for(iid = 0; iid < TI_LOG_NIDS; iid++)
+    {
+      tiLogId *m = &lgId[iid];
+
+      if(__atomic_load_n(&m->format, __ATOMIC_ACQUIRE) == NULL)
+	continue;
+      /* Below the level is not worth a report */
+      if(__atomic_load_n(&m->level, __ATOMIC_RELAXED) < lgLevel)
+	continue;
+
+      suppressed = __atomic_load_n(&m->suppressed, __ATOMIC_RELAXED);
+      dropped    = __atomic_load_n(&m->dropped, __ATOMIC_RELAXED);
+      lost = suppressed + dropped - m->reported;
+      if(lost == 0)
+	continue;
+      m->reported = suppressed + dropped;
+
+      /* First line of the format, without the leading newline */
+      for(ichar = 0; (m->format[ichar] == '\n'); ichar++)
+	;
+      strncpy(first, &m->format[ichar], sizeof(first) - 1);
+      first[sizeof(first) - 1] = 0;
+      first[strcspn(first, "\n")] = 0;
+
+      snprintf(msg, sizeof(msg), "tiLog: WARN: %llu messages not printed: \"%s\"\n",
+	       (unsigned long long)lost, first);
+      tiLogOutput(TI_LOG_WARN, iid, now.tv_sec + 1e-9 * now.tv_nsec, msg);
+    }
+}
+
+static void *
+tiLogThread(void *arg)
+{
+  struct timespec now;
+  time_t lastReport = 0;
+
+  prctl(PR_SET_NAME, "tiLog");
+  while(1)
+    {
+      if((tiLogDrain() == 0) && lgThreadStop)
+	break;
+
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if(now.tv_sec != lastReport)
+	{
+	  tiLogReport();
+	  lastReport = now.tv_sec;
+	}
+
+      /* Until the next report */
+      if(!lgThreadStop)
+	tiLogWait(1000 - now.tv_nsec / 1000000);
+    }
+
+  tiLogReport();
+  if(lgSink == NULL)
+    fflush(stdout);
+
+  return NULL;
+}
+
+static void
+tiLogAtExit()
+{
+  tiLogStop();
+}
+
+/**
+ * @ingroup Log
+ * @brief Start queueing messages, printed by the drain thread.  Not
+ *   called by tiInit: until then, messages go to logMsg when logged.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiLogStart()
+{
+  int status, ientry;
+
+  if(lgRunning)
+    return OK;
+
+  if(lgEventFd < 0)
+    {
+      lgEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if(lgEventFd < 0)
+	{
+	  perror("eventfd");
+	  printf("%s: ERROR: Unable to create the drain thread eventfd\n", __func__);
+	  return ERROR;
+	}
+    }
+
+  for(ientry = 0; ientry < TI_LOG_QUEUE; ientry++)
+    lgQueue[ientry].seq = ientry;
+  lgEnqueue = 0;
+  lgDequeue = 0;
+
+  lgThreadStop = 0;
+  status = pthread_create(&lgThread, NULL, tiLogThread, NULL);
+  if(status != 0)
+    {
+      printf("%s: ERROR: Unable to start drain thread (%d)\n", __func__, status);
+      return ERROR;
+    }
+
+  if(!lgAtExit)
+    {
+      atexit(tiLogAtExit);
+      lgAtExit = 1;
+    }
+
+  __atomic_store_n(&lgRunning, 1, __ATOMIC_RELEASE);
+
+  return OK;
+}
+
+/**
+ * @ingroup Log
+ * @brief Print what is queued and stop the drain thread.  Messages are
+ *   then printed when logged.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiLogStop()
+{
+  if(!lgRunning)
+    return OK;
+
+  /* Messages logged from here on are printed directly */
+  __atomic_store_n(&lgRunning, 0, __ATOMIC_RELEASE);
+  lgThreadStop = 1;
+  tiLogWake();
+  pthread_join(lgThread, NULL);
+
+  return OK;
+}
+
+/**
+ * @ingroup Log
+ * @brief Wait until the messages queued so far are printed
+ *
+ * @param timeout_ms  Maximum time to wait (ms)
+ *
+ * @return OK if the queue was drained, otherwise ERROR
+ */
+int
+tiLogFlush(int timeout_ms)
+{
+  struct timespec wait = {0, 1000000};
+  uint64_t target;
+  int ims;
+
+  if(!lgRunning)
+    return OK;
+
+  target = __atomic_load_n(&lgEnqueue, __ATOMIC_ACQUIRE);
+  for(ims = 0; ims <= timeout_ms; ims++)
+    {
+      if(__atomic_load_n(&lgDequeue, __ATOMIC_ACQUIRE) >= target)
+	return OK;
+      nanosleep(&wait, NULL);
+    }
+
+  return ERROR;
+}
+
+/**
+ * @ingroup Log
+ * @brief Set the lowest severity that is printed
+ *
+ * @param level TI_LOG_DEBUG, TI_LOG_INFO, TI_LOG_WARN or TI_LOG_ERROR
+ */
+void
+tiLogSetLevel(int level)
+{
+  lgLevel = level;
+}
+
+/**
+ * @ingroup Log
+ * @brief Set the number of messages of each ID printed per second
+ *
+ * @param perSecond  Limit, the rest are counted as suppressed
+ */
+void
+tiLogSetRateLimit(int perSecond)
+{
+  lgRateLimit = (perSecond < 0) ? 0 : perSecond;
+}
+
+/**
+ * @ingroup Log
+ * @brief Send the messages to a routine instead of stdout.  Called by the
+ *   drain thread.
+ *
+ * @param sink  Routine, NULL for stdout
+ */
+void
+tiLogSetSink(TILOGSINK sink)
+{
+  lgSink = sink;
+}
+
+/**
+ * @ingroup Log
+ * @brief Copy the counters of each message ID
+ *
+ * @param stats   Where to store the counters
+ * @param maxids  Number of elements of stats
+ *
+ * @return Number of message IDs copied
+ */
+int
+tiLogGetStats(tiLogStats *stats, int maxids)
+{
+  int iid, nids = 0;
+
+  if(stats == NULL)
+    {
+      printf("%s: ERROR: Invalid destination\n", __func__);
+      return ERROR;
+    }
+
+  for(iid = 0; (iid < TI_LOG_NIDS) && (nids < maxids); iid++)
+    {
+      tiLogId *m = &lgId[iid];
+
+      stats[nids].format = __atomic_load_n(&m->format, __ATOMIC_ACQUIRE);
+      if(stats[nids].format == NULL)
+	continue;
+
+      stats[nids].level      = __atomic_load_n(&m->level, __ATOMIC_RELAXED);
+      stats[nids].count      = __atomic_load_n(&m->count, __ATOMIC_RELAXED);
+      stats[nids].printed    = __atomic_load_n(&m->printed, __ATOMIC_RELAXED);
+      stats[nids].suppressed = __atomic_load_n(&m->suppressed, __ATOMIC_RELAXED);
+      stats[nids].dropped    = __atomic_load_n(&m->dropped, __ATOMIC_RELAXED);
+      nids++;
+    }
+
+  return nids;
+}
+
+/**
+ * @ingroup Log
+ * @brief Print the counters of each message ID to standard out
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiLogPrintStats()
+{
+  static tiLogStats stats[TI_LOG_NIDS];
+  char first[48];
+  int nids, iid, ichar;
+
+  nids = tiLogGetStats(stats, TI_LOG_NIDS);
+
+  printf("\n");
+  printf("TI Log Messages (%s)\n", lgRunning ? "queued" : "printed when logged");
+  printf("--------------------------------------------------------------------------------\n");
+  printf("Level     Count   Printed Suppressed Dropped  Message\n");
+  for(iid = 0; iid < nids; iid++)
+    {
+      for(ichar = 0; (stats[iid].format[ichar] == '\n'); ichar++)
+	;
+      strncpy(first, &stats[iid].format[ichar], sizeof(first) - 1);
+      first[sizeof(first) - 1] = 0;
+      first[strcspn(first, "\n")] = 0;
+
+      printf("%-5s %9llu %9llu %10llu %7llu  %s\n",
+	     lgLevelName[stats[iid].level & 0x3],
+	     (unsigned long long)stats[iid].count,
+	     (unsigned long long)stats[iid].printed,
+	     (unsigned long long)stats[iid].suppressed,
+	     (unsigned long long)stats[iid].dropped, first);
+    }
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n");
+
+  return OK;
+}
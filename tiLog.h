@@ -0,0 +1,58 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Non-blocking logging for the readout path (Linux): the logMsg
+ *     messages of tiLib.  The printf status and configuration output is
+ *     not queued.  tiLogMsgLevel has the vxWorks logMsg calling
+ *     convention, after the severity: the format is kept by pointer and
+ *     formatted later, by a drain thread, with its six int arguments.
+ *     Each format (call site) is a message ID with counters and a per
+ *     second rate limit.  tiInit does not start the drain thread: until
+ *     tiLogStart, messages go to logMsg when logged.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define TI_LOG_QUEUE    4096   /* queued messages, power of 2 */
+#define TI_LOG_NIDS      256   /* distinct message IDs (formats) */
+#define TI_LOG_MSGLEN    256   /* formatted message length */
+
+/* Severity levels */
+#define TI_LOG_DEBUG     0
+#define TI_LOG_INFO      1
+#define TI_LOG_WARN      2
+#define TI_LOG_ERROR     3
+
+/* Message ID counters */
+typedef struct tiLogStats
+{
+  const char *format;
+  int         level;        /* of the last message */
+  uint64_t    count;        /* logged */
+  uint64_t    printed;      /* passed to the sink */
+  uint64_t    suppressed;   /* over the rate limit, or below the level */
+  uint64_t    dropped;      /* queue full */
+} tiLogStats;
+
+/* Output of the drain thread.  time: CLOCK_REALTIME when logged (s) */
+typedef void (*TILOGSINK)(int level, int id, double time, const char *msg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int  tiLogMsgLevel(int level, const char *format, int arg1, int arg2, int arg3,
+		     int arg4, int arg5, int arg6);
+  int  tiLogMsg(const char *format, int arg1, int arg2, int arg3,
+		int arg4, int arg5, int arg6);
+  int  tiLogStart();
+  int  tiLogStop();
+  int  tiLogFlush(int timeout_ms);
+  void tiLogSetLevel(int level);
+  void tiLogSetRateLimit(int perSecond);
+  void tiLogSetSink(TILOGSINK sink);
+  int  tiLogGetStats(tiLogStats *stats, int maxids);
+  int  tiLogPrintStats();
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,570 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     OpenMetrics text exporter for the TI.
+ *
+ *     tiMetricsUpdate reads the TI once (scalers latched together with the
+ *     busy counters, block status, fiber masks) along with the library
+ *     counters, and renders the text exposition.  Readers only ever get
+ *     that rendered text: tiMetricsRender copies it, tiMetricsWriteFile
+ *     writes it (to a temporary file, renamed into place, for the node
+ *     exporter textfile collector), and the thread from tiMetricsStart
+ *     serves it to every connection on a UNIX socket, e.g.
+ *       socat - UNIX-CONNECT:/tmp/ti.metrics
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiMetrics.h"
+
+/**
+ * @defgroup Metrics OpenMetrics Exporter
+ *   Cached TI counters in the OpenMetrics text format.
+ */
+
+static pthread_mutex_t mtMutex = PTHREAD_MUTEX_INITIALIZER;
+#define MTLOCK     if(pthread_mutex_lock(&mtMutex)<0) perror("pthread_mutex_lock");
+#define MTUNLOCK   if(pthread_mutex_unlock(&mtMutex)<0) perror("pthread_mutex_unlock");
+
+#define TI_TIMER_PERIOD  7.68e-6   /* live/busy timer unit, s */
+
+/* One read of the TI and library counters */
+typedef struct
+{
+  double         time;          /* CLOCK_REALTIME, s */
+  int            crateID;
+  int            slot;
+  int            firmware;
+  uint32_t       livetime;
+  uint32_t       busytime;
+  uint32_t       busy[16];      /* indexed as the busysrc of tiGetBusyCounter */
+  unsigned int   scaler[12];    /* from tiReadScalers */
+  int            blockLevel;
+  int            bufferLevel;
+  unsigned int   blockStatus[9];
+  int            slaveMask;
+  int            fiberConnected;
+  int            fiberTrigSrc;
+  unsigned int   evType[8];     /* from tiGetEvTypeScalers */
+  uint32_t       intCount;
+  uint32_t       ackCount;
+  tiLatencyStats latency[TI_LATENCY_NSTAGES];
+} tiMetricsSnapshot;
+
+static tiMetricsSnapshot mtSnap, mtPrev;
+static int  mtHavePrev = 0;
+static char mtText[TI_METRICS_TEXT_SIZE];
+static int  mtTextLen = 0;
+
+static pthread_t mtThread;
+static int       mtThreadRunning = 0;
+static volatile int mtThreadStop = 0;
+static int       mtThreadPeriod = 0;   /* ms */
+static char      mtFilename[256];
+static char      mtSocketPath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static int       mtListenFd = -1;
+
+static const char *mtBusyName[16] =
+  {
+    "swa", "swb", "p2", "fp_ftdc", "fp_fadc", "fp", NULL, "loopback",
+    "fiber1", "fiber2", "fiber3", "fiber4", "fiber5", "fiber6", "fiber7", "fiber8"
+  };
+
+static const char *mtStageName[TI_LATENCY_NSTAGES] =
+  {
+    "ready_to_routine", "routine", "dma", "routine_to_ack"
+  };
+
+static int
+tiMetricsRead(tiMetricsSnapshot *s)
+{
+  struct timespec now;
+
+  memset(s, 0, sizeof(tiMetricsSnapshot));
+  clock_gettime(CLOCK_REALTIME, &now);
+  s->time = now.tv_sec + 1e-9 * now.tv_nsec;
+
+  /* Latch once, the TS scalers are read back from the same latch */
+  if(tiGetBusyScalers(&s->livetime, &s->busytime, s->busy) != OK)
+    return ERROR;
+  if(tiReadScalers(s->scaler, 0) == ERROR)
+    return ERROR;
+  if(tiBlockStatusAll(s->blockStatus) != OK)
+    return ERROR;
+
+  s->crateID     = tiGetCrateID(0);
+  s->slot        = tiGetGeoAddress();
+  s->firmware    = tiGetFirmwareVersion();
+  s->blockLevel  = tiGetCurrentBlockLevel();
+  s->bufferLevel = tiGetBlockBufferLevel();
+
+  /* Slaves are only added on the TI Master, which has the fiber masks */
+  s->slaveMask = tiGetSlaveMask();
+  if(s->slaveMask > 0)
+    {
+      s->fiberConnected = tiGetConnectedFiberMask();
+      s->fiberTrigSrc   = tiGetTrigSrcEnabledFiberMask();
+    }
+
+  tiGetEvTypeScalers(s->evType, 8);
+  s->intCount = tiGetIntCount();
+  s->ackCount = tiGetAckCount();
+  tiGetLatencyStats(s->latency);
+
+  return OK;
+}
+
+static void
+mtAppend(int *len, const char *fmt, ...)
+{
+  va_list args;
+  int n;
+
+  if(*len >= TI_METRICS_TEXT_SIZE)
+    return;
+
+  va_start(args, fmt);
+  n = vsnprintf(&mtText[*len], TI_METRICS_TEXT_SIZE - *len, fmt, args);
+  va_end(args);
+
+  if(n > 0)
+    *len += n;
+}
+
+static void
+mtFamily(int *len, const char *name, const char *type, const char *help)
+{
+  mtAppend(len, "# TYPE %s %s\n", name, type);
+  mtAppend(len, "# HELP %s %s\n", name, help);
+}
+
+/* Render mtSnap (and the live fraction since mtPrev) into mtText */
+static void
+tiMetricsFormat(int up)
+{
+  tiMetricsSnapshot *s = &mtSnap;
+  uint32_t dlive, dbusy;
+  int len = 0, isrc, iport, iinp, istage;
+  static const char *quantile[4] = { "0.5", "0.9", "0.99", "0.999" };
+
+  mtFamily(&len, "ti_up", "gauge", "1 if the last snapshot of the TI succeeded");
+  mtAppend(&len, "ti_up %d\n", up);
+  mtFamily(&len, "ti_snapshot_timestamp_seconds", "gauge", "Time of the last snapshot");
+  mtAppend(&len, "ti_snapshot_timestamp_seconds %.3f\n", s->time);
+  if(!up)
+    goto done;
+
+  mtFamily(&len, "ti_info", "gauge", "TI identification");
+  mtAppend(&len, "ti_info{crate=\"%d\",slot=\"%d\",firmware=\"0x%x\"} 1\n",
+	   s->crateID, s->slot, s->firmware);
+
+  mtFamily(&len, "ti_live_seconds", "counter", "Live timer");
+  mtAppend(&len, "ti_live_seconds_total %.6f\n", s->livetime * TI_TIMER_PERIOD);
+  mtFamily(&len, "ti_busy_seconds", "counter", "Busy timer");
+  mtAppend(&len, "ti_busy_seconds_total %.6f\n", s->busytime * TI_TIMER_PERIOD);
+  if(mtHavePrev)
+    {
+      dlive = s->livetime - mtPrev.livetime;
+      dbusy = s->busytime - mtPrev.busytime;
+      if(dlive + dbusy > 0)
+	{
+	  mtFamily(&len, "ti_live_fraction", "gauge", "Live fraction since the previous snapshot");
+	  mtAppend(&len, "ti_live_fraction %.6f\n", (double)dlive / (double)(dlive + dbusy));
+	}
+    }
+
+  mtFamily(&len, "ti_busy_source", "counter", "BUSY counter of each busy source");
+  for(isrc = 0; isrc < 16; isrc++)
+    {
+      if(mtBusyName[isrc] == NULL)
+	continue;
+      mtAppend(&len, "ti_busy_source_total{source=\"%s\"} %u\n", mtBusyName[isrc], s->busy[isrc]);
+    }
+
+  mtFamily(&len, "ti_ts_input_triggers", "counter", "TS input scalers");
+  for(iinp = 0; iinp < 6; iinp++)
+    mtAppend(&len, "ti_ts_input_triggers_total{input=\"%d\"} %u\n", iinp + 1, s->scaler[2 + iinp]);
+  mtFamily(&len, "ti_triggers", "counter", "Triggers from all sources");
+  mtAppend(&len, "ti_triggers_total %u\n", s->scaler[8]);
+  mtFamily(&len, "ti_events", "counter", "Accepted events");
+  mtAppend(&len, "ti_events_total %llu\n",
+	   ((unsigned long long)s->scaler[9] << 32) | s->scaler[10]);
+
+  mtFamily(&len, "ti_block_level", "gauge", "Current block level");
+  mtAppend(&len, "ti_block_level %d\n", s->blockLevel);
+  mtFamily(&len, "ti_block_buffer_level", "gauge", "Block buffer level");
+  mtAppend(&len, "ti_block_buffer_level %d\n", s->bufferLevel);
+
+  mtFamily(&len, "ti_blocks_ready", "gauge", "Blocks ready, loopback and fiber ports");
+  for(iport = 0; iport < 9; iport++)
+    mtAppend(&len, "ti_blocks_ready{port=\"%s\"} %u\n", mtBusyName[7 + iport],
+	     s->blockStatus[iport] & TI_BLOCKSTATUS_NBLOCKS_READY0);
+  mtFamily(&len, "ti_blocks_need_ack", "gauge", "Blocks needing acknowledge, loopback and fiber ports");
+  for(iport = 0; iport < 9; iport++)
+    mtAppend(&len, "ti_blocks_need_ack{port=\"%s\"} %u\n", mtBusyName[7 + iport],
+	     (s->blockStatus[iport] & TI_BLOCKSTATUS_NBLOCKS_NEEDACK0) >> 8);
+
+  if(s->slaveMask > 0)
+    {
+      mtFamily(&len, "ti_fiber_slave", "gauge", "1 if the fiber port has an added TI Slave");
+      for(iport = 0; iport < 8; iport++)
+	mtAppend(&len, "ti_fiber_slave{fiber=\"%d\"} %d\n", iport + 1, (s->slaveMask >> iport) & 1);
+      mtFamily(&len, "ti_fiber_connected", "gauge", "1 if the fiber port reports connected");
+      for(iport = 0; iport < 8; iport++)
+	mtAppend(&len, "ti_fiber_connected{fiber=\"%d\"} %d\n", iport + 1,
+		 (s->fiberConnected >= 0) ? (s->fiberConnected >> iport) & 1 : 0);
+      mtFamily(&len, "ti_fiber_trigger_enabled", "gauge",
+	       "1 if the fiber port has its trigger source enabled");
+      for(iport = 0; iport < 8; iport++)
+	mtAppend(&len, "ti_fiber_trigger_enabled{fiber=\"%d\"} %d\n", iport + 1,
+		 (s->fiberTrigSrc >= 0) ? (s->fiberTrigSrc >> iport) & 1 : 0);
+    }
+
+  mtFamily(&len, "ti_event_type_events", "counter", "Event type scalers, by TS input bit");
+  for(iinp = 0; iinp < 6; iinp++)
+    mtAppend(&len, "ti_event_type_events_total{input=\"%d\"} %u\n", iinp + 1, s->evType[iinp]);
+  mtFamily(&len, "ti_event_type_overflow", "counter", "Event types outside of the TS input bits");
+  mtAppend(&len, "ti_event_type_overflow_total %u\n", s->evType[6]);
+  mtFamily(&len, "ti_event_type_scanned", "counter", "Events scanned for the event type scalers");
+  mtAppend(&len, "ti_event_type_scanned_total %u\n", s->evType[7]);
+
+  mtFamily(&len, "ti_readouts", "counter", "Readouts (interrupts or polls with blocks ready)");
+  mtAppend(&len, "ti_readouts_total %u\n", s->intCount);
+  mtFamily(&len, "ti_acks", "counter", "Readout acknowledges");
+  mtAppend(&len, "ti_acks_total %u\n", s->ackCount);
+
+  mtFamily(&len, "ti_readout_latency_seconds", "summary", "Readout latency of each stage");
+  for(istage = 0; istage < TI_LATENCY_NSTAGES; istage++)
+    {
+      tiLatencyStats *st = &s->latency[istage];
+      double value[4] = { st->p50, st->p90, st->p99, st->p999 };
+      int iq;
+
+      for(iq = 0; iq < 4; iq++)
+	mtAppend(&len, "ti_readout_latency_seconds{stage=\"%s\",quantile=\"%s\"} %.9f\n",
+		 mtStageName[istage], quantile[iq], value[iq] * 1e-9);
+      mtAppend(&len, "ti_readout_latency_seconds_sum{stage=\"%s\"} %.9f\n",
+	       mtStageName[istage], st->mean * st->count * 1e-9);
+      mtAppend(&len, "ti_readout_latency_seconds_count{stage=\"%s\"} %llu\n",
+	       mtStageName[istage], st->count);
+    }
+
+ done:
+  mtAppend(&len, "# EOF\n");
+
+  if(len >= TI_METRICS_TEXT_SIZE)
+    {
+      printf("%s: ERROR: Text truncated at %d bytes\n", __func__, TI_METRICS_TEXT_SIZE);
+      len = TI_METRICS_TEXT_SIZE - 1;
+    }
+  mtTextLen = len;
+}
+
+/**
+ * @ingroup Metrics
+ * @brief Take a snapshot of the TI and library counters, and render it.
+ *   This is the only routine of the exporter that accesses the TI.
+ *
+ * @return OK if successful, otherwise ERROR (the rendered text then has ti_up 0)
+ */
+int
+tiMetricsUpdate()
+{
+  tiMetricsSnapshot snap;
+  int rval;
+
+  rval = tiMetricsRead(&snap);
+
+  MTLOCK;
+  if(rval == OK)
+    {
+      if(mtSnap.time > 0)
+	{
+	  mtPrev = mtSnap;
+	  mtHavePrev = 1;
+	}
+      mtSnap = snap;
+    }
+  else
+    {
+      mtSnap.time = snap.time;
+      mtHavePrev = 0;
+    }
+  tiMetricsFormat(rval == OK);
+  MTUNLOCK;
+
+  return rval;
+}
+
+/**
+ * @ingroup Metrics
+ * @brief Copy the text rendered by the last tiMetricsUpdate
+ *
+ * @param text    Where to store the text, null terminated
+ * @param maxlen  Size of text (bytes)
+ *
+ * @return Length of the text, or ERROR if there is none yet or it does not fit
+ */
+int
+tiMetricsRender(char *text, int maxlen)
+{
+  int rval;
+
+  if(text == NULL)
+    {
+      printf("%s: ERROR: Invalid destination\n", __func__);
+      return ERROR;
+    }
+
+  MTLOCK;
+  rval = mtTextLen;
+  if((rval == 0) || (rval >= maxlen))
+    rval = ERROR;
+  else
+    {
+      memcpy(text, mtText, mtTextLen);
+      text[mtTextLen] = 0;
+    }
+  MTUNLOCK;
+
+  if(rval == ERROR)
+    printf("%s: ERROR: No text, or larger than %d bytes\n", __func__, maxlen);
+
+  return rval;
+}
+
+/**
+ * @ingroup Metrics
+ * @brief Write the text rendered by the last tiMetricsUpdate to a file.
+ *   Written to filename.tmp and renamed, so readers never see part of it.
+ *
+ * @param filename  Output file, e.g. in the node exporter textfile directory
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiMetricsWriteFile(const char *filename)
+{
+  char tmpname[300];
+  FILE *f;
+  int rval = OK;
+
+  if((filename == NULL) || (strlen(filename) >= sizeof(mtFilename)))
+    {
+      printf("%s: ERROR: Invalid filename\n", __func__);
+      return ERROR;
+    }
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+
+  f = fopen(tmpname, "w");
+  if(f == NULL)
+    {
+      printf("%s: ERROR: Unable to open %s: %s\n", __func__, tmpname, strerror(errno));
+      return ERROR;
+    }
+
+  MTLOCK;
+  if(fwrite(mtText, 1, mtTextLen, f) != (size_t)mtTextLen)
+    rval = ERROR;
+  MTUNLOCK;
+
+  if(fclose(f) != 0)
+    rval = ERROR;
+
+  if((rval == OK) && (rename(tmpname, filename) != 0))
+    rval = ERROR;
+
+  if(rval != OK)
+    {
+      printf("%s: ERROR: Unable to write %s: %s\n", __func__, filename, strerror(errno));
+      unlink(tmpname);
+    }
+
+  return rval;
+}
+
+static void
+tiMetricsServe(int fd)
+{
+  int sent = 0, n;
+
+  MTLOCK;
+  while(sent < mtTextLen)
+    {
+      n = send(fd, &mtText[sent], mtTextLen - sent, MSG_NOSIGNAL);
+      if(n <= 0)
+	break;
+      sent += n;
+    }
+  MTUNLOCK;
+
+  close(fd);
+}
+
+static void *
+tiMetricsThread(void *arg)
+{
+  struct timespec now, next;
+  struct pollfd pfd;
+  int wait_ms, fd;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while(!mtThreadStop)
+    {
+      tiMetricsUpdate();
+      if(mtFilename[0] != 0)
+	tiMetricsWriteFile(mtFilename);
+
+      next.tv_sec  += mtThreadPeriod / 1000;
+      next.tv_nsec += (mtThreadPeriod % 1000) * 1000000;
+      if(next.tv_nsec >= 1000000000)
+	{
+	  next.tv_sec++;
+	  next.tv_nsec -= 1000000000;
+	}
+
+      /* Serve the cached text until the next snapshot */
+      while(!mtThreadStop)
+	{
+	  clock_gettime(CLOCK_MONOTONIC, &now);
+	  wait_ms = (next.tv_sec - now.tv_sec) * 1000 + (next.tv_nsec - now.tv_nsec) / 1000000;
+	  if(wait_ms <= 0)
+	    break;
+	  if(wait_ms > 100)   /* check for stop */
+	    wait_ms = 100;
+
+	  pfd.fd = mtListenFd;
+	  pfd.events = POLLIN;
+	  pfd.revents = 0;
+	  if((poll(&pfd, (mtListenFd >= 0) ? 1 : 0, wait_ms) > 0) && (pfd.revents & POLLIN))
+	    {
+	      fd = accept(mtListenFd, NULL, NULL);
+	      if(fd >= 0)
+		tiMetricsServe(fd);
+	    }
+	}
+    }
+
+  return NULL;
+}
+
+/**
+ * @ingroup Metrics
+ * @brief Start the exporter thread.  Every period it updates the snapshot
+ *   and writes the file; in between it serves the text on the socket.
+ *
+ * @param period_ms   Time between snapshots (ms)
+ * @param filename    File to rewrite every period, NULL for none
+ * @param socketPath  UNIX socket to serve the text on, NULL for none
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiMetricsStart(int period_ms, const char *filename, const char *socketPath)
+{
+  struct sockaddr_un addr;
+  int status = 0;
+
+  if(period_ms <= 0)
+    {
+      printf("%s: ERROR: Invalid period (%d ms)\n", __func__, period_ms);
+      return ERROR;
+    }
+
+  if(((filename != NULL) && (strlen(filename) >= sizeof(mtFilename))) ||
+     ((socketPath != NULL) && (strlen(socketPath) >= sizeof(mtSocketPath))))
+    {
+      printf("%s: ERROR: Filename or socket path too long\n", __func__);
+      return ERROR;
+    }
+
+  if(mtThreadRunning)
+    {
+      printf("%s: ERROR: Exporter already running\n", __func__);
+      return ERROR;
+    }
+
+  mtFilename[0] = 0;
+  if(filename != NULL)
+    strcpy(mtFilename, filename);
+
+  mtSocketPath[0] = 0;
+  mtListenFd = -1;
+  if(socketPath != NULL)
+    {
+      strcpy(mtSocketPath, socketPath);
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      strcpy(addr.sun_path, mtSocketPath);
+
+      unlink(mtSocketPath);
+      mtListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if((mtListenFd < 0) ||
+	 (bind(mtListenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+	 (listen(mtListenFd, 8) != 0))
+	{
+	  printf("%s: ERROR: Unable to listen on %s: %s\n", __func__,
+		 mtSocketPath, strerror(errno));
+	  if(mtListenFd >= 0)
+	    close(mtListenFd);
+	  mtListenFd = -1;
+	  return ERROR;
+	}
+    }
+
+  mtThreadPeriod = period_ms;
+  mtThreadStop = 0;
+  status = pthread_create(&mtThread, NULL, tiMetricsThread, NULL);
+  if(status != 0)
+    {
+      printf("%s: ERROR: Unable to start exporter thread (%d)\n", __func__, status);
+      if(mtListenFd >= 0)
+	{
+	  close(mtListenFd);
+	  unlink(mtSocketPath);
+	  mtListenFd = -1;
+	}
+      return ERROR;
+    }
+  mtThreadRunning = 1;
+
+  return OK;
+}
+
+/**
+ * @ingroup Metrics
+ * @brief Stop the exporter thread and remove its socket
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiMetricsStop()
+{
+  if(!mtThreadRunning)
+    return OK;
+
+  mtThreadStop = 1;
+  pthread_join(mtThread, NULL);
+  mtThreadRunning = 0;
+
+  if(mtListenFd >= 0)
+    {
+      close(mtListenFd);
+      unlink(mtSocketPath);
+      mtListenFd = -1;
+    }
+
+  return OK;
+}
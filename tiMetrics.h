@@ -0,0 +1,26 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     OpenMetrics text exporter for the TI scalers, live and busy timers,
+ *     block counts, fiber status, event type scalers and library
+ *     counters.  Each interval takes one snapshot of the TI and renders
+ *     it once; the rendered text is written to a file and/or served on
+ *     a UNIX socket, so scraping causes no VME traffic.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define TI_METRICS_TEXT_SIZE  (64*1024)   /* rendered text, bytes */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int tiMetricsUpdate();
+  int tiMetricsRender(char *text, int maxlen);
+  int tiMetricsWriteFile(const char *filename);
+  int tiMetricsStart(int period_ms, const char *filename, const char *socketPath);
+  int tiMetricsStop();
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,358 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Rate scan with the TI internal pulser.
+ *
+ *     Each target rate is converted to the closest pulser setting:
+ *       fixed:  period 120ns + 30ns x period_inc (range 0)
+ *               or 120ns + 30ns x 2048 x period_inc (range 1)
+ *       random: 500MHz / 2^prescale
+ *     Range 0 stops at 1017Hz.  Below that the 61.44us steps of range 1
+ *     are coarse until about 650Hz (up to 3% off at 1kHz); the offered
+ *     rate of each step is recorded.
+ *     The pulser runs for the dwell time, and the accepted rate comes
+ *     from the event counter over the live and busy timer interval
+ *     (tiDeadTimeUpdate), with the busy source breakdown of that interval.
+ *
+ *     The fixed pulser counts at most 0xFFFF triggers, so it is restarted
+ *     before the count runs out during long dwells.
+ *
+ *     The TI must be running with the pulser as trigger source.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiRateScan.h"
+
+/**
+ * @defgroup RateScan Pulser Rate Scan
+ *   Throughput versus offered rate with the internal pulser.
+ */
+
+#define TI_RATESCAN_PERIOD_MIN   ((double)TI_FIXEDPULSER_PERIOD_MIN_NS)
+#define TI_RATESCAN_STEP_RANGE0  ((double)TI_FIXEDPULSER_STEP_NS)
+#define TI_RATESCAN_STEP_RANGE1							\
+  ((double)TI_FIXEDPULSER_STEP_NS * TI_FIXEDPULSER_RANGE1_FACTOR)    /* 61.44us */
+#define TI_RATESCAN_NEVENTS      TI_FIXEDPULSER1_NTRIGGERS_MASK
+#define TI_RATESCAN_RANDOM_MAX   500e6     /* Hz, random pulser with prescale 0 */
+
+static double
+tiRateScanNow()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+tiRateScanSleep(double seconds)
+{
+  struct timespec ts;
+
+  ts.tv_sec = (time_t)seconds;
+  ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+  nanosleep(&ts, NULL);
+}
+
+/**
+ * @ingroup RateScan
+ * @brief Closest fixed pulser setting to a rate
+ *
+ * @param rate        Requested rate (Hz)
+ * @param period_inc  Where to store the period multiplier for tiSoftTrig
+ * @param range       Where to store the period range for tiSoftTrig
+ * @param actual      If not NULL, where to store the rate of the setting (Hz)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiRateScanFixedSetting(double rate, unsigned int *period_inc, int *range, double *actual)
+{
+  const double step[2] = { TI_RATESCAN_STEP_RANGE0, TI_RATESCAN_STEP_RANGE1 };
+  unsigned int incMax = TI_FIXEDPULSER1_PERIOD_MASK >> 16;
+  double inc = 0, best = -1, diff = 0, r = 0;
+  int irange;
+
+  if((period_inc == NULL) || (range == NULL) || (rate <= 0))
+    {
+      printf("%s: ERROR: Invalid rate (%g Hz) or destination\n", __func__, rate);
+      return ERROR;
+    }
+
+  for(irange = 0; irange < 2; irange++)
+    {
+      inc = floor((1e9 / rate - TI_RATESCAN_PERIOD_MIN) / step[irange] + 0.5);
+      if(inc < 0)
+	inc = 0;
+      if(inc > incMax)
+	inc = incMax;
+
+      r = 1e9 / (TI_RATESCAN_PERIOD_MIN + inc * step[irange]);
+      diff = fabs(r - rate) / rate;
+      if((best < 0) || (diff < best))
+	{
+	  best = diff;
+	  *period_inc = (unsigned int)inc;
+	  *range = irange;
+	  if(actual)
+	    *actual = r;
+	}
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup RateScan
+ * @brief Closest random pulser setting to a rate (closest in ratio)
+ *
+ * @param rate      Requested mean rate (Hz)
+ * @param prescale  Where to store the prescale for tiSetRandomTrigger
+ * @param actual    If not NULL, where to store the rate of the setting (Hz)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiRateScanRandomSetting(double rate, int *prescale, double *actual)
+{
+  int ps = 0;
+
+  if((prescale == NULL) || (rate <= 0))
+    {
+      printf("%s: ERROR: Invalid rate (%g Hz) or destination\n", __func__, rate);
+      return ERROR;
+    }
+
+  ps = (int)floor(log2(TI_RATESCAN_RANDOM_MAX / rate) + 0.5);
+  if(ps < 0)
+    ps = 0;
+  if(ps > TI_RANDOMPULSER_TRIG1_RATE_MASK)
+    ps = TI_RANDOMPULSER_TRIG1_RATE_MASK;
+
+  *prescale = ps;
+  if(actual)
+    *actual = TI_RATESCAN_RANDOM_MAX / (double)(1 << ps);
+
+  return OK;
+}
+
+static void
+tiRateScanStop(int pulser)
+{
+  if(pulser == TI_RATESCAN_FIXED)
+    tiSoftTrig(1, 0, 0, 0);
+  else
+    tiDisableRandomTrigger();
+}
+
+/**
+ * @ingroup RateScan
+ * @brief Step the internal pulser (trig1) through a list of rates
+ *
+ * @param pulser    TI_RATESCAN_FIXED or TI_RATESCAN_RANDOM
+ * @param rates     Target rates (Hz)
+ * @param nrates    Number of rates
+ * @param dwell_ms  Time at each rate (ms)
+ * @param steps     Where to store the results, nrates entries
+ *
+ * @return Number of steps completed if successful, otherwise ERROR
+ */
+int
+tiRateScanRun(int pulser, const double *rates, int nrates, int dwell_ms,
+	      tiRateScanStep *steps)
+{
+  tiDeadTimeState state;
+  tiRateScanStep *step = NULL;
+  unsigned long long evt0 = 0, evt1 = 0;
+  double start = 0, now = 0, slice = 0, rearm = 0, wall = 0;
+  int32_t trigsrc = 0;
+  int istep;
+
+  if((rates == NULL) || (steps == NULL) || (nrates <= 0) || (dwell_ms <= 0))
+    {
+      printf("%s: ERROR: Invalid rates, steps or dwell time (%d ms)\n",
+	     __func__, dwell_ms);
+      return ERROR;
+    }
+
+  if((pulser != TI_RATESCAN_FIXED) && (pulser != TI_RATESCAN_RANDOM))
+    {
+      printf("%s: ERROR: Invalid pulser (%d)\n", __func__, pulser);
+      return ERROR;
+    }
+
+  trigsrc = tiGetTriggerSource();
+  if(trigsrc == ERROR)
+    return ERROR;
+  if((trigsrc != TI_TRIGGER_PULSER) && (trigsrc != TI_TRIGGER_TRIG21))
+    printf("%s: WARN: Trigger source (%d) is not the pulser\n", __func__, trigsrc);
+
+  for(istep = 0; istep < nrates; istep++)
+    {
+      step = &steps[istep];
+      memset((void *)step, 0, sizeof(tiRateScanStep));
+      step->target = rates[istep];
+
+      if(pulser == TI_RATESCAN_FIXED)
+	{
+	  if(tiRateScanFixedSetting(rates[istep], &step->period_inc, &step->range,
+				    &step->offered) != OK)
+	    break;
+	}
+      else
+	{
+	  if(tiRateScanRandomSetting(rates[istep], &step->prescale, &step->offered) != OK)
+	    break;
+	}
+
+      tiDeadTimeInit(&state);
+      tiDeadTimeUpdate(&state, &step->dt);
+      evt0 = tiGetEventCounter();
+      start = tiRateScanNow();
+
+      if(pulser == TI_RATESCAN_FIXED)
+	{
+	  if(tiSoftTrig(1, TI_RATESCAN_NEVENTS, step->period_inc, step->range) != OK)
+	    break;
+	  /* Restart when half of the count is used */
+	  rearm = 0.5 * TI_RATESCAN_NEVENTS / step->offered;
+	}
+      else
+	{
+	  if(tiSetRandomTrigger(1, step->prescale) != OK)
+	    break;
+	  rearm = dwell_ms * 1e-3;
+	}
+
+      while((now = tiRateScanNow() - start) < dwell_ms * 1e-3)
+	{
+	  slice = dwell_ms * 1e-3 - now;
+	  if(slice > rearm)
+	    slice = rearm;
+	  tiRateScanSleep(slice);
+
+	  if((pulser == TI_RATESCAN_FIXED) && (tiRateScanNow() - start < dwell_ms * 1e-3))
+	    tiSoftTrigRestart(1);
+	}
+
+      tiRateScanStop(pulser);
+      tiDeadTimeUpdate(&state, &step->dt);
+      evt1 = tiGetEventCounter();
+      wall = tiRateScanNow() - start;
+
+      if((evt0 == (unsigned long long)ERROR) || (evt1 == (unsigned long long)ERROR))
+	break;
+
+      if(step->dt.interval > 0)
+	step->accepted = (evt1 - evt0) / step->dt.interval;
+      else if(wall > 0)
+	step->accepted = (evt1 - evt0) / wall;
+
+      if(step->offered > 0)
+	step->throughput = step->accepted / step->offered;
+    }
+
+  tiRateScanStop(pulser);
+
+  return istep;
+}
+
+/**
+ * @ingroup RateScan
+ * @brief Print the throughput versus offered rate
+ *
+ * @param steps   Results from tiRateScanRun
+ * @param nsteps  Number of steps
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiRateScanPrint(const tiRateScanStep *steps, int nsteps)
+{
+  const tiRateScanStep *step = NULL;
+  int istep;
+
+  if(steps == NULL)
+    return ERROR;
+
+  printf("\n");
+  printf(" Rate Scan\n");
+  printf("--------------------------------------------------------------------------------\n");
+  printf("     Target      Offered     Accepted  Through   Live   Dead  Dominant busy\n");
+  printf("       (Hz)         (Hz)         (Hz)      (%%)    (%%)    (%%)\n");
+  printf("--------------------------------------------------------------------------------\n");
+
+  for(istep = 0; istep < nsteps; istep++)
+    {
+      step = &steps[istep];
+      printf("%11.1f  %11.1f  %11.1f  %6.2f  %5.1f  %5.1f  ",
+	     step->target, step->offered, step->accepted, 100. * step->throughput,
+	     100. * step->dt.live, 100. * step->dt.dead);
+      if(step->dt.dominant >= 0)
+	printf("%s (%.1f%%)\n", tiDeadTimeSourceName(step->dt.dominant),
+	       100. * step->dt.source[step->dt.dominant]);
+      else
+	printf("-\n");
+    }
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n");
+
+  return OK;
+}
+
+/**
+ * @ingroup RateScan
+ * @brief Write the throughput versus offered rate curve, as comma
+ *        separated values with a header line.
+ *
+ * @param filename  Output file
+ * @param steps     Results from tiRateScanRun
+ * @param nsteps    Number of steps
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiRateScanWrite(const char *filename, const tiRateScanStep *steps, int nsteps)
+{
+  const tiRateScanStep *step = NULL;
+  FILE *f = NULL;
+  int istep, isrc;
+
+  if((filename == NULL) || (steps == NULL))
+    return ERROR;
+
+  f = fopen(filename, "w");
+  if(f == NULL)
+    {
+      printf("%s: ERROR: Unable to open %s\n", __func__, filename);
+      return ERROR;
+    }
+
+  fprintf(f, "target,offered,accepted,throughput,live,dead,dominant");
+  for(isrc = 0; isrc < TI_DEADTIME_NSOURCES; isrc++)
+    if(isrc != 6)
+      fprintf(f, ",%s", tiDeadTimeSourceName(isrc));
+  fprintf(f, "\n");
+
+  for(istep = 0; istep < nsteps; istep++)
+    {
+      step = &steps[istep];
+      fprintf(f, "%.3f,%.3f,%.3f,%.5f,%.5f,%.5f,%s",
+	      step->target, step->offered, step->accepted, step->throughput,
+	      step->dt.live, step->dt.dead,
+	      (step->dt.dominant >= 0) ? tiDeadTimeSourceName(step->dt.dominant) : "");
+      for(isrc = 0; isrc < TI_DEADTIME_NSOURCES; isrc++)
+	if(isrc != 6)
+	  fprintf(f, ",%.5f", step->dt.source[isrc]);
+      fprintf(f, "\n");
+    }
+
+  fclose(f);
+
+  return OK;
+}
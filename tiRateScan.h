@@ -0,0 +1,39 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Rate scan with the TI internal pulser.  Steps the pulser through a
+ *     list of rates and records the accepted rate, live time and busy
+ *     sources at each step.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "tiDeadTime.h"
+
+#define TI_RATESCAN_FIXED   0   /* fixed period pulser (tiSoftTrig) */
+#define TI_RATESCAN_RANDOM  1   /* pseudo random pulser (tiSetRandomTrigger) */
+
+typedef struct tiRateScanStep
+{
+  double     target;      /* Hz, requested */
+  double     offered;     /* Hz, of the closest pulser setting */
+  uint32_t   period_inc;  /* fixed pulser setting */
+  int        range;
+  int        prescale;    /* random pulser setting */
+  double     accepted;    /* Hz, from the event counter */
+  double     throughput;  /* accepted / offered */
+  tiDeadTime dt;          /* live time and busy sources over the dwell */
+} tiRateScanStep;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int tiRateScanFixedSetting(double rate, unsigned int *period_inc, int *range, double *actual);
+  int tiRateScanRandomSetting(double rate, int *prescale, double *actual);
+  int tiRateScanRun(int pulser, const double *rates, int nrates, int dwell_ms,
+		    tiRateScanStep *steps);
+  int tiRateScanPrint(const tiRateScanStep *steps, int nsteps);
+  int tiRateScanWrite(const char *filename, const tiRateScanStep *steps, int nsteps);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,537 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Trigger rule (holdoff) model.
+ *
+ *     Rule k (1-4) rejects a trigger that arrives less than its period
+ *     after the k-th previous accepted trigger (no more than k triggers
+ *     within the period).  The minimum of rule k (2-4) is modelled as:
+ *     while k-1 accepted triggers are within the rule k period, the next
+ *     trigger must also be at least the minimum after the previous one.
+ *
+ *     The front end holds each accepted event until it has been read
+ *     out.  Events are read out one at a time, each taking readout_ns.
+ *     A trigger accepted while bufferDepth events are held is an
+ *     overflow.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiRuleSim.h"
+
+/**
+ * @defgroup RuleSim Trigger Rule Model
+ *   Offline model and optimizer of the trigger rules.
+ */
+
+/* Timestep sizes (ns) for each rule, from tiSetTriggerHoldoff */
+static const uint32_t tiRuleSimStep[3][TI_RULESIM_NRULES] =
+  {
+    {16, 16, 32, 64},
+    {480, 960, 1920, 3840},
+    {15360, 30720, 61440, 122880}
+  };
+
+/* Minimum step sizes (ns) for each rule, from tiSetTriggerHoldoffMin */
+static const uint32_t tiRuleSimMinStep[TI_RULESIM_NRULES] = {0, 16, 480, 480};
+
+/**
+ * @ingroup RuleSim
+ * @brief Return the period of a trigger rule setting
+ *
+ * @param rule      Rule (1-4)
+ * @param value     Register value (0-127)
+ * @param timestep  Timestep (0-2)
+ * @return Period in ns, 0 if the setting is invalid
+ */
+uint32_t
+tiRuleSimPeriod(int rule, int value, int timestep)
+{
+  if((rule < 1) || (rule > TI_RULESIM_NRULES) ||
+     (value < 0) || (value > TI_RULESIM_MAXVALUE) ||
+     (timestep < 0) || (timestep > 2))
+    return 0;
+
+  return value * tiRuleSimStep[timestep][rule - 1];
+}
+
+/**
+ * @ingroup RuleSim
+ * @brief Return the period of a trigger rule minimum setting
+ *
+ * @param rule   Rule (2-4)
+ * @param value  Register value (0-127)
+ * @return Minimum in ns, 0 if the setting is invalid
+ */
+uint32_t
+tiRuleSimMinPeriod(int rule, int value)
+{
+  if((rule < 2) || (rule > TI_RULESIM_NRULES) ||
+     (value < 0) || (value > TI_RULESIM_MAXVALUE))
+    return 0;
+
+  return value * tiRuleSimMinStep[rule - 1];
+}
+
+/**
+ * @ingroup RuleSim
+ * @brief Check that a rule set can be programmed.  Timesteps 1 and 2 share
+ *        the slow clock bit, so they cannot both be used.
+ *
+ * @return OK if valid, otherwise ERROR
+ */
+int
+tiRuleSimValidate(const tiRuleSet *rules)
+{
+  int irule, slow = 0;
+
+  if(rules == NULL)
+    return ERROR;
+
+  for(irule = 0; irule < TI_RULESIM_NRULES; irule++)
+    {
+      if((rules->value[irule] < 0) || (rules->value[irule] > TI_RULESIM_MAXVALUE) ||
+	 (rules->minValue[irule] < 0) || (rules->minValue[irule] > TI_RULESIM_MAXVALUE) ||
+	 (rules->timestep[irule] < 0) || (rules->timestep[irule] > 2))
+	{
+	  printf("%s: ERROR: Invalid setting for rule %d\n", __func__, irule + 1);
+	  return ERROR;
+	}
+
+      if(rules->timestep[irule] > 0)
+	{
+	  if((slow != 0) && (slow != rules->timestep[irule]))
+	    {
+	      printf("%s: ERROR: Timesteps 1 and 2 cannot be mixed\n", __func__);
+	      return ERROR;
+	    }
+	  slow = rules->timestep[irule];
+	}
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup RuleSim
+ * @brief Generate Poisson distributed trigger arrival times
+ *
+ * @param rate  Mean rate (Hz)
+ * @param n     Number of triggers
+ * @param seed  Random seed (0 uses a fixed default)
+ * @param t_ns  Array of n arrival times (ns) to fill
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiRuleSimPoisson(double rate, int n, uint32_t seed, uint64_t *t_ns)
+{
+  uint64_t x = seed ? seed : 0x9E3779B97F4A7C15ULL;
+  double t = 0, u = 0;
+  int i;
+
+  if((rate <= 0) || (n < 0) || (t_ns == NULL))
+    {
+      printf("%s: ERROR: Invalid rate (%g) or destination\n", __func__, rate);
+      return ERROR;
+    }
+
+  for(i = 0; i < n; i++)
+    {
+      /* xorshift64* */
+      x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+      u = ((x * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+
+      t += -log(1.0 - u) / rate * 1e9;
+      t_ns[i] = (uint64_t)t;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup RuleSim
+ * @brief Simulate a rule set on a sequence of trigger arrival times
+ *
+ * @param rules        Rule set
+ * @param t_ns         Arrival times (ns), in increasing order
+ * @param n            Number of arrival times
+ * @param bufferDepth  Front end buffer depth (events), 0: unlimited
+ * @param readout_ns   Front end readout time per event (ns)
+ * @param result       Where to store the result
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiRuleSimRun(const tiRuleSet *rules, const uint64_t *t_ns, int n,
+	     int bufferDepth, double readout_ns, tiRuleSimResult *result)
+{
+  uint64_t period[TI_RULESIM_NRULES], minPeriod[TI_RULESIM_NRULES];
+  uint64_t acc[TI_RULESIM_NRULES], t = 0;
+  double *held = NULL, lastDone = 0;
+  int irule, i, reject = 0, nheld = 0, head = 0;
+  uint64_t nacc = 0;
+
+  if((rules == NULL) || (t_ns == NULL) || (result == NULL) || (n < 0) ||
+     (bufferDepth < 0) || (readout_ns < 0))
+    {
+      printf("%s: ERROR: Invalid arguments\n", __func__);
+      return ERROR;
+    }
+
+  if(tiRuleSimValidate(rules) != OK)
+    return ERROR;
+
+  for(irule = 0; irule < TI_RULESIM_NRULES; irule++)
+    {
+      period[irule] = tiRuleSimPeriod(irule + 1, rules->value[irule],
+				      rules->timestep[irule]);
+      minPeriod[irule] = tiRuleSimMinPeriod(irule + 1, rules->minValue[irule]);
+      acc[irule] = 0;
+    }
+
+  held = (double *)malloc(TI_RULESIM_MAXHELD * sizeof(double));
+  if(held == NULL)
+    {
+      perror("malloc");
+      return ERROR;
+    }
+
+  memset((void *)result, 0, sizeof(tiRuleSimResult));
+
+  for(i = 0; i < n; i++)
+    {
+      t = t_ns[i];
+      reject = 0;
+
+      for(irule = 0; (irule < TI_RULESIM_NRULES) && !reject; irule++)
+	{
+	  /* k-th previous accepted trigger */
+	  if(period[irule] && (nacc > (uint64_t)irule) &&
+	     ((t - acc[(nacc - 1 - irule) % TI_RULESIM_NRULES]) < period[irule]))
+	    {
+	      result->rejected[irule]++;
+	      reject = 1;
+	    }
+	}
+
+      for(irule = 1; (irule < TI_RULESIM_NRULES) && !reject; irule++)
+	{
+	  /* (k-1)-th previous accepted trigger still inside the rule k period */
+	  if(minPeriod[irule] && period[irule] && (nacc >= (uint64_t)irule) &&
+	     ((t - acc[(nacc - irule) % TI_RULESIM_NRULES]) < period[irule]) &&
+	     ((t - acc[(nacc - 1) % TI_RULESIM_NRULES]) < minPeriod[irule]))
+	    {
+	      result->rejectedMin++;
+	      reject = 1;
+	    }
+	}
+
+      if(reject)
+	continue;
+
+      /* Accepted: release the events the front end has read out */
+      while((nheld > 0) && (held[head] <= (double)t))
+	{
+	  head = (head + 1) % TI_RULESIM_MAXHELD;
+	  nheld--;
+	}
+
+      if((bufferDepth > 0) && (nheld >= bufferDepth))
+	result->overflows++;
+
+      lastDone = ((lastDone > (double)t) ? lastDone : (double)t) + readout_ns;
+      if(nheld < TI_RULESIM_MAXHELD)
+	{
+	  held[(head + nheld) % TI_RULESIM_MAXHELD] = lastDone;
+	  nheld++;
+	}
+      if(nheld > result->maxOccupancy)
+	result->maxOccupancy = nheld;
+
+      acc[nacc % TI_RULESIM_NRULES] = t;
+      nacc++;
+    }
+  free(held);
+
+  result->offered = n;
+  result->accepted = nacc;
+  if(n > 1)
+    result->duration = (t_ns[n - 1] - t_ns[0]) * 1e-9;
+  if(result->duration > 0)
+    {
+      result->offeredRate = result->offered / result->duration;
+      result->acceptedRate = result->accepted / result->duration;
+    }
+  if(n > 0)
+    result->deadFraction = (double)(result->offered - result->accepted) / result->offered;
+
+  return OK;
+}
+
+/* Settings of one rule, sorted by period */
+typedef struct
+{
+  uint32_t period;
+  int      value;
+  int      timestep;
+} tiRuleSimCandidate;
+
+static int
+tiRuleSimCandidates(int rule, int slow, tiRuleSimCandidate *cand)
+{
+  int ncand = 0, value, ic, jc, ts[2] = {0, slow}, its;
+  tiRuleSimCandidate tmp;
+
+  for(its = 0; its < 2; its++)
+    {
+      for(value = 0; value <= TI_RULESIM_MAXVALUE; value++)
+	{
+	  cand[ncand].period = tiRuleSimPeriod(rule, value, ts[its]);
+	  cand[ncand].value = value;
+	  cand[ncand].timestep = (value == 0) ? 0 : ts[its];
+	  ncand++;
+	}
+    }
+
+  /* Insertion sort by period, timestep 0 first */
+  for(ic = 1; ic < ncand; ic++)
+    {
+      tmp = cand[ic];
+      for(jc = ic - 1; (jc >= 0) &&
+	    ((cand[jc].period > tmp.period) ||
+	     ((cand[jc].period == tmp.period) && (cand[jc].timestep > tmp.timestep))); jc--)
+	cand[jc + 1] = cand[jc];
+      cand[jc + 1] = tmp;
+    }
+
+  /* Remove duplicate periods */
+  for(ic = 1, jc = 0; ic < ncand; ic++)
+    {
+      if(cand[ic].period != cand[jc].period)
+	cand[++jc] = cand[ic];
+    }
+
+  return jc + 1;
+}
+
+/**
+ * @ingroup RuleSim
+ * @brief Search the rule settings for the highest accepted rate that does
+ *        not overflow the front end buffers.
+ *
+ *   For each choice of the slow clock, every rule starts at its longest
+ *   period and is then shortened, one rule at a time, to the shortest
+ *   period that still has no overflow, until no rule can be shortened.
+ *   Both rule orders (1 to 4 and 4 to 1) are tried.  Rule minimums are
+ *   left disabled.
+ *
+ * @param t_ns         Arrival times (ns), in increasing order
+ * @param n            Number of arrival times
+ * @param bufferDepth  Front end buffer depth (events)
+ * @param readout_ns   Front end readout time per event (ns)
+ * @param best         Where to store the best rule set
+ * @param result       If not NULL, where to store its result
+ * @return OK if a setting without overflow was found, otherwise ERROR
+ */
+int
+tiRuleSimOptimize(const uint64_t *t_ns, int n, int bufferDepth,
+		  double readout_ns, tiRuleSet *best, tiRuleSimResult *result)
+{
+  static tiRuleSimCandidate cand[TI_RULESIM_NRULES][2 * (TI_RULESIM_MAXVALUE + 1)];
+  int ncand[TI_RULESIM_NRULES], index[TI_RULESIM_NRULES];
+  tiRuleSet rules;
+  tiRuleSimResult res, bestres;
+  int slow, order, ipass, iorder, irule, changed, lo, hi, mid, found = 0;
+
+  if((t_ns == NULL) || (best == NULL) || (bufferDepth <= 0))
+    {
+      printf("%s: ERROR: Invalid arguments\n", __func__);
+      return ERROR;
+    }
+
+  memset((void *)&bestres, 0, sizeof(bestres));
+
+  for(slow = 1; slow <= 2; slow++)
+    {
+      for(irule = 0; irule < TI_RULESIM_NRULES; irule++)
+	ncand[irule] = tiRuleSimCandidates(irule + 1, slow, cand[irule]);
+
+      for(order = 0; order < 2; order++)
+	{
+	  memset((void *)&rules, 0, sizeof(rules));
+	  for(irule = 0; irule < TI_RULESIM_NRULES; irule++)
+	    {
+	      index[irule] = ncand[irule] - 1;
+	      rules.value[irule] = cand[irule][index[irule]].value;
+	      rules.timestep[irule] = cand[irule][index[irule]].timestep;
+	    }
+
+	  tiRuleSimRun(&rules, t_ns, n, bufferDepth, readout_ns, &res);
+	  if(res.overflows)
+	    continue;
+
+	  for(ipass = 0; ipass < 8; ipass++)
+	    {
+	      changed = 0;
+	      for(iorder = 0; iorder < TI_RULESIM_NRULES; iorder++)
+		{
+		  irule = (order == 0) ? iorder : (TI_RULESIM_NRULES - 1 - iorder);
+
+		  /* Shortest period without overflow; the current one has none */
+		  lo = 0; hi = index[irule];
+		  while(lo < hi)
+		    {
+		      mid = (lo + hi) / 2;
+		      rules.value[irule] = cand[irule][mid].value;
+		      rules.timestep[irule] = cand[irule][mid].timestep;
+		      tiRuleSimRun(&rules, t_ns, n, bufferDepth, readout_ns, &res);
+		      if(res.overflows == 0)
+			hi = mid;
+		      else
+			lo = mid + 1;
+		    }
+
+		  if(hi != index[irule])
+		    changed = 1;
+		  index[irule] = hi;
+		  rules.value[irule] = cand[irule][hi].value;
+		  rules.timestep[irule] = cand[irule][hi].timestep;
+		}
+
+	      if(!changed)
+		break;
+	    }
+
+	  tiRuleSimRun(&rules, t_ns, n, bufferDepth, readout_ns, &res);
+	  if((res.overflows == 0) && (!found || (res.accepted > bestres.accepted)))
+	    {
+	      *best = rules;
+	      bestres = res;
+	      found = 1;
+	    }
+	}
+    }
+
+  if(!found)
+    {
+      printf("%s: ERROR: No rule setting avoids front end overflow\n", __func__);
+      return ERROR;
+    }
+
+  if(result)
+    *result = bestres;
+
+  return OK;
+}
+
+/**
+ * @ingroup RuleSim
+ * @brief Read the rule set programmed in the TI
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiRuleSimRead(tiRuleSet *rules)
+{
+  int irule, raw = 0, slow = 0;
+
+  if(rules == NULL)
+    return ERROR;
+
+  slow = tiGetTriggerHoldoffClock();
+  if(slow == ERROR)
+    return ERROR;
+
+  memset((void *)rules, 0, sizeof(tiRuleSet));
+  for(irule = 0; irule < TI_RULESIM_NRULES; irule++)
+    {
+      raw = tiGetTriggerHoldoff(irule + 1);
+      if(raw == ERROR)
+	return ERROR;
+
+      rules->value[irule] = raw & TI_RULESIM_MAXVALUE;
+      if(raw & (1<<7))
+	rules->timestep[irule] = slow ? 2 : 1;
+
+      if(irule > 0)
+	{
+	  raw = tiGetTriggerHoldoffMin(irule + 1, 0);
+	  if(raw == ERROR)
+	    return ERROR;
+	  if(raw & (1<<7))
+	    rules->minValue[irule] = raw & TI_RULESIM_MAXVALUE;
+	}
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup RuleSim
+ * @brief Program a rule set into the TI
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiRuleSimApply(const tiRuleSet *rules)
+{
+  int irule;
+
+  if(tiRuleSimValidate(rules) != OK)
+    return ERROR;
+
+  for(irule = 0; irule < TI_RULESIM_NRULES; irule++)
+    {
+      if(tiSetTriggerHoldoff(irule + 1, rules->value[irule],
+			     rules->timestep[irule]) != OK)
+	return ERROR;
+
+      /* A minimum of 0 disables one left from a previous setting */
+      if(irule > 0)
+	{
+	  if(tiSetTriggerHoldoffMin(irule + 1, rules->minValue[irule]) != OK)
+	    return ERROR;
+	}
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup RuleSim
+ * @brief Print a rule set and, if not NULL, its simulated result
+ */
+void
+tiRuleSimPrint(const tiRuleSet *rules, const tiRuleSimResult *result)
+{
+  int irule;
+
+  printf("\n");
+  printf("    Rule   Value  Timestep   Period[ns]   Min[ns]   Rejected\n");
+  printf("    ----   -----  --------   ----------   -------   --------\n");
+  for(irule = 0; irule < TI_RULESIM_NRULES; irule++)
+    {
+      printf("    %4d   %5d  %8d   %10d   %7d   %8llu\n",
+	     irule + 1, rules->value[irule], rules->timestep[irule],
+	     tiRuleSimPeriod(irule + 1, rules->value[irule], rules->timestep[irule]),
+	     tiRuleSimMinPeriod(irule + 1, rules->minValue[irule]),
+	     result ? (unsigned long long)result->rejected[irule] : 0ULL);
+    }
+
+  if(result)
+    {
+      printf("\n");
+      printf("  Offered  %10llu  (%.1f Hz)\n",
+	     (unsigned long long)result->offered, result->offeredRate);
+      printf("  Accepted %10llu  (%.1f Hz)\n",
+	     (unsigned long long)result->accepted, result->acceptedRate);
+      printf("  Dead time %.3f%%  (rule minimums rejected %llu)\n",
+	     100. * result->deadFraction, (unsigned long long)result->rejectedMin);
+      printf("  Front end: max occupancy %d, overflows %llu\n",
+	     result->maxOccupancy, (unsigned long long)result->overflows);
+    }
+  printf("\n");
+}
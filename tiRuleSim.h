@@ -0,0 +1,55 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Trigger rule (holdoff) model.  Simulates the rules programmed with
+ *     tiSetTriggerHoldoff and tiSetTriggerHoldoffMin on a sequence of
+ *     trigger arrival times, and searches the register settings for the
+ *     highest accepted rate that does not overflow the front end buffers.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define TI_RULESIM_NRULES     4
+#define TI_RULESIM_MAXVALUE   0x7f
+#define TI_RULESIM_MAXHELD    4096   /* front end events tracked */
+
+typedef struct tiRuleSet
+{
+  int value[TI_RULESIM_NRULES];     /* rule 1-4 period in timestep units, 0: disabled */
+  int timestep[TI_RULESIM_NRULES];  /* 0, 1 or 2.  1 and 2 share the slow clock bit */
+  int minValue[TI_RULESIM_NRULES];  /* rule 2-4 minimum (index 1-3), 0: disabled */
+} tiRuleSet;
+
+typedef struct tiRuleSimResult
+{
+  uint64_t offered;
+  uint64_t accepted;
+  uint64_t rejected[TI_RULESIM_NRULES];  /* by the first rule that rejected */
+  uint64_t rejectedMin;                  /* by a rule minimum */
+  double   duration;       /* s, first to last offered trigger */
+  double   offeredRate;    /* Hz */
+  double   acceptedRate;   /* Hz */
+  double   deadFraction;   /* rejected / offered */
+  int      maxOccupancy;   /* most events held by the front end */
+  uint64_t overflows;      /* triggers accepted with bufferDepth events already held */
+} tiRuleSimResult;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  uint32_t tiRuleSimPeriod(int rule, int value, int timestep);
+  uint32_t tiRuleSimMinPeriod(int rule, int value);
+  int      tiRuleSimValidate(const tiRuleSet *rules);
+  int      tiRuleSimPoisson(double rate, int n, uint32_t seed, uint64_t *t_ns);
+  int      tiRuleSimRun(const tiRuleSet *rules, const uint64_t *t_ns, int n,
+			int bufferDepth, double readout_ns, tiRuleSimResult *result);
+  int      tiRuleSimOptimize(const uint64_t *t_ns, int n, int bufferDepth,
+			     double readout_ns, tiRuleSet *best,
+			     tiRuleSimResult *result);
+  int      tiRuleSimRead(tiRuleSet *rules);
+  int      tiRuleSimApply(const tiRuleSet *rules);
+  void     tiRuleSimPrint(const tiRuleSet *rules, const tiRuleSimResult *result);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,432 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Sync Command history log.
+ *
+ *     tiSyncHistDrain empties the sync history buffer (tiReadSyncHistory)
+ *     into a ring of TI_SYNCHIST_RING entries, overwriting the oldest.
+ *     tiSyncHistStart runs it in a background thread.  There is one
+ *     writer (the drain, serialized by shDrainMutex).  Readers take no
+ *     lock: the writer claims an entry before writing it and publishes
+ *     it after, and a reader drops any entry claimed again while it was
+ *     being copied.
+ *
+ *     The 16 bit timestamp is extended with a wrap count, incremented
+ *     when a word has the overflow flag set or its timestamp is below the
+ *     previous one.  More than one wrap between two words cannot be seen.
+ *
+ *     While the drainer runs, tiPrintSyncHistory finds the buffer empty.
+ *     Use tiSyncHistPrint instead.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiSyncHist.h"
+
+/**
+ * @defgroup SyncHist Sync Command History Log
+ *   Continuous drain of the sync history buffer, with extended timestamps.
+ */
+
+#define TI_SYNCHIST_MASK   (TI_SYNCHIST_RING - 1)
+#define TI_SYNCHIST_BURST  256   /* words per read */
+
+static tiSyncHistEntry shRing[TI_SYNCHIST_RING];
+static uint64_t shClaim = 0;     /* entries claimed by the writer */
+static uint64_t shHead = 0;      /* entries published */
+static uint64_t shWraps = 0;
+static int      shLastTimestamp = -1;
+static uint64_t shDrains = 0, shFull = 0;
+
+static pthread_mutex_t shDrainMutex = PTHREAD_MUTEX_INITIALIZER;
+#define SHLOCK     if(pthread_mutex_lock(&shDrainMutex)<0) perror("pthread_mutex_lock");
+#define SHUNLOCK   if(pthread_mutex_unlock(&shDrainMutex)<0) perror("pthread_mutex_unlock");
+
+static pthread_t shThread;
+static volatile int shThreadStop = 0, shThreadRunning = 0, shThreadPeriod = 10;
+
+static const char *shCodeNames[16] =
+  {
+    "",
+    "VME Clock Reset",
+    "CLK250 Resync",
+    "AD9510 Resync",
+    "GTP StatusB Reset",
+    "TrigLink Enable",
+    "",
+    "TrigLink Disable",
+    "",
+    "SyncReset High",
+    "Trigger Ready Reset",
+    "Reset Event Number",
+    "SyncReset Low",
+    "SyncReset",
+    "SyncReset 4us",
+    ""
+  };
+
+/**
+ * @ingroup SyncHist
+ * @brief Return the name of a sync code, from the TI_SYNCCOMMAND_* commands
+ *
+ * @param code  Sync code (0-15)
+ * @return Name of the code, or "" if it is not a sync command
+ */
+const char *
+tiSyncHistCodeName(int code)
+{
+  if((code < 0) || (code > 15))
+    return "";
+
+  return shCodeNames[code];
+}
+
+/**
+ * @ingroup SyncHist
+ * @brief Clear the log.  The timestamp extension starts over.
+ *
+ * @return OK
+ */
+int
+tiSyncHistInit()
+{
+  SHLOCK;
+  __atomic_store_n(&shHead, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&shClaim, 0, __ATOMIC_RELEASE);
+  memset((void *)shRing, 0, sizeof(shRing));
+  shWraps = 0;
+  shLastTimestamp = -1;
+  shDrains = 0;
+  shFull = 0;
+  SHUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup SyncHist
+ * @brief Empty the sync history buffer into the log
+ *
+ * @return Number of entries added if successful, otherwise ERROR
+ */
+int
+tiSyncHistDrain()
+{
+  unsigned int data[TI_SYNCHIST_BURST];
+  tiSyncHistEntry *entry = NULL;
+  uint64_t seq = 0;
+  int code = 0, valid = 0, overflow = 0, timestamp = 0;
+  int nwords = 0, iword, nadded = 0, status = 0;
+
+  SHLOCK;
+  shDrains++;
+
+  status = tiGetSyncHistoryBufferStatus(0);
+  if(status == ERROR)
+    {
+      SHUNLOCK;
+      return ERROR;
+    }
+  if(status == 2)
+    shFull++;
+
+  do
+    {
+      nwords = tiReadSyncHistory(data, TI_SYNCHIST_BURST);
+      if(nwords == ERROR)
+	{
+	  SHUNLOCK;
+	  return ERROR;
+	}
+
+      for(iword = 0; iword < nwords; iword++)
+	{
+	  if(tiDecodeSyncHistory(data[iword], &code, &valid, &overflow, &timestamp) != OK)
+	    {
+	      SHUNLOCK;
+	      return ERROR;
+	    }
+
+	  if((shLastTimestamp >= 0) && (overflow || (timestamp < shLastTimestamp)))
+	    shWraps++;
+	  shLastTimestamp = timestamp;
+
+	  /* Claim, write, publish */
+	  seq = shHead;
+	  __atomic_store_n(&shClaim, seq + 1, __ATOMIC_RELEASE);
+	  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	  entry = &shRing[seq & TI_SYNCHIST_MASK];
+	  entry->seq       = seq;
+	  entry->timestamp = (shWraps << 16) | (uint64_t)timestamp;
+	  entry->word      = data[iword];
+	  entry->code      = code;
+	  entry->valid     = valid;
+	  entry->overflow  = overflow;
+
+	  __atomic_store_n(&shHead, seq + 1, __ATOMIC_RELEASE);
+	  nadded++;
+	}
+    }
+  while(nwords == TI_SYNCHIST_BURST);
+  SHUNLOCK;
+
+  return nadded;
+}
+
+static void *
+tiSyncHistThread(void *arg)
+{
+  struct timespec period;
+
+  period.tv_sec  = shThreadPeriod / 1000;
+  period.tv_nsec = (shThreadPeriod % 1000) * 1000000;
+
+  while(!shThreadStop)
+    {
+      if(tiSyncHistDrain() == ERROR)
+	break;
+
+      nanosleep(&period, NULL);
+    }
+
+  printf("%s: Drain stopped\n", __func__);
+  return NULL;
+}
+
+/**
+ * @ingroup SyncHist
+ * @brief Drain the sync history buffer in a background thread
+ *
+ * @param period_ms  Time between drains (ms).  The buffer must not fill
+ *                   up within this time.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiSyncHistStart(int period_ms)
+{
+  int status = 0;
+
+  if(period_ms <= 0)
+    {
+      printf("%s: ERROR: Invalid period (%d ms)\n", __func__, period_ms);
+      return ERROR;
+    }
+
+  if(shThreadRunning)
+    {
+      printf("%s: ERROR: Drain already running\n", __func__);
+      return ERROR;
+    }
+
+  shThreadPeriod = period_ms;
+  shThreadStop = 0;
+  status = pthread_create(&shThread, NULL, tiSyncHistThread, NULL);
+  if(status != 0)
+    {
+      printf("%s: ERROR: Unable to start drain thread (%d)\n", __func__, status);
+      return ERROR;
+    }
+  shThreadRunning = 1;
+
+  return OK;
+}
+
+/**
+ * @ingroup SyncHist
+ * @brief Stop the background drain, after a last drain of the buffer
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiSyncHistStop()
+{
+  if(!shThreadRunning)
+    return OK;
+
+  shThreadStop = 1;
+  pthread_join(shThread, NULL);
+  shThreadRunning = 0;
+
+  return (tiSyncHistDrain() == ERROR) ? ERROR : OK;
+}
+
+/* Copy entry seq, if it is still in the ring.  Returns 1 if copied. */
+static int
+tiSyncHistCopy(uint64_t seq, tiSyncHistEntry *entry)
+{
+  memcpy((void *)entry, (void *)&shRing[seq & TI_SYNCHIST_MASK], sizeof(tiSyncHistEntry));
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  /* Overwritten while copying? */
+  if(__atomic_load_n(&shClaim, __ATOMIC_ACQUIRE) > seq + TI_SYNCHIST_RING)
+    return 0;
+
+  return 1;
+}
+
+static int
+tiSyncHistMatch(const tiSyncHistEntry *entry, int code, int validOnly)
+{
+  if(validOnly && !entry->valid)
+    return 0;
+  if((code >= 0) && (entry->code != code))
+    return 0;
+
+  return 1;
+}
+
+/**
+ * @ingroup SyncHist
+ * @brief Copy logged entries, oldest first
+ *
+ * @param code        Only this sync code, or -1 for any
+ * @param validOnly   Only entries with the code valid flag
+ * @param since       First entry (seq) to consider.  Older entries that
+ *                    are no longer in the ring are skipped.
+ * @param entry       Where to store the entries
+ * @param maxentries  Maximum number of entries to store
+ * @param next        If not NULL, where to store the seq to continue from
+ *
+ * @return Number of entries stored if successful, otherwise ERROR
+ */
+int
+tiSyncHistQuery(int code, int validOnly, uint64_t since,
+		tiSyncHistEntry *entry, int maxentries, uint64_t *next)
+{
+  uint64_t head = 0, seq = 0;
+  int n = 0;
+
+  if((entry == NULL) || (maxentries < 0))
+    {
+      printf("%s: ERROR: Invalid destination\n", __func__);
+      return ERROR;
+    }
+
+  head = __atomic_load_n(&shHead, __ATOMIC_ACQUIRE);
+  seq = (head > TI_SYNCHIST_RING) ? (head - TI_SYNCHIST_RING) : 0;
+  if(since > seq)
+    seq = since;
+
+  for(; (seq < head) && (n < maxentries); seq++)
+    {
+      if(!tiSyncHistCopy(seq, &entry[n]))
+	continue;
+      if(tiSyncHistMatch(&entry[n], code, validOnly))
+	n++;
+    }
+
+  if(next)
+    *next = seq;
+
+  return n;
+}
+
+/**
+ * @ingroup SyncHist
+ * @brief Call a routine for each logged entry, oldest first
+ *
+ * @param code       Only this sync code, or -1 for any
+ * @param validOnly  Only entries with the code valid flag
+ * @param func       Routine to call, returns non-zero to stop
+ * @param arg        Passed to func
+ *
+ * @return Number of entries passed to func if successful, otherwise ERROR
+ */
+int
+tiSyncHistIterate(int code, int validOnly, tiSyncHistFunc func, void *arg)
+{
+  tiSyncHistEntry entry;
+  uint64_t head = 0, seq = 0;
+  int n = 0;
+
+  if(func == NULL)
+    {
+      printf("%s: ERROR: Invalid routine\n", __func__);
+      return ERROR;
+    }
+
+  head = __atomic_load_n(&shHead, __ATOMIC_ACQUIRE);
+  seq = (head > TI_SYNCHIST_RING) ? (head - TI_SYNCHIST_RING) : 0;
+
+  for(; seq < head; seq++)
+    {
+      if(!tiSyncHistCopy(seq, &entry) || !tiSyncHistMatch(&entry, code, validOnly))
+	continue;
+
+      n++;
+      if(func(&entry, arg) != 0)
+	break;
+    }
+
+  return n;
+}
+
+/**
+ * @ingroup SyncHist
+ * @brief Return the log statistics
+ *
+ * @param stats  Where to store the statistics
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiSyncHistGetStats(tiSyncHistStats *stats)
+{
+  if(stats == NULL)
+    return ERROR;
+
+  SHLOCK;
+  stats->nentries = shHead;
+  stats->ndrains = shDrains;
+  stats->nfull = shFull;
+  stats->overwritten = (shHead > TI_SYNCHIST_RING) ? (shHead - TI_SYNCHIST_RING) : 0;
+  SHUNLOCK;
+
+  return OK;
+}
+
+static int
+tiSyncHistPrintEntry(const tiSyncHistEntry *entry, void *arg)
+{
+  printf("%8llu  0x%08x  %d  %14llu   0x%x  %d  %s\n",
+	 (unsigned long long)entry->seq, entry->word, entry->overflow,
+	 (unsigned long long)entry->timestamp, entry->code, entry->valid,
+	 tiSyncHistCodeName(entry->code));
+
+  return 0;
+}
+
+/**
+ * @ingroup SyncHist
+ * @brief Print the logged entries to standard out
+ *
+ * @param code       Only this sync code, or -1 for any
+ * @param validOnly  Only entries with the code valid flag
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiSyncHistPrint(int code, int validOnly)
+{
+  tiSyncHistStats stats;
+
+  tiSyncHistGetStats(&stats);
+
+  printf("\n");
+  printf(" Sync History Log: %llu entries, %llu overwritten, buffer full in %llu of %llu drains\n",
+	 (unsigned long long)stats.nentries, (unsigned long long)stats.overwritten,
+	 (unsigned long long)stats.nfull, (unsigned long long)stats.ndrains);
+  printf("--------------------------------------------------------------------------------\n");
+  printf("     Seq        Word  OF       Timestamp  Code  V\n");
+  printf("--------------------------------------------------------------------------------\n");
+  tiSyncHistIterate(code, validOnly, tiSyncHistPrintEntry, NULL);
+  printf("\n");
+
+  return OK;
+}
@@ -0,0 +1,49 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Sync Command history log.  Drains the TI sync history buffer into
+ *     an in-memory ring, with the 16 bit timestamps extended to 64 bits.
+ *     Readers do not block the drainer.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define TI_SYNCHIST_RING  8192   /* entries kept, power of 2 */
+
+typedef struct tiSyncHistEntry
+{
+  uint64_t seq;         /* position in the log, from 0 */
+  uint64_t timestamp;   /* extended timestamp */
+  uint32_t word;        /* raw history buffer word */
+  uint8_t  code;        /* sync code (4 bits) */
+  uint8_t  valid;
+  uint8_t  overflow;    /* timestamp overflow flag of the word */
+} tiSyncHistEntry;
+
+typedef struct tiSyncHistStats
+{
+  uint64_t nentries;    /* entries logged */
+  uint64_t ndrains;     /* drain passes */
+  uint64_t nfull;       /* drains that found the buffer full (entries may be lost) */
+  uint64_t overwritten; /* oldest entries no longer in the ring */
+} tiSyncHistStats;
+
+typedef int (*tiSyncHistFunc)(const tiSyncHistEntry *entry, void *arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int         tiSyncHistInit();
+  int         tiSyncHistDrain();
+  int         tiSyncHistStart(int period_ms);
+  int         tiSyncHistStop();
+  int         tiSyncHistQuery(int code, int validOnly, uint64_t since,
+			      tiSyncHistEntry *entry, int maxentries, uint64_t *next);
+  int         tiSyncHistIterate(int code, int validOnly, tiSyncHistFunc func, void *arg);
+  int         tiSyncHistGetStats(tiSyncHistStats *stats);
+  const char *tiSyncHistCodeName(int code);
+  int         tiSyncHistPrint(int code, int validOnly);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,649 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Hot path tracing.
+ *
+ *     A thread gets its ring at its first trace point (tiTraceAttach, the
+ *     only step that takes a lock).  After that, a trace point is the
+ *     timestamp counter read, three stores and a release store of the
+ *     ring head (a plain store on x86), with the oldest records
+ *     overwritten; the counter read takes most of its time (tiTrace.h).
+ *     tiTraceDump copies each ring without stopping the writers, and drops
+ *     the records that were overwritten during the copy.
+ *
+ *     Timestamps are from the time stamp counter (x86), the virtual
+ *     counter (aarch64), or CLOCK_MONOTONIC.  The counter rate is
+ *     calibrated against CLOCK_MONOTONIC from tiTraceInit to the dump.
+ *
+ *     Binary trace file (host byte order):
+ *       header   "TITRACE1", version, number of threads, ticks/us, first tsc
+ *       points   TI_TRACE_NPOINTS x (name, type)
+ *       threads  tid, name, number of records, records
+ *
+ *     A span is a BEGIN point and the END point that follows it
+ *     (point + 1).  Spans of one point are not nested.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include "jvme.h"
+#include "tiTrace.h"
+
+/**
+ * @defgroup Trace Hot Path Tracing
+ *   Per thread trace rings, binary dump and Chrome trace conversion.
+ */
+
+#define TI_TRACE_MAGIC    "TITRACE1"
+#define TI_TRACE_VERSION  1
+
+typedef struct tiTraceFileHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t nthreads;
+  double   ticksPerUs;
+  uint64_t tsc0;
+} tiTraceFileHeader;
+
+typedef struct tiTraceFilePoint
+{
+  char     name[TI_TRACE_NAMELEN];
+  uint32_t type;
+} tiTraceFilePoint;
+
+typedef struct tiTraceFileThread
+{
+  uint32_t tid;
+  char     name[16];
+  uint32_t nrecords;
+} tiTraceFileThread;
+
+/* Trace file, as loaded */
+typedef struct tiTraceFile
+{
+  tiTraceFileHeader  header;
+  tiTraceFilePoint   point[TI_TRACE_NPOINTS];
+  tiTraceFileThread *thread;
+  tiTraceRecord    **rec;
+} tiTraceFile;
+
+volatile int tiTraceEnabled = 0;
+__thread tiTraceRing *tiTraceThisRing = NULL;
+
+static tiTraceRing *trRings = NULL;
+static uint64_t trTsc0 = 0, trNs0 = 0;
+static double   trTicksPerUs = 0.;
+
+static tiTraceFilePoint trPoint[TI_TRACE_NPOINTS] =
+  {
+    [TI_TRACE_POLL_READY]       = {"tiPoll ready",    TI_TRACE_INSTANT},
+    [TI_TRACE_INT]              = {"tiInt",           TI_TRACE_INSTANT},
+    [TI_TRACE_BREADY_BEGIN]     = {"tiBReady",        TI_TRACE_BEGIN},
+    [TI_TRACE_BREADY_END]       = {"tiBReady",        TI_TRACE_END},
+    [TI_TRACE_ROUTINE_BEGIN]    = {"readout routine", TI_TRACE_BEGIN},
+    [TI_TRACE_ROUTINE_END]      = {"readout routine", TI_TRACE_END},
+    [TI_TRACE_READBLOCK_BEGIN]  = {"tiReadBlock",     TI_TRACE_BEGIN},
+    [TI_TRACE_READBLOCK_END]    = {"tiReadBlock",     TI_TRACE_END},
+    [TI_TRACE_DMASEND_BEGIN]    = {"vmeDmaSend",      TI_TRACE_BEGIN},
+    [TI_TRACE_DMASEND_END]      = {"vmeDmaSend",      TI_TRACE_END},
+    [TI_TRACE_DMADONE_BEGIN]    = {"vmeDmaDone",      TI_TRACE_BEGIN},
+    [TI_TRACE_DMADONE_END]      = {"vmeDmaDone",      TI_TRACE_END},
+    [TI_TRACE_INTACK_BEGIN]     = {"tiIntAck",        TI_TRACE_BEGIN},
+    [TI_TRACE_INTACK_END]       = {"tiIntAck",        TI_TRACE_END},
+  };
+
+static pthread_mutex_t trMutex = PTHREAD_MUTEX_INITIALIZER;
+#define TRLOCK     if(pthread_mutex_lock(&trMutex)<0) perror("pthread_mutex_lock");
+#define TRUNLOCK   if(pthread_mutex_unlock(&trMutex)<0) perror("pthread_mutex_unlock");
+
+static uint64_t
+tiTraceNs()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Counter ticks per us, from tiTraceInit to now */
+static double
+tiTraceCalibrate()
+{
+  uint64_t ns = tiTraceNs(), tsc = tiTraceClock();
+
+  if(ns > trNs0)
+    trTicksPerUs = (double)(tsc - trTsc0) * 1000. / (ns - trNs0);
+
+  return trTicksPerUs;
+}
+
+/**
+ * @ingroup Trace
+ * @brief Start recording.  Calibrates the timestamp counter (10 ms).
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiTraceInit()
+{
+  struct timespec wait = {0, 10000000};
+
+  TRLOCK;
+  trNs0 = tiTraceNs();
+  trTsc0 = tiTraceClock();
+  nanosleep(&wait, NULL);
+  tiTraceCalibrate();
+  TRUNLOCK;
+
+  printf("%s: Timestamp counter at %.1f MHz\n", __func__, trTicksPerUs);
+
+  tiTraceEnabled = 1;
+
+  return OK;
+}
+
+/**
+ * @ingroup Trace
+ * @brief Enable or disable recording, after tiTraceInit
+ *
+ * @param enable  1 to record, 0 to stop
+ */
+void
+tiTraceEnable(int enable)
+{
+  if(enable && (trNs0 == 0))
+    {
+      tiTraceInit();
+      return;
+    }
+
+  tiTraceEnabled = enable ? 1 : 0;
+}
+
+/**
+ * @ingroup Trace
+ * @brief Empty all rings.  Only while no thread is recording.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiTraceReset()
+{
+  tiTraceRing *r;
+
+  TRLOCK;
+  for(r = trRings; r != NULL; r = r->next)
+    __atomic_store_n(&r->head, 0, __ATOMIC_RELEASE);
+  TRUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup Trace
+ * @brief Name a user trace point.  The END point of a span is the one
+ *        after its BEGIN point, with the same name.
+ *
+ * @param point  TI_TRACE_USER - TI_TRACE_NPOINTS-1
+ * @param name   Name shown in the trace
+ * @param type   TI_TRACE_INSTANT, TI_TRACE_BEGIN or TI_TRACE_END
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiTraceDefine(int point, const char *name, int type)
+{
+  if((point < TI_TRACE_USER) || (point >= TI_TRACE_NPOINTS) || (name == NULL) ||
+     (type < TI_TRACE_INSTANT) || (type > TI_TRACE_END))
+    {
+      printf("%s: ERROR: Invalid point (%d) or type (%d)\n", __func__, point, type);
+      return ERROR;
+    }
+
+  TRLOCK;
+  strncpy(trPoint[point].name, name, TI_TRACE_NAMELEN - 1);
+  trPoint[point].name[TI_TRACE_NAMELEN - 1] = 0;
+  trPoint[point].type = type;
+  TRUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup Trace
+ * @brief Give the calling thread its ring.  Called at its first trace point.
+ *
+ * @return The ring, or NULL if it could not be allocated
+ */
+tiTraceRing *
+tiTraceAttach()
+{
+  tiTraceRing *r = NULL;
+
+  if(tiTraceThisRing != NULL)
+    return tiTraceThisRing;
+
+  r = (tiTraceRing *)calloc(1, sizeof(tiTraceRing));
+  if(r == NULL)
+    return NULL;
+
+  r->tid = (uint32_t)syscall(SYS_gettid);
+  prctl(PR_GET_NAME, r->name);
+
+  TRLOCK;
+  r->next = trRings;
+  trRings = r;
+  TRUNLOCK;
+
+  tiTraceThisRing = r;
+
+  return r;
+}
+
+/**
+ * @ingroup Trace
+ * @brief Write the rings of all threads to a binary trace file
+ *
+ * @param filename  Trace file
+ * @return Number of records written, otherwise ERROR
+ */
+int
+tiTraceDump(const char *filename)
+{
+  static tiTraceRecord copy[TI_TRACE_RING];
+  tiTraceFileHeader header;
+  tiTraceFileThread thread;
+  tiTraceRing *r;
+  uint64_t head = 0, first = 0, last = 0, valid = 0;
+  uint32_t irec;
+  FILE *f = NULL;
+  int rval = 0;
+
+  if(filename == NULL)
+    {
+      printf("%s: ERROR: Invalid filename\n", __func__);
+      return ERROR;
+    }
+
+  f = fopen(filename, "wb");
+  if(f == NULL)
+    {
+      perror("fopen");
+      printf("%s: ERROR: Unable to open %s\n", __func__, filename);
+      return ERROR;
+    }
+
+  TRLOCK;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TI_TRACE_MAGIC, 8);
+  header.version = TI_TRACE_VERSION;
+  for(r = trRings; r != NULL; r = r->next)
+    header.nthreads++;
+  header.ticksPerUs = (trNs0 != 0) ? tiTraceCalibrate() : 1000.;
+  header.tsc0 = trTsc0;
+
+  fwrite(&header, sizeof(header), 1, f);
+  fwrite(trPoint, sizeof(trPoint), 1, f);
+
+  for(r = trRings; r != NULL; r = r->next)
+    {
+      head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+      first = (head > TI_TRACE_RING) ? head - TI_TRACE_RING : 0;
+      for(last = first; last < head; last++)
+	copy[last - first] = r->rec[last & (TI_TRACE_RING - 1)];
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+      /* Writer may have overwritten the oldest, and be writing one more */
+      valid = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+      valid = (valid >= TI_TRACE_RING) ? valid - TI_TRACE_RING + 1 : 0;
+      if(valid < first)
+	valid = first;
+      if(valid > head)
+	valid = head;
+
+      memset(&thread, 0, sizeof(thread));
+      thread.tid = r->tid;
+      memcpy(thread.name, r->name, sizeof(thread.name));
+      thread.nrecords = head - valid;
+      fwrite(&thread, sizeof(thread), 1, f);
+
+      irec = valid - first;
+      fwrite(&copy[irec], sizeof(tiTraceRecord), thread.nrecords, f);
+      rval += thread.nrecords;
+    }
+  TRUNLOCK;
+
+  if(fclose(f) != 0)
+    {
+      perror("fclose");
+      return ERROR;
+    }
+
+  return rval;
+}
+
+static void
+tiTraceFree(tiTraceFile *tf)
+{
+  uint32_t ithread;
+
+  if(tf->rec != NULL)
+    {
+      for(ithread = 0; ithread < tf->header.nthreads; ithread++)
+	free(tf->rec[ithread]);
+      free(tf->rec);
+    }
+  free(tf->thread);
+  memset(tf, 0, sizeof(tiTraceFile));
+}
+
+static int
+tiTraceLoad(const char *filename, tiTraceFile *tf)
+{
+  FILE *f = NULL;
+  uint32_t ithread, n = 0;
+
+  memset(tf, 0, sizeof(tiTraceFile));
+
+  if(filename == NULL)
+    {
+      printf("%s: ERROR: Invalid filename\n", __func__);
+      return ERROR;
+    }
+
+  f = fopen(filename, "rb");
+  if(f == NULL)
+    {
+      perror("fopen");
+      printf("%s: ERROR: Unable to open %s\n", __func__, filename);
+      return ERROR;
+    }
+
+  if((fread(&tf->header, sizeof(tf->header), 1, f) != 1) ||
+     (memcmp(tf->header.magic, TI_TRACE_MAGIC, 8) != 0) ||
+     (tf->header.version != TI_TRACE_VERSION) ||
+     (fread(tf->point, sizeof(tf->point), 1, f) != 1))
+    {
+      printf("%s: ERROR: %s is not a trace file\n", __func__, filename);
+      fclose(f);
+      return ERROR;
+    }
+
+  tf->thread = (tiTraceFileThread *)calloc(tf->header.nthreads + 1, sizeof(tiTraceFileThread));
+  tf->rec = (tiTraceRecord **)calloc(tf->header.nthreads + 1, sizeof(tiTraceRecord *));
+  if((tf->thread == NULL) || (tf->rec == NULL))
+    {
+      printf("%s: ERROR: Out of memory\n", __func__);
+      fclose(f);
+      tiTraceFree(tf);
+      return ERROR;
+    }
+
+  for(ithread = 0; ithread < tf->header.nthreads; ithread++)
+    {
+      if(fread(&tf->thread[ithread], sizeof(tiTraceFileThread), 1, f) != 1)
+	break;
+
+      n = tf->thread[ithread].nrecords;
+      tf->rec[ithread] = (tiTraceRecord *)malloc((n + 1) * sizeof(tiTraceRecord));
+      if((tf->rec[ithread] == NULL) ||
+	 (fread(tf->rec[ithread], sizeof(tiTraceRecord), n, f) != n))
+	break;
+    }
+  fclose(f);
+
+  if(ithread != tf->header.nthreads)
+    {
+      printf("%s: ERROR: %s is truncated (thread %d)\n", __func__, filename, ithread);
+      tiTraceFree(tf);
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/* Earliest timestamp in the file */
+static uint64_t
+tiTraceFirst(const tiTraceFile *tf)
+{
+  uint64_t first = 0;
+  uint32_t ithread;
+  int found = 0;
+
+  for(ithread = 0; ithread < tf->header.nthreads; ithread++)
+    if((tf->thread[ithread].nrecords > 0) &&
+       (!found || (tf->rec[ithread][0].tsc < first)))
+      {
+	first = tf->rec[ithread][0].tsc;
+	found = 1;
+      }
+
+  return first;
+}
+
+/**
+ * @ingroup Trace
+ * @brief Convert a binary trace file to the Chrome trace event format
+ *        (JSON), for chrome://tracing or ui.perfetto.dev
+ *
+ * @param tracefile  Trace file from tiTraceDump
+ * @param jsonfile   Output file
+ *
+ * @return Number of events written, otherwise ERROR
+ */
+int
+tiTraceConvert(const char *tracefile, const char *jsonfile)
+{
+  static const char *phase[3] = {"i", "B", "E"};
+  tiTraceFile tf;
+  const tiTraceRecord *rec;
+  const tiTraceFilePoint *p;
+  uint64_t first = 0;
+  uint32_t ithread, irec;
+  FILE *f = NULL;
+  int rval = 0;
+
+  if(jsonfile == NULL)
+    {
+      printf("%s: ERROR: Invalid output filename\n", __func__);
+      return ERROR;
+    }
+
+  if(tiTraceLoad(tracefile, &tf) != OK)
+    return ERROR;
+
+  f = fopen(jsonfile, "w");
+  if(f == NULL)
+    {
+      perror("fopen");
+      printf("%s: ERROR: Unable to open %s\n", __func__, jsonfile);
+      tiTraceFree(&tf);
+      return ERROR;
+    }
+
+  first = tiTraceFirst(&tf);
+
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  for(ithread = 0; ithread < tf.header.nthreads; ithread++)
+    {
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+	      "\"args\":{\"name\":\"%.16s\"}}",
+	      (ithread == 0) ? "" : ",\n", tf.thread[ithread].tid, tf.thread[ithread].name);
+
+      for(irec = 0; irec < tf.thread[ithread].nrecords; irec++)
+	{
+	  rec = &tf.rec[ithread][irec];
+	  if(rec->point >= TI_TRACE_NPOINTS)
+	    continue;
+	  p = &tf.point[rec->point];
+
+	  fprintf(f, ",\n{\"name\":\"");
+	  if(p->name[0] != 0)
+	    fprintf(f, "%.*s", TI_TRACE_NAMELEN, p->name);
+	  else
+	    fprintf(f, "point %u", rec->point);
+	  fprintf(f, "\",\"ph\":\"%s\",", phase[(p->type <= TI_TRACE_END) ? p->type : 0]);
+	  if(p->type == TI_TRACE_INSTANT)
+	    fprintf(f, "\"s\":\"t\",");
+	  fprintf(f, "\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"arg\":%u}}",
+		  (double)(rec->tsc - first) / tf.header.ticksPerUs,
+		  tf.thread[ithread].tid, rec->arg);
+	  rval++;
+	}
+    }
+  fprintf(f, "\n]}\n");
+
+  tiTraceFree(&tf);
+
+  if(fclose(f) != 0)
+    {
+      perror("fclose");
+      return ERROR;
+    }
+
+  return rval;
+}
+
+static void
+tiTraceSpanAdd(tiTraceSpan *span, double us)
+{
+  if((span->count == 0) || (us < span->min))
+    span->min = us;
+  if((span->count == 0) || (us > span->max))
+    span->max = us;
+  span->mean += (us - span->mean) / (span->count + 1);
+  span->count++;
+}
+
+/**
+ * @ingroup Trace
+ * @brief Latency of each span in a trace file, over all threads.  The
+ *        last span is "ready to ack", from tiPoll ready (or tiInt) to
+ *        the end of the tiIntAck that follows.
+ *
+ * @param tracefile  Trace file from tiTraceDump
+ * @param span       Where to store the spans
+ * @param maxspans   Size of span
+ *
+ * @return Number of spans, otherwise ERROR
+ */
+int
+tiTraceSummary(const char *tracefile, tiTraceSpan *span, int maxspans)
+{
+  tiTraceFile tf;
+  tiTraceSpan all[TI_TRACE_NPOINTS + 1];
+  uint64_t open[TI_TRACE_NPOINTS], ready = 0;
+  int isopen[TI_TRACE_NPOINTS], isready = 0;
+  const tiTraceRecord *rec;
+  uint32_t ithread, irec, pt;
+  int ipoint, nspans = 0;
+
+  if((span == NULL) || (maxspans <= 0))
+    {
+      printf("%s: ERROR: Invalid destination\n", __func__);
+      return ERROR;
+    }
+
+  if(tiTraceLoad(tracefile, &tf) != OK)
+    return ERROR;
+
+  memset(all, 0, sizeof(all));
+  for(ithread = 0; ithread < tf.header.nthreads; ithread++)
+    {
+      memset(isopen, 0, sizeof(isopen));
+      isready = 0;
+
+      for(irec = 0; irec < tf.thread[ithread].nrecords; irec++)
+	{
+	  rec = &tf.rec[ithread][irec];
+	  pt = rec->point;
+	  if(pt >= TI_TRACE_NPOINTS)
+	    continue;
+
+	  switch(tf.point[pt].type)
+	    {
+	    case TI_TRACE_BEGIN:
+	      open[pt] = rec->tsc;
+	      isopen[pt] = 1;
+	      break;
+
+	    case TI_TRACE_END:
+	      if((pt > 0) && isopen[pt - 1])
+		{
+		  tiTraceSpanAdd(&all[pt - 1], (rec->tsc - open[pt - 1]) / tf.header.ticksPerUs);
+		  isopen[pt - 1] = 0;
+		}
+	      if((pt == TI_TRACE_INTACK_END) && isready)
+		{
+		  tiTraceSpanAdd(&all[TI_TRACE_NPOINTS], (rec->tsc - ready) / tf.header.ticksPerUs);
+		  isready = 0;
+		}
+	      break;
+
+	    default:
+	      if((pt == TI_TRACE_POLL_READY) || (pt == TI_TRACE_INT))
+		{
+		  ready = rec->tsc;
+		  isready = 1;
+		}
+	    }
+	}
+    }
+
+  for(ipoint = 0; ipoint <= TI_TRACE_NPOINTS; ipoint++)
+    {
+      if((all[ipoint].count == 0) || (nspans >= maxspans))
+	continue;
+
+      span[nspans] = all[ipoint];
+      if(ipoint < TI_TRACE_NPOINTS)
+	memcpy(span[nspans].name, tf.point[ipoint].name, TI_TRACE_NAMELEN);
+      else
+	strcpy(span[nspans].name, "ready to ack");
+      span[nspans].name[TI_TRACE_NAMELEN - 1] = 0;
+      nspans++;
+    }
+
+  tiTraceFree(&tf);
+
+  return nspans;
+}
+
+/**
+ * @ingroup Trace
+ * @brief Print the span latencies of a trace file
+ *
+ * @param tracefile  Trace file from tiTraceDump
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiTracePrintSummary(const char *tracefile)
+{
+  tiTraceSpan span[TI_TRACE_NPOINTS + 1];
+  int nspans, ispan;
+
+  nspans = tiTraceSummary(tracefile, span, TI_TRACE_NPOINTS + 1);
+  if(nspans == ERROR)
+    return ERROR;
+
+  printf("\n");
+  printf(" Trace spans (%s)\n", tracefile);
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Span                         Count      Mean(us)     Min(us)     Max(us)\n");
+  printf("--------------------------------------------------------------------------------\n");
+  for(ispan = 0; ispan < nspans; ispan++)
+    printf("  %-24s  %10u  %12.3f  %10.3f  %10.3f\n",
+	   span[ispan].name, span[ispan].count, span[ispan].mean,
+	   span[ispan].min, span[ispan].max);
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n");
+
+  return OK;
+}
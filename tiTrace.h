@@ -0,0 +1,150 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Hot path tracing.  Trace points record (timestamp counter, point,
+ *     argument) into a lock-free ring owned by the calling thread.  The
+ *     rings are dumped to a binary file, converted to the Chrome trace
+ *     format (chrome://tracing, ui.perfetto.dev) and summarized offline.
+ *
+ *     Trace points in the library are compiled in with -DTI_TRACE (make
+ *     TI_TRACE=1), and record only after tiTraceInit.
+ *
+ *     A trace point is not a few ns: it costs the timestamp counter read
+ *     plus a few ns of stores.  tiTraceTest measured about 24 ns per point
+ *     on a virtual machine, of which the counter read alone was about
+ *     21 ns.  Disabled, a trace point is a load and a branch.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define TI_TRACE_RING      16384   /* records per thread, power of 2 */
+#define TI_TRACE_NPOINTS   64
+#define TI_TRACE_NAMELEN   24
+
+/* Library trace points.  Pairs of BEGIN/END are spans, the others instants */
+enum tiTracePoint
+  {
+    TI_TRACE_NONE = 0,
+    TI_TRACE_POLL_READY,        /* tiPoll found blocks, arg: blocks ready */
+    TI_TRACE_INT,               /* tiInt, arg: interrupt count */
+    TI_TRACE_BREADY_BEGIN,      /* tiBReady that found blocks */
+    TI_TRACE_BREADY_END,        /* arg: blocks ready */
+    TI_TRACE_ROUTINE_BEGIN,     /* user readout routine, arg: interrupt count */
+    TI_TRACE_ROUTINE_END,
+    TI_TRACE_READBLOCK_BEGIN,   /* tiReadBlock, arg: max words */
+    TI_TRACE_READBLOCK_END,     /* arg: words read */
+    TI_TRACE_DMASEND_BEGIN,     /* vmeDmaSend, arg: bytes */
+    TI_TRACE_DMASEND_END,
+    TI_TRACE_DMADONE_BEGIN,     /* vmeDmaDone */
+    TI_TRACE_DMADONE_END,       /* arg: bytes transferred */
+    TI_TRACE_INTACK_BEGIN,      /* tiIntAck, arg: ack count */
+    TI_TRACE_INTACK_END,
+    TI_TRACE_USER = 32          /* first point for tiTraceDefine */
+  };
+
+/* Point types */
+#define TI_TRACE_INSTANT   0
+#define TI_TRACE_BEGIN     1
+#define TI_TRACE_END       2
+
+typedef struct tiTraceRecord
+{
+  uint64_t tsc;
+  uint32_t point;
+  uint32_t arg;
+} tiTraceRecord;
+
+typedef struct tiTraceRing
+{
+  uint64_t            head;      /* records written */
+  uint32_t            tid;
+  char                name[16];
+  struct tiTraceRing *next;
+  tiTraceRecord       rec[TI_TRACE_RING];
+} tiTraceRing;
+
+/* Span of one point pair, from tiTraceSummary */
+typedef struct tiTraceSpan
+{
+  char     name[TI_TRACE_NAMELEN];
+  uint32_t count;
+  double   mean;   /* us */
+  double   min;
+  double   max;
+} tiTraceSpan;
+
+extern volatile int tiTraceEnabled;
+extern __thread tiTraceRing *tiTraceThisRing;
+
+static inline uint64_t
+tiTraceClock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t v;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+  return v;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int          tiTraceInit();
+  void         tiTraceEnable(int enable);
+  int          tiTraceReset();
+  int          tiTraceDefine(int point, const char *name, int type);
+  tiTraceRing *tiTraceAttach();
+  int          tiTraceDump(const char *filename);
+  int          tiTraceConvert(const char *tracefile, const char *jsonfile);
+  int          tiTraceSummary(const char *tracefile, tiTraceSpan *span, int maxspans);
+  int          tiTracePrintSummary(const char *tracefile);
+#ifdef __cplusplus
+}
+#endif
+
+static inline void
+tiTraceAt(uint32_t point, uint64_t tsc, uint32_t arg)
+{
+  tiTraceRing *r = tiTraceThisRing;
+  tiTraceRecord *e;
+  uint64_t h;
+
+  if(__builtin_expect(r == NULL, 0))
+    {
+      r = tiTraceAttach();
+      if(r == NULL)
+	return;
+    }
+
+  h = r->head;
+  e = &r->rec[h & (TI_TRACE_RING - 1)];
+  e->tsc = tsc;
+  e->point = point;
+  e->arg = arg;
+  __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+#if defined(TI_TRACE) && !defined(VXWORKS)
+#define TI_TRACE_POINT(_point, _arg)					\
+  do { if(tiTraceEnabled)						\
+      tiTraceAt((_point), tiTraceClock(), (uint32_t)(_arg)); } while(0)
+#define TI_TRACE_POINT_AT(_point, _tsc, _arg)				\
+  do { if(tiTraceEnabled)						\
+      tiTraceAt((_point), (_tsc), (uint32_t)(_arg)); } while(0)
+#define TI_TRACE_CLOCK(_var)  uint64_t _var = tiTraceEnabled ? tiTraceClock() : 0
+#else
+#define TI_TRACE_POINT(_point, _arg)           do { } while(0)
+#define TI_TRACE_POINT_AT(_point, _tsc, _arg)  do { } while(0)
+#define TI_TRACE_CLOCK(_var)
+#endif
@@ -0,0 +1,476 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Trigger rate and burst analyzer.
+ *
+ *     Inter-trigger times go into a histogram with TI_TRIGRATE_SUBBINS
+ *     logarithmic bins per octave of 4 ns ticks.  A burst is a run of at
+ *     least minBurst triggers separated by less than burstGap.
+ *
+ *     Throttling is estimated by comparing with a free running (Poisson)
+ *     source, held off for a time T after each accepted trigger (rule 1).
+ *     Gaps just above T then fall off as exp(-rate * (gap - T)).  The
+ *     offered rate is taken from the ratio of the counts in two ranges
+ *     above T, so gaps stretched by other busy sources (front end buffers
+ *     full, readout) do not bias it as long as they are longer than about
+ *     2.5 T.  The holdoff alone loses rate*T / (1 + rate*T); anything lost
+ *     beyond that is from other busy sources.
+ *
+ *     Format 1 only has the lower 32 bits of the timestamp; the upper
+ *     bits are carried from the previous trigger.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiDecode.h"
+#include "tiTrigRate.h"
+
+/**
+ * @defgroup TrigRate Trigger Rate Analyzer
+ *   Trigger rate, inter-trigger time and burst statistics from the
+ *   event timestamps.
+ */
+
+static pthread_mutex_t trMutex = PTHREAD_MUTEX_INITIALIZER;
+#define TRLOCK     if(pthread_mutex_lock(&trMutex)<0) perror("pthread_mutex_lock");
+#define TRUNLOCK   if(pthread_mutex_unlock(&trMutex)<0) perror("pthread_mutex_unlock");
+
+static uint64_t trHisto[TI_TRIGRATE_NBINS];
+static uint64_t trBurstHisto[TI_TRIGRATE_NBURSTBINS];
+static uint64_t trWindow[TI_TRIGRATE_WINDOW];
+static uint64_t trCount = 0, trFirst = 0, trLast = 0, trMinGap = 0, trSumGap = 0;
+static uint64_t trBursts = 0;
+static uint32_t trRun = 1, trMaxBurst = 0;
+static double   trPeakRate = 0;
+static uint64_t trBurstGap = 250;    /* ticks */
+static int      trMinBurst = 3;
+static double   trHoldoff = 0;       /* ns, 0: use the minimum gap */
+
+/* Histogram bin of a gap (ticks) */
+static int
+trBin(uint64_t gap)
+{
+  int msb = 0, sub = 0, bin = 0;
+
+  if(gap == 0)
+    return 0;
+
+  msb = 63 - __builtin_clzll(gap);
+  if(msb >= 2)
+    sub = (gap >> (msb - 2)) & (TI_TRIGRATE_SUBBINS - 1);
+  else
+    sub = (gap << (2 - msb)) & (TI_TRIGRATE_SUBBINS - 1);
+
+  bin = msb * TI_TRIGRATE_SUBBINS + sub;
+  return (bin < TI_TRIGRATE_NBINS) ? bin : (TI_TRIGRATE_NBINS - 1);
+}
+
+/* Lower edge (ticks) of a histogram bin */
+static double
+trBinEdge(int bin)
+{
+  int msb = bin / TI_TRIGRATE_SUBBINS, sub = bin % TI_TRIGRATE_SUBBINS;
+
+  return ldexp(1.0 + (double)sub / TI_TRIGRATE_SUBBINS, msb);
+}
+
+/* End the current run of short gaps.  Call with TRLOCK held. */
+static void
+trEndRun()
+{
+  int bin = 0;
+
+  if(trRun >= (uint32_t)trMinBurst)
+    {
+      trBursts++;
+      bin = 31 - __builtin_clz(trRun);
+      trBurstHisto[(bin < TI_TRIGRATE_NBURSTBINS) ? bin : (TI_TRIGRATE_NBURSTBINS - 1)]++;
+      if(trRun > trMaxBurst)
+	trMaxBurst = trRun;
+    }
+  trRun = 1;
+}
+
+/* Add one timestamp (ticks).  Call with TRLOCK held. */
+static void
+trAdd(uint64_t ts)
+{
+  uint64_t gap = 0, oldest = 0;
+  double rate = 0;
+
+  if(trCount == 0)
+    trFirst = ts;
+  else
+    {
+      if(ts <= trLast)   /* out of order or repeated, keep the order of arrival */
+	gap = 0;
+      else
+	gap = ts - trLast;
+
+      trHisto[trBin(gap)]++;
+      trSumGap += gap;
+      if((trCount == 1) || (gap < trMinGap))
+	trMinGap = gap;
+
+      if(gap < trBurstGap)
+	trRun++;
+      else
+	trEndRun();
+    }
+
+  /* Rate over the last TI_TRIGRATE_WINDOW triggers */
+  if(trCount >= TI_TRIGRATE_WINDOW)
+    {
+      oldest = trWindow[trCount % TI_TRIGRATE_WINDOW];
+      if(ts > oldest)
+	{
+	  rate = (TI_TRIGRATE_WINDOW / ((ts - oldest) * TI_DECODE_TIMESTAMP_NS * 1e-9));
+	  if(rate > trPeakRate)
+	    trPeakRate = rate;
+	}
+    }
+  trWindow[trCount % TI_TRIGRATE_WINDOW] = ts;
+
+  trLast = ts;
+  trCount++;
+}
+
+/**
+ * @ingroup TrigRate
+ * @brief Clear the statistics and set the burst definition
+ *
+ * @param burstGap_ns  Gaps shorter than this continue a burst (<= 0: 1000 ns)
+ * @param minBurst     Minimum number of triggers in a burst (< 2: 3)
+ *
+ * @return OK
+ */
+int
+tiTrigRateInit(double burstGap_ns, int minBurst)
+{
+  TRLOCK;
+  memset((void *)trHisto, 0, sizeof(trHisto));
+  memset((void *)trBurstHisto, 0, sizeof(trBurstHisto));
+  memset((void *)trWindow, 0, sizeof(trWindow));
+  trCount = 0; trFirst = 0; trLast = 0; trMinGap = 0; trSumGap = 0;
+  trBursts = 0; trRun = 1; trMaxBurst = 0; trPeakRate = 0;
+  trBurstGap = (uint64_t)(((burstGap_ns > 0) ? burstGap_ns : 1000) / TI_DECODE_TIMESTAMP_NS);
+  trMinBurst = (minBurst >= 2) ? minBurst : 3;
+  TRUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup TrigRate
+ * @brief Set the holdoff used for the free running comparison.
+ *        Typically the rule 1 period (tiRuleSimPeriod).
+ *
+ * @param holdoff_ns  Holdoff in ns.  0: use the minimum observed gap.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiTrigRateSetHoldoff(double holdoff_ns)
+{
+  if(holdoff_ns < 0)
+    {
+      printf("%s: ERROR: Invalid holdoff (%g ns)\n", __func__, holdoff_ns);
+      return ERROR;
+    }
+
+  TRLOCK;
+  trHoldoff = holdoff_ns;
+  TRUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup TrigRate
+ * @brief Add the events of trigger banks from tiReadTriggerBlock
+ *
+ * @param data    Trigger banks, each starting at its bank length word
+ * @param nwords  Number of words in data
+ *
+ * @return Number of timestamps added if successful, otherwise ERROR
+ */
+int
+tiTrigRateFeed(const uint32_t *data, int nwords)
+{
+  tiDecodedEvent event[256];
+  uint64_t ts = 0;
+  int iword = 0, nused = 0, nev = 0, iev = 0, nts = 0;
+
+  if(data == NULL)
+    return ERROR;
+
+  while(iword < nwords)
+    {
+      nev = tiDecodeTriggerBank(&data[iword], nwords - iword, event, 256, &nused);
+      if(nev == ERROR)
+	return ERROR;
+
+      TRLOCK;
+      for(iev = 0; iev < nev; iev++)
+	{
+	  if(!event[iev].hasTimestamp)
+	    continue;
+
+	  ts = event[iev].timestamp;
+	  if(tiDecodeGetEventFormat() == 1)
+	    {
+	      /* Format 1: carry the upper bits, across a 32 bit wrap */
+	      ts |= trLast & ~0xFFFFFFFFULL;
+	      if((trCount > 0) && (ts < trLast))
+		ts += 0x100000000ULL;
+	    }
+
+	  trAdd(ts);
+	  nts++;
+	}
+      TRUNLOCK;
+
+      iword += nused;
+    }
+
+  return nts;
+}
+
+/**
+ * @ingroup TrigRate
+ * @brief Add timestamps directly
+ *
+ * @param timestamp  Timestamps (4 ns ticks), in trigger order
+ * @param n          Number of timestamps
+ *
+ * @return Number of timestamps added if successful, otherwise ERROR
+ */
+int
+tiTrigRateFeedTimestamps(const uint64_t *timestamp, int n)
+{
+  int its;
+
+  if((timestamp == NULL) || (n < 0))
+    return ERROR;
+
+  TRLOCK;
+  for(its = 0; its < n; its++)
+    trAdd(timestamp[its]);
+  TRUNLOCK;
+
+  return n;
+}
+
+/*
+  Offered rate (Hz) from nshort gaps in [T, T+a) and nnext in [T+a, T+b)
+  (a, b in ns).  Solves (1 - e^-ra) / (e^-ra - e^-rb) = nshort / nnext,
+  which increases with r.  Returns 0 if there are too few gaps.
+*/
+static double
+trOfferedRate(uint64_t nshort, uint64_t nnext, double a, double b)
+{
+  double ratio = 0, lo = 0, hi = 0, mid = 0, f = 0;
+  int iter;
+
+  if((nshort + nnext < 100) || (nnext == 0) || (a <= 0) || (b <= a))
+    return 0;
+
+  ratio = (double)nshort / nnext;
+  if(ratio <= a / (b - a))
+    return 0;
+
+  a *= 1e-9; b *= 1e-9;
+  hi = 50. / a;
+  for(iter = 0; iter < 100; iter++)
+    {
+      mid = 0.5 * (lo + hi);
+      f = (1. - exp(-mid * a)) / (exp(-mid * a) - exp(-mid * b));
+      if(f < ratio)
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  return 0.5 * (lo + hi);
+}
+
+/**
+ * @ingroup TrigRate
+ * @brief Return the rate, gap, throttling and burst statistics
+ *
+ * @param stats  Where to store the statistics
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiTrigRateGetStats(tiTrigRateStats *stats)
+{
+  double holdoff = 0, lambda = 0, a = 0, b = 0;
+  uint64_t nshort = 0, nnext = 0, ngaps = 0;
+  int ibin, isamp, lo;
+
+  if(stats == NULL)
+    return ERROR;
+
+  memset((void *)stats, 0, sizeof(tiTrigRateStats));
+
+  TRLOCK;
+  stats->ntriggers = trCount;
+  if(trCount > 1)
+    {
+      ngaps = trCount - 1;
+      stats->elapsed = (trLast - trFirst) * TI_DECODE_TIMESTAMP_NS * 1e-9;
+      stats->minGap = trMinGap * TI_DECODE_TIMESTAMP_NS;
+      stats->meanGap = ((double)trSumGap / ngaps) * TI_DECODE_TIMESTAMP_NS;
+      if(stats->elapsed > 0)
+	stats->meanRate = ngaps / stats->elapsed;
+    }
+
+  if(trCount > TI_TRIGRATE_WINDOW)
+    {
+      uint64_t newest = trWindow[(trCount - 1) % TI_TRIGRATE_WINDOW];
+      uint64_t oldest = trWindow[trCount % TI_TRIGRATE_WINDOW];
+      if(newest > oldest)
+	stats->instRate = (TI_TRIGRATE_WINDOW - 1) /
+	  ((newest - oldest) * TI_DECODE_TIMESTAMP_NS * 1e-9);
+    }
+  stats->peakRate = trPeakRate;
+
+  holdoff = (trHoldoff > 0) ? trHoldoff : stats->minGap;
+  stats->holdoff = holdoff;
+
+  /* Gaps in [T, U1) and [U1, U2), U1 two bins above T and U2 an octave above U1 */
+  lo = trBin((uint64_t)(holdoff / TI_DECODE_TIMESTAMP_NS)) + 2;
+  if(lo + TI_TRIGRATE_SUBBINS < TI_TRIGRATE_NBINS)
+    {
+      for(ibin = 0; ibin < lo + TI_TRIGRATE_SUBBINS; ibin++)
+	{
+	  if(ibin < lo)
+	    nshort += trHisto[ibin];
+	  else
+	    nnext += trHisto[ibin];
+	}
+      a = trBinEdge(lo) * TI_DECODE_TIMESTAMP_NS - holdoff;
+      b = trBinEdge(lo + TI_TRIGRATE_SUBBINS) * TI_DECODE_TIMESTAMP_NS - holdoff;
+    }
+
+  for(isamp = 0; isamp < TI_TRIGRATE_NBURSTBINS; isamp++)
+    stats->burstHisto[isamp] = trBurstHisto[isamp];
+  stats->nbursts = trBursts;
+  stats->maxBurst = trMaxBurst;
+  /* Include a burst still in progress */
+  if(trRun >= (uint32_t)trMinBurst)
+    {
+      stats->nbursts++;
+      if(trRun > stats->maxBurst)
+	stats->maxBurst = trRun;
+    }
+  TRUNLOCK;
+
+  if((ngaps > 0) && (stats->meanGap > holdoff))
+    {
+      lambda = trOfferedRate(nshort, nnext, a, b);
+      if(lambda <= 0)
+	lambda = 1e9 / (stats->meanGap - holdoff);
+
+      stats->freeRate = lambda;
+      stats->lossFraction = 1. - stats->meanRate / lambda;
+      stats->ruleLoss = (lambda * holdoff * 1e-9) / (1. + lambda * holdoff * 1e-9);
+      stats->otherLoss = stats->lossFraction - stats->ruleLoss;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup TrigRate
+ * @brief Copy the inter-trigger time histogram
+ *
+ * @param counts   Array for the bin contents
+ * @param edge_ns  If not NULL, array for the lower bin edges (ns)
+ * @param maxbins  Size of the arrays
+ *
+ * @return Number of bins copied if successful, otherwise ERROR
+ */
+int
+tiTrigRateGetHisto(uint64_t *counts, double *edge_ns, int maxbins)
+{
+  int ibin, nbins = 0;
+
+  if((counts == NULL) || (maxbins < 0))
+    return ERROR;
+
+  nbins = (maxbins < TI_TRIGRATE_NBINS) ? maxbins : TI_TRIGRATE_NBINS;
+
+  TRLOCK;
+  for(ibin = 0; ibin < nbins; ibin++)
+    {
+      counts[ibin] = trHisto[ibin];
+      if(edge_ns)
+	edge_ns[ibin] = trBinEdge(ibin) * TI_DECODE_TIMESTAMP_NS;
+    }
+  TRUNLOCK;
+
+  return nbins;
+}
+
+/**
+ * @ingroup TrigRate
+ * @brief Print the statistics and the occupied part of the histogram
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiTrigRatePrint()
+{
+  tiTrigRateStats stats;
+  uint64_t counts[TI_TRIGRATE_NBINS], maxcount = 0;
+  double edge[TI_TRIGRATE_NBINS];
+  int ibin, first = -1, last = -1, ibar, nbar;
+
+  if(tiTrigRateGetStats(&stats) != OK)
+    return ERROR;
+  tiTrigRateGetHisto(counts, edge, TI_TRIGRATE_NBINS);
+
+  for(ibin = 0; ibin < TI_TRIGRATE_NBINS; ibin++)
+    {
+      if(counts[ibin] == 0)
+	continue;
+      if(first < 0)
+	first = ibin;
+      last = ibin;
+      if(counts[ibin] > maxcount)
+	maxcount = counts[ibin];
+    }
+
+  printf("\n");
+  printf(" Trigger Rate Analyzer\n");
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Triggers %llu over %.3f s\n",
+	 (unsigned long long)stats.ntriggers, stats.elapsed);
+  printf("  Rate: mean %.1f Hz  instantaneous %.1f Hz  peak %.1f Hz\n",
+	 stats.meanRate, stats.instRate, stats.peakRate);
+  printf("  Gap:  min %.0f ns  mean %.0f ns\n", stats.minGap, stats.meanGap);
+  printf("  Offered %.1f Hz, %.2f%% lost: %.2f%% to the %.0f ns holdoff, %.2f%% to other busy\n",
+	 stats.freeRate, 100. * stats.lossFraction, 100. * stats.ruleLoss,
+	 stats.holdoff, 100. * stats.otherLoss);
+  printf("  Bursts %llu, longest %d triggers\n",
+	 (unsigned long long)stats.nbursts, stats.maxBurst);
+  printf("--------------------------------------------------------------------------------\n");
+
+  for(ibin = first; (ibin >= 0) && (ibin <= last); ibin++)
+    {
+      nbar = maxcount ? (int)((50 * counts[ibin]) / maxcount) : 0;
+      printf("  %12.0f ns %10llu ", edge[ibin], (unsigned long long)counts[ibin]);
+      for(ibar = 0; ibar < nbar; ibar++)
+	printf("*");
+      printf("\n");
+    }
+  printf("\n");
+
+  return OK;
+}
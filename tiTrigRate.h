@@ -0,0 +1,48 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Trigger rate and burst analyzer, fed with the trigger banks from
+ *     tiReadTriggerBlock (event format 1 or 3).  Uses the event timestamps
+ *     and constant memory.
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define TI_TRIGRATE_SUBBINS     4                         /* bins per octave */
+#define TI_TRIGRATE_NBINS      (48 * TI_TRIGRATE_SUBBINS) /* 4 ns to 2^48 ticks */
+#define TI_TRIGRATE_NBURSTBINS 16                         /* log2 of burst length */
+#define TI_TRIGRATE_WINDOW     64                         /* triggers in the instantaneous rate */
+
+typedef struct tiTrigRateStats
+{
+  uint64_t ntriggers;
+  double   elapsed;       /* s, first to last trigger */
+  double   meanRate;      /* Hz */
+  double   instRate;      /* Hz, over the last TI_TRIGRATE_WINDOW triggers */
+  double   peakRate;      /* Hz, highest instRate */
+  double   minGap;        /* ns */
+  double   meanGap;       /* ns */
+  double   holdoff;       /* ns, from tiTrigRateSetHoldoff, otherwise minGap */
+  double   freeRate;      /* Hz, offered rate estimated from the gaps just above the holdoff */
+  double   lossFraction;  /* 1 - meanRate / freeRate */
+  double   ruleLoss;      /* part of lossFraction expected from the holdoff alone */
+  double   otherLoss;     /* lossFraction - ruleLoss: busy from other sources */
+  uint64_t nbursts;
+  uint32_t maxBurst;      /* triggers in the longest burst */
+  uint64_t burstHisto[TI_TRIGRATE_NBURSTBINS];
+} tiTrigRateStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int    tiTrigRateInit(double burstGap_ns, int minBurst);
+  int    tiTrigRateSetHoldoff(double holdoff_ns);
+  int    tiTrigRateFeed(const uint32_t *data, int nwords);
+  int    tiTrigRateFeedTimestamps(const uint64_t *timestamp, int n);
+  int    tiTrigRateGetStats(tiTrigRateStats *stats);
+  int    tiTrigRateGetHisto(uint64_t *counts, double *edge_ns, int maxbins);
+  int    tiTrigRatePrint();
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,544 @@
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Trigger table compiler.
+ *
+ *     Rules are separated by ';' or newlines, '#' starts a comment:
+ *        <expression> -> <trigger> [type <evType>]
+ *     expression:  TS1 - TS6, any, ! (not), & (and), | (or), parentheses
+ *     trigger:     trig1, trig2, sync or none
+ *     evType:      0 - 63.  Default: the TS pattern, as in the predefined
+ *                  tables (0 for none)
+ *
+ *     Each of the 64 TS patterns takes the first rule that matches it.
+ *     Patterns without a rule generate no trigger.  The empty pattern
+ *     (no TS input) never generates a trigger and is skipped.
+ *
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "tiTrigTable.h"
+
+/**
+ * @defgroup TrigTable Trigger Table Compiler
+ *   Trigger table from logical expressions of the TS inputs.
+ */
+
+#define TT_NPATTERNS  64
+#define TT_ALL        0xFFFFFFFFFFFFFFFFULL
+
+static const char *ttHwName[4] = { "none", "trig1", "trig2", "sync" };
+
+typedef struct
+{
+  const char *start;
+  const char *p;
+  int rule;
+  int error;
+} ttParser;
+
+static uint64_t ttParseOr(ttParser *ps);
+
+static void
+ttError(ttParser *ps, const char *msg)
+{
+  if(ps->error)
+    return;
+
+  printf("tiTriggerTableCompile: ERROR: rule %d, column %d: %s\n",
+	 ps->rule, (int)(ps->p - ps->start) + 1, msg);
+  ps->error = 1;
+}
+
+static void
+ttSkipSpace(ttParser *ps)
+{
+  while((*ps->p == ' ') || (*ps->p == '\t') || (*ps->p == '\r'))
+    ps->p++;
+}
+
+/* Set of patterns with TS input its (0-5) set */
+static uint64_t
+ttInput(int its)
+{
+  uint64_t set = 0;
+  int ipat;
+
+  for(ipat = 0; ipat < TT_NPATTERNS; ipat++)
+    if(ipat & (1 << its))
+      set |= 1ULL << ipat;
+
+  return set;
+}
+
+/* Case insensitive keyword, not followed by more of a word */
+static int
+ttKeyword(ttParser *ps, const char *word)
+{
+  int len = strlen(word);
+
+  if((strncasecmp(ps->p, word, len) == 0) && !isalnum(ps->p[len]))
+    {
+      ps->p += len;
+      return 1;
+    }
+
+  return 0;
+}
+
+static uint64_t
+ttParsePrimary(ttParser *ps)
+{
+  uint64_t set = 0;
+
+  ttSkipSpace(ps);
+
+  if((*ps->p == '!') || (*ps->p == '~'))
+    {
+      ps->p++;
+      return ~ttParsePrimary(ps);
+    }
+
+  if(*ps->p == '(')
+    {
+      ps->p++;
+      set = ttParseOr(ps);
+      ttSkipSpace(ps);
+      if(*ps->p != ')')
+	{
+	  ttError(ps, "Expected ')'");
+	  return 0;
+	}
+      ps->p++;
+      return set;
+    }
+
+  if((toupper(ps->p[0]) == 'T') && (toupper(ps->p[1]) == 'S') &&
+     (ps->p[2] >= '1') && (ps->p[2] <= '6') && !isalnum(ps->p[3]))
+    {
+      set = ttInput(ps->p[2] - '1');
+      ps->p += 3;
+      return set;
+    }
+
+  if(ttKeyword(ps, "any"))
+    return TT_ALL;
+
+  ttError(ps, "Expected TS1 - TS6, any, '!' or '('");
+  return 0;
+}
+
+static uint64_t
+ttParseAnd(ttParser *ps)
+{
+  uint64_t set = ttParsePrimary(ps);
+
+  ttSkipSpace(ps);
+  while(*ps->p == '&')
+    {
+      ps->p += (ps->p[1] == '&') ? 2 : 1;
+      set &= ttParsePrimary(ps);
+      ttSkipSpace(ps);
+    }
+
+  return set;
+}
+
+static uint64_t
+ttParseOr(ttParser *ps)
+{
+  uint64_t set = ttParseAnd(ps);
+
+  ttSkipSpace(ps);
+  while(*ps->p == '|')
+    {
+      ps->p += (ps->p[1] == '|') ? 2 : 1;
+      set |= ttParseAnd(ps);
+      ttSkipSpace(ps);
+    }
+
+  return set;
+}
+
+static int
+ttEndOfRule(const char *p)
+{
+  return (*p == '\0') || (*p == ';') || (*p == '\n') || (*p == '#');
+}
+
+/**
+ * @ingroup TrigTable
+ * @brief Compile trigger table rules into the 16 word table used by
+ *        tiTriggerTableConfig
+ *
+ *  Rules are separated by ';' or newlines.  Each rule is
+ *     expression -> trig1 | trig2 | sync | none [type evType]
+ *  with TS1 - TS6, any, '!', '&', '|' and parentheses in the expression.
+ *  The first rule matching a TS pattern defines its entry.  evType
+ *  defaults to the TS pattern.
+ *
+ * @param expr   Rules
+ * @param table  Output Table (Array of 16 4byte words, user must allocate memory)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiTriggerTableCompile(const char *expr, unsigned int *table)
+{
+  ttParser ps;
+  uint64_t set = 0, assigned = 1;   /* the empty pattern is never assigned */
+  int hwTrig = 0, evType = 0, ipat = 0;
+  char *end = NULL;
+  long val = 0;
+
+  if((expr == NULL) || (table == NULL))
+    {
+      printf("%s: ERROR: Invalid rules or table address\n", __func__);
+      return ERROR;
+    }
+
+  memset((void *)table, 0, 16 * sizeof(unsigned int));
+  memset((void *)&ps, 0, sizeof(ps));
+  ps.start = expr;
+  ps.p = expr;
+
+  while(*ps.p != '\0')
+    {
+      /* Skip separators, comments and empty rules */
+      ttSkipSpace(&ps);
+      if(*ps.p == '#')
+	{
+	  while((*ps.p != '\0') && (*ps.p != '\n'))
+	    ps.p++;
+	  continue;
+	}
+      if((*ps.p == ';') || (*ps.p == '\n'))
+	{
+	  if(*ps.p == '\n')
+	    ps.start = ps.p + 1;
+	  ps.p++;
+	  continue;
+	}
+      if(*ps.p == '\0')
+	break;
+
+      ps.rule++;
+      set = ttParseOr(&ps);
+      if(ps.error)
+	return ERROR;
+
+      ttSkipSpace(&ps);
+      if(strncmp(ps.p, "->", 2) != 0)
+	{
+	  ttError(&ps, "Expected '->'");
+	  return ERROR;
+	}
+      ps.p += 2;
+      ttSkipSpace(&ps);
+
+      for(hwTrig = 0; hwTrig < 4; hwTrig++)
+	if(ttKeyword(&ps, ttHwName[hwTrig]))
+	  break;
+      if(hwTrig == 4)
+	{
+	  ttError(&ps, "Expected trig1, trig2, sync or none");
+	  return ERROR;
+	}
+
+      /* evType, -1 for the default */
+      evType = -1;
+      ttSkipSpace(&ps);
+      if(ttKeyword(&ps, "type"))
+	{
+	  ttSkipSpace(&ps);
+	  val = strtol(ps.p, &end, 0);
+	  if(end == ps.p)
+	    {
+	      ttError(&ps, "Expected event type");
+	      return ERROR;
+	    }
+	  if((val < 0) || (val > 0x3F))
+	    {
+	      ttError(&ps, "Event type must be 0 - 63");
+	      return ERROR;
+	    }
+	  ps.p = end;
+	  evType = (int)val;
+	}
+
+      ttSkipSpace(&ps);
+      if(!ttEndOfRule(ps.p))
+	{
+	  ttError(&ps, "Expected ';' or end of line");
+	  return ERROR;
+	}
+
+      set &= ~assigned;
+      if(set == 0)
+	printf("%s: WARN: rule %d matches no TS pattern not taken by an earlier rule\n",
+	       __func__, ps.rule);
+
+      for(ipat = 1; ipat < TT_NPATTERNS; ipat++)
+	{
+	  if((set & (1ULL << ipat)) == 0)
+	    continue;
+
+	  if(evType >= 0)
+	    val = evType;
+	  else
+	    val = (hwTrig == 0) ? 0 : ipat;
+
+	  table[ipat / 4] |= ((hwTrig << 6) | val) << ((ipat % 4) * 8);
+	}
+      assigned |= set;
+    }
+
+  if(ps.rule == 0)
+    {
+      printf("%s: ERROR: No rules\n", __func__);
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/* Patterns covered by the cube (val, dc): TS inputs in dc are free */
+static uint64_t
+ttCube(int val, int dc)
+{
+  uint64_t set = 0;
+  int sub = dc;
+
+  while(1)
+    {
+      set |= 1ULL << (val | sub);
+      if(sub == 0)
+	break;
+      sub = (sub - 1) & dc;
+    }
+
+  return set;
+}
+
+/* Append, keeping track of the room left */
+static void
+ttAppend(char *expr, int maxlen, int *len, const char *str)
+{
+  int n = strlen(str);
+
+  if(*len + n < maxlen)
+    strcpy(&expr[*len], str);
+  *len += n;
+}
+
+/*
+  Sum of products covering set.  The empty pattern and the patterns taken
+  by earlier rules (assigned) are don't cares.  Prime implicants, then a
+  greedy cover: most patterns, then fewest negated inputs and fewest
+  inputs.  If that takes more than one term and nothing else is left,
+  "any" is used instead.
+*/
+static void
+ttMinimize(uint64_t set, uint64_t assigned, char *expr, int maxlen, int *len)
+{
+  int val, dc, bit, its, iterm, jterm, nprime = 0, iprime, nterm = 0, best = 0;
+  int primeVal[729], primeDc[729], termVal[64], termDc[64], tmp = 0;
+  int n = 0, neg = 0, bestNeg = 0, lits = 0, bestLits = 0;
+  uint64_t allowed = set | assigned | 1, uncovered = set, cube = 0;
+  char term[64];
+
+  /* Prime implicants, not counting the cube of all patterns */
+  for(dc = 0; dc < 0x3F; dc++)
+    for(val = 0; val < TT_NPATTERNS; val++)
+      {
+	if((val & dc) || (ttCube(val, dc) & ~allowed) || ((ttCube(val, dc) & set) == 0))
+	  continue;
+
+	for(bit = 0; bit < 6; bit++)
+	  if(!(dc & (1 << bit)) && ((dc | (1 << bit)) != 0x3F) &&
+	     !(ttCube(val & ~(1 << bit), dc | (1 << bit)) & ~allowed))
+	    break;
+	if(bit == 6)
+	  {
+	    primeVal[nprime] = val;
+	    primeDc[nprime] = dc;
+	    nprime++;
+	  }
+      }
+
+  while(uncovered && (nterm < 64))
+    {
+      best = -1;
+      for(iprime = 0; iprime < nprime; iprime++)
+	{
+	  n = __builtin_popcountll(ttCube(primeVal[iprime], primeDc[iprime]) & uncovered);
+	  lits = 6 - __builtin_popcount(primeDc[iprime]);
+	  neg = lits - __builtin_popcount(primeVal[iprime]);
+	  if((n > best) ||
+	     ((n == best) && ((neg < bestNeg) || ((neg == bestNeg) && (lits < bestLits)))))
+	    {
+	      best = n;
+	      bestNeg = neg;
+	      bestLits = lits;
+	      termVal[nterm] = primeVal[iprime];
+	      termDc[nterm] = primeDc[iprime];
+	    }
+	}
+      uncovered &= ~ttCube(termVal[nterm], termDc[nterm]);
+      nterm++;
+    }
+
+  if((nterm > 1) && (allowed == TT_ALL))
+    {
+      ttAppend(expr, maxlen, len, "any");
+      return;
+    }
+
+  /* TS1 first */
+  for(iterm = 0; iterm < nterm; iterm++)
+    for(jterm = iterm + 1; jterm < nterm; jterm++)
+      if(termVal[jterm] < termVal[iterm])
+	{
+	  tmp = termVal[iterm]; termVal[iterm] = termVal[jterm]; termVal[jterm] = tmp;
+	  tmp = termDc[iterm]; termDc[iterm] = termDc[jterm]; termDc[jterm] = tmp;
+	}
+
+  for(iterm = 0; iterm < nterm; iterm++)
+    {
+      term[0] = '\0';
+      for(its = 0; its < 6; its++)
+	{
+	  if(termDc[iterm] & (1 << its))
+	    continue;
+	  sprintf(&term[strlen(term)], "%s%sTS%d", (term[0] != '\0') ? " & " : "",
+		  (termVal[iterm] & (1 << its)) ? "" : "!", its + 1);
+	}
+      if(iterm)
+	ttAppend(expr, maxlen, len, " | ");
+      ttAppend(expr, maxlen, len, term);
+    }
+}
+
+/**
+ * @ingroup TrigTable
+ * @brief Write a trigger table as rules, one per line.  The rules compile
+ *        back to the same table with tiTriggerTableCompile.  Later rules
+ *        may overlap earlier ones, which take precedence.
+ *
+ * @param table   Input Table (Array of 16 4byte words)
+ * @param expr    Output rules
+ * @param maxlen  Size of expr
+ *
+ * @return Length of the rules if successful, otherwise ERROR
+ */
+int
+tiTriggerTableDecompile(const unsigned int *table, char *expr, int maxlen)
+{
+  int entry[TT_NPATTERNS], done[TT_NPATTERNS], deflt[TT_NPATTERNS];
+  int ipat, jpat, hwTrig, evType, len = 0;
+  uint64_t set = 0, assigned = 0;
+  char action[32];
+
+  if((table == NULL) || (expr == NULL) || (maxlen <= 0))
+    {
+      printf("%s: ERROR: Invalid table or rules address\n", __func__);
+      return ERROR;
+    }
+
+  for(ipat = 0; ipat < TT_NPATTERNS; ipat++)
+    {
+      entry[ipat] = (table[ipat / 4] >> ((ipat % 4) * 8)) & 0xFF;
+      done[ipat] = (ipat == 0) || (entry[ipat] == 0);
+    }
+
+  /* Default event type (the TS pattern), unless another pattern has the same entry */
+  for(ipat = 1; ipat < TT_NPATTERNS; ipat++)
+    {
+      deflt[ipat] = (entry[ipat] & 0xC0) && ((entry[ipat] & 0x3F) == ipat);
+      for(jpat = 1; deflt[ipat] && (jpat < TT_NPATTERNS); jpat++)
+	if((jpat != ipat) && (entry[jpat] == entry[ipat]))
+	  deflt[ipat] = 0;
+    }
+
+  expr[0] = '\0';
+  for(ipat = 1; ipat < TT_NPATTERNS; ipat++)
+    {
+      if(done[ipat])
+	continue;
+
+      /* Group the patterns with the same trigger and event type */
+      hwTrig = (entry[ipat] & 0xC0) >> 6;
+      evType = entry[ipat] & 0x3F;
+
+      set = 0;
+      for(jpat = ipat; jpat < TT_NPATTERNS; jpat++)
+	{
+	  if(done[jpat] || (deflt[jpat] != deflt[ipat]))
+	    continue;
+	  if(deflt[ipat] ? (((entry[jpat] & 0xC0) >> 6) != hwTrig) : (entry[jpat] != entry[ipat]))
+	    continue;
+
+	  set |= 1ULL << jpat;
+	  done[jpat] = 1;
+	}
+
+      ttMinimize(set, assigned, expr, maxlen, &len);
+      assigned |= set;
+
+      if(deflt[ipat])
+	sprintf(action, " -> %s\n", ttHwName[hwTrig]);
+      else
+	sprintf(action, " -> %s type %d\n", ttHwName[hwTrig], evType);
+      ttAppend(expr, maxlen, &len, action);
+    }
+
+  if(len >= maxlen)
+    {
+      printf("%s: ERROR: Rules need %d characters (have %d)\n",
+	     __func__, len + 1, maxlen);
+      return ERROR;
+    }
+
+  return len;
+}
+
+/**
+ * @ingroup TrigTable
+ * @brief Configure the trigger table to be loaded from rules.
+ *        Load with tiLoadTriggerTable(4).
+ *
+ * @param expr  Rules, @sa tiTriggerTableCompile
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+tiTriggerTableConfigExpr(const char *expr)
+{
+  unsigned int table[16];
+
+  if(tiTriggerTableCompile(expr, table) != OK)
+    return ERROR;
+
+  return tiTriggerTableConfig(table);
+}
+
+/**
+ * @ingroup TrigTable
+ * @brief Print the trigger table stored in local memory as rules
+ */
+void
+tiPrintTriggerTableExpr()
+{
+  unsigned int table[16];
+  char expr[4096];
+
+  tiGetTriggerTable(table);
+  if(tiTriggerTableDecompile(table, expr, sizeof(expr)) == ERROR)
+    return;
+
+  printf("%s", expr);
+}
@@ -0,0 +1,21 @@
+#pragma once
+/*----------------------------------------------------------------------------*
+ * Description:
+ *     Trigger table compiler.  Builds the 64 entry trigger table
+ *     (tiTriggerTableConfig) from rules like
+ *        TS1 & !TS3 -> trig1 type 5; TS4 | TS5 -> sync
+ *
+ *----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  /* routine prototypes */
+  int  tiTriggerTableCompile(const char *expr, unsigned int *table);
+  int  tiTriggerTableDecompile(const unsigned int *table, char *expr, int maxlen);
+  int  tiTriggerTableConfigExpr(const char *expr);
+  void tiPrintTriggerTableExpr();
+#ifdef __cplusplus
+}
+#endif